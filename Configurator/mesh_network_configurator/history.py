@@ -0,0 +1,342 @@
+import argparse
+import os
+import queue
+import random
+import sqlite3
+import tempfile
+import threading
+import time
+
+# Histórico da rede: relatórios, mudanças de topologia e pings em SQLite.
+# As escritas passam por uma fila e são gravadas em lote por uma thread própria;
+# a cada lote, os agregados por minuto e por hora são atualizados (UPSERT),
+# para que consultas de longos períodos não precisem varrer os dados brutos.
+
+BATCH_MAX = 2000          # linhas por transação
+BATCH_INTERVAL = 1.0      # segundos entre gravações com a fila parada
+RAW_RETENTION = 2 * 86400     # relatórios e pings brutos
+ROLLUP_1M_RETENTION = 30 * 86400
+ROLLUP_1H_RETENTION = 365 * 86400
+TOPO_RETENTION = 90 * 86400   # mudanças de topologia (a última de cada nó antes do corte fica)
+PRUNE_INTERVAL = 600
+
+SCHEMA = """
+CREATE TABLE IF NOT EXISTS reports (
+    ts REAL NOT NULL, mac TEXT NOT NULL, parent TEXT, hops INTEGER, rssi INTEGER, nc INTEGER
+);
+CREATE INDEX IF NOT EXISTS reports_ts ON reports(ts);
+
+CREATE TABLE IF NOT EXISTS pings (ts REAL NOT NULL, mac TEXT NOT NULL, latency_ms REAL NOT NULL);
+CREATE INDEX IF NOT EXISTS pings_ts ON pings(ts);
+
+CREATE TABLE IF NOT EXISTS topo_changes (
+    ts REAL NOT NULL, mac TEXT NOT NULL, kind TEXT NOT NULL, parent TEXT, hops INTEGER
+);
+CREATE INDEX IF NOT EXISTS topo_changes_mac_ts ON topo_changes(mac, ts);
+CREATE INDEX IF NOT EXISTS topo_changes_ts ON topo_changes(ts);
+"""
+
+ROLLUP_SCHEMA = """
+CREATE TABLE IF NOT EXISTS {name} (
+    bucket INTEGER NOT NULL, mac TEXT NOT NULL,
+    reports INTEGER NOT NULL DEFAULT 0, sum_hops REAL NOT NULL DEFAULT 0,
+    n_rssi INTEGER NOT NULL DEFAULT 0, sum_rssi REAL NOT NULL DEFAULT 0, min_rssi INTEGER,
+    moves INTEGER NOT NULL DEFAULT 0,
+    n_ping INTEGER NOT NULL DEFAULT 0, sum_ping REAL NOT NULL DEFAULT 0,
+    PRIMARY KEY (bucket, mac)
+) WITHOUT ROWID;
+CREATE INDEX IF NOT EXISTS {name}_mac ON {name}(mac, bucket);
+"""
+
+ROLLUP_UPSERT = """
+INSERT INTO {name} (bucket, mac, reports, sum_hops, n_rssi, sum_rssi, min_rssi, moves, n_ping, sum_ping)
+VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, ?)
+ON CONFLICT(bucket, mac) DO UPDATE SET
+    reports = reports + excluded.reports,
+    sum_hops = sum_hops + excluded.sum_hops,
+    n_rssi = n_rssi + excluded.n_rssi,
+    sum_rssi = sum_rssi + excluded.sum_rssi,
+    min_rssi = MIN(COALESCE(min_rssi, excluded.min_rssi), COALESCE(excluded.min_rssi, min_rssi)),
+    moves = moves + excluded.moves,
+    n_ping = n_ping + excluded.n_ping,
+    sum_ping = sum_ping + excluded.sum_ping
+"""
+
+ROLLUPS = (("rollup_1m", 60), ("rollup_1h", 3600))
+
+_STOP = object()
+
+
+class HistoryStore:
+    def __init__(self, path, queue_size=100000):
+        self.path = path
+        self._queue = queue.Queue(maxsize=queue_size)
+        self._state_lock = threading.Lock()
+        self._state = {}  # mac -> (parent, hops, ts) do último relatório
+        self._local = threading.local()
+
+        conn = sqlite3.connect(path)
+        conn.execute("PRAGMA journal_mode=WAL")
+        conn.executescript(SCHEMA)
+        for name, _ in ROLLUPS:
+            conn.executescript(ROLLUP_SCHEMA.format(name=name))
+        self._close_dangling(conn)
+        conn.commit()
+        conn.close()
+
+        self._writer = threading.Thread(target=self._writer_loop, name="history_writer", daemon=True)
+        self._writer.start()
+
+    # --- Escrita -------------------------------------------------------------
+
+    def add_report(self, data, ts=None):
+        ts = time.time() if ts is None else ts
+        mac = data["mac"]
+        parent = data.get("parent")
+        hops = data.get("hops")
+
+        with self._state_lock:
+            prev = self._state.get(mac)
+            self._state[mac] = (parent, hops, ts)
+
+        # Só a troca de pai conta como "move"; a camada pode mudar porque um ancestral se moveu
+        if prev is None:
+            self._queue.put(("change", (ts, mac, "join", parent, hops)))
+        elif prev[0] != parent:
+            self._queue.put(("change", (ts, mac, "move", parent, hops)))
+        elif prev[1] != hops:
+            self._queue.put(("change", (ts, mac, "hops", parent, hops)))
+        self._queue.put(("report", (ts, mac, parent, hops, data.get("rssi"), data.get("nc"))))
+
+    def add_ping(self, mac, latency_ms, ts=None):
+        self._queue.put(("ping", (time.time() if ts is None else ts, mac, latency_ms)))
+
+    def mark_leave(self, mac, ts=None):
+        with self._state_lock:
+            if self._state.pop(mac, None) is None:
+                return
+        self._queue.put(("change", (time.time() if ts is None else ts, mac, "leave", None, None)))
+
+    def flush(self):
+        # Bloqueia até tudo o que já foi enfileirado estar gravado
+        done = threading.Event()
+        self._queue.put(("sync", done))
+        done.wait()
+
+    def close(self):
+        with self._state_lock:
+            macs = list(self._state)
+        for mac in macs:
+            self.mark_leave(mac)
+        self._queue.put(_STOP)
+        self._writer.join()
+
+    def _close_dangling(self, conn):
+        # Nós que ficaram "presentes" quando o configurador foi encerrado saem no último relatório
+        rows = conn.execute(
+            "SELECT mac, kind, MAX(ts) FROM topo_changes GROUP BY mac").fetchall()
+        for mac, kind, ts in rows:
+            if kind == "leave":
+                continue
+            last = conn.execute("SELECT MAX(ts) FROM reports WHERE mac = ?", (mac,)).fetchone()[0]
+            conn.execute("INSERT INTO topo_changes VALUES (?, ?, 'leave', NULL, NULL)", (max(ts, last or ts), mac))
+
+    def _writer_loop(self):
+        conn = sqlite3.connect(self.path)
+        conn.execute("PRAGMA synchronous=NORMAL")
+        last_prune = 0.0
+        stop = False
+
+        while not stop:
+            batch = []
+            syncs = []
+            try:
+                item = self._queue.get(timeout=BATCH_INTERVAL)
+                while True:
+                    if item is _STOP:
+                        stop = True
+                        break
+                    if item[0] == "sync":
+                        syncs.append(item[1])
+                    else:
+                        batch.append(item)
+                    if len(batch) >= BATCH_MAX:
+                        break
+                    item = self._queue.get_nowait()
+            except queue.Empty:
+                pass
+
+            if batch:
+                self._write_batch(conn, batch)
+            now = time.time()
+            if now - last_prune > PRUNE_INTERVAL:
+                self._prune(conn, now)
+                last_prune = now
+            for done in syncs:
+                done.set()
+
+        conn.close()
+
+    def _write_batch(self, conn, batch):
+        reports, pings, changes = [], [], []
+        rollups = [{} for _ in ROLLUPS]
+
+        for kind, row in batch:
+            if kind == "report":
+                reports.append(row)
+            elif kind == "ping":
+                pings.append(row)
+            else:
+                changes.append(row)
+
+            ts, mac = row[0], row[1]
+            for agg, (_, size) in zip(rollups, ROLLUPS):
+                key = (int(ts // size) * size, mac)
+                acc = agg.get(key)
+                if acc is None:
+                    acc = agg[key] = [0, 0.0, 0, 0.0, None, 0, 0, 0.0]
+                if kind == "report":
+                    acc[0] += 1
+                    acc[1] += row[3] or 0
+                    if row[4] is not None:
+                        acc[2] += 1
+                        acc[3] += row[4]
+                        acc[4] = row[4] if acc[4] is None else min(acc[4], row[4])
+                elif kind == "ping":
+                    acc[6] += 1
+                    acc[7] += row[2]
+                elif row[2] == "move":
+                    acc[5] += 1
+
+        with conn:
+            conn.executemany("INSERT INTO reports VALUES (?, ?, ?, ?, ?, ?)", reports)
+            conn.executemany("INSERT INTO pings VALUES (?, ?, ?)", pings)
+            conn.executemany("INSERT INTO topo_changes VALUES (?, ?, ?, ?, ?)", changes)
+            for agg, (name, _) in zip(rollups, ROLLUPS):
+                conn.executemany(ROLLUP_UPSERT.format(name=name),
+                                 [(b, m, *acc) for (b, m), acc in agg.items()])
+
+    def _prune(self, conn, now):
+        with conn:
+            conn.execute("DELETE FROM reports WHERE ts < ?", (now - RAW_RETENTION,))
+            conn.execute("DELETE FROM pings WHERE ts < ?", (now - RAW_RETENTION,))
+            conn.execute("DELETE FROM rollup_1m WHERE bucket < ?", (now - ROLLUP_1M_RETENTION,))
+            conn.execute("DELETE FROM rollup_1h WHERE bucket < ?", (now - ROLLUP_1H_RETENTION,))
+            # Antes do corte fica só o último estado de cada nó ainda presente, para topology_at
+            cutoff = now - TOPO_RETENTION
+            conn.execute(
+                """DELETE FROM topo_changes WHERE ts < :cutoff AND rowid NOT IN (
+                       SELECT (SELECT rowid FROM topo_changes c
+                               WHERE c.mac = m.mac AND c.ts < :cutoff ORDER BY ts DESC LIMIT 1)
+                       FROM (SELECT DISTINCT mac FROM topo_changes WHERE ts < :cutoff) m)""",
+                {"cutoff": cutoff})
+            conn.execute("DELETE FROM topo_changes WHERE ts < ? AND kind = 'leave'", (cutoff,))
+
+    # --- Consultas (conexão própria por thread) -------------------------------
+
+    def _reader(self):
+        conn = getattr(self._local, "conn", None)
+        if conn is None:
+            conn = self._local.conn = sqlite3.connect(self.path)
+        return conn
+
+    def time_range(self):
+        return self._reader().execute("SELECT MIN(ts), MAX(ts) FROM topo_changes").fetchone()
+
+    def topology_at(self, ts):
+        """Nós presentes no instante ts: {mac: (parent, hops)}."""
+        rows = self._reader().execute(
+            """SELECT c.mac, c.kind, c.parent, c.hops
+               FROM (SELECT DISTINCT mac FROM topo_changes) m
+               JOIN topo_changes c ON c.rowid = (
+                   SELECT rowid FROM topo_changes
+                   WHERE mac = m.mac AND ts <= ? ORDER BY ts DESC LIMIT 1)""",
+            (ts,)).fetchall()
+        return {mac: (parent, hops) for mac, kind, parent, hops in rows if kind != "leave"}
+
+    def changes(self, start, end, mac=None):
+        sql = "SELECT ts, mac, kind, parent, hops FROM topo_changes WHERE ts BETWEEN ? AND ?"
+        args = [start, end]
+        if mac:
+            sql += " AND mac = ?"
+            args.append(mac)
+        return self._reader().execute(sql + " ORDER BY ts", args).fetchall()
+
+    def series(self, mac, start, end):
+        """Série agregada de um nó; a resolução (1 min ou 1 h) depende do período pedido.
+
+        Cada ponto: (bucket, relatórios, saltos médios, RSSI médio, RSSI mínimo, mudanças de pai, ping médio).
+        """
+        name, size = ROLLUPS[0] if end - start <= 6 * 3600 else ROLLUPS[1]
+        return self._reader().execute(
+            f"""SELECT bucket, reports,
+                       CASE WHEN reports THEN sum_hops / reports END,
+                       CASE WHEN n_rssi THEN sum_rssi / n_rssi END,
+                       min_rssi, moves,
+                       CASE WHEN n_ping THEN sum_ping / n_ping END
+                FROM {name} WHERE mac = ? AND bucket BETWEEN ? AND ? ORDER BY bucket""",
+            (mac, start - start % size, end)).fetchall()
+
+
+def benchmark(nodes, days, interval, path):
+    # Rede sintética: árvore com trocas de pai ocasionais e pings esparsos
+    store = HistoryStore(path)
+    macs = [f"AA:BB:CC:{i >> 16 & 0xFF:02X}:{i >> 8 & 0xFF:02X}:{i & 0xFF:02X}" for i in range(nodes)]
+    parents = {mac: ("null" if i == 0 else macs[(i - 1) // 4]) for i, mac in enumerate(macs)}
+    hops = {mac: (1 if i == 0 else hops_of(i)) for i, mac in enumerate(macs)}
+    rng = random.Random(1)
+
+    start = time.time() - days * 86400
+    ticks = int(days * 86400 / interval)
+    t0 = time.perf_counter()
+    for tick in range(ticks):
+        ts = start + tick * interval
+        for i, mac in enumerate(macs):
+            if i and rng.random() < 0.0005:
+                parents[mac] = macs[rng.randrange(0, i)]
+            store.add_report({"mac": mac, "parent": parents[mac], "hops": hops[mac],
+                              "rssi": -40 - rng.randrange(50), "nc": 4}, ts)
+        if tick % 30 == 0:
+            store.add_ping(macs[rng.randrange(nodes)], rng.uniform(20, 400), ts)
+    store.flush()
+    elapsed = time.perf_counter() - t0
+    total = ticks * nodes
+    print(f"📥 {total} relatórios em {elapsed:.1f} s ({total / elapsed:.0f}/s)")
+
+    end = start + ticks * interval
+
+    def measure(label, fn, runs=20):
+        t = time.perf_counter()
+        for _ in range(runs):
+            result = fn()
+        print(f"🔎 {label}: {(time.perf_counter() - t) / runs * 1000:.1f} ms ({len(result)} linhas)")
+
+    measure("topologia em um instante", lambda: store.topology_at(rng.uniform(start, end)))
+    measure("série de 1 h", lambda: store.series(macs[rng.randrange(nodes)], end - 3600, end))
+    measure("série de 1 dia", lambda: store.series(macs[rng.randrange(nodes)], end - 86400, end))
+    measure("série de 7 dias", lambda: store.series(macs[rng.randrange(nodes)], end - 7 * 86400, end))
+    measure("mudanças em 1 dia", lambda: store.changes(end - 86400, end))
+    store.close()
+
+
+def hops_of(i):
+    layer = 1
+    while i > 0:
+        i = (i - 1) // 4
+        layer += 1
+    return layer
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description="Benchmark do histórico com dados sintéticos")
+    parser.add_argument("--nodes", type=int, default=300)
+    parser.add_argument("--days", type=float, default=7)
+    parser.add_argument("--interval", type=float, default=10, help="intervalo de relatório (s)")
+    parser.add_argument("--db", help="arquivo SQLite (padrão: temporário)")
+    args = parser.parse_args()
+
+    if args.db:
+        benchmark(args.nodes, args.days, args.interval, args.db)
+    else:
+        with tempfile.TemporaryDirectory() as tmp:
+            benchmark(args.nodes, args.days, args.interval, os.path.join(tmp, "bench.db"))
@@ -4,20 +4,20 @@ import networkx as nx
 import matplotlib.pyplot as plt
 import matplotlib.colors as colors
 from matplotlib.backends.backend_tkagg import FigureCanvasTkAgg
-import paho.mqtt.client as mqtt
 import subprocess
 import os
+import sys
 import time
 import socket
+import urllib.request
 import tkinter as tk
 from tkinter import ttk
+from topology_server import SERVER_HOST, SERVER_PORT, eventos_sse
 
 G = nx.DiGraph()
 G.add_node("ROUTER", is_router=True)
 
 lock = threading.Lock()
-mqtt_client = None
-last_seen = {}
 NODE_TIMEOUT = 20
 last_node_snapshot = set()
 running = True  # Flag para controlar encerramento seguro
@@ -25,8 +25,11 @@ selected_node_mac = None
 selected_node_mac_draw = False
 highlight_timer_id = None
 root = None
-ping_timers = {}
 ping_latencies = {}  # mac -> tempo decorrido do ping (float)
+TOPOLOGY_SERVER = f"http://{SERVER_HOST}:{SERVER_PORT}"
+SERVER_LOG = os.path.join(os.path.dirname(os.path.abspath(__file__)), "topology_server.log")
+HISTORY_RANGE_TTL = 600  # s; o início do histórico só anda com a limpeza periódica do serviço
+timeline_ts = None  # None = ao vivo; senão, instante exibido na linha do tempo
 
 
 
@@ -45,8 +48,6 @@ def get_local_ip():
 MQTT_BROKER = get_local_ip()
 #MQTT_BROKER = "192.168.50.208"
 MQTT_PORT = 1883
-MQTT_TOPIC = "mesh/network/info"
-MQTT_CONFIG_COMMAND_TOPIC = "mesh/cmd"
 
 def start_mosquitto():
     mosquitto_path = r"C:\\Program Files\\mosquitto\\mosquitto.exe"
@@ -63,67 +64,131 @@ def start_mosquitto():
     time.sleep(1)
     return process
 
-def on_connect(client, userdata, flags, rc):
-    if rc == 0:
-        print("✅ Conectado ao broker MQTT")
-        client.subscribe(MQTT_TOPIC)
-        print(f"📡 Inscrito no tópico: {MQTT_TOPIC}")
+def start_topology_server():
+    # Um serviço já em execução (de outro painel) é reaproveitado
+    if servidor_disponivel():
+        print("🔗 Usando o serviço de topologia já em execução")
+        return None
+    # Desacoplado do painel: continua rodando (e gravando o histórico) depois que a janela fecha,
+    # e outros painéis podem usá-lo. A saída vai para um arquivo, já que o terminal pode sumir
+    print(f"🚀 Iniciando serviço de topologia (log em {SERVER_LOG})...")
+    if os.name == "nt":
+        detach = {"creationflags": subprocess.DETACHED_PROCESS | subprocess.CREATE_NEW_PROCESS_GROUP}
     else:
-        print(f"❌ Falha na conexão. Código de retorno: {rc}")
-
-def on_message(client, userdata, msg):
-    try:
-        payload = msg.payload.decode()
-        data = json.loads(payload)
-        # Se for resposta pong
-        if data.get("type") == "pong" and "mac" in data:
-            pong_mac = data["mac"]
-            if pong_mac in ping_timers:
-                elapsed = (time.time() - ping_timers[pong_mac]) * 1000
-                ping_latencies[pong_mac] = elapsed  # salva para exibir
-                print(f"🏓 Ping para {pong_mac} respondido em {elapsed:.0f} ms")
-                del ping_timers[pong_mac]
-            else:
-                print(f"🏓 Pong recebido de {pong_mac}, mas não foi feito ping.")
-            return
-
-
-
+        detach = {"start_new_session": True}
+    with open(SERVER_LOG, "a") as log:
+        process = subprocess.Popen([
+            sys.executable, os.path.join(os.path.dirname(os.path.abspath(__file__)), "topology_server.py"),
+            "--broker", MQTT_BROKER, "--mqtt-port", str(MQTT_PORT)
+        ], stdin=subprocess.DEVNULL, stdout=log, stderr=subprocess.STDOUT, **detach)
+    for _ in range(50):
+        if servidor_disponivel():
+            break
+        time.sleep(0.1)
+    return process
 
-        if all(k in data for k in ('mac', 'parent', 'hops', 'children')):
-            mac = data['mac']
-            parent = data['parent']
-            hops = data['hops']
-            children = data.get('children', [])
-
-            with lock:
-                G.add_node(mac, hops=hops, is_root=(parent == "null"))
-                last_seen[mac] = time.time()
-                edges_to_remove = [(u, v) for u, v in G.edges() if v == mac]
-                G.remove_edges_from(edges_to_remove)
-                if parent != "null":
-                    G.add_node(parent)
-                    G.add_edge(parent, mac)
-                for child in children:
-                    if child not in G.nodes:
-                        G.add_node(child)
-                    last_seen[child] = time.time()
-        else:
-            print("⚠️ JSON incompleto:", data)
-    except Exception as e:
-        print(f"❌ Erro ao processar mensagem: {e}")
+def consultar(caminho):
+    with urllib.request.urlopen(TOPOLOGY_SERVER + caminho, timeout=5) as resp:
+        return json.load(resp)
 
-def cleanup_inactive_nodes():
-    if NODE_TIMEOUT == 0:
-        return  # 👈 timeout infinito, não remove nada
-    now = time.time()
+def servidor_disponivel():
+    try:
+        consultar("/snapshot")
+        return True
+    except OSError:
+        return False
+
+def enviar_ao_servidor(caminho, msg):
+    req = urllib.request.Request(TOPOLOGY_SERVER + caminho, data=msg.encode(),
+                                 headers={"Content-Type": "application/json"})
+    urllib.request.urlopen(req, timeout=5).close()
+
+def acompanhar_topologia():
+    # Snapshot ao conectar e, depois, só as diferenças; ao reconectar, um novo snapshot
+    while running:
+        try:
+            with urllib.request.urlopen(TOPOLOGY_SERVER + "/events") as resp:
+                for evento, dados in eventos_sse(resp):
+                    msg = json.loads(dados)
+                    if evento == "snapshot":
+                        aplicar_snapshot(msg)
+                    elif evento == "diff":
+                        aplicar_diferencas(msg["ops"])
+                    if not running:
+                        return
+        except OSError as e:
+            print(f"⚠️ Conexão com o serviço de topologia perdida: {e}")
+        time.sleep(1)
+
+def aplicar_snapshot(snapshot):
+    global NODE_TIMEOUT
     with lock:
-        for node, last in list(last_seen.items()):
-            if now - last > NODE_TIMEOUT:
-                print(f"🗑️ Removendo nó inativo/incompleto: {node}")
-                G.remove_node(node)
-                del last_seen[node]
-
+        G.clear()
+        G.add_node("ROUTER", is_router=True)
+        ping_latencies.clear()
+        ping_latencies.update(snapshot["pings"])
+        NODE_TIMEOUT = snapshot["node_timeout"]
+    aplicar_diferencas([{"op": "node", "mac": mac, **node} for mac, node in snapshot["nodes"].items()])
+
+def aplicar_no(op):
+    mac, parent = op["mac"], op["parent"]
+    G.add_node(mac, **{k: op[k] for k in ("parent", "hops", "is_root", "radio_pct") if op.get(k) is not None})
+    if parent is None:
+        return  # só conhecido como pai/filho de outro nó
+    G.remove_edges_from(list(G.in_edges(mac)))
+    if parent != "null":
+        G.add_edge(parent, mac)
+    # Filhos que já apontavam para este nó antes de ele (re)aparecer
+    G.add_edges_from([(mac, n) for n, p in G.nodes(data="parent") if p == mac])
+
+def aplicar_diferencas(ops):
+    global NODE_TIMEOUT
+    for op in ops:
+        tipo = op["op"]
+        if tipo == "event":
+            tratar_evento(op["data"])
+            continue
+        with lock:
+            if tipo == "node":
+                aplicar_no(op)
+            elif tipo == "remove":
+                if op["mac"] in G:
+                    G.remove_node(op["mac"])
+                ping_latencies.pop(op["mac"], None)
+            elif tipo == "ping":
+                ping_latencies[op["mac"]] = op["ms"]  # salva para exibir
+            elif tipo == "config":
+                NODE_TIMEOUT = op["node_timeout"]
+        if tipo == "ping":
+            print(f"🏓 Ping para {op['mac']} respondido em {op['ms']:.0f} ms")
+
+def tratar_evento(data):
+    if data.get("type") == "profile" and "mac" in data:
+        imprimir_perfil(data)
+    elif data.get("type") == "advice":
+        imprimir_sugestoes(data)
+    elif data.get("type") == "metric" and "mac" in data:
+        print(f"📈 {data['mac']}: {data.get('name')} = {data.get('value')}")
+    elif data.get("type") == "cmd_error":
+        print(f"❌ Comando {data.get('action', '')} recusado pelo root: {data.get('error')}")
+
+def imprimir_perfil(data):
+    heap = data.get("heap", {})
+    cj = data.get("cjson", {})
+    print(f"📊 Perfil de {data['mac']} (janela {data.get('window_ms', '?')} ms)")
+    print(f"   Heap livre: {heap.get('free')} | mínimo: {heap.get('min_free')} | maior bloco: {heap.get('largest')}")
+    print(f"   cJSON: {cj.get('allocs')} alocações, {cj.get('frees')} liberações, {cj.get('live')} ativas")
+    for t in sorted(data.get("tasks", []), key=lambda t: t.get("cpu", 0), reverse=True):
+        cpu = t.get("cpu", -1)
+        cpu_str = f"{cpu:5.1f}%" if cpu >= 0 else "    -"
+        print(f"   {t.get('name', '?'):<16} prio {t.get('prio', '?'):>2}  CPU {cpu_str}  stack livre {t.get('stack_free')} B")
+
+def imprimir_sugestoes(data):
+    estado = "aplicadas" if data.get("applied") else "sugeridas"
+    print(f"📐 Balanceamento: {data.get('nodes')} nós, camada máx. {data.get('max_layer')}, "
+          f"média {data.get('avg_layer', 0):.2f} | {len(data.get('suggestions', []))} alterações {estado}")
+    for s in data.get("suggestions", []):
+        print(f"   {s.get('mac')}: max_children={s.get('max_children')} camada={s.get('layer')} ({s.get('reason')})")
 
 def get_text_color(rgb):
     r, g, b = [x * 255 for x in rgb[:3]]
@@ -131,26 +196,30 @@ def get_text_color(rgb):
     return 'white' if luminance < 128 else 'black'
 
 def send_message(msg):
-    mqtt_client.publish(MQTT_CONFIG_COMMAND_TOPIC, msg)
+    try:
+        enviar_ao_servidor("/cmd", msg)
+    except OSError as e:
+        print(f"❌ Erro ao enviar comando ao serviço de topologia: {e}")
 
-def plot_graph(ax, canvas):
-    cleanup_inactive_nodes()
+def plot_graph(ax, canvas, grafo=None):
+    if grafo is None:
+        grafo = G
     with lock:
         ax.clear()
-        root_nodes = [n for n in G.nodes() if G.nodes[n].get("is_root", False)]
+        root_nodes = [n for n in grafo.nodes() if grafo.nodes[n].get("is_root", False)]
         if root_nodes:
-            G.add_node("ROUTER", is_router=True)
+            grafo.add_node("ROUTER", is_router=True)
             for root in root_nodes:
-                G.add_edge("ROUTER", root)
+                grafo.add_edge("ROUTER", root)
 
         pos = {}
         parent_to_children = {}
         layer_to_nodes = {}
 
-        for node in G.nodes():
-            layer = 0 if G.nodes[node].get("is_router", False) else G.nodes[node].get("hops", 1)
+        for node in grafo.nodes():
+            layer = 0 if grafo.nodes[node].get("is_router", False) else grafo.nodes[node].get("hops", 1)
             layer_to_nodes.setdefault(layer, []).append(node)
-            for parent, child in G.edges():
+            for parent, child in grafo.edges():
                 if child == node:
                     parent_to_children.setdefault(parent, []).append(node)
 
@@ -163,44 +232,47 @@ def plot_graph(ax, canvas):
                 y = pos[parent][1] - y_spacing * parent_to_children[parent].index(node) if parent in pos else -i
                 pos[node] = (x, y)
 
-        node_hops = [G.nodes[n].get("hops", 0) for n in G.nodes() if not G.nodes[n].get("is_router", False)]
+        node_hops = [grafo.nodes[n].get("hops", 0) for n in grafo.nodes() if not grafo.nodes[n].get("is_router", False)]
         max_hops = max(node_hops) if node_hops else 1
         cmap = plt.get_cmap('viridis')
 
         norm = colors.Normalize(vmin=0, vmax=max_hops)
 
         node_colors = []
-        for n in G.nodes():
-            if G.nodes[n].get("is_router", False):
+        for n in grafo.nodes():
+            if grafo.nodes[n].get("is_router", False):
                 node_colors.append("blue")
-            elif G.nodes[n].get("is_root", False):
+            elif grafo.nodes[n].get("is_root", False):
                 node_colors.append("red")
             else:
-                node_colors.append(cmap(norm(G.nodes[n].get("hops", 0))))
+                node_colors.append(cmap(norm(grafo.nodes[n].get("hops", 0))))
 
         labels = {}
-        for node in G.nodes():
-            if G.nodes[node].get("is_router", False):
+        for node in grafo.nodes():
+            if grafo.nodes[node].get("is_router", False):
                 labels[node] = "ROUTER"
             else:
-                hops = G.nodes[node].get("hops", "?")
+                hops = grafo.nodes[node].get("hops", "?")
                 label = f"{node}\nHops:{hops}"
                 if node in ping_latencies:
                     latency = ping_latencies[node]
                     label += f"\nPing:{latency:.0f}ms"
+                radio = grafo.nodes[node].get("radio_pct")
+                if radio is not None and radio < 100:
+                    label += f"\nRádio:{radio}%"
                 labels[node] = label
 
 
         font_colors = {
-            node: 'white' if G.nodes[node].get("is_router", False)
-            else get_text_color(cmap(norm(G.nodes[node].get("hops", 0))))
-            for node in G.nodes()
+            node: 'white' if grafo.nodes[node].get("is_router", False)
+            else get_text_color(cmap(norm(grafo.nodes[node].get("hops", 0))))
+            for node in grafo.nodes()
         }
 
-        nx.draw_networkx_edges(G, pos, ax=ax, arrows=True, arrowstyle='-|>', arrowsize=25, min_source_margin=15, min_target_margin=30)
-        nx.draw_networkx_nodes(G, pos, node_color=node_colors, node_size=3500, ax=ax)
+        nx.draw_networkx_edges(grafo, pos, ax=ax, arrows=True, arrowstyle='-|>', arrowsize=25, min_source_margin=15, min_target_margin=30)
+        nx.draw_networkx_nodes(grafo, pos, node_color=node_colors, node_size=3500, ax=ax)
         for node, label in labels.items():
-            nx.draw_networkx_labels(G, pos, labels={node: label}, font_color=font_colors.get(node, 'black'), font_size=6, ax=ax)
+            nx.draw_networkx_labels(grafo, pos, labels={node: label}, font_color=font_colors.get(node, 'black'), font_size=6, ax=ax)
 
     # Calcula limites com margem extra para evitar corte das bolinhas
     x_vals = [p[0] for p in pos.values()]
@@ -226,6 +298,15 @@ def plot_graph(ax, canvas):
     plt.subplots_adjust(left=0.02, right=0.98, top=0.98, bottom=0.02)
 
 
+def grafo_historico(ts):
+    grafo = nx.DiGraph()
+    for mac, (parent, hops) in consultar(f"/history/topology?ts={ts}").items():
+        grafo.add_node(mac, hops=hops, is_root=(parent == "null"))
+        if parent and parent != "null":
+            grafo.add_edge(parent, mac)
+    return grafo
+
+
 def enviar_config(entry_intervalo, entry_maxfilhos, entry_timeout):
     global NODE_TIMEOUT
     try:
@@ -234,20 +315,41 @@ def enviar_config(entry_intervalo, entry_maxfilhos, entry_timeout):
         NODE_TIMEOUT = int(entry_timeout.get())
         msg = json.dumps({"interval": intervalo, "max_children": max_filhos})
         send_message(msg)
+        enviar_ao_servidor("/config", json.dumps({"node_timeout": NODE_TIMEOUT}))
         print(f"📤 Config enviado: {msg} | 🕒 Timeout atualizado para {NODE_TIMEOUT}s")
     except ValueError:
         print("❌ Valores inválidos.")
+    except OSError as e:
+        print(f"❌ Erro ao enviar timeout ao serviço de topologia: {e}")
 
 def enviar_ping():
     global selected_node_mac
     if selected_node_mac:
         print("ping no {}".format(selected_node_mac))
-        ping_timers[selected_node_mac] = time.time()  # Marca tempo de envio
         msg = json.dumps({"target": selected_node_mac, "action": "ping"})
         send_message(msg)
         print(f"📤 Comando de ping enviado para {selected_node_mac}")
 
 
+def enviar_profile():
+    if selected_node_mac:
+        msg = json.dumps({"target": selected_node_mac, "action": "profile", "window_ms": 5000})
+        send_message(msg)
+        print(f"📤 Comando de profile enviado para {selected_node_mac}")
+
+
+def enviar_rebalance(aplicar):
+    msg = json.dumps({"action": "rebalance", "apply": aplicar})
+    send_message(msg)
+    print(f"📤 Balanceamento solicitado (aplicar={aplicar})")
+
+
+def enviar_handover():
+    msg = json.dumps({"action": "handover"})
+    send_message(msg)
+    print("📤 Troca de root solicitada")
+
+
 def atualizar_lista_nos(listbox):
     global last_node_snapshot
     if NODE_TIMEOUT == 0:
@@ -311,22 +413,20 @@ def ao_selecionar_no(event):
 
 def main():
     after_id = None
-    global mqtt_client, running, root
+    global running, root
     mosquitto_process = start_mosquitto()
+    server_process = start_topology_server()
 
-    mqtt_client = mqtt.Client(protocol=mqtt.MQTTv311)
-    mqtt_client.on_connect = on_connect
-    mqtt_client.on_message = on_message
-
-    try:
-        mqtt_client.connect(MQTT_BROKER, MQTT_PORT, 60)
-        mqtt_client.loop_start()
-    except Exception as e:
-        print(f"❌ Erro ao conectar no broker MQTT: {e}")
+    if not servidor_disponivel():
+        print("❌ Serviço de topologia indisponível.")
+        if server_process:
+            server_process.terminate()
         if mosquitto_process:
             mosquitto_process.terminate()
         return
 
+    threading.Thread(target=acompanhar_topologia, daemon=True).start()
+
     root = tk.Tk()
     root.title("Mesh Network Viewer")
 
@@ -380,9 +480,94 @@ def main():
         command=lambda: enviar_ping()
     ).pack(side=tk.RIGHT, padx=10)
 
+    ttk.Button(
+        frame,
+        text="Profile",
+        command=lambda: enviar_profile()
+    ).pack(side=tk.RIGHT, padx=10)
+
+    ttk.Button(
+        frame,
+        text="Trocar root",
+        command=lambda: enviar_handover()
+    ).pack(side=tk.RIGHT, padx=10)
+
+    ttk.Button(
+        frame,
+        text="Aplicar balanceamento",
+        command=lambda: enviar_rebalance(True)
+    ).pack(side=tk.RIGHT, padx=10)
+
+    ttk.Button(
+        frame,
+        text="Sugerir balanceamento",
+        command=lambda: enviar_rebalance(False)
+    ).pack(side=tk.RIGHT, padx=10)
+
+    # Linha do tempo: no fim = ao vivo; antes disso, topologia gravada no histórico
+    timeline = ttk.Frame(root, padding=(10, 0, 10, 10))
+    timeline.pack(fill=tk.X)
+    historico_exibido = None
+    # Início do histórico, buscado fora da thread da interface e guardado por HISTORY_RANGE_TTL
+    intervalo_historico = {"inicio": None, "buscado_em": 0.0, "buscando": False}
+
+    def buscar_intervalo_historico():
+        try:
+            inicio, _ = consultar("/history/range")
+            intervalo_historico["inicio"] = inicio
+            intervalo_historico["buscado_em"] = time.time()
+        except OSError as e:
+            print(f"❌ Histórico indisponível: {e}")
+        finally:
+            intervalo_historico["buscando"] = False
+
+    def atualizar_intervalo_historico():
+        # Sem histórico ainda, tenta de novo no próximo movimento
+        recente = time.time() - intervalo_historico["buscado_em"] < HISTORY_RANGE_TTL
+        if intervalo_historico["buscando"] or (recente and intervalo_historico["inicio"] is not None):
+            return
+        intervalo_historico["buscando"] = True
+        threading.Thread(target=buscar_intervalo_historico, daemon=True).start()
+
+    def ao_mover_linha_do_tempo(valor):
+        global timeline_ts
+        atualizar_intervalo_historico()
+        inicio = intervalo_historico["inicio"]
+        posicao = float(valor)
+        if inicio is None or posicao >= 999:
+            timeline_ts = None
+            label_tempo.config(text="ao vivo")
+            return
+        timeline_ts = inicio + (time.time() - inicio) * posicao / 1000
+        label_tempo.config(text=time.strftime("%d/%m %H:%M:%S", time.localtime(timeline_ts)))
+
+    def voltar_ao_vivo():
+        global timeline_ts
+        timeline_ts = None
+        escala_tempo.set(1000)
+        label_tempo.config(text="ao vivo")
+
+    ttk.Label(timeline, text="Linha do tempo:").pack(side=tk.LEFT)
+    label_tempo = ttk.Label(timeline, text="ao vivo", width=16)
+    escala_tempo = ttk.Scale(timeline, from_=0, to=1000, orient=tk.HORIZONTAL, command=ao_mover_linha_do_tempo)
+    escala_tempo.set(1000)
+    atualizar_intervalo_historico()
+    escala_tempo.pack(side=tk.LEFT, fill=tk.X, expand=True, padx=5)
+    label_tempo.pack(side=tk.LEFT)
+    ttk.Button(timeline, text="Ao vivo", command=voltar_ao_vivo).pack(side=tk.LEFT, padx=10)
+
     def atualizar_interface():
-        plot_graph(ax, canvas)
-        atualizar_lista_nos(listbox_nodes)
+        nonlocal historico_exibido
+        if timeline_ts is None:
+            historico_exibido = None
+            plot_graph(ax, canvas)
+            atualizar_lista_nos(listbox_nodes)
+        elif historico_exibido != timeline_ts:
+            historico_exibido = timeline_ts
+            try:
+                plot_graph(ax, canvas, grafo_historico(timeline_ts))
+            except OSError as e:
+                print(f"❌ Histórico indisponível: {e}")
 
     def agendar_atualizacao():
         nonlocal after_id
@@ -398,6 +583,7 @@ def main():
                 root.after_cancel(after_id)
             except:
                 pass
+        # O serviço de topologia fica rodando: outros painéis e o histórico dependem dele
         if mosquitto_process:
             mosquitto_process.terminate()
         root.quit()  # <- Sai imediatamente da mainloop
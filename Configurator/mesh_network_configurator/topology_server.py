@@ -0,0 +1,443 @@
+import argparse
+import http.client
+import json
+import multiprocessing
+import os
+import queue
+import random
+import signal
+import threading
+import time
+from http.server import BaseHTTPRequestHandler, ThreadingHTTPServer
+from urllib.parse import parse_qs, urlparse
+
+import paho.mqtt.client as mqtt
+from history import HistoryStore
+
+# Serviço de topologia: dono da única assinatura MQTT e do estado da rede.
+# Os painéis (main.py ou outros) recebem um snapshot e, a partir daí, só as
+# diferenças, por HTTP com Server-Sent Events; os comandos chegam por POST
+# e são publicados no broker por aqui.
+#
+#   GET  /snapshot                estado atual
+#   GET  /events                  evento "snapshot" seguido de eventos "diff"
+#   GET  /history/range           primeiro e último instante do histórico
+#   GET  /history/topology?ts=    topologia gravada no instante ts
+#   POST /cmd                     JSON publicado em mesh/cmd
+#   POST /config                  {"node_timeout": s}
+#
+# Cada diff: {"version": n, "ts": instante do envio, "ops": [...]}, com ops
+#   {"op": "node", "mac", "parent", "hops", "is_root", "radio_pct"}
+#   {"op": "remove", "mac"} | {"op": "ping", "mac", "ms"}
+#   {"op": "event", "data"} | {"op": "config", "node_timeout"}
+# Um nó com "parent" None só é conhecido como pai/filho de outro nó.
+
+SERVER_HOST = "127.0.0.1"
+SERVER_PORT = 8765
+MQTT_PORT = 1883
+MQTT_TOPIC = "mesh/network/info"
+MQTT_CONFIG_COMMAND_TOPIC = "mesh/cmd"
+NODE_TIMEOUT = 20
+HISTORY_DB = os.path.join(os.path.dirname(os.path.abspath(__file__)), "mesh_history.db")
+
+CLIENT_QUEUE_LEN = 512     # diffs pendentes por painel antes de desconectá-lo
+KEEPALIVE_INTERVAL = 15    # segundos sem diffs até um comentário SSE
+EVENT_TYPES = ("profile", "advice", "metric", "cmd_error")
+
+
+def sse(evento, dados):
+    return f"event: {evento}\ndata: {dados}\n\n".encode()
+
+
+def eventos_sse(stream):
+    """Lê (evento, dados) de uma resposta text/event-stream até ela ser fechada."""
+    evento, dados = "message", []
+    for linha in stream:
+        linha = linha.decode().rstrip("\r\n")
+        if not linha:
+            if dados:
+                yield evento, "\n".join(dados)
+            evento, dados = "message", []
+        elif linha.startswith("event:"):
+            evento = linha[6:].strip()
+        elif linha.startswith("data:"):
+            dados.append(linha[5:].lstrip())
+
+
+class Subscriber:
+    def __init__(self):
+        self.queue = queue.Queue(CLIENT_QUEUE_LEN)
+        self.dropped = False
+
+
+class TopologyState:
+    def __init__(self, history=None, node_timeout=NODE_TIMEOUT):
+        self.lock = threading.Lock()
+        self.nodes = {}        # mac -> atributos enviados aos painéis
+        self.last_seen = {}
+        self.pings = {}        # mac -> latência do último ping (ms)
+        self.ping_timers = {}
+        self.version = 0
+        self.node_timeout = node_timeout
+        self.history = history
+        self.subscribers = []
+
+    def _snapshot(self):
+        return {"version": self.version, "nodes": self.nodes, "pings": self.pings,
+                "node_timeout": self.node_timeout}
+
+    def snapshot(self):
+        with self.lock:
+            return json.dumps(self._snapshot())
+
+    def subscribe(self):
+        # Inscrição e snapshot sob o mesmo lock: o primeiro diff da fila é o seguinte ao snapshot
+        sub = Subscriber()
+        with self.lock:
+            self.subscribers.append(sub)
+            return sub, sse("snapshot", json.dumps(self._snapshot()))
+
+    def unsubscribe(self, sub):
+        with self.lock:
+            if sub in self.subscribers:
+                self.subscribers.remove(sub)
+
+    def _publish(self, ops):
+        """Codifica o diff uma única vez e o entrega a todos os painéis. Chamar com lock."""
+        if not ops:
+            return
+        self.version += 1
+        frame = sse("diff", json.dumps({"version": self.version, "ts": time.time(), "ops": ops}))
+        for sub in list(self.subscribers):
+            try:
+                sub.queue.put_nowait(frame)
+            except queue.Full:
+                # Painel lento: é desconectado e recomeça por um snapshot ao reconectar
+                sub.dropped = True
+                self.subscribers.remove(sub)
+
+    def ingest(self, payload):
+        try:
+            data = json.loads(payload)
+        except ValueError as e:
+            print(f"❌ Erro ao processar mensagem: {e}")
+            return
+
+        kind = data.get("type")
+        if kind == "pong" and "mac" in data:
+            self._pong(data["mac"])
+        elif kind in EVENT_TYPES:
+            with self.lock:
+                self._publish([{"op": "event", "data": data}])
+        elif all(k in data for k in ('mac', 'parent', 'hops', 'children')):
+            self._report(data)
+        else:
+            print("⚠️ JSON incompleto:", data)
+
+    def _report(self, data):
+        mac, parent = data["mac"], data["parent"]
+        node = {"parent": parent, "hops": data["hops"], "is_root": parent == "null",
+                "radio_pct": data.get("radio_pct")}
+        if self.history:
+            self.history.add_report(data)
+
+        now = time.time()
+        ops = []
+        with self.lock:
+            # Relatório igual ao anterior só renova o last_seen: nada é enviado aos painéis
+            if self.nodes.get(mac) != node:
+                self.nodes[mac] = node
+                ops.append({"op": "node", "mac": mac, **node})
+            self.last_seen[mac] = now
+
+            vizinhos = data.get("children", []) + ([parent] if parent != "null" else [])
+            for other in vizinhos:
+                if other not in self.nodes:
+                    self.nodes[other] = {"parent": None, "hops": None, "is_root": False, "radio_pct": None}
+                    ops.append({"op": "node", "mac": other, **self.nodes[other]})
+                if other != parent or other not in self.last_seen:
+                    self.last_seen[other] = now
+            self._publish(ops)
+
+    def _pong(self, mac):
+        with self.lock:
+            sent = self.ping_timers.pop(mac, None)
+            if sent is None:
+                print(f"🏓 Pong recebido de {mac}, mas não foi feito ping.")
+                return
+            elapsed = (time.time() - sent) * 1000
+            self.pings[mac] = elapsed
+            self._publish([{"op": "ping", "mac": mac, "ms": elapsed}])
+        if self.history:
+            self.history.add_ping(mac, elapsed)
+        print(f"🏓 Ping para {mac} respondido em {elapsed:.0f} ms")
+
+    def note_command(self, data):
+        if data.get("action") == "ping" and "target" in data:
+            with self.lock:
+                self.ping_timers[data["target"]] = time.time()  # Marca tempo de envio
+
+    def set_node_timeout(self, timeout):
+        with self.lock:
+            self.node_timeout = timeout
+            self._publish([{"op": "config", "node_timeout": timeout}])
+
+    def expire(self):
+        if self.node_timeout == 0:
+            return  # 👈 timeout infinito, não remove nada
+        now = time.time()
+        with self.lock:
+            ops = []
+            for mac, last in list(self.last_seen.items()):
+                if now - last > self.node_timeout:
+                    print(f"🗑️ Removendo nó inativo/incompleto: {mac}")
+                    if self.history:
+                        self.history.mark_leave(mac)
+                    del self.last_seen[mac]
+                    self.nodes.pop(mac, None)
+                    self.pings.pop(mac, None)
+                    ops.append({"op": "remove", "mac": mac})
+            self._publish(ops)
+
+
+class TopologyHTTPServer(ThreadingHTTPServer):
+    daemon_threads = True
+
+    def __init__(self, address, state, send_cmd, history=None):
+        super().__init__(address, TopologyHandler)
+        self.state = state
+        self.send_cmd = send_cmd
+        self.history = history
+        self.running = True
+
+
+class TopologyHandler(BaseHTTPRequestHandler):
+    def log_message(self, format, *args):
+        pass
+
+    def _json(self, obj, status=200):
+        body = (obj if isinstance(obj, str) else json.dumps(obj)).encode()
+        self.send_response(status)
+        self.send_header("Content-Type", "application/json")
+        self.send_header("Content-Length", str(len(body)))
+        self.end_headers()
+        self.wfile.write(body)
+
+    def do_GET(self):
+        url = urlparse(self.path)
+        history = self.server.history
+        if url.path == "/snapshot":
+            self._json(self.server.state.snapshot())
+        elif url.path == "/events":
+            self._events()
+        elif url.path.startswith("/history/") and not history:
+            self.send_error(503, "Histórico desativado")
+        elif url.path == "/history/range":
+            self._json(history.time_range())
+        elif url.path == "/history/topology":
+            try:
+                ts = float(parse_qs(url.query)["ts"][0])
+            except (KeyError, ValueError):
+                self.send_error(400, "Parâmetro 'ts' inválido")
+                return
+            self._json(history.topology_at(ts))
+        else:
+            self.send_error(404)
+
+    def _events(self):
+        state = self.server.state
+        sub, snapshot = state.subscribe()
+        try:
+            self.send_response(200)
+            self.send_header("Content-Type", "text/event-stream")
+            self.send_header("Cache-Control", "no-cache")
+            self.end_headers()
+            self.wfile.write(snapshot)
+            while self.server.running:
+                try:
+                    frame = sub.queue.get(timeout=KEEPALIVE_INTERVAL)
+                except queue.Empty:
+                    if sub.dropped:
+                        break
+                    self.wfile.write(b": keepalive\n\n")
+                    continue
+                self.wfile.write(frame)
+                if sub.dropped and sub.queue.empty():
+                    break
+        except OSError:
+            pass  # painel fechado
+        finally:
+            state.unsubscribe(sub)
+
+    def do_POST(self):
+        url = urlparse(self.path)
+        body = self.rfile.read(int(self.headers.get("Content-Length", 0)))
+        try:
+            data = json.loads(body)
+        except ValueError:
+            self.send_error(400, "JSON inválido")
+            return
+
+        if url.path == "/cmd":
+            self.server.state.note_command(data)
+            self.server.send_cmd(body.decode())
+            self._json({"ok": True})
+        elif url.path == "/config" and isinstance(data.get("node_timeout"), int):
+            self.server.state.set_node_timeout(data["node_timeout"])
+            print(f"🕒 Timeout atualizado para {data['node_timeout']}s")
+            self._json({"ok": True})
+        else:
+            self.send_error(400)
+
+
+def start_http(state, host, port, send_cmd, history=None):
+    httpd = TopologyHTTPServer((host, port), state, send_cmd, history)
+    threading.Thread(target=httpd.serve_forever, daemon=True).start()
+    return httpd
+
+
+def start_mqtt(state, broker, port):
+    client = mqtt.Client(protocol=mqtt.MQTTv311)
+
+    def on_connect(client, userdata, flags, rc):
+        if rc == 0:
+            print("✅ Conectado ao broker MQTT")
+            client.subscribe(MQTT_TOPIC)
+            print(f"📡 Inscrito no tópico: {MQTT_TOPIC}")
+        else:
+            print(f"❌ Falha na conexão. Código de retorno: {rc}")
+
+    client.on_connect = on_connect
+    client.on_message = lambda client, userdata, msg: state.ingest(msg.payload)
+    client.connect(broker, port, 60)
+    client.loop_start()
+    return client
+
+
+def serve(broker, mqtt_port, host, http_port, db):
+    history = HistoryStore(db) if db else None
+    state = TopologyState(history)
+    parar = threading.Event()
+    signal.signal(signal.SIGTERM, lambda *args: parar.set())
+
+    try:
+        mqtt_client = start_mqtt(state, broker, mqtt_port)
+    except Exception as e:
+        print(f"❌ Erro ao conectar no broker MQTT: {e}")
+        if history:
+            history.close()
+        return
+
+    httpd = start_http(state, host, http_port, lambda msg: mqtt_client.publish(MQTT_CONFIG_COMMAND_TOPIC, msg), history)
+    print(f"🛰️ Serviço de topologia em http://{host}:{httpd.server_address[1]}")
+
+    try:
+        while not parar.wait(1):
+            state.expire()
+    except KeyboardInterrupt:
+        pass
+
+    httpd.running = False
+    httpd.shutdown()
+    mqtt_client.loop_stop()
+    mqtt_client.disconnect()
+    if history:
+        history.close()
+    print("✅ Serviço de topologia finalizado.")
+
+
+def _bench_clients(port, clients, pronto, parar, resultado):
+    # Roda em outro processo: a CPU medida no processo principal é só a do serviço
+    latencias = [[] for _ in range(clients)]
+    conectados = threading.Semaphore(0)
+
+    def cliente(amostras):
+        conn = http.client.HTTPConnection(SERVER_HOST, port)
+        conn.request("GET", "/events")
+        for evento, dados in eventos_sse(conn.getresponse()):
+            if evento == "snapshot":
+                conectados.release()
+            elif evento == "diff":
+                amostras.append(time.time() - json.loads(dados)["ts"])
+
+    for amostras in latencias:
+        threading.Thread(target=cliente, args=(amostras,), daemon=True).start()
+    for _ in range(clients):
+        conectados.acquire()
+    pronto.set()
+    parar.wait()
+    resultado.put([len(a) for a in latencias] + [x for a in latencias for x in a])
+
+
+def benchmark(clients, nodes, rate, duration):
+    # Dublê do broker: relatórios sintéticos entregues pelo mesmo caminho do on_message do MQTT.
+    # Todo relatório muda o radio_pct do nó, então cada um gera um diff para todos os painéis.
+    rng = random.Random(1)
+    macs = [f"AA:BB:CC:00:{i >> 8 & 0xFF:02X}:{i & 0xFF:02X}" for i in range(nodes)]
+    payloads = []
+    for n in range(int(rate * duration)):
+        i = n % nodes
+        payloads.append(json.dumps({"mac": macs[i], "parent": "null" if i == 0 else macs[(i - 1) // 4],
+                                    "hops": 1, "children": [], "radio_pct": rng.randrange(5, 100)}).encode())
+
+    state = TopologyState(node_timeout=0)
+    httpd = start_http(state, SERVER_HOST, 0, lambda msg: None)
+
+    ctx = multiprocessing.get_context("spawn")
+    pronto, parar, resultado = ctx.Event(), ctx.Event(), ctx.Queue()
+    worker = ctx.Process(target=_bench_clients, args=(httpd.server_address[1], clients, pronto, parar, resultado))
+    worker.start()
+    if not pronto.wait(30):
+        print("❌ Painéis simulados não conectaram.")
+        worker.terminate()
+        return
+    print(f"👥 {clients} painéis conectados; {len(payloads)} relatórios a {rate}/s")
+
+    cpu0, t0 = time.process_time(), time.perf_counter()
+    for n, payload in enumerate(payloads):
+        atraso = t0 + n / rate - time.perf_counter()
+        if atraso > 0:
+            time.sleep(atraso)
+        state.ingest(payload)
+    time.sleep(1)  # entrega dos últimos diffs
+    cpu, wall = time.process_time() - cpu0, time.perf_counter() - t0
+
+    parar.set()
+    dados = resultado.get()
+    worker.join()
+    httpd.running = False
+    httpd.shutdown()
+
+    recebidos, latencias = dados[:clients], sorted(dados[clients:])
+    if not latencias:
+        print("❌ Nenhum diff recebido.")
+        return
+
+    def pct(p):
+        return latencias[min(len(latencias) - 1, int(len(latencias) * p))] * 1000
+
+    print(f"📤 {state.version} diffs, {len(latencias)} entregas "
+          f"(mín. {min(recebidos)} / máx. {max(recebidos)} por painel)")
+    print(f"⏱️ Latência de distribuição: p50 {pct(0.5):.2f} ms | p95 {pct(0.95):.2f} ms | "
+          f"p99 {pct(0.99):.2f} ms | máx. {latencias[-1] * 1000:.2f} ms")
+    print(f"🧮 CPU do serviço: {cpu:.2f} s em {wall:.1f} s ({cpu / wall * 100:.1f}% de um núcleo)")
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description="Serviço de topologia da rede mesh")
+    parser.add_argument("--broker", default="127.0.0.1", help="endereço do broker MQTT")
+    parser.add_argument("--mqtt-port", type=int, default=MQTT_PORT)
+    parser.add_argument("--host", default=SERVER_HOST, help="endereço HTTP dos painéis")
+    parser.add_argument("--http-port", type=int, default=SERVER_PORT)
+    parser.add_argument("--db", default=HISTORY_DB, help="histórico SQLite ('' desativa)")
+    parser.add_argument("--bench", action="store_true", help="teste de carga com painéis simulados")
+    parser.add_argument("--clients", type=int, default=50)
+    parser.add_argument("--nodes", type=int, default=100)
+    parser.add_argument("--rate", type=float, default=100, help="relatórios por segundo")
+    parser.add_argument("--duration", type=float, default=20, help="segundos")
+    args = parser.parse_args()
+
+    if args.bench:
+        benchmark(args.clients, args.nodes, args.rate, args.duration)
+    else:
+        serve(args.broker, args.mqtt_port, args.host, args.http_port, args.db)
@@ -0,0 +1,162 @@
+/**
+ * @file fuzz_mesh_cmd.c
+ * @brief Alvo de fuzzing de mesh_cmd_decode(): quadros arbitrários vindos da mesh.
+ *
+ * Com libFuzzer (-DMESH_HOST_FUZZ=ON) o ponto de entrada é LLVMFuzzerTestOneInput.
+ * Com MESH_FUZZ_STANDALONE há um main() que lê os arquivos da linha de comando
+ * (uso com AFL: ./fuzz_mesh_cmd @@) ou, sem argumentos, roda mutações
+ * pseudoaleatórias de quadros válidos como teste do ctest.
+ *
+ * Propriedades verificadas: um quadro aceito volta idêntico pelo mesh_cmd_encode()
+ * e, despachado como vindo da mesh em um nó que não é root, nunca executa um
+ * comando MESH_CMD_F_ROOT_ONLY.
+ */
+
+#include "esp_mesh.h"
+#include "esp_random.h"
+#include "mesh_cmd.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define HDR_LEN (11)
+
+static void on_cmd(const mesh_cmd_t *cmd, mesh_cmd_src_t src)
+{
+}
+
+static void on_root_only(const mesh_cmd_t *cmd, mesh_cmd_src_t src)
+{
+    if (src == MESH_CMD_SRC_MESH && !esp_mesh_is_root())
+    {
+        abort();
+    }
+}
+
+static void register_once(void)
+{
+    static bool done = false;
+    if (done)
+    {
+        return;
+    }
+    // Um comando de cada forma: tamanho fixo, variável e sem argumentos
+    const mesh_cmd_def_t fixed = {"fixed", 0, 8, NULL, on_cmd};
+    const mesh_cmd_def_t var = {"var", MESH_CMD_F_ROOT_ONLY, 0, NULL, on_root_only};
+    const mesh_cmd_def_t targeted = {"targeted", MESH_CMD_F_TARGETED, 0, NULL, on_cmd};
+    mesh_cmd_init(NULL);
+    mesh_cmd_register(1, &fixed);
+    mesh_cmd_register(2, &var);
+    mesh_cmd_register(3, &targeted);
+    done = true;
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+    static uint8_t out[HDR_LEN + MESH_CMD_ARGS_MAX];
+    mesh_cmd_t cmd;
+
+    register_once();
+    if (mesh_cmd_decode(data, size, &cmd) != ESP_OK)
+    {
+        return 0;
+    }
+
+    size_t len = mesh_cmd_encode(&cmd, out, sizeof(out));
+    if (len == 0 || len > size || cmd.args_len > MESH_CMD_ARGS_MAX || memcmp(out, data, len) != 0)
+    {
+        abort();
+    }
+    mesh_cmd_dispatch(&cmd, MESH_CMD_SRC_MESH);
+    return 0;
+}
+
+#ifdef MESH_FUZZ_STANDALONE
+
+#define SMOKE_RUNS (200000)
+
+static int run_file(const char *path)
+{
+    static uint8_t buf[64 * 1024];
+    FILE *f = strcmp(path, "-") == 0 ? stdin : fopen(path, "rb");
+    if (!f)
+    {
+        perror(path);
+        return 1;
+    }
+    size_t len = fread(buf, 1, sizeof(buf), f);
+    if (f != stdin)
+    {
+        fclose(f);
+    }
+    LLVMFuzzerTestOneInput(buf, len);
+    return 0;
+}
+
+/**
+ * @brief Quadros válidos com bytes trocados, cortados ou estendidos. Sem achados, sai com 0.
+ */
+static void smoke(void)
+{
+    static uint8_t frame[HDR_LEN + MESH_CMD_ARGS_MAX + 16];
+    static const uint16_t seeds[][2] = {{1, 8}, {2, 0}, {2, 40}, {2, MESH_CMD_ARGS_MAX}, {3, 0}};
+    unsigned accepted = 0;
+
+    for (int run = 0; run < SMOKE_RUNS; run++)
+    {
+        const uint16_t *seed = seeds[run % (sizeof(seeds) / sizeof(seeds[0]))];
+        size_t len = HDR_LEN + seed[1];
+
+        memset(frame, 0, sizeof(frame));
+        frame[0] = 0xA9;
+        frame[1] = (uint8_t)seed[0];
+        memcpy(frame + 9, &seed[1], 2);
+        for (size_t i = HDR_LEN; i < len; i++)
+        {
+            frame[i] = (uint8_t)esp_random();
+        }
+
+        int flips = esp_random() % 4;
+        for (int i = 0; i < flips; i++)
+        {
+            frame[esp_random() % len] = (uint8_t)esp_random();
+        }
+        switch (esp_random() % 3)
+        {
+        case 0:
+            len = esp_random() % (len + 1);
+            break;
+        case 1:
+            len += esp_random() % 16;
+            break;
+        default:
+            break;
+        }
+
+        if (LLVMFuzzerTestOneInput(frame, len) == 0)
+        {
+            mesh_cmd_t cmd;
+            accepted += mesh_cmd_decode(frame, len, &cmd) == ESP_OK;
+        }
+    }
+    printf("%d quadros mutados, %u aceitos, nenhuma falha\n", SMOKE_RUNS, accepted);
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        smoke();
+        return 0;
+    }
+    for (int i = 1; i < argc; i++)
+    {
+        if (run_file(argv[i]))
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+#endif // MESH_FUZZ_STANDALONE
@@ -0,0 +1,58 @@
+/**
+ * @file host_test.h
+ * @brief Verificações mínimas dos testes no host (sem framework): cada falha é impressa e contada.
+ */
+
+#ifndef HOST_TEST_H
+#define HOST_TEST_H
+
+#include <stdio.h>
+#include <string.h>
+
+static int host_test_failures = 0;
+
+#define CHECK(cond)                                                               \
+    do                                                                            \
+    {                                                                             \
+        if (!(cond))                                                              \
+        {                                                                         \
+            fprintf(stderr, "%s:%d: falhou: %s\n", __FILE__, __LINE__, #cond);    \
+            host_test_failures++;                                                 \
+        }                                                                         \
+    } while (0)
+
+#define CHECK_INT(actual, expected)                                                         \
+    do                                                                                      \
+    {                                                                                       \
+        long long a_ = (long long)(actual), e_ = (long long)(expected);                     \
+        if (a_ != e_)                                                                       \
+        {                                                                                   \
+            fprintf(stderr, "%s:%d: %s = %lld, esperado %lld\n", __FILE__, __LINE__, #actual, \
+                    a_, e_);                                                                \
+            host_test_failures++;                                                           \
+        }                                                                                   \
+    } while (0)
+
+#define CHECK_STR(actual, expected)                                                                   \
+    do                                                                                                \
+    {                                                                                                 \
+        const char *a_ = (actual), *e_ = (expected);                                                  \
+        if (!a_ || strcmp(a_, e_) != 0)                                                               \
+        {                                                                                             \
+            fprintf(stderr, "%s:%d: %s = \"%s\", esperado \"%s\"\n", __FILE__, __LINE__, #actual,     \
+                    a_ ? a_ : "(null)", e_);                                                          \
+            host_test_failures++;                                                                     \
+        }                                                                                             \
+    } while (0)
+
+#define RUN_TEST(fn)                         \
+    do                                       \
+    {                                        \
+        int before_ = host_test_failures;    \
+        fn();                                \
+        printf("%s %s\n", host_test_failures == before_ ? "ok  " : "FAIL", #fn); \
+    } while (0)
+
+#define HOST_TEST_RESULT() (host_test_failures ? 1 : 0)
+
+#endif // HOST_TEST_H
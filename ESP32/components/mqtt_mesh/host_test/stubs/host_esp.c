@@ -0,0 +1,126 @@
+/**
+ * @file host_esp.c
+ * @brief Partes do ESP-IDF sem hardware usadas pelos módulos: nomes de erro, log, esp_timer, esp_random, heap, restart e HTTP.
+ */
+
+#include "esp_err.h"
+#include "esp_heap_caps.h"
+#include "esp_http_client.h"
+#include "esp_log.h"
+#include "esp_random.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include <stdlib.h>
+#include <string.h>
+
+const char *esp_err_to_name(esp_err_t code)
+{
+    switch (code)
+    {
+    case ESP_OK:
+        return "ESP_OK";
+    case ESP_FAIL:
+        return "ESP_FAIL";
+    case ESP_ERR_NO_MEM:
+        return "ESP_ERR_NO_MEM";
+    case ESP_ERR_INVALID_ARG:
+        return "ESP_ERR_INVALID_ARG";
+    case ESP_ERR_INVALID_STATE:
+        return "ESP_ERR_INVALID_STATE";
+    case ESP_ERR_INVALID_SIZE:
+        return "ESP_ERR_INVALID_SIZE";
+    case ESP_ERR_NOT_FOUND:
+        return "ESP_ERR_NOT_FOUND";
+    case ESP_ERR_NOT_SUPPORTED:
+        return "ESP_ERR_NOT_SUPPORTED";
+    case ESP_ERR_TIMEOUT:
+        return "ESP_ERR_TIMEOUT";
+    case ESP_ERR_NOT_ALLOWED:
+        return "ESP_ERR_NOT_ALLOWED";
+    default:
+        return "ESP_ERR_UNKNOWN";
+    }
+}
+
+int host_log_enabled(void)
+{
+    static int enabled = -1;
+    if (enabled < 0)
+    {
+        const char *env = getenv("HOST_TEST_VERBOSE");
+        enabled = env && strcmp(env, "0") != 0;
+    }
+    return enabled;
+}
+
+int64_t esp_timer_get_time(void)
+{
+    return host_clock_us();
+}
+
+uint32_t esp_random(void)
+{
+    // xorshift32 com semente fixa
+    static uint32_t state = 0x2545F491;
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+
+size_t host_heap_free = 150 * 1024;
+size_t host_heap_min_free = 120 * 1024;
+size_t host_heap_largest = 100 * 1024;
+
+size_t heap_caps_get_free_size(uint32_t caps)
+{
+    return host_heap_free;
+}
+
+size_t heap_caps_get_minimum_free_size(uint32_t caps)
+{
+    return host_heap_min_free;
+}
+
+size_t heap_caps_get_largest_free_block(uint32_t caps)
+{
+    return host_heap_largest;
+}
+
+int host_restart_count = 0;
+
+void esp_restart(void)
+{
+    host_restart_count++;
+}
+
+esp_http_client_handle_t esp_http_client_init(const esp_http_client_config_t *config)
+{
+    return NULL;
+}
+
+esp_err_t esp_http_client_open(esp_http_client_handle_t client, int write_len)
+{
+    return ESP_FAIL;
+}
+
+int64_t esp_http_client_fetch_headers(esp_http_client_handle_t client)
+{
+    return -1;
+}
+
+int esp_http_client_read(esp_http_client_handle_t client, char *buffer, int len)
+{
+    return -1;
+}
+
+esp_err_t esp_http_client_close(esp_http_client_handle_t client)
+{
+    return ESP_OK;
+}
+
+esp_err_t esp_http_client_cleanup(esp_http_client_handle_t client)
+{
+    return ESP_OK;
+}
@@ -0,0 +1,254 @@
+/**
+ * @file host_freertos.c
+ * @brief Filas, semáforos, tasks e relógio do dublê do FreeRTOS.
+ */
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct host_queue
+{
+    UBaseType_t length;
+    UBaseType_t item_size;
+    UBaseType_t head;
+    UBaseType_t count;
+    uint8_t *items;
+    bool mutex;
+};
+
+static int64_t clock_us = 0;
+
+static TaskStatus_t *fake_tasks = NULL;
+static uint16_t *fake_load = NULL;
+static UBaseType_t fake_task_count = 0;
+static configRUN_TIME_COUNTER_TYPE fake_total = 0;
+
+void host_clock_advance_ms(uint32_t ms)
+{
+    clock_us += (int64_t)ms * 1000;
+
+    // Tempo de CPU simulado: cada task recebe a sua fração da janela em cada núcleo
+    fake_total += ms * 1000;
+    for (UBaseType_t i = 0; i < fake_task_count; i++)
+    {
+        fake_tasks[i].ulRunTimeCounter += (configRUN_TIME_COUNTER_TYPE)ms * fake_load[i] * portNUM_PROCESSORS;
+    }
+}
+
+void host_clock_set_us(int64_t us)
+{
+    if (us > clock_us)
+    {
+        clock_us = us;
+    }
+}
+
+int64_t host_clock_us(void)
+{
+    return clock_us;
+}
+
+static BaseType_t fail_after(TickType_t wait)
+{
+    if (wait != portMAX_DELAY)
+    {
+        host_clock_advance_ms(wait);
+    }
+    return pdFALSE;
+}
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size)
+{
+    QueueHandle_t q = calloc(1, sizeof(*q));
+    if (!q)
+    {
+        return NULL;
+    }
+    q->length = length;
+    q->item_size = item_size;
+    q->items = calloc(length ? length : 1, item_size ? item_size : 1);
+    if (!q->items)
+    {
+        free(q);
+        return NULL;
+    }
+    return q;
+}
+
+void vQueueDelete(QueueHandle_t q)
+{
+    if (q)
+    {
+        free(q->items);
+        free(q);
+    }
+}
+
+BaseType_t xQueueSend(QueueHandle_t q, const void *item, TickType_t wait)
+{
+    if (q->count == q->length)
+    {
+        return fail_after(wait);
+    }
+    UBaseType_t tail = (q->head + q->count) % q->length;
+    if (q->item_size)
+    {
+        memcpy(q->items + tail * q->item_size, item, q->item_size);
+    }
+    q->count++;
+    return pdTRUE;
+}
+
+BaseType_t xQueueSendToFront(QueueHandle_t q, const void *item, TickType_t wait)
+{
+    if (q->count == q->length)
+    {
+        return fail_after(wait);
+    }
+    q->head = (q->head + q->length - 1) % q->length;
+    if (q->item_size)
+    {
+        memcpy(q->items + q->head * q->item_size, item, q->item_size);
+    }
+    q->count++;
+    return pdTRUE;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t q, void *item, TickType_t wait)
+{
+    if (q->count == 0)
+    {
+        return fail_after(wait);
+    }
+    if (q->item_size)
+    {
+        memcpy(item, q->items + q->head * q->item_size, q->item_size);
+    }
+    q->head = (q->head + 1) % q->length;
+    q->count--;
+    return pdTRUE;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t q)
+{
+    return q->count;
+}
+
+UBaseType_t uxQueueSpacesAvailable(QueueHandle_t q)
+{
+    return q->length - q->count;
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void)
+{
+    SemaphoreHandle_t sem = xQueueCreate(1, 0);
+    if (sem)
+    {
+        sem->mutex = true;
+        xQueueSend(sem, NULL, 0);
+    }
+    return sem;
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary(void)
+{
+    return xQueueCreate(1, 0);
+}
+
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t max, UBaseType_t initial)
+{
+    SemaphoreHandle_t sem = xQueueCreate(max, 0);
+    for (UBaseType_t i = 0; sem && i < initial; i++)
+    {
+        xQueueSend(sem, NULL, 0);
+    }
+    return sem;
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t wait)
+{
+    // Com uma thread só, ninguém mais devolveria o mutex: no alvo seria um deadlock
+    if (sem->mutex && sem->count == 0 && wait == portMAX_DELAY)
+    {
+        fprintf(stderr, "deadlock: mutex tomado de novo por quem já o tem\n");
+        abort();
+    }
+    return xQueueReceive(sem, NULL, wait);
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t sem)
+{
+    return xQueueSend(sem, NULL, 0);
+}
+
+BaseType_t xTaskCreate(TaskFunction_t fn, const char *name, uint32_t stack, void *arg, UBaseType_t prio,
+                       TaskHandle_t *handle)
+{
+    (void)fn;
+    (void)name;
+    (void)stack;
+    (void)arg;
+    (void)prio;
+    if (handle)
+    {
+        *handle = NULL;
+    }
+    return pdPASS;
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char *name, uint32_t stack, void *arg,
+                                   UBaseType_t prio, TaskHandle_t *handle, BaseType_t core)
+{
+    (void)core;
+    return xTaskCreate(fn, name, stack, arg, prio, handle);
+}
+
+void vTaskDelete(TaskHandle_t task)
+{
+    (void)task;
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+    host_clock_advance_ms(ticks);
+}
+
+TickType_t xTaskGetTickCount(void)
+{
+    return (TickType_t)(clock_us / 1000);
+}
+
+void host_tasks_set(const TaskStatus_t *tasks, const uint16_t *load_permille, UBaseType_t count)
+{
+    free(fake_tasks);
+    free(fake_load);
+    fake_tasks = count ? calloc(count, sizeof(TaskStatus_t)) : NULL;
+    fake_load = count ? calloc(count, sizeof(uint16_t)) : NULL;
+    fake_task_count = count;
+    if (count)
+    {
+        memcpy(fake_tasks, tasks, count * sizeof(TaskStatus_t));
+        memcpy(fake_load, load_permille, count * sizeof(uint16_t));
+    }
+}
+
+UBaseType_t uxTaskGetNumberOfTasks(void)
+{
+    return fake_task_count;
+}
+
+UBaseType_t uxTaskGetSystemState(TaskStatus_t *tasks, UBaseType_t cap, configRUN_TIME_COUNTER_TYPE *total)
+{
+    UBaseType_t n = fake_task_count < cap ? fake_task_count : cap;
+    memcpy(tasks, fake_tasks, n * sizeof(TaskStatus_t));
+    if (total)
+    {
+        *total = fake_total;
+    }
+    return n;
+}
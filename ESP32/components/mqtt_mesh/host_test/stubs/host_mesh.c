@@ -0,0 +1,185 @@
+/**
+ * @file host_mesh.c
+ * @brief ESP-MESH, MAC e cliente MQTT simulados: envios são registrados para os testes conferirem.
+ */
+
+#include "esp_mac.h"
+#include "esp_mesh.h"
+#include "mqtt_client.h"
+#include <string.h>
+
+#define ROUTING_MAX (64)
+
+bool host_mesh_root = false;
+host_mesh_send_hook_t host_mesh_send_hook = NULL;
+host_mesh_sent_t host_mesh_sent[HOST_MESH_SENT_MAX];
+int host_mesh_sent_count = 0;
+bool host_mesh_ps = false;
+int host_mesh_duty = 100;
+
+uint8_t host_sta_mac[6] = {0x24, 0x6F, 0x28, 0x00, 0x00, 0x10};
+
+static mesh_addr_t routing[ROUTING_MAX];
+static int routing_count = 0;
+static mesh_addr_t parent = {.addr = {0x24, 0x6F, 0x28, 0x00, 0x00, 0x01}};
+
+static struct host_mqtt_client
+{
+    int unused;
+} fake_client;
+
+esp_mqtt_client_handle_t host_mqtt_client = &fake_client;
+bool host_mqtt_fail = false;
+host_mqtt_pub_t host_mqtt_pubs[HOST_MQTT_PUB_MAX];
+int host_mqtt_pub_count = 0;
+
+void host_mesh_reset(void)
+{
+    host_mesh_root = false;
+    host_mesh_send_hook = NULL;
+    host_mesh_sent_count = 0;
+    host_mesh_ps = false;
+    host_mesh_duty = 100;
+    routing_count = 0;
+}
+
+void host_mesh_set_routing_table(const mesh_addr_t *table, int count)
+{
+    routing_count = count < ROUTING_MAX ? count : ROUTING_MAX;
+    memcpy(routing, table, routing_count * sizeof(mesh_addr_t));
+}
+
+esp_err_t esp_mesh_send(const mesh_addr_t *to, const mesh_data_t *data, int flag, const mesh_opt_t opt[],
+                        int opt_count)
+{
+    esp_err_t err = host_mesh_send_hook ? host_mesh_send_hook(to, data->data, data->size, flag) : ESP_OK;
+    if (err == ESP_OK && host_mesh_sent_count < HOST_MESH_SENT_MAX)
+    {
+        host_mesh_sent_t *s = &host_mesh_sent[host_mesh_sent_count++];
+        s->to_root = to == NULL;
+        if (to)
+        {
+            s->to = *to;
+        }
+        s->flag = flag;
+        s->size = data->size < sizeof(s->data) ? data->size : sizeof(s->data);
+        memcpy(s->data, data->data, s->size);
+    }
+    return err;
+}
+
+bool esp_mesh_is_root(void)
+{
+    return host_mesh_root;
+}
+
+bool esp_mesh_is_ps_enabled(void)
+{
+    return host_mesh_ps;
+}
+
+esp_err_t esp_mesh_set_active_duty_cycle(int dev_duty, int dev_duty_type)
+{
+    if (!host_mesh_ps)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    host_mesh_duty = dev_duty;
+    return ESP_OK;
+}
+
+esp_err_t esp_mesh_get_running_active_duty_cycle(int *dev_duty, int *nwk_duty)
+{
+    if (!host_mesh_ps)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    *dev_duty = host_mesh_duty;
+    *nwk_duty = host_mesh_duty;
+    return ESP_OK;
+}
+
+esp_err_t esp_mesh_get_parent_bssid(mesh_addr_t *bssid)
+{
+    *bssid = parent;
+    return ESP_OK;
+}
+
+int esp_mesh_get_routing_table_size(void)
+{
+    return routing_count;
+}
+
+esp_err_t esp_mesh_get_routing_table(mesh_addr_t *mac, int len, int *size)
+{
+    int n = routing_count;
+    if ((int)(n * sizeof(mesh_addr_t)) > len)
+    {
+        n = len / (int)sizeof(mesh_addr_t);
+    }
+    memcpy(mac, routing, n * sizeof(mesh_addr_t));
+    *size = n;
+    return ESP_OK;
+}
+
+esp_err_t esp_read_mac(uint8_t *mac, esp_mac_type_t type)
+{
+    memcpy(mac, host_sta_mac, 6);
+    if (type == ESP_MAC_WIFI_SOFTAP)
+    {
+        mac[5]++;
+    }
+    return ESP_OK;
+}
+
+void host_mqtt_reset(void)
+{
+    host_mqtt_fail = false;
+    host_mqtt_pub_count = 0;
+}
+
+static int record(const char *topic, const char *data, int len, int qos, bool enqueued)
+{
+    if (host_mqtt_fail)
+    {
+        return -1;
+    }
+    if (host_mqtt_pub_count < HOST_MQTT_PUB_MAX)
+    {
+        host_mqtt_pub_t *p = &host_mqtt_pubs[host_mqtt_pub_count++];
+        strncpy(p->topic, topic, sizeof(p->topic) - 1);
+        p->topic[sizeof(p->topic) - 1] = '\0';
+        if (len <= 0)
+        {
+            len = data ? (int)strlen(data) : 0;
+        }
+        p->len = len < (int)sizeof(p->data) ? len : (int)sizeof(p->data) - 1;
+        memcpy(p->data, data, p->len);
+        p->data[p->len] = '\0';
+        p->qos = qos;
+        p->enqueued = enqueued;
+    }
+    return host_mqtt_pub_count;
+}
+
+int esp_mqtt_client_publish(esp_mqtt_client_handle_t client, const char *topic, const char *data, int len, int qos,
+                            int retain)
+{
+    return record(topic, data, len, qos, false);
+}
+
+int esp_mqtt_client_enqueue(esp_mqtt_client_handle_t client, const char *topic, const char *data, int len, int qos,
+                            int retain, bool store)
+{
+    return record(topic, data, len, qos, true);
+}
+
+int esp_mqtt_client_subscribe(esp_mqtt_client_handle_t client, const char *topic, int qos)
+{
+    return host_mqtt_fail ? -1 : 1;
+}
+
+int esp_mqtt_client_get_outbox_size(esp_mqtt_client_handle_t client)
+{
+    return 0;
+}
@@ -0,0 +1,401 @@
+/**
+ * @file host_nvs.c
+ * @brief NVS e tabela de partições em memória para os testes no host.
+ */
+
+#include "esp_partition.h"
+#include "nvs.h"
+#include "nvs_flash.h"
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define NVS_PAGE_SIZE    (4096)
+#define NVS_PAGE_ENTRIES (126)
+#define NVS_ENTRY_SIZE   (32)
+#define MAX_ITEMS        (256)
+#define MAX_HANDLES      (16)
+
+// Mesmas partições NVS de partition_table/partitionTable.csv
+static const esp_partition_t partitions[] = {
+    {ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_DATA_NVS, 0x9000, 24 * 1024, "nvs"},
+    {ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_DATA_NVS, 0, 0x4000, "nvs_custom"},
+    {ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_DATA_NVS, 0, 0x8000, "nvs_upbuf"},
+};
+#define PART_COUNT (sizeof(partitions) / sizeof(partitions[0]))
+
+typedef struct
+{
+    bool used;
+    int part;
+    char ns[16];
+    char key[16];
+    bool blob;
+    size_t len;
+    uint8_t *data;
+} item_t;
+
+typedef struct
+{
+    bool initialized;
+    uint32_t writes;
+    uint32_t commits;
+    uint32_t erases;
+    esp_err_t fail_init;
+} part_state_t;
+
+typedef struct
+{
+    bool open;
+    int part;
+    char ns[16];
+} handle_t;
+
+static item_t items[MAX_ITEMS];
+static part_state_t state[PART_COUNT];
+static handle_t handles[MAX_HANDLES];
+
+static int part_index(const char *label)
+{
+    for (size_t i = 0; i < PART_COUNT; i++)
+    {
+        if (strcmp(partitions[i].label, label) == 0)
+        {
+            return (int)i;
+        }
+    }
+    return -1;
+}
+
+const esp_partition_t *esp_partition_find_first(esp_partition_type_t type, esp_partition_subtype_t subtype,
+                                                const char *label)
+{
+    int i = label ? part_index(label) : 0;
+    if (i < 0 || partitions[i].type != type ||
+        (subtype != ESP_PARTITION_SUBTYPE_ANY && partitions[i].subtype != subtype))
+    {
+        return NULL;
+    }
+    return &partitions[i];
+}
+
+/**
+ * @brief Entradas de 32 bytes ocupadas por um item: uma de cabeçalho mais os dados (blobs têm também o índice).
+ */
+static size_t item_cost(const item_t *it)
+{
+    if (!it->blob)
+    {
+        return NVS_ENTRY_SIZE;
+    }
+    return NVS_ENTRY_SIZE * (2 + (it->len + NVS_ENTRY_SIZE - 1) / NVS_ENTRY_SIZE);
+}
+
+size_t host_nvs_used(const char *label)
+{
+    int p = part_index(label);
+    size_t used = 0;
+    for (int i = 0; i < MAX_ITEMS; i++)
+    {
+        if (items[i].used && items[i].part == p)
+        {
+            used += item_cost(&items[i]);
+        }
+    }
+    return used;
+}
+
+size_t host_nvs_capacity(const char *label)
+{
+    int p = part_index(label);
+    if (p < 0)
+    {
+        return 0;
+    }
+    // Uma página fica sempre livre para a compactação
+    size_t pages = partitions[p].size / NVS_PAGE_SIZE;
+    return pages > 1 ? (pages - 1) * NVS_PAGE_ENTRIES * NVS_ENTRY_SIZE : 0;
+}
+
+uint32_t host_nvs_writes(const char *label)
+{
+    int p = part_index(label);
+    return p < 0 ? 0 : state[p].writes;
+}
+
+uint32_t host_nvs_commits(const char *label)
+{
+    int p = part_index(label);
+    return p < 0 ? 0 : state[p].commits;
+}
+
+uint32_t host_nvs_erases(const char *label)
+{
+    int p = part_index(label);
+    return p < 0 ? 0 : state[p].erases;
+}
+
+void host_nvs_fail_init(const char *label, esp_err_t err)
+{
+    int p = part_index(label);
+    if (p >= 0)
+    {
+        state[p].fail_init = err;
+    }
+}
+
+void host_nvs_reset(void)
+{
+    for (int i = 0; i < MAX_ITEMS; i++)
+    {
+        free(items[i].data);
+    }
+    memset(items, 0, sizeof(items));
+    memset(state, 0, sizeof(state));
+    memset(handles, 0, sizeof(handles));
+}
+
+esp_err_t nvs_flash_init_partition(const char *label)
+{
+    int p = part_index(label);
+    if (p < 0)
+    {
+        return ESP_ERR_NOT_FOUND;
+    }
+    if (state[p].fail_init != ESP_OK)
+    {
+        esp_err_t err = state[p].fail_init;
+        state[p].fail_init = ESP_OK;
+        return err;
+    }
+    state[p].initialized = true;
+    return ESP_OK;
+}
+
+esp_err_t nvs_flash_init(void)
+{
+    return nvs_flash_init_partition("nvs");
+}
+
+esp_err_t nvs_flash_erase_partition(const char *label)
+{
+    int p = part_index(label);
+    if (p < 0)
+    {
+        return ESP_ERR_NOT_FOUND;
+    }
+    for (int i = 0; i < MAX_ITEMS; i++)
+    {
+        if (items[i].used && items[i].part == p)
+        {
+            free(items[i].data);
+            memset(&items[i], 0, sizeof(items[i]));
+        }
+    }
+    state[p].erases++;
+    return ESP_OK;
+}
+
+esp_err_t nvs_open_from_partition(const char *label, const char *ns, nvs_open_mode_t mode, nvs_handle_t *handle)
+{
+    int p = part_index(label);
+    if (p < 0 || !state[p].initialized)
+    {
+        return ESP_ERR_NVS_NOT_INITIALIZED;
+    }
+    for (int h = 0; h < MAX_HANDLES; h++)
+    {
+        if (!handles[h].open)
+        {
+            handles[h].open = true;
+            handles[h].part = p;
+            strncpy(handles[h].ns, ns, sizeof(handles[h].ns) - 1);
+            *handle = (nvs_handle_t)(h + 1);
+            return ESP_OK;
+        }
+    }
+    return ESP_ERR_NO_MEM;
+}
+
+void nvs_close(nvs_handle_t handle)
+{
+    if (handle >= 1 && handle <= MAX_HANDLES)
+    {
+        handles[handle - 1].open = false;
+    }
+}
+
+static handle_t *get_handle(nvs_handle_t handle)
+{
+    if (handle < 1 || handle > MAX_HANDLES || !handles[handle - 1].open)
+    {
+        return NULL;
+    }
+    return &handles[handle - 1];
+}
+
+static item_t *find(const handle_t *h, const char *key)
+{
+    for (int i = 0; i < MAX_ITEMS; i++)
+    {
+        if (items[i].used && items[i].part == h->part && strcmp(items[i].ns, h->ns) == 0 &&
+            strcmp(items[i].key, key) == 0)
+        {
+            return &items[i];
+        }
+    }
+    return NULL;
+}
+
+static esp_err_t set(nvs_handle_t handle, const char *key, const void *value, size_t len, bool blob)
+{
+    handle_t *h = get_handle(handle);
+    if (!h)
+    {
+        return ESP_ERR_NVS_NOT_INITIALIZED;
+    }
+
+    item_t *it = find(h, key);
+    item_t probe = {.blob = blob, .len = len};
+    size_t used = host_nvs_used(partitions[h->part].label) - (it ? item_cost(it) : 0);
+    if (used + item_cost(&probe) > host_nvs_capacity(partitions[h->part].label))
+    {
+        return ESP_ERR_NVS_NOT_ENOUGH_SPACE;
+    }
+
+    if (!it)
+    {
+        for (int i = 0; i < MAX_ITEMS && !it; i++)
+        {
+            if (!items[i].used)
+            {
+                it = &items[i];
+            }
+        }
+        if (!it)
+        {
+            return ESP_ERR_NVS_NOT_ENOUGH_SPACE;
+        }
+        it->used = true;
+        it->part = h->part;
+        strncpy(it->ns, h->ns, sizeof(it->ns) - 1);
+        strncpy(it->key, key, sizeof(it->key) - 1);
+    }
+    free(it->data);
+    it->data = malloc(len ? len : 1);
+    memcpy(it->data, value, len);
+    it->len = len;
+    it->blob = blob;
+    state[h->part].writes++;
+    return ESP_OK;
+}
+
+static esp_err_t get(nvs_handle_t handle, const char *key, void *out, size_t len)
+{
+    handle_t *h = get_handle(handle);
+    if (!h)
+    {
+        return ESP_ERR_NVS_NOT_INITIALIZED;
+    }
+    item_t *it = find(h, key);
+    if (!it)
+    {
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+    if (it->len != len)
+    {
+        return ESP_ERR_NVS_INVALID_LENGTH;
+    }
+    memcpy(out, it->data, len);
+    return ESP_OK;
+}
+
+esp_err_t nvs_commit(nvs_handle_t handle)
+{
+    handle_t *h = get_handle(handle);
+    if (!h)
+    {
+        return ESP_ERR_NVS_NOT_INITIALIZED;
+    }
+    state[h->part].commits++;
+    return ESP_OK;
+}
+
+esp_err_t nvs_erase_key(nvs_handle_t handle, const char *key)
+{
+    handle_t *h = get_handle(handle);
+    if (!h)
+    {
+        return ESP_ERR_NVS_NOT_INITIALIZED;
+    }
+    item_t *it = find(h, key);
+    if (!it)
+    {
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+    free(it->data);
+    memset(it, 0, sizeof(*it));
+    state[h->part].writes++;
+    return ESP_OK;
+}
+
+esp_err_t nvs_set_u32(nvs_handle_t handle, const char *key, uint32_t value)
+{
+    return set(handle, key, &value, sizeof(value), false);
+}
+
+esp_err_t nvs_get_u32(nvs_handle_t handle, const char *key, uint32_t *value)
+{
+    return get(handle, key, value, sizeof(*value));
+}
+
+esp_err_t nvs_set_u8(nvs_handle_t handle, const char *key, uint8_t value)
+{
+    return set(handle, key, &value, sizeof(value), false);
+}
+
+esp_err_t nvs_get_u8(nvs_handle_t handle, const char *key, uint8_t *value)
+{
+    return get(handle, key, value, sizeof(*value));
+}
+
+esp_err_t nvs_set_i8(nvs_handle_t handle, const char *key, int8_t value)
+{
+    return set(handle, key, &value, sizeof(value), false);
+}
+
+esp_err_t nvs_get_i8(nvs_handle_t handle, const char *key, int8_t *value)
+{
+    return get(handle, key, value, sizeof(*value));
+}
+
+esp_err_t nvs_set_blob(nvs_handle_t handle, const char *key, const void *value, size_t len)
+{
+    return set(handle, key, value, len, true);
+}
+
+esp_err_t nvs_get_blob(nvs_handle_t handle, const char *key, void *out, size_t *len)
+{
+    handle_t *h = get_handle(handle);
+    if (!h)
+    {
+        return ESP_ERR_NVS_NOT_INITIALIZED;
+    }
+    item_t *it = find(h, key);
+    if (!it)
+    {
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+    if (!out)
+    {
+        *len = it->len;
+        return ESP_OK;
+    }
+    if (*len < it->len)
+    {
+        return ESP_ERR_NVS_INVALID_LENGTH;
+    }
+    memcpy(out, it->data, it->len);
+    *len = it->len;
+    return ESP_OK;
+}
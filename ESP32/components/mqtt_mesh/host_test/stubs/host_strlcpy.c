@@ -0,0 +1,19 @@
+/**
+ * @file host_strlcpy.c
+ * @brief strlcpy para libcs do host que não a têm.
+ */
+
+#include "host_strlcpy.h"
+#include <string.h>
+
+size_t strlcpy(char *dst, const char *src, size_t size)
+{
+    size_t len = strlen(src);
+    if (size)
+    {
+        size_t n = len < size - 1 ? len : size - 1;
+        memcpy(dst, src, n);
+        dst[n] = '\0';
+    }
+    return len;
+}
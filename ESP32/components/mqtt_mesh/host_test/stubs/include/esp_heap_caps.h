@@ -0,0 +1,20 @@
+#ifndef HOST_ESP_HEAP_CAPS_H
+#define HOST_ESP_HEAP_CAPS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define MALLOC_CAP_DEFAULT (1 << 12)
+
+size_t heap_caps_get_free_size(uint32_t caps);
+size_t heap_caps_get_minimum_free_size(uint32_t caps);
+size_t heap_caps_get_largest_free_block(uint32_t caps);
+
+/**
+ * @brief Valores devolvidos pelas funções acima (o heap do host não é medido).
+ */
+extern size_t host_heap_free;
+extern size_t host_heap_min_free;
+extern size_t host_heap_largest;
+
+#endif // HOST_ESP_HEAP_CAPS_H
@@ -0,0 +1,25 @@
+#ifndef HOST_ESP_HTTP_CLIENT_H
+#define HOST_ESP_HTTP_CLIENT_H
+
+#include <stdint.h>
+
+#include "esp_err.h"
+
+typedef struct host_http_client *esp_http_client_handle_t;
+
+typedef struct {
+    const char *url;
+    int timeout_ms;
+} esp_http_client_config_t;
+
+/**
+ * @brief Sem rede no host: init devolve NULL e as demais falham.
+ */
+esp_http_client_handle_t esp_http_client_init(const esp_http_client_config_t *config);
+esp_err_t esp_http_client_open(esp_http_client_handle_t client, int write_len);
+int64_t esp_http_client_fetch_headers(esp_http_client_handle_t client);
+int esp_http_client_read(esp_http_client_handle_t client, char *buffer, int len);
+esp_err_t esp_http_client_close(esp_http_client_handle_t client);
+esp_err_t esp_http_client_cleanup(esp_http_client_handle_t client);
+
+#endif // HOST_ESP_HTTP_CLIENT_H
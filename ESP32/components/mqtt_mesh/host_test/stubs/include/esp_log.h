@@ -0,0 +1,26 @@
+#ifndef HOST_ESP_LOG_H
+#define HOST_ESP_LOG_H
+
+#include <stdio.h>
+
+/**
+ * @brief Logs só aparecem com HOST_TEST_VERBOSE=1 no ambiente; os formatos continuam verificados.
+ */
+int host_log_enabled(void);
+
+#define HOST_LOG(level, tag, fmt, ...)                                   \
+    do                                                                   \
+    {                                                                    \
+        if (host_log_enabled())                                          \
+        {                                                                \
+            fprintf(stderr, level " (%s) " fmt "\n", tag, ##__VA_ARGS__); \
+        }                                                                \
+    } while (0)
+
+#define ESP_LOGE(tag, fmt, ...) HOST_LOG("E", tag, fmt, ##__VA_ARGS__)
+#define ESP_LOGW(tag, fmt, ...) HOST_LOG("W", tag, fmt, ##__VA_ARGS__)
+#define ESP_LOGI(tag, fmt, ...) HOST_LOG("I", tag, fmt, ##__VA_ARGS__)
+#define ESP_LOGD(tag, fmt, ...) HOST_LOG("D", tag, fmt, ##__VA_ARGS__)
+#define ESP_LOGV(tag, fmt, ...) HOST_LOG("V", tag, fmt, ##__VA_ARGS__)
+
+#endif // HOST_ESP_LOG_H
@@ -0,0 +1,23 @@
+#ifndef HOST_ESP_MAC_H
+#define HOST_ESP_MAC_H
+
+#include <stdint.h>
+
+#include "esp_err.h"
+
+typedef enum {
+    ESP_MAC_WIFI_STA,
+    ESP_MAC_WIFI_SOFTAP,
+} esp_mac_type_t;
+
+#define MACSTR "%02x:%02x:%02x:%02x:%02x:%02x"
+#define MAC2STR(a) (a)[0], (a)[1], (a)[2], (a)[3], (a)[4], (a)[5]
+
+esp_err_t esp_read_mac(uint8_t *mac, esp_mac_type_t type);
+
+/**
+ * @brief MAC STA do nó simulado (o do AP é este + 1 no último byte).
+ */
+extern uint8_t host_sta_mac[6];
+
+#endif // HOST_ESP_MAC_H
@@ -0,0 +1,94 @@
+#ifndef HOST_ESP_MESH_H
+#define HOST_ESP_MESH_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "esp_mac.h"
+
+#define ESP_ERR_MESH_BASE       (0x4000)
+#define ESP_ERR_MESH_DISCONNECTED (ESP_ERR_MESH_BASE + 0x0b)
+#define ESP_ERR_MESH_NO_ROUTE_FOUND (ESP_ERR_MESH_BASE + 0x17)
+
+#define MESH_DATA_ENC     (0x0001)
+#define MESH_DATA_P2P     (0x0002)
+#define MESH_DATA_FROMDS  (0x0004)
+#define MESH_DATA_TODS    (0x0008)
+#define MESH_DATA_NONBLOCK (0x0010)
+
+typedef union {
+    uint8_t addr[6];
+} mesh_addr_t;
+
+typedef enum {
+    MESH_PROTO_BIN,
+    MESH_PROTO_HTTP,
+    MESH_PROTO_JSON,
+    MESH_PROTO_MQTT,
+    MESH_PROTO_AP,
+    MESH_PROTO_STA,
+} mesh_proto_t;
+
+typedef enum {
+    MESH_TOS_P2P,
+    MESH_TOS_E2E,
+    MESH_TOS_DEF,
+} mesh_tos_t;
+
+typedef struct {
+    uint8_t *data;
+    uint16_t size;
+    mesh_proto_t proto;
+    mesh_tos_t tos;
+} mesh_data_t;
+
+typedef struct {
+    uint8_t type;
+    uint16_t len;
+    uint8_t *val;
+} mesh_opt_t;
+
+esp_err_t esp_mesh_send(const mesh_addr_t *to, const mesh_data_t *data, int flag, const mesh_opt_t opt[],
+                        int opt_count);
+bool esp_mesh_is_root(void);
+esp_err_t esp_mesh_get_parent_bssid(mesh_addr_t *bssid);
+int esp_mesh_get_routing_table_size(void);
+esp_err_t esp_mesh_get_routing_table(mesh_addr_t *mac, int len, int *size);
+
+#define MESH_PS_DEVICE_DUTY_REQUEST (0x01)
+#define MESH_PS_DEVICE_DUTY_DEMAND  (0x04)
+
+bool esp_mesh_is_ps_enabled(void);
+esp_err_t esp_mesh_set_active_duty_cycle(int dev_duty, int dev_duty_type);
+esp_err_t esp_mesh_get_running_active_duty_cycle(int *dev_duty, int *nwk_duty);
+
+/**
+ * @brief Estado da mesh simulada.
+ *
+ * Cada esp_mesh_send é passado a host_mesh_send_hook (se definido) e copiado
+ * para o registro de envios; sem hook, o envio tem sucesso.
+ */
+typedef esp_err_t (*host_mesh_send_hook_t)(const mesh_addr_t *to, const uint8_t *data, uint16_t size, int flag);
+
+#define HOST_MESH_SENT_MAX (64)
+
+typedef struct {
+    bool to_root;
+    mesh_addr_t to;
+    int flag;
+    uint16_t size;
+    uint8_t data[1600];
+} host_mesh_sent_t;
+
+extern bool host_mesh_root;
+extern host_mesh_send_hook_t host_mesh_send_hook;
+extern host_mesh_sent_t host_mesh_sent[HOST_MESH_SENT_MAX];
+extern int host_mesh_sent_count;
+extern bool host_mesh_ps;   // esp_mesh_is_ps_enabled()
+extern int host_mesh_duty;  // duty em execução, trocado por esp_mesh_set_active_duty_cycle()
+
+void host_mesh_reset(void);
+void host_mesh_set_routing_table(const mesh_addr_t *table, int count);
+
+#endif // HOST_ESP_MESH_H
@@ -0,0 +1,28 @@
+#ifndef HOST_ESP_OTA_OPS_H
+#define HOST_ESP_OTA_OPS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "esp_partition.h"
+
+#define ESP_ERR_OTA_BASE            (0x1500)
+#define ESP_ERR_OTA_VALIDATE_FAILED (ESP_ERR_OTA_BASE + 0x03)
+
+#define OTA_SIZE_UNKNOWN           (0xffffffff)
+#define OTA_WITH_SEQUENTIAL_WRITES (0xfffffffe)
+
+typedef uint32_t esp_ota_handle_t;
+
+/**
+ * @brief Sem implementação em host_stubs: cada teste de OTA define as suas (uma partição por nó simulado).
+ */
+const esp_partition_t *esp_ota_get_next_update_partition(const esp_partition_t *start_from);
+esp_err_t esp_ota_begin(const esp_partition_t *partition, size_t image_size, esp_ota_handle_t *out_handle);
+esp_err_t esp_ota_write(esp_ota_handle_t handle, const void *data, size_t size);
+esp_err_t esp_ota_end(esp_ota_handle_t handle);
+esp_err_t esp_ota_abort(esp_ota_handle_t handle);
+esp_err_t esp_ota_set_boot_partition(const esp_partition_t *partition);
+
+#endif // HOST_ESP_OTA_OPS_H
@@ -0,0 +1,11 @@
+#ifndef HOST_ESP_RANDOM_H
+#define HOST_ESP_RANDOM_H
+
+#include <stdint.h>
+
+/**
+ * @brief Pseudoaleatório determinístico (mesma sequência a cada execução).
+ */
+uint32_t esp_random(void);
+
+#endif // HOST_ESP_RANDOM_H
@@ -0,0 +1,12 @@
+#ifndef HOST_ESP_SYSTEM_H
+#define HOST_ESP_SYSTEM_H
+
+#include "esp_err.h"
+
+/**
+ * @brief No host só conta as chamadas.
+ */
+void esp_restart(void);
+extern int host_restart_count;
+
+#endif // HOST_ESP_SYSTEM_H
@@ -0,0 +1,49 @@
+/**
+ * @file FreeRTOS.h
+ * @brief Dublê mínimo do FreeRTOS para os testes no host: uma única thread e um relógio simulado.
+ *
+ * Filas e semáforos nunca bloqueiam; uma espera que não pode ser atendida
+ * avança o relógio pelo tempo pedido (ou nada, com portMAX_DELAY) e falha.
+ */
+
+#ifndef HOST_FREERTOS_H
+#define HOST_FREERTOS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint32_t TickType_t;
+
+#define pdTRUE  (1)
+#define pdFALSE (0)
+#define pdPASS  (1)
+#define pdFAIL  (0)
+
+#define portMAX_DELAY      ((TickType_t)0xffffffffUL)
+#define portTICK_PERIOD_MS (1)
+#define pdMS_TO_TICKS(ms)  ((TickType_t)(ms))
+
+#define portNUM_PROCESSORS (2)
+#define tskNO_AFFINITY     (0x7FFFFFFF)
+
+#define configUSE_TRACE_FACILITY      (1)
+#define configGENERATE_RUN_TIME_STATS (1)
+#define configRUN_TIME_COUNTER_TYPE   uint32_t
+#define configMAX_TASK_NAME_LEN       (16)
+
+typedef int portMUX_TYPE;
+#define portMUX_INITIALIZER_UNLOCKED (0)
+#define portENTER_CRITICAL(mux) ((void)(mux))
+#define portEXIT_CRITICAL(mux)  ((void)(mux))
+
+/**
+ * @brief Avança o relógio simulado (também usado por esp_timer_get_time).
+ */
+void host_clock_advance_ms(uint32_t ms);
+void host_clock_set_us(int64_t us); // só avança; o tempo de CPU das tasks não é contado
+int64_t host_clock_us(void);
+
+#endif // HOST_FREERTOS_H
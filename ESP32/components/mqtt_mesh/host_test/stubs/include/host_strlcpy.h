@@ -0,0 +1,11 @@
+#ifndef HOST_STRLCPY_H
+#define HOST_STRLCPY_H
+
+#include <stddef.h>
+
+/**
+ * @brief strlcpy da newlib do ESP-IDF, ausente na glibc antes da 2.38.
+ */
+size_t strlcpy(char *dst, const char *src, size_t size);
+
+#endif // HOST_STRLCPY_H
@@ -0,0 +1,38 @@
+#ifndef HOST_MQTT_CLIENT_H
+#define HOST_MQTT_CLIENT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+
+typedef struct host_mqtt_client *esp_mqtt_client_handle_t;
+
+int esp_mqtt_client_publish(esp_mqtt_client_handle_t client, const char *topic, const char *data, int len, int qos,
+                            int retain);
+int esp_mqtt_client_enqueue(esp_mqtt_client_handle_t client, const char *topic, const char *data, int len, int qos,
+                            int retain, bool store);
+int esp_mqtt_client_subscribe(esp_mqtt_client_handle_t client, const char *topic, int qos);
+int esp_mqtt_client_get_outbox_size(esp_mqtt_client_handle_t client);
+
+/**
+ * @brief Cliente simulado: as publicações são registradas; com host_mqtt_fail, falham.
+ */
+#define HOST_MQTT_PUB_MAX (64)
+
+typedef struct {
+    char topic[128];
+    int len;
+    int qos;
+    bool enqueued;
+    char data[1600];
+} host_mqtt_pub_t;
+
+extern esp_mqtt_client_handle_t host_mqtt_client;
+extern bool host_mqtt_fail;
+extern host_mqtt_pub_t host_mqtt_pubs[HOST_MQTT_PUB_MAX];
+extern int host_mqtt_pub_count;
+
+void host_mqtt_reset(void);
+
+#endif // HOST_MQTT_CLIENT_H
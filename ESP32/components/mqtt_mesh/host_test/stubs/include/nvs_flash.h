@@ -0,0 +1,11 @@
+#ifndef HOST_NVS_FLASH_H
+#define HOST_NVS_FLASH_H
+
+#include "esp_err.h"
+#include "nvs.h"
+
+esp_err_t nvs_flash_init(void);
+esp_err_t nvs_flash_init_partition(const char *part);
+esp_err_t nvs_flash_erase_partition(const char *part);
+
+#endif // HOST_NVS_FLASH_H
@@ -0,0 +1,325 @@
+/**
+ * @file test_mesh_agg.c
+ * @brief Montagem e desmontagem dos quadros agregados, e quadros por enlace com e sem agregação.
+ */
+
+#include "host_test.h"
+#include "mesh_agg.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_FRAMES (256)
+
+typedef struct
+{
+    char *data;
+    size_t len;
+} frame_t;
+
+// Quadros entregues pela função de envio desde o último reset_sent()
+static frame_t sent[MAX_FRAMES];
+static int sent_count = 0;
+
+static void capture_send(const char *frame, size_t len)
+{
+    CHECK(len < MESH_AGG_FRAME_MAX);
+    CHECK(frame[len] == '\0');
+    if (sent_count < MAX_FRAMES)
+    {
+        sent[sent_count].data = malloc(len + 1);
+        memcpy(sent[sent_count].data, frame, len + 1);
+        sent[sent_count].len = len;
+        sent_count++;
+    }
+}
+
+static void reset_sent(void)
+{
+    for (int i = 0; i < sent_count; i++)
+    {
+        free(sent[i].data);
+    }
+    sent_count = 0;
+}
+
+typedef struct
+{
+    char reports[64][256];
+    int count;
+} collected_t;
+
+static void collect_cb(const char *report, size_t len, void *ctx)
+{
+    collected_t *c = ctx;
+    if (c->count < 64 && len < sizeof(c->reports[0]))
+    {
+        memcpy(c->reports[c->count], report, len);
+        c->reports[c->count][len] = '\0';
+    }
+    c->count++;
+}
+
+static int count_reports(void)
+{
+    int total = 0;
+    for (int i = 0; i < sent_count; i++)
+    {
+        total += mesh_agg_foreach(sent[i].data, sent[i].len, NULL, NULL);
+    }
+    return total;
+}
+
+static void test_flush_joins_children_with_own_report(void)
+{
+    const char *a = "{\"mac\":\"AA\",\"hops\":2}";
+    const char *b = "{\"mac\":\"BB\",\"hops\":2}";
+    const char *own = "{\"mac\":\"PP\",\"hops\":1}";
+    collected_t got = {0};
+
+    reset_sent();
+    // O receptor entrega o quadro com o '\0' final contado no tamanho
+    mesh_agg_push(a, strlen(a) + 1);
+    mesh_agg_push(b, strlen(b));
+    CHECK_INT(sent_count, 0);
+
+    mesh_agg_flush(own, strlen(own));
+    CHECK_INT(sent_count, 1);
+    CHECK_STR(sent[0].data, "{\"type\":\"agg\",\"reports\":[{\"mac\":\"AA\",\"hops\":2},{\"mac\":\"BB\",\"hops\":2},"
+                            "{\"mac\":\"PP\",\"hops\":1}]}");
+
+    CHECK_INT(mesh_agg_foreach(sent[0].data, sent[0].len, collect_cb, &got), 3);
+    CHECK_STR(got.reports[0], a);
+    CHECK_STR(got.reports[1], b);
+    CHECK_STR(got.reports[2], own);
+
+    // Depois do flush não sobra nada: o próximo intervalo só leva o relatório próprio
+    reset_sent();
+    mesh_agg_flush(own, strlen(own));
+    CHECK_INT(sent_count, 1);
+    CHECK_INT(count_reports(), 1);
+}
+
+static void test_child_frame_is_unpacked(void)
+{
+    const char *child = "{\"type\":\"agg\",\"reports\":[{\"mac\":\"C1\"},{\"mac\":\"C2\"}]}";
+    const char *own = "{\"mac\":\"PP\"}";
+
+    reset_sent();
+    CHECK(mesh_agg_is_frame(child, strlen(child)));
+    CHECK(!mesh_agg_is_frame(own, strlen(own)));
+
+    mesh_agg_push(child, strlen(child) + 1);
+    mesh_agg_flush(own, strlen(own));
+    CHECK_INT(sent_count, 1);
+    CHECK_STR(sent[0].data, "{\"type\":\"agg\",\"reports\":[{\"mac\":\"C1\"},{\"mac\":\"C2\"},{\"mac\":\"PP\"}]}");
+
+    // Quadro agregado vazio não acrescenta nada
+    reset_sent();
+    mesh_agg_push("{\"type\":\"agg\",\"reports\":[]}", 27);
+    mesh_agg_flush(NULL, 0);
+    CHECK_INT(sent_count, 0);
+}
+
+static void test_foreach_ignores_braces_in_strings(void)
+{
+    const char *frame = "{\"type\":\"agg\",\"reports\":[{\"mac\":\"A\",\"s\":\"}{\\\"x\"},{\"mac\":\"B\",\"o\":{\"n\":1}}]}\n";
+    collected_t got = {0};
+
+    CHECK_INT(mesh_agg_foreach(frame, strlen(frame), collect_cb, &got), 2);
+    CHECK_STR(got.reports[0], "{\"mac\":\"A\",\"s\":\"}{\\\"x\"}");
+    CHECK_STR(got.reports[1], "{\"mac\":\"B\",\"o\":{\"n\":1}}");
+
+    CHECK_INT(mesh_agg_foreach("{\"mac\":\"A\"}", 11, NULL, NULL), 0);
+}
+
+static void test_non_json_is_dropped(void)
+{
+    reset_sent();
+    mesh_agg_push("not json", 8);
+    mesh_agg_push("", 0);
+    mesh_agg_flush(NULL, 0);
+    CHECK_INT(sent_count, 0);
+}
+
+static void test_overflow_splits_without_loss(void)
+{
+    char report[200];
+    int pushed = 0;
+
+    reset_sent();
+    for (int i = 0; i < 40; i++)
+    {
+        int n = snprintf(report, sizeof(report), "{\"mac\":\"AA:BB:CC:DD:EE:%02X\",\"pad\":\"%0120d\"}", i, i);
+        mesh_agg_push(report, (size_t)n);
+        pushed++;
+    }
+    mesh_agg_flush("{\"mac\":\"own\"}", 13);
+    pushed++;
+
+    // 40 x ~160 bytes não cabem em um quadro: vários, todos dentro do limite, nenhum relatório perdido
+    CHECK(sent_count > 1);
+    CHECK_INT(count_reports(), pushed);
+    for (int i = 0; i < sent_count; i++)
+    {
+        CHECK(mesh_agg_is_frame(sent[i].data, sent[i].len));
+    }
+}
+
+static void test_oversized_child_report_goes_alone(void)
+{
+    static char big[MESH_AGG_FRAME_MAX];
+    memset(big, 'x', sizeof(big));
+    memcpy(big, "{\"mac\":\"BIG\",\"p\":\"", 18);
+    size_t len = MESH_AGG_FRAME_MAX - 40;
+    big[len - 2] = '"';
+    big[len - 1] = '}';
+
+    reset_sent();
+    mesh_agg_push("{\"mac\":\"S\"}", 11);
+    mesh_agg_flush("{\"mac\":\"own\",\"pad\":\"0000000000000000000000000000000000000000\"}", 63);
+    reset_sent();
+
+    // Com a reserva do relatório próprio não cabe junto: sai sozinho, sem esperar o flush
+    mesh_agg_push(big, len);
+    CHECK_INT(sent_count, 1);
+    CHECK_INT(count_reports(), 1);
+    mesh_agg_flush(NULL, 0);
+    CHECK_INT(sent_count, 1);
+}
+
+/*******************************************************
+ *                Quadros por enlace
+ *******************************************************/
+
+typedef struct
+{
+    int parent;
+    int subtree; // nós na subárvore, incluindo o próprio
+    frame_t out[32];
+    int out_count;
+} sim_node_t;
+
+/**
+ * @brief Relatório no formato de build_node_status_json: "children" é a tabela de roteamento (toda a subárvore).
+ */
+static size_t make_report(char *out, size_t size, int id, int parent, int layer, int descendants)
+{
+    size_t n = (size_t)snprintf(out, size, "{\"mac\":\"24:6F:28:00:%02X:%02X\",\"parent\":\"24:6F:28:00:%02X:%02X\","
+                                           "\"hops\":%d,\"children\":[", id >> 8, id & 0xFF, parent >> 8, parent & 0xFF, layer);
+    for (int i = 0; i < descendants; i++)
+    {
+        n += (size_t)snprintf(out + n, size - n, "%s\"24:6F:28:00:00:%02X\"", i ? "," : "", i & 0xFF);
+    }
+    n += (size_t)snprintf(out + n, size - n, "],\"nc\":2,\"max_ch\":6,\"radio_ms\":123456,\"radio_pct\":100,"
+                                             "\"ctrl_wait_ms\":3,\"rssi\":-62}");
+    return n;
+}
+
+/**
+ * @brief Um intervalo de relatórios em uma árvore de fanout fixo, simulada em pós-ordem com o módulo real.
+ *
+ * Numeração em largura: o pai de i é (i - 1) / fanout, então filhos sempre têm índice maior.
+ */
+static void bench_tree(int nodes, int fanout)
+{
+    sim_node_t *tree = calloc((size_t)nodes, sizeof(sim_node_t));
+    char report[2048];
+    int layer_of[1024] = {0};
+
+    for (int i = nodes - 1; i >= 0; i--)
+    {
+        tree[i].subtree++;
+        tree[i].parent = i ? (i - 1) / fanout : -1;
+        if (i)
+        {
+            tree[tree[i].parent].subtree += tree[i].subtree;
+        }
+    }
+    for (int i = 1; i < nodes; i++)
+    {
+        layer_of[i] = layer_of[tree[i].parent] + 1;
+    }
+
+    for (int i = nodes - 1; i >= 1; i--)
+    {
+        reset_sent();
+        for (int c = i * fanout + 1; c <= i * fanout + fanout && c < nodes; c++)
+        {
+            for (int f = 0; f < tree[c].out_count; f++)
+            {
+                mesh_agg_push(tree[c].out[f].data, tree[c].out[f].len + 1);
+            }
+        }
+        size_t len = make_report(report, sizeof(report), i, tree[i].parent, layer_of[i] + 1, tree[i].subtree - 1);
+        mesh_agg_flush(report, len);
+
+        // Os quadros ficam com o nó: sent[] é reaproveitado
+        for (int f = 0; f < sent_count && f < 32; f++)
+        {
+            tree[i].out[f] = sent[f];
+        }
+        tree[i].out_count = sent_count;
+        sent_count = 0;
+    }
+
+    int agg_total = 0, agg_max = 0, plain_total = 0, plain_max = 0, at_root = 0, depth = 0;
+    for (int i = 1; i < nodes; i++)
+    {
+        agg_total += tree[i].out_count;
+        plain_total += tree[i].subtree;
+        if (tree[i].parent == 0)
+        {
+            agg_max = tree[i].out_count > agg_max ? tree[i].out_count : agg_max;
+            plain_max = tree[i].subtree > plain_max ? tree[i].subtree : plain_max;
+            for (int f = 0; f < tree[i].out_count; f++)
+            {
+                at_root += mesh_agg_foreach(tree[i].out[f].data, tree[i].out[f].len, NULL, NULL);
+            }
+        }
+        depth = layer_of[i] > depth ? layer_of[i] : depth;
+    }
+
+    // Todo relatório chega ao root exatamente uma vez
+    CHECK_INT(at_root, nodes - 1);
+    CHECK(agg_total <= plain_total);
+
+    printf("  %4d nós, fanout %d, %d camadas: quadros/intervalo %5d -> %4d (%.1fx), "
+           "enlace mais carregado %4d -> %2d\n",
+           nodes, fanout, depth + 1, plain_total, agg_total, (double)plain_total / agg_total, plain_max, agg_max);
+
+    for (int i = 0; i < nodes; i++)
+    {
+        for (int f = 0; f < tree[i].out_count; f++)
+        {
+            free(tree[i].out[f].data);
+        }
+    }
+    free(tree);
+}
+
+static void bench_frames_per_link(void)
+{
+    printf("Quadros de relatório por intervalo, sem -> com agregação:\n");
+    bench_tree(10, 3);
+    bench_tree(30, 2);
+    bench_tree(50, 4);
+    bench_tree(100, 6);
+    bench_tree(60, 3);
+}
+
+int main(void)
+{
+    CHECK_INT(mesh_agg_init(NULL), ESP_ERR_INVALID_ARG);
+    CHECK_INT(mesh_agg_init(capture_send), ESP_OK);
+
+    RUN_TEST(test_flush_joins_children_with_own_report);
+    RUN_TEST(test_child_frame_is_unpacked);
+    RUN_TEST(test_foreach_ignores_braces_in_strings);
+    RUN_TEST(test_non_json_is_dropped);
+    RUN_TEST(test_overflow_splits_without_loss);
+    RUN_TEST(test_oversized_child_report_goes_alone);
+    RUN_TEST(bench_frames_per_link);
+
+    reset_sent();
+    return HOST_TEST_RESULT();
+}
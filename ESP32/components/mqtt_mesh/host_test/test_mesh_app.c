@@ -0,0 +1,398 @@
+/**
+ * @file test_mesh_app.c
+ * @brief Fila de envio do canal da aplicação, tópicos reservados, downlink e uso do buffer do uplink.
+ *
+ * O módulo é incluído como fonte para chamar app_tx_one(), o corpo da task de
+ * envio (as tasks não rodam no host).
+ */
+
+#include "host_test.h"
+#include "../mesh_app.c"
+#include <time.h>
+
+#define QUEUE_LEN (4)
+
+/**
+ * @brief Faz o papel da app_tx_task: envia tudo o que está na fila.
+ */
+static int run_tx(void)
+{
+    mesh_app_msg_t *msg;
+    int n = 0;
+    while (xQueueReceive(send_q, &msg, 0) == pdTRUE)
+    {
+        app_tx_one(msg);
+        xQueueSend(free_q, &msg, 0);
+        n++;
+    }
+    return n;
+}
+
+static esp_err_t refuse_send(const mesh_addr_t *to, const uint8_t *data, uint16_t size, int flag)
+{
+    return ESP_ERR_MESH_DISCONNECTED;
+}
+
+static void drain_upbuf(void)
+{
+    uint8_t buf[MESH_APP_FRAME_MAX];
+    uint32_t seq;
+    while (mesh_upbuf_peek(buf, sizeof(buf), &seq) > 0)
+    {
+        mesh_upbuf_consume(seq);
+    }
+}
+
+static void test_full_queue_returns_no_mem(void)
+{
+    mesh_app_stats_t st;
+    uint8_t *payload;
+
+    CHECK_INT(mesh_publish("temp", "1", 1, 0), ESP_ERR_INVALID_STATE);
+    CHECK_INT(mesh_app_init(0), ESP_ERR_INVALID_ARG);
+    CHECK_INT(mesh_app_init(QUEUE_LEN), ESP_OK);
+
+    for (int i = 0; i < QUEUE_LEN; i++)
+    {
+        CHECK_INT(mesh_publish("temp", "21.5", 4, 1), ESP_OK);
+    }
+    // Sem a task de envio rodando a fila não anda: a próxima falha sem bloquear
+    CHECK_INT(mesh_publish("temp", "21.5", 4, 1), ESP_ERR_NO_MEM);
+    CHECK(mesh_publish_begin("temp", 1, &payload, NULL) == NULL);
+
+    mesh_app_get_stats(&st);
+    CHECK_INT(st.queued, QUEUE_LEN);
+    CHECK_INT(st.dropped, 2);
+
+    // Esvaziada a fila, os slots voltam
+    CHECK_INT(run_tx(), QUEUE_LEN);
+    CHECK_INT(mesh_publish("temp", "21.5", 4, 1), ESP_OK);
+    CHECK_INT(run_tx(), 1);
+    host_mesh_reset();
+}
+
+static void test_publish_limits(void)
+{
+    static uint8_t big[MESH_APP_FRAME_MAX];
+    uint8_t *payload;
+    size_t max_len;
+
+    mesh_app_msg_t *msg = mesh_publish_begin("t", 0, &payload, &max_len);
+    CHECK(msg != NULL);
+    CHECK_INT(max_len, MESH_APP_FRAME_MAX - sizeof(mesh_app_hdr_t) - 1);
+    CHECK_INT(mesh_publish_commit(msg, max_len + 1), ESP_ERR_INVALID_SIZE);
+
+    CHECK_INT(mesh_publish("t", big, max_len + 1, 0), ESP_ERR_INVALID_SIZE);
+    CHECK_INT(mesh_publish("t", NULL, 3, 0), ESP_ERR_INVALID_ARG);
+
+    // Slots devolvidos pelos erros: a fila inteira continua disponível
+    for (int i = 0; i < QUEUE_LEN; i++)
+    {
+        CHECK_INT(mesh_publish("t", "x", 1, 0), ESP_OK);
+    }
+    run_tx();
+    host_mesh_reset();
+}
+
+static void test_reserved_suffixes(void)
+{
+    CHECK(valid_suffix("temp", 4));
+    CHECK(valid_suffix("downstairs", 10));
+    CHECK(valid_suffix("sensors/down", 12));
+    CHECK(!valid_suffix("down", 4));
+    CHECK(!valid_suffix("down/cfg", 8));
+    CHECK(!valid_suffix("a+b", 3));
+    CHECK(!valid_suffix("a/#", 3));
+    CHECK(!valid_suffix("", 0));
+
+    CHECK_INT(mesh_publish("downstairs", "1", 1, 0), ESP_OK);
+    CHECK_INT(mesh_publish("down/x", "1", 1, 0), ESP_ERR_INVALID_ARG);
+    CHECK_INT(mesh_publish("a/#", "1", 1, 0), ESP_ERR_INVALID_ARG);
+    CHECK_INT(mesh_publish(NULL, "1", 1, 0), ESP_ERR_INVALID_ARG);
+
+    // Tópico inválido não gasta slot nem conta como fila cheia
+    mesh_app_stats_t st;
+    mesh_app_get_stats(&st);
+    uint32_t dropped = st.dropped;
+    for (int i = 0; i < QUEUE_LEN + 1; i++)
+    {
+        CHECK_INT(mesh_publish("down", "1", 1, 0), ESP_ERR_INVALID_ARG);
+    }
+    mesh_app_get_stats(&st);
+    CHECK_INT(st.dropped, dropped);
+    run_tx();
+    host_mesh_reset();
+}
+
+typedef struct
+{
+    int calls;
+    char topic[MESH_APP_TOPIC_MAX];
+    char data[64];
+} rx_log_t;
+
+static void on_rx(const char *topic, const uint8_t *data, size_t len, void *ctx)
+{
+    rx_log_t *log = ctx;
+    log->calls++;
+    strcpy(log->topic, topic);
+    memcpy(log->data, data, len);
+    log->data[len] = '\0';
+}
+
+static void test_downlink(void)
+{
+    rx_log_t log = {0};
+    char topic[96];
+
+    host_mesh_root = true;
+    CHECK_INT(mesh_subscribe("cfg", on_rx, &log), ESP_OK);
+
+    // Para o próprio root (MAC do AP = STA + 1): callback direto
+    snprintf(topic, sizeof(topic), "mesh/node/24:6F:28:00:00:11/down/cfg");
+    CHECK(mesh_app_handle_mqtt(topic, strlen(topic), "on", 2));
+    CHECK_INT(log.calls, 1);
+    CHECK_STR(log.topic, "cfg");
+    CHECK_STR(log.data, "on");
+
+    // Para outro nó: quadro DOWN pela mesh até o MAC STA do destino
+    snprintf(topic, sizeof(topic), "mesh/node/24:6F:28:00:00:21/down/cfg");
+    CHECK(mesh_app_handle_mqtt(topic, strlen(topic), "off", 3));
+    CHECK_INT(host_mesh_sent_count, 1);
+    CHECK_INT(host_mesh_sent[0].to.addr[5], 0x20);
+    CHECK_INT(host_mesh_sent[0].flag, MESH_DATA_P2P);
+
+    // Que o destino entrega ao seu assinante
+    mesh_app_handle_rx(host_mesh_sent[0].data, host_mesh_sent[0].size);
+    CHECK_INT(log.calls, 2);
+    CHECK_STR(log.data, "off");
+
+    // Sem assinante ou quadro truncado: nada entregue
+    snprintf(topic, sizeof(topic), "mesh/node/24:6F:28:00:00:11/down/other");
+    CHECK(mesh_app_handle_mqtt(topic, strlen(topic), "x", 1));
+    mesh_app_handle_rx(host_mesh_sent[0].data, host_mesh_sent[0].size - 1);
+    CHECK_INT(log.calls, 2);
+
+    CHECK(!mesh_app_handle_mqtt("mesh/cmd", 8, "{}", 2));
+    host_mesh_reset();
+}
+
+static void test_send_failure_goes_to_upbuf(void)
+{
+    mesh_app_stats_t before, after;
+    uint8_t frame[MESH_APP_FRAME_MAX];
+
+    mesh_upbuf_init(4096, false, 0);
+    mesh_app_get_stats(&before);
+
+    // Nó sem pai: as mensagens ficam no buffer do uplink, em ordem
+    host_mesh_send_hook = refuse_send;
+    CHECK_INT(mesh_publish("temp", "A", 1, 1), ESP_OK);
+    CHECK_INT(mesh_publish("temp", "B", 1, 1), ESP_OK);
+    run_tx();
+    mesh_app_get_stats(&after);
+    CHECK_INT(after.buffered - before.buffered, 2);
+    CHECK_INT(after.failed - before.failed, 0);
+    CHECK_INT(mesh_upbuf_pending(), 2);
+
+    // Pai de volta, mas com fila: a nova entra atrás das antigas
+    host_mesh_send_hook = NULL;
+    CHECK_INT(mesh_publish("temp", "C", 1, 1), ESP_OK);
+    run_tx();
+    CHECK_INT(host_mesh_sent_count, 0);
+    CHECK_INT(mesh_upbuf_pending(), 3);
+
+    // Este nó virou root: o buffer é publicado no tópico de origem, em ordem
+    host_mesh_root = true;
+    mesh_app_mqtt_connected(host_mqtt_client);
+    host_mqtt_reset();
+    size_t len;
+    uint32_t seq;
+    while ((len = mesh_upbuf_peek(frame, sizeof(frame), &seq)) > 0)
+    {
+        CHECK(mesh_app_is_frame(frame, len));
+        CHECK(mesh_app_publish_frame(frame, len));
+        CHECK(mesh_upbuf_consume(seq));
+    }
+    CHECK_INT(host_mqtt_pub_count, 3);
+    CHECK_STR(host_mqtt_pubs[0].topic, "mesh/node/24:6F:28:00:00:11/temp");
+    CHECK_STR(host_mqtt_pubs[0].data, "A");
+    CHECK_STR(host_mqtt_pubs[2].data, "C");
+    CHECK_INT(host_mqtt_pubs[0].qos, 1);
+
+    // Broker fora no root: quadros de filhos também esperam no buffer
+    host_mqtt_fail = true;
+    CHECK_INT(mesh_publish("temp", "D", 1, 1), ESP_OK);
+    run_tx();
+    uint8_t *child = NULL;
+    CHECK(mesh_upbuf_peek(frame, sizeof(frame), NULL) > 0);
+    child = frame;
+    child[((mesh_app_hdr_t *)child)->topic_len + sizeof(mesh_app_hdr_t)] = 'E';
+    mesh_app_handle_rx(child, sizeof(mesh_app_hdr_t) + 4 + 1);
+    CHECK_INT(mesh_upbuf_pending(), 2);
+    CHECK(!mesh_app_publish_frame(frame, sizeof(mesh_app_hdr_t) + 5));
+
+    // Lixo no buffer não trava a entrega
+    CHECK(mesh_app_publish_frame((const uint8_t *)"\xA7xx", 3));
+
+    drain_upbuf();
+    host_mqtt_reset();
+    host_mesh_reset();
+}
+
+static void test_subscription_limit(void)
+{
+    rx_log_t log = {0};
+    int added = 0;
+    char topic[16];
+
+    while (added < 2 * MESH_APP_MAX_SUBS)
+    {
+        snprintf(topic, sizeof(topic), "s%d", added);
+        if (mesh_subscribe(topic, on_rx, &log) != ESP_OK)
+        {
+            break;
+        }
+        added++;
+    }
+    // Uma já foi registrada em test_downlink
+    CHECK_INT(added, MESH_APP_MAX_SUBS - 1);
+    CHECK_INT(mesh_subscribe("x", NULL, NULL), ESP_ERR_INVALID_ARG);
+}
+
+/* --- Vazão --- */
+
+static uint64_t bench_bytes;
+
+static esp_err_t count_send(const mesh_addr_t *to, const uint8_t *data, uint16_t size, int flag)
+{
+    bench_bytes += size;
+    return ESP_OK;
+}
+
+static double now_s(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * @brief Mensagens por segundo do caminho fila + quadro + envio, com cópia (mesh_publish) e sem (begin/commit).
+ */
+static double run_throughput(size_t payload_len, bool zero_copy, int count)
+{
+    static uint8_t src[MESH_APP_FRAME_MAX];
+    mesh_app_stats_t before, after;
+
+    mesh_app_get_stats(&before);
+    double t0 = now_s();
+    for (int i = 0; i < count; i++)
+    {
+        if (zero_copy)
+        {
+            uint8_t *payload;
+            mesh_app_msg_t *msg = mesh_publish_begin("bench", 0, &payload, NULL);
+            CHECK(msg != NULL);
+            memset(payload, i, payload_len); // a aplicação escreve direto no quadro
+            CHECK_INT(mesh_publish_commit(msg, payload_len), ESP_OK);
+        }
+        else
+        {
+            memset(src, i, payload_len);
+            CHECK_INT(mesh_publish("bench", src, payload_len, 0), ESP_OK);
+        }
+        // A task de envio acorda a cada mensagem enfileirada
+        run_tx();
+    }
+    double elapsed = now_s() - t0;
+
+    mesh_app_get_stats(&after);
+    CHECK_INT(after.sent - before.sent, count);
+    CHECK_INT(after.dropped - before.dropped, 0);
+    return count / elapsed;
+}
+
+static void bench_throughput(void)
+{
+    static const size_t sizes[] = {16, 256, 1024, MESH_APP_FRAME_MAX - sizeof(mesh_app_hdr_t) - 5};
+    const int count = 100000;
+
+    host_mesh_reset();
+    host_mesh_send_hook = count_send;
+
+    printf("\nvazão do canal da aplicação no host (fila, quadro e esp_mesh_send simulado)\n");
+    printf("  %-10s %-22s %-22s\n", "payload", "mesh_publish", "begin/commit");
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+    {
+        bench_bytes = 0;
+        double copy = run_throughput(sizes[i], false, count);
+        double zc = run_throughput(sizes[i], true, count);
+        CHECK_INT(bench_bytes, 2ULL * count * (sizeof(mesh_app_hdr_t) + 5 + sizes[i]));
+        printf("  %6u B   %8.0f msg/s %5.0f MB/s %8.0f msg/s %5.0f MB/s\n", (unsigned)sizes[i], copy,
+               copy * sizes[i] / 1e6, zc, zc * sizes[i] / 1e6);
+    }
+    host_mesh_reset();
+}
+
+/**
+ * @brief Produtor mais rápido que o envio: a fila limita o que entra e o resto é recusado na hora.
+ */
+static void bench_overflow(void)
+{
+    static const int rates[] = {1, 2, 4, 8};
+    const int ticks = 1000;
+    const int tx_per_tick = 2; // quadros que o enlace aceita por tick
+
+    host_mesh_reset();
+    printf("\nfila de %d: produtor a N mensagens por tick, envio de %d por tick, %d ticks\n", QUEUE_LEN, tx_per_tick,
+           ticks);
+    printf("  %-6s %10s %10s %12s\n", "N", "aceitas", "enviadas", "recusadas");
+    for (size_t r = 0; r < sizeof(rates) / sizeof(rates[0]); r++)
+    {
+        mesh_app_stats_t before, after;
+        int accepted = 0, refused = 0, sent = 0;
+
+        mesh_app_get_stats(&before);
+        for (int t = 0; t < ticks; t++)
+        {
+            for (int i = 0; i < rates[r]; i++)
+            {
+                esp_err_t err = mesh_publish("bench", "x", 1, 0);
+                CHECK(err == ESP_OK || err == ESP_ERR_NO_MEM);
+                accepted += err == ESP_OK;
+                refused += err == ESP_ERR_NO_MEM;
+            }
+            mesh_app_msg_t *msg;
+            for (int i = 0; i < tx_per_tick && xQueueReceive(send_q, &msg, 0) == pdTRUE; i++)
+            {
+                app_tx_one(msg);
+                xQueueSend(free_q, &msg, 0);
+                sent++;
+            }
+        }
+        sent += run_tx();
+        mesh_app_get_stats(&after);
+        printf("  %-6d %10d %10d %12d\n", rates[r], accepted, sent, refused);
+
+        // Nada se perde depois de aceito; acima da vazão do envio, o excesso é recusado e contado
+        CHECK_INT(sent, accepted);
+        CHECK_INT(after.dropped - before.dropped, refused);
+        CHECK_INT(refused, rates[r] > tx_per_tick ? (rates[r] - tx_per_tick) * ticks - QUEUE_LEN + tx_per_tick : 0);
+    }
+    printf("\n");
+    host_mesh_reset();
+}
+
+int main(void)
+{
+    RUN_TEST(test_full_queue_returns_no_mem);
+    RUN_TEST(test_publish_limits);
+    RUN_TEST(test_reserved_suffixes);
+    RUN_TEST(test_downlink);
+    RUN_TEST(test_send_failure_goes_to_upbuf);
+    RUN_TEST(test_subscription_limit);
+    RUN_TEST(bench_throughput);
+    RUN_TEST(bench_overflow);
+    return HOST_TEST_RESULT();
+}
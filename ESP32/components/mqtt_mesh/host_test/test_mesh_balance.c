@@ -0,0 +1,422 @@
+/**
+ * @file test_mesh_balance.c
+ * @brief Assistente de balanceamento sobre o cache de topologia, JSON da resposta e limites na NVS.
+ */
+
+#include "host_test.h"
+#include "cJSON.h"
+#include "mesh_balance.h"
+#include "mesh_topo.h"
+#include "nvs_flash.h"
+#include <stdlib.h>
+
+#define CAP (6)
+#define STRONG (-60)
+#define WEAK (-80)
+
+static void report(const char *mac, int hops, int rssi, int nc, int max_ch)
+{
+    char buf[256];
+    int len = snprintf(buf, sizeof(buf),
+                       "{\"mac\":\"%s\",\"parent\":\"x\",\"hops\":%d,\"rssi\":%d,\"nc\":%d,\"max_ch\":%d,\"children\":[]}",
+                       mac, hops, rssi, nc, max_ch);
+    mesh_topo_update(buf, len);
+}
+
+static const mesh_balance_advice_t *find(const mesh_balance_report_t *r, const char *mac)
+{
+    for (size_t i = 0; i < r->count; i++)
+    {
+        if (strcmp(r->advice[i].mac, mac) == 0)
+        {
+            return &r->advice[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Árvore de 4 camadas: root e camada 2 forte com 1 filho cada, um ramo fraco.
+ */
+static void build_deep_tree(void)
+{
+    report("00:00:00:00:00:01", 1, -45, 1, 1);  // root
+    report("00:00:00:00:00:02", 2, -50, 1, 1);  // forte
+    report("00:00:00:00:00:03", 2, -70, 1, 1);  // nem forte nem fraco
+    report("00:00:00:00:00:04", 3, -85, 0, 1);  // fraco, sem filhos
+    report("00:00:00:00:00:05", 3, -88, 3, 6);  // fraco, com filhos
+    report("00:00:00:00:00:06", 4, -60, 0, 1);
+    report("00:00:00:00:00:07", 2, -55, 0, CAP); // forte, já no teto
+}
+
+static void test_advise_deep_tree(void)
+{
+    mesh_balance_report_t r;
+
+    build_deep_tree();
+    mesh_balance_advise(CAP, STRONG, WEAK, &r);
+
+    CHECK_INT(r.nodes, 7);
+    CHECK_INT(r.max_layer, 4);
+    CHECK(r.avg_layer > 2.4f && r.avg_layer < 2.5f); // 17 / 7
+
+    // 7 nós cabem em 3 camadas com 2 filhos por pai; o root vai por último
+    const mesh_balance_advice_t *a = find(&r, "00:00:00:00:00:01");
+    CHECK(a != NULL);
+    CHECK_INT(a->limits.max_children, 2);
+    CHECK(a == &r.advice[r.count - 1]);
+
+    a = find(&r, "00:00:00:00:00:02");
+    CHECK(a != NULL);
+    CHECK_INT(a->limits.max_children, 2);
+
+    a = find(&r, "00:00:00:00:00:04");
+    CHECK(a != NULL);
+    CHECK_INT(a->limits.max_children, 0);
+    CHECK_INT(a->limits.layer_pref, MESH_LAYER_PREF_LEAF);
+
+    a = find(&r, "00:00:00:00:00:05");
+    CHECK(a != NULL);
+    CHECK_INT(a->limits.max_children, 1);
+    CHECK_INT(a->limits.layer_pref, MESH_LAYER_PREF_AUTO);
+
+    CHECK(find(&r, "00:00:00:00:00:03") == NULL);
+    CHECK(find(&r, "00:00:00:00:00:06") == NULL);
+    CHECK(find(&r, "00:00:00:00:00:07") == NULL);
+    CHECK_INT(r.count, 4);
+
+    // Nenhuma sugestão passa do teto que os comandos config e limits aceitam
+    for (size_t i = 0; i < r.count; i++)
+    {
+        CHECK(r.advice[i].limits.max_children <= CAP);
+    }
+}
+
+static void test_advise_shallow_tree_keeps_limits(void)
+{
+    mesh_balance_report_t r;
+
+    // Nós das camadas 3 e 4 reconectados mais acima: nada a sugerir para os fortes
+    report("00:00:00:00:00:04", 2, -65, 0, 0);
+    report("00:00:00:00:00:05", 2, -65, 0, 1);
+    report("00:00:00:00:00:06", 2, -60, 0, 1);
+    mesh_balance_advise(CAP, STRONG, WEAK, &r);
+
+    CHECK_INT(r.max_layer, 2);
+    CHECK_INT(r.count, 0);
+}
+
+static void test_advise_overloaded_root(void)
+{
+    mesh_balance_report_t r;
+
+    // Árvore rasa, root no teto com 6 filhos; dois deles fortes, com vaga para mais 3 no total
+    mesh_topo_expire(-1);
+    report("00:00:00:00:00:01", 1, -40, CAP, CAP);
+    report("00:00:00:00:00:02", 2, -50, 0, 2);
+    report("00:00:00:00:00:03", 2, -55, 1, 2);
+    report("00:00:00:00:00:04", 2, -70, 0, 2);
+    report("00:00:00:00:00:05", 2, -72, 0, 2);
+    report("00:00:00:00:00:06", 2, -74, 0, 2);
+    report("00:00:00:00:00:07", 2, -75, 0, 2);
+    mesh_balance_advise(CAP, STRONG, WEAK, &r);
+
+    const mesh_balance_advice_t *a = find(&r, "00:00:00:00:00:01");
+    CHECK(a != NULL);
+    CHECK_INT(a->limits.max_children, CAP - 3);
+    CHECK_INT(a->limits.layer_pref, MESH_LAYER_PREF_AUTO);
+    CHECK(a == &r.advice[r.count - 1]);
+
+    // Sem vaga na camada 2, os filhos do root não têm para onde ir: limite mantido
+    mesh_topo_expire(-1);
+    report("00:00:00:00:00:01", 1, -40, CAP, CAP);
+    report("00:00:00:00:00:02", 2, -50, 2, 2);
+    report("00:00:00:00:00:03", 2, -70, 0, 2);
+    mesh_balance_advise(CAP, STRONG, WEAK, &r);
+    CHECK(find(&r, "00:00:00:00:00:01") == NULL);
+
+    // Só uma vaga: o root perde um filho só
+    report("00:00:00:00:00:03", 2, -58, 1, 2);
+    mesh_balance_advise(CAP, STRONG, WEAK, &r);
+    a = find(&r, "00:00:00:00:00:01");
+    CHECK(a != NULL);
+    CHECK_INT(a->limits.max_children, CAP - 1);
+    mesh_topo_expire(-1);
+}
+
+static void test_advice_json(void)
+{
+    mesh_balance_report_t r;
+
+    build_deep_tree();
+    mesh_balance_advise(CAP, STRONG, WEAK, &r);
+    char *str = mesh_balance_to_json(&r, true);
+    cJSON *json = cJSON_Parse(str);
+    CHECK(json != NULL);
+
+    CHECK_STR(cJSON_GetObjectItem(json, "type")->valuestring, "advice");
+    CHECK(cJSON_IsTrue(cJSON_GetObjectItem(json, "applied")));
+    cJSON *list = cJSON_GetObjectItem(json, "suggestions");
+    CHECK_INT(cJSON_GetArraySize(list), (int)r.count);
+
+    cJSON *item;
+    cJSON_ArrayForEach(item, list)
+    {
+        CHECK(cJSON_GetObjectItem(item, "skipped") == NULL);
+        if (strcmp(cJSON_GetObjectItem(item, "mac")->valuestring, "00:00:00:00:00:04") == 0)
+        {
+            CHECK_STR(cJSON_GetObjectItem(item, "layer")->valuestring, "leaf");
+        }
+    }
+    item = cJSON_GetArrayItem(list, cJSON_GetArraySize(list) - 1);
+    CHECK_STR(cJSON_GetObjectItem(item, "mac")->valuestring, "00:00:00:00:00:01");
+
+    cJSON_Delete(json);
+    cJSON_free(str);
+}
+
+/*
+ * Formação da árvore em uma grade 5x5 com o root no centro. O RSSI cai com o quadrado da
+ * distância e cada nó escolhe o pai como a ESP-MESH: a camada mais rasa com vaga e, nela,
+ * o melhor sinal. A latência de um relatório soma, por salto, o encaminhamento e a disputa
+ * do canal com os irmãos; enlaces fracos pagam retransmissões.
+ */
+#define SIM_SIDE     (5)
+#define SIM_NODES    (SIM_SIDE * SIM_SIDE)
+#define SIM_ROOT     (SIM_NODES / 2)
+#define SIM_MIN_RSSI (-85) // abaixo disso o nó não associa
+#define SIM_RELAY_MS (10.0)
+#define SIM_AIR_MS   (1.0) // por irmão no mesmo pai
+#define SIM_RETRIES  (3.0) // enlace abaixo de WEAK
+
+typedef struct {
+    int parent;
+    int layer; // 0 = sem pai
+    int children;
+    int rssi;
+    mesh_node_limits_t limits;
+} sim_node_t;
+
+typedef struct {
+    double avg_hops;
+    int max_layer;
+    int root_children;
+    double avg_ms;
+    double max_ms;
+    int orphans;
+} sim_stats_t;
+
+static int sim_rssi(int a, int b)
+{
+    int dx = a % SIM_SIDE - b % SIM_SIDE;
+    int dy = a / SIM_SIDE - b / SIM_SIDE;
+    return -48 - 7 * (dx * dx + dy * dy);
+}
+
+static void sim_mac(int i, char mac[18])
+{
+    snprintf(mac, 18, "00:00:00:00:01:%02X", i);
+}
+
+/**
+ * @brief Mesma regra de effective_max_children() no main.c.
+ */
+static int sim_limit(const sim_node_t *n, int global)
+{
+    if (n->limits.layer_pref == MESH_LAYER_PREF_LEAF)
+    {
+        return 0;
+    }
+    return n->limits.max_children > 0 ? n->limits.max_children : global;
+}
+
+static void sim_form(sim_node_t *net, int global)
+{
+    for (int i = 0; i < SIM_NODES; i++)
+    {
+        net[i].parent = -1;
+        net[i].layer = 0;
+        net[i].children = 0;
+    }
+    net[SIM_ROOT].layer = 1;
+
+    // Camada por camada, o par (nó sem pai, pai com vaga) de melhor sinal associa primeiro
+    for (int layer = 1; layer < SIM_NODES; layer++)
+    {
+        for (;;)
+        {
+            int best_i = -1, best_p = -1;
+            for (int i = 0; i < SIM_NODES; i++)
+            {
+                for (int p = 0; p < SIM_NODES && !net[i].layer; p++)
+                {
+                    if (net[p].layer != layer || net[p].children >= sim_limit(&net[p], global) ||
+                        sim_rssi(i, p) < SIM_MIN_RSSI)
+                    {
+                        continue;
+                    }
+                    if (best_i < 0 || sim_rssi(i, p) > sim_rssi(best_i, best_p))
+                    {
+                        best_i = i;
+                        best_p = p;
+                    }
+                }
+            }
+            if (best_i < 0)
+            {
+                break;
+            }
+            net[best_i].parent = best_p;
+            net[best_i].layer = layer + 1;
+            net[best_i].rssi = sim_rssi(best_i, best_p);
+            net[best_p].children++;
+        }
+    }
+}
+
+static sim_stats_t sim_measure(const sim_node_t *net)
+{
+    sim_stats_t st = {.root_children = net[SIM_ROOT].children};
+    int joined = 0;
+
+    for (int i = 0; i < SIM_NODES; i++)
+    {
+        if (i == SIM_ROOT || !net[i].layer)
+        {
+            st.orphans += i != SIM_ROOT;
+            continue;
+        }
+        double ms = 0;
+        for (int n = i; net[n].parent >= 0; n = net[n].parent)
+        {
+            double hop = SIM_RELAY_MS + SIM_AIR_MS * (net[net[n].parent].children - 1);
+            ms += net[n].rssi < WEAK ? hop * SIM_RETRIES : hop;
+        }
+        joined++;
+        st.avg_hops += net[i].layer - 1;
+        st.avg_ms += ms;
+        st.max_ms = ms > st.max_ms ? ms : st.max_ms;
+        st.max_layer = net[i].layer > st.max_layer ? net[i].layer : st.max_layer;
+    }
+    st.avg_hops /= joined;
+    st.avg_ms /= joined;
+    return st;
+}
+
+/**
+ * @brief Uma rodada de "rebalance apply": relatórios no cache, assistente real, limites aplicados.
+ *
+ * @return Sugestões aplicadas.
+ */
+static size_t sim_rebalance(sim_node_t *net, int global)
+{
+    mesh_balance_report_t r;
+    char mac[18];
+
+    mesh_topo_expire(-1);
+    for (int i = 0; i < SIM_NODES; i++)
+    {
+        if (net[i].layer)
+        {
+            sim_mac(i, mac);
+            report(mac, net[i].layer, i == SIM_ROOT ? MESH_TOPO_NO_RSSI : net[i].rssi, net[i].children,
+                   sim_limit(&net[i], global));
+        }
+    }
+    mesh_balance_advise(CAP, STRONG, WEAK, &r);
+
+    for (size_t a = 0; a < r.count; a++)
+    {
+        for (int i = 0; i < SIM_NODES; i++)
+        {
+            sim_mac(i, mac);
+            if (strcmp(mac, r.advice[a].mac) == 0)
+            {
+                net[i].limits = r.advice[a].limits;
+            }
+        }
+    }
+    return r.count;
+}
+
+static void bench_rebalance_global(int global)
+{
+    sim_node_t net[SIM_NODES];
+    int rounds = 0;
+
+    for (int i = 0; i < SIM_NODES; i++)
+    {
+        net[i].limits = (mesh_node_limits_t){.max_children = -1, .layer_pref = MESH_LAYER_PREF_AUTO};
+    }
+    sim_form(net, global);
+    sim_stats_t before = sim_measure(net);
+
+    // Reaplica até o assistente não ter mais o que sugerir
+    while (rounds < 5 && sim_rebalance(net, global) > 0)
+    {
+        sim_form(net, global);
+        rounds++;
+    }
+    sim_stats_t after = sim_measure(net);
+
+    printf("  max_children %d: saltos %.2f -> %.2f, camadas %d -> %d, filhos do root %d -> %d, "
+           "latência média %5.1f -> %5.1f ms (máx. %5.1f -> %5.1f), %d rodada(s)\n",
+           global, before.avg_hops, after.avg_hops, before.max_layer, after.max_layer, before.root_children,
+           after.root_children, before.avg_ms, after.avg_ms, before.max_ms, after.max_ms, rounds);
+
+    CHECK_INT(before.orphans, 0);
+    CHECK_INT(after.orphans, 0);
+    CHECK(rounds < 5); // converge, sem oscilar entre sugestões
+    CHECK(after.max_layer <= before.max_layer);
+    if (before.max_layer > 3)
+    {
+        CHECK(after.avg_hops < before.avg_hops);
+        CHECK(after.avg_ms < before.avg_ms);
+    }
+    else
+    {
+        CHECK(after.root_children < before.root_children); // árvore já rasa: só alivia o root
+    }
+    mesh_topo_expire(-1);
+}
+
+static void bench_rebalance(void)
+{
+    printf("Árvore de %d nós antes -> depois de rebalance apply:\n", SIM_NODES);
+    bench_rebalance_global(1);
+    bench_rebalance_global(2);
+    bench_rebalance_global(CAP);
+}
+
+static void test_limits_nvs_round_trip(void)
+{
+    mesh_node_limits_t limits;
+
+    host_nvs_reset();
+    CHECK_INT(mesh_balance_load_limits(&limits), ESP_OK);
+    CHECK_INT(limits.max_children, -1);
+    CHECK_INT(limits.layer_pref, MESH_LAYER_PREF_AUTO);
+
+    mesh_node_limits_t saved = {.max_children = 0, .layer_pref = MESH_LAYER_PREF_LEAF};
+    CHECK_INT(mesh_balance_save_limits(&saved), ESP_OK);
+    CHECK_INT(mesh_balance_load_limits(&limits), ESP_OK);
+    CHECK_INT(limits.max_children, 0);
+    CHECK_INT(limits.layer_pref, MESH_LAYER_PREF_LEAF);
+
+    // Partição ilegível: segue com os padrões
+    host_nvs_fail_init("nvs_custom", ESP_FAIL);
+    CHECK(mesh_balance_load_limits(&limits) != ESP_OK);
+    CHECK_INT(limits.max_children, -1);
+}
+
+int main(void)
+{
+    CHECK_INT(mesh_topo_init(32), ESP_OK);
+    RUN_TEST(test_advise_deep_tree);
+    RUN_TEST(test_advise_shallow_tree_keeps_limits);
+    RUN_TEST(test_advise_overloaded_root);
+    RUN_TEST(test_advice_json);
+    RUN_TEST(bench_rebalance);
+    RUN_TEST(test_limits_nvs_round_trip);
+    return HOST_TEST_RESULT();
+}
@@ -0,0 +1,381 @@
+/**
+ * @file test_mesh_cmd.c
+ * @brief Ida e volta JSON -> binário -> decodificação, quadros malformados e comandos exclusivos do root.
+ */
+
+#include "host_test.h"
+#include "esp_mesh.h"
+#include "mesh_cmd.h"
+#include <string.h>
+
+#define HDR_LEN      (11) // [magic][op][flags][target 6][args_len 2]
+#define ARGS_LEN_OFS (9)
+
+enum {
+    OP_CONFIG = 1,
+    OP_BLINK = 2,
+    OP_OTA = 4,
+    OP_UNUSED = 20,
+};
+
+typedef struct {
+    int calls;
+    mesh_cmd_t last;
+} handled_t;
+
+static handled_t handled[MESH_CMD_MAX_OPS];
+
+static struct {
+    int calls;
+    uint8_t frame[HDR_LEN + MESH_CMD_ARGS_MAX];
+    size_t len;
+    bool broadcast;
+} forwarded;
+
+static void on_cmd(const mesh_cmd_t *cmd, mesh_cmd_src_t src)
+{
+    handled[cmd->op].calls++;
+    handled[cmd->op].last = *cmd;
+}
+
+static void on_forward(const uint8_t *frame, size_t len, const uint8_t *target)
+{
+    forwarded.calls++;
+    memcpy(forwarded.frame, frame, len);
+    forwarded.len = len;
+    forwarded.broadcast = target == NULL;
+}
+
+static esp_err_t parse_config(const cJSON *json, mesh_cmd_t *cmd)
+{
+    cJSON *interval = cJSON_GetObjectItem(json, "interval");
+    if (!cJSON_IsNumber(interval) || interval->valueint < 0)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    int32_t args[2] = {interval->valueint, -1};
+    memcpy(cmd->args, args, sizeof(args));
+    cmd->args_len = sizeof(args);
+    return ESP_OK;
+}
+
+static esp_err_t parse_url(const cJSON *json, mesh_cmd_t *cmd)
+{
+    cJSON *url = cJSON_GetObjectItem(json, "url");
+    if (!cJSON_IsString(url) || strlen(url->valuestring) >= MESH_CMD_ARGS_MAX)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    cmd->args_len = strlen(url->valuestring) + 1;
+    memcpy(cmd->args, url->valuestring, cmd->args_len);
+    return ESP_OK;
+}
+
+static void reset_calls(void)
+{
+    memset(handled, 0, sizeof(handled));
+    memset(&forwarded, 0, sizeof(forwarded));
+}
+
+static esp_err_t from_json(const char *json, mesh_cmd_t *cmd)
+{
+    return mesh_cmd_from_json(json, strlen(json), cmd);
+}
+
+static size_t encode(const char *json, uint8_t *frame, size_t size)
+{
+    mesh_cmd_t cmd;
+    CHECK_INT(from_json(json, &cmd), ESP_OK);
+    return mesh_cmd_encode(&cmd, frame, size);
+}
+
+static void test_register(void)
+{
+    const mesh_cmd_def_t config = {"config", 0, 2 * sizeof(int32_t), parse_config, on_cmd};
+    const mesh_cmd_def_t blink = {"blink", MESH_CMD_F_TARGETED, 0, NULL, on_cmd};
+    const mesh_cmd_def_t ota = {"ota", MESH_CMD_F_ROOT_ONLY, 0, parse_url, on_cmd};
+    const mesh_cmd_def_t no_handler = {"x", 0, 0, NULL, NULL};
+    const mesh_cmd_def_t too_big = {"x", 0, MESH_CMD_ARGS_MAX + 1, NULL, on_cmd};
+
+    CHECK_INT(mesh_cmd_init(on_forward), ESP_OK);
+    CHECK_INT(mesh_cmd_register(OP_CONFIG, &config), ESP_OK);
+    CHECK_INT(mesh_cmd_register(OP_BLINK, &blink), ESP_OK);
+    CHECK_INT(mesh_cmd_register(OP_OTA, &ota), ESP_OK);
+
+    CHECK_INT(mesh_cmd_register(OP_CONFIG, &blink), ESP_ERR_INVALID_STATE);
+    CHECK_INT(mesh_cmd_register(0, &blink), ESP_ERR_INVALID_ARG);
+    CHECK_INT(mesh_cmd_register(MESH_CMD_MAX_OPS, &blink), ESP_ERR_INVALID_ARG);
+    CHECK_INT(mesh_cmd_register(OP_UNUSED, &no_handler), ESP_ERR_INVALID_ARG);
+    CHECK_INT(mesh_cmd_register(OP_UNUSED, &too_big), ESP_ERR_INVALID_ARG);
+}
+
+static void test_json_round_trip(void)
+{
+    static const char *const cases[] = {
+        "{\"action\":\"config\",\"interval\":5000}",
+        "{\"interval\":250}", // formato antigo do configurador
+        "{\"op\":1,\"interval\":0,\"target\":\"24:6F:28:00:00:21\"}",
+        "{\"action\":\"blink\",\"target\":\"aa:bb:cc:dd:ee:ff\"}",
+        "{\"action\":\"ota\",\"url\":\"http://10.0.0.2/fw.bin\"}",
+    };
+    uint8_t frame[HDR_LEN + MESH_CMD_ARGS_MAX];
+
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++)
+    {
+        mesh_cmd_t in, out;
+        memset(&out, 0x5A, sizeof(out));
+
+        CHECK_INT(from_json(cases[i], &in), ESP_OK);
+        size_t len = mesh_cmd_encode(&in, frame, sizeof(frame));
+        CHECK_INT(len, HDR_LEN + in.args_len);
+        CHECK(mesh_cmd_is_frame(frame, len));
+        CHECK_INT(mesh_cmd_decode(frame, len, &out), ESP_OK);
+
+        CHECK_INT(out.op, in.op);
+        CHECK_INT(out.flags, in.flags);
+        CHECK(memcmp(out.target, in.target, 6) == 0);
+        CHECK_INT(out.args_len, in.args_len);
+        CHECK(memcmp(out.args, in.args, in.args_len) == 0);
+    }
+
+    mesh_cmd_t cmd;
+    CHECK_INT(from_json(cases[0], &cmd), ESP_OK);
+    CHECK(cmd.flags & MESH_CMD_BROADCAST);
+    CHECK_INT(from_json(cases[3], &cmd), ESP_OK);
+    CHECK(!(cmd.flags & MESH_CMD_BROADCAST));
+    CHECK_INT(cmd.target[0], 0xAA);
+    CHECK_INT(from_json(cases[4], &cmd), ESP_OK);
+    CHECK_STR((const char *)cmd.args, "http://10.0.0.2/fw.bin");
+}
+
+static void test_invalid_json(void)
+{
+    mesh_cmd_t cmd;
+
+    CHECK_INT(from_json("", &cmd), ESP_ERR_INVALID_ARG);
+    CHECK_INT(from_json("[1,2]", &cmd), ESP_ERR_INVALID_ARG);
+    CHECK_INT(from_json("{\"action\":\"config\"", &cmd), ESP_ERR_INVALID_ARG);
+    // Sem parse: o tamanho vem do buffer, não de um '\0'
+    CHECK_INT(mesh_cmd_from_json("{\"interval\":5}xxxx", 14, &cmd), ESP_OK);
+
+    CHECK_INT(from_json("{\"action\":\"config\",\"interval\":-1}", &cmd), ESP_ERR_INVALID_ARG);
+    CHECK_INT(from_json("{\"action\":\"config\",\"interval\":1,\"target\":\"24:6F:28\"}", &cmd), ESP_ERR_INVALID_ARG);
+    CHECK_INT(from_json("{\"action\":\"config\",\"interval\":1,\"target\":\"24:6F:28:00:00:21:99\"}", &cmd),
+              ESP_ERR_INVALID_ARG);
+    CHECK_INT(from_json("{\"action\":\"config\",\"interval\":1,\"target\":7}", &cmd), ESP_ERR_INVALID_ARG);
+    CHECK_INT(from_json("{\"action\":\"blink\"}", &cmd), ESP_ERR_INVALID_ARG);
+    CHECK_INT(from_json("{\"action\":\"ota\"}", &cmd), ESP_ERR_INVALID_ARG);
+}
+
+static void test_unknown_opcode(void)
+{
+    uint8_t frame[HDR_LEN + MESH_CMD_ARGS_MAX];
+    mesh_cmd_t cmd;
+
+    CHECK_INT(from_json("{\"action\":\"reboot\"}", &cmd), ESP_ERR_NOT_SUPPORTED);
+    CHECK_INT(from_json("{\"op\":20}", &cmd), ESP_ERR_NOT_SUPPORTED);
+    CHECK_INT(from_json("{\"op\":0}", &cmd), ESP_ERR_NOT_SUPPORTED);
+    CHECK_INT(from_json("{\"op\":255}", &cmd), ESP_ERR_NOT_SUPPORTED);
+    CHECK_INT(from_json("{\"target\":\"24:6F:28:00:00:21\"}", &cmd), ESP_ERR_NOT_SUPPORTED);
+
+    size_t len = encode("{\"action\":\"blink\",\"target\":\"24:6F:28:00:00:21\"}", frame, sizeof(frame));
+    frame[1] = OP_UNUSED; // não registrado
+    CHECK_INT(mesh_cmd_decode(frame, len, &cmd), ESP_ERR_NOT_SUPPORTED);
+    frame[1] = 0;
+    CHECK_INT(mesh_cmd_decode(frame, len, &cmd), ESP_ERR_INVALID_ARG);
+    frame[1] = MESH_CMD_MAX_OPS;
+    CHECK_INT(mesh_cmd_decode(frame, len, &cmd), ESP_ERR_INVALID_ARG);
+    frame[1] = 0xFF;
+    CHECK_INT(mesh_cmd_decode(frame, len, &cmd), ESP_ERR_INVALID_ARG);
+
+    // Opcode fora da tabela também não é despachado
+    memset(&cmd, 0, sizeof(cmd));
+    cmd.op = OP_UNUSED;
+    cmd.flags = MESH_CMD_BROADCAST;
+    reset_calls();
+    mesh_cmd_dispatch(&cmd, MESH_CMD_SRC_MESH);
+    CHECK_INT(handled[OP_UNUSED].calls, 0);
+}
+
+static void test_truncated_frames(void)
+{
+    uint8_t frame[HDR_LEN + MESH_CMD_ARGS_MAX];
+    mesh_cmd_t cmd;
+
+    size_t len = encode("{\"action\":\"ota\",\"url\":\"http://10.0.0.2/fw.bin\"}", frame, sizeof(frame));
+    CHECK(len > HDR_LEN);
+
+    // Todo prefixo do quadro é recusado, inclusive o que para no meio do cabeçalho
+    for (size_t cut = 0; cut < len; cut++)
+    {
+        CHECK(mesh_cmd_decode(frame, cut, &cmd) != ESP_OK);
+    }
+    CHECK(!mesh_cmd_is_frame(frame, HDR_LEN - 1));
+    CHECK_INT(mesh_cmd_decode(frame, len, &cmd), ESP_OK);
+
+    // Bytes a mais depois dos argumentos não atrapalham
+    CHECK_INT(mesh_cmd_decode(frame, sizeof(frame), &cmd), ESP_OK);
+    CHECK_INT(cmd.args_len, len - HDR_LEN);
+
+    // Magic errado
+    frame[0] = 0xA7;
+    CHECK_INT(mesh_cmd_decode(frame, len, &cmd), ESP_ERR_INVALID_ARG);
+}
+
+static void test_oversized_frames(void)
+{
+    static uint8_t frame[HDR_LEN + MESH_CMD_ARGS_MAX + 64];
+    mesh_cmd_t cmd;
+
+    size_t len = encode("{\"action\":\"ota\",\"url\":\"http://x\"}", frame, sizeof(frame));
+
+    // args_len acima do máximo, mesmo com bytes suficientes no quadro
+    uint16_t args_len = MESH_CMD_ARGS_MAX + 1;
+    memcpy(frame + ARGS_LEN_OFS, &args_len, 2);
+    CHECK_INT(mesh_cmd_decode(frame, sizeof(frame), &cmd), ESP_ERR_INVALID_ARG);
+    args_len = 0xFFFF;
+    memcpy(frame + ARGS_LEN_OFS, &args_len, 2);
+    CHECK_INT(mesh_cmd_decode(frame, sizeof(frame), &cmd), ESP_ERR_INVALID_ARG);
+
+    // args_len maior que o que chegou
+    args_len = len - HDR_LEN + 1;
+    memcpy(frame + ARGS_LEN_OFS, &args_len, 2);
+    CHECK_INT(mesh_cmd_decode(frame, len, &cmd), ESP_ERR_INVALID_ARG);
+
+    // O máximo exato passa
+    args_len = MESH_CMD_ARGS_MAX;
+    memcpy(frame + ARGS_LEN_OFS, &args_len, 2);
+    CHECK_INT(mesh_cmd_decode(frame, HDR_LEN + MESH_CMD_ARGS_MAX, &cmd), ESP_OK);
+
+    // Comando de tamanho fixo com argumentos de outro tamanho
+    len = encode("{\"action\":\"config\",\"interval\":10}", frame, sizeof(frame));
+    args_len = len - HDR_LEN - 1;
+    memcpy(frame + ARGS_LEN_OFS, &args_len, 2);
+    CHECK_INT(mesh_cmd_decode(frame, len, &cmd), ESP_ERR_NOT_SUPPORTED);
+
+    // URL que não cabe nos argumentos
+    char json[MESH_CMD_ARGS_MAX + 64];
+    int n = snprintf(json, sizeof(json), "{\"action\":\"ota\",\"url\":\"");
+    memset(json + n, 'u', MESH_CMD_ARGS_MAX);
+    strcpy(json + n + MESH_CMD_ARGS_MAX, "\"}");
+    CHECK_INT(from_json(json, &cmd), ESP_ERR_INVALID_ARG);
+
+    // Buffer de saída pequeno demais
+    CHECK_INT(from_json("{\"action\":\"config\",\"interval\":10}", &cmd), ESP_OK);
+    CHECK_INT(mesh_cmd_encode(&cmd, frame, HDR_LEN + cmd.args_len - 1), 0);
+}
+
+static void test_root_only_target(void)
+{
+    mesh_cmd_t cmd;
+
+    host_mesh_root = true;
+    reset_calls();
+
+    // Para outro nó seria descartado: recusado já na conversão, para o root avisar o broker
+    CHECK_INT(from_json("{\"action\":\"ota\",\"url\":\"http://x\",\"target\":\"24:6F:28:00:00:21\"}", &cmd),
+              ESP_ERR_NOT_ALLOWED);
+
+    // Com o MAC do próprio root (AP = STA + 1) é o mesmo que sem target
+    CHECK_INT(from_json("{\"action\":\"ota\",\"url\":\"http://x\",\"target\":\"24:6F:28:00:00:11\"}", &cmd), ESP_OK);
+    mesh_cmd_dispatch(&cmd, MESH_CMD_SRC_MQTT);
+    CHECK_INT(handled[OP_OTA].calls, 1);
+    CHECK_INT(forwarded.calls, 0);
+
+    // Broadcast: roda no root e não é repassado
+    CHECK_INT(from_json("{\"action\":\"ota\",\"url\":\"http://x\"}", &cmd), ESP_OK);
+    mesh_cmd_dispatch(&cmd, MESH_CMD_SRC_MQTT);
+    CHECK_INT(handled[OP_OTA].calls, 2);
+    CHECK_INT(forwarded.calls, 0);
+
+    // Gerado no próprio root para outro nó: não executa, não repassa
+    CHECK_INT(mesh_cmd_send(OP_OTA, "24:6F:28:00:00:21", "http://x", 9), ESP_OK);
+    CHECK_INT(handled[OP_OTA].calls, 2);
+    CHECK_INT(forwarded.calls, 0);
+    host_mesh_root = false;
+}
+
+static void test_root_only_from_mesh(void)
+{
+    uint8_t frame[HDR_LEN + MESH_CMD_ARGS_MAX];
+    mesh_cmd_t cmd;
+
+    // Quadro binário de um par da mesh, em broadcast ou para este nó, que não é root
+    size_t len = encode("{\"action\":\"ota\",\"url\":\"http://x\"}", frame, sizeof(frame));
+    host_mesh_root = false;
+    reset_calls();
+    CHECK_INT(mesh_cmd_decode(frame, len, &cmd), ESP_OK);
+    CHECK(mesh_cmd_is_for_me(&cmd));
+    mesh_cmd_dispatch(&cmd, MESH_CMD_SRC_MESH);
+    CHECK_INT(handled[OP_OTA].calls, 0);
+
+    cmd.flags &= ~MESH_CMD_BROADCAST;
+    CHECK(mesh_cmd_parse_mac("24:6F:28:00:00:11", cmd.target));
+    CHECK(mesh_cmd_is_for_me(&cmd));
+    mesh_cmd_dispatch(&cmd, MESH_CMD_SRC_MESH);
+    CHECK_INT(handled[OP_OTA].calls, 0);
+
+    // Os demais comandos da mesh seguem valendo
+    len = encode("{\"action\":\"config\",\"interval\":3000}", frame, sizeof(frame));
+    CHECK_INT(mesh_cmd_decode(frame, len, &cmd), ESP_OK);
+    mesh_cmd_dispatch(&cmd, MESH_CMD_SRC_MESH);
+    CHECK_INT(handled[OP_CONFIG].calls, 1);
+
+    // No root, o mesmo quadro é executado
+    host_mesh_root = true;
+    len = encode("{\"action\":\"ota\",\"url\":\"http://x\"}", frame, sizeof(frame));
+    CHECK_INT(mesh_cmd_decode(frame, len, &cmd), ESP_OK);
+    mesh_cmd_dispatch(&cmd, MESH_CMD_SRC_MESH);
+    CHECK_INT(handled[OP_OTA].calls, 1);
+    CHECK_INT(forwarded.calls, 0);
+    host_mesh_root = false;
+}
+
+static void test_dispatch_forwarding(void)
+{
+    mesh_cmd_t cmd, decoded;
+
+    host_mesh_root = true;
+    reset_calls();
+
+    // Broadcast vindo do broker: executa no root e repassa a todos
+    CHECK_INT(from_json("{\"action\":\"config\",\"interval\":3000}", &cmd), ESP_OK);
+    mesh_cmd_dispatch(&cmd, MESH_CMD_SRC_MQTT);
+    CHECK_INT(handled[OP_CONFIG].calls, 1);
+    CHECK_INT(forwarded.calls, 1);
+    CHECK(forwarded.broadcast);
+
+    // O quadro repassado é o que o nó decodifica
+    CHECK_INT(mesh_cmd_decode(forwarded.frame, forwarded.len, &decoded), ESP_OK);
+    CHECK(memcmp(decoded.args, cmd.args, cmd.args_len) == 0);
+
+    // Para outro nó: só repassa
+    CHECK_INT(from_json("{\"action\":\"blink\",\"target\":\"24:6F:28:00:00:21\"}", &cmd), ESP_OK);
+    mesh_cmd_dispatch(&cmd, MESH_CMD_SRC_MQTT);
+    CHECK_INT(handled[OP_BLINK].calls, 0);
+    CHECK_INT(forwarded.calls, 2);
+    CHECK(!forwarded.broadcast);
+
+    // Recebido pela mesh: nunca repassa de novo
+    host_mesh_root = false;
+    reset_calls();
+    CHECK_INT(from_json("{\"action\":\"blink\",\"target\":\"24:6F:28:00:00:11\"}", &cmd), ESP_OK);
+    CHECK(mesh_cmd_is_for_me(&cmd));
+    mesh_cmd_dispatch(&cmd, MESH_CMD_SRC_MESH);
+    CHECK_INT(handled[OP_BLINK].calls, 1);
+    CHECK_INT(forwarded.calls, 0);
+}
+
+int main(void)
+{
+    RUN_TEST(test_register);
+    RUN_TEST(test_json_round_trip);
+    RUN_TEST(test_invalid_json);
+    RUN_TEST(test_unknown_opcode);
+    RUN_TEST(test_truncated_frames);
+    RUN_TEST(test_oversized_frames);
+    RUN_TEST(test_root_only_target);
+    RUN_TEST(test_root_only_from_mesh);
+    RUN_TEST(test_dispatch_forwarding);
+    return HOST_TEST_RESULT();
+}
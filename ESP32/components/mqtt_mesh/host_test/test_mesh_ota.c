@@ -0,0 +1,573 @@
+/**
+ * @file test_mesh_ota.c
+ * @brief Distribuição de firmware pela mesh simulada: integridade, retomada, perdas e tempo de rollout.
+ *
+ * O módulo é incluído como fonte e cada nó simulado guarda a sua cópia do
+ * estado estático (ota, children), trocada a cada evento. A rede entrega os
+ * quadros com atraso de transmissão: cada nó transmite um quadro por vez, a
+ * uma taxa fixa, mais a latência do enlace.
+ */
+
+#include "host_test.h"
+#include "../mesh_ota.c"
+
+#define MAX_NODES     (64)
+#define IMAGE_SIZE    (256 * 1024)
+#define LINK_BPS      (2000000) // vazão útil de um enlace P2P da mesh
+#define LINK_LAT_US   (1500)
+#define HTTP_CHUNK_US (5000)    // root baixa ~200 KB/s
+#define TICK_US       (500 * 1000)
+#define MAX_EVENTS    (4096)
+
+typedef struct
+{
+    mesh_addr_t addr; // MAC STA (endereço mesh)
+    int parent;
+    int layer;
+    __typeof__(ota) ota_state;
+    ota_child_t children_state[MESH_OTA_MAX_CHILDREN];
+    esp_partition_t part;
+    uint8_t *flash;
+    size_t flash_len;
+    int begins;
+    int64_t done_us;
+    int64_t tx_free_us;
+    bool rebooted;
+} sim_node_t;
+
+typedef struct
+{
+    int64_t at_us;
+    int from;
+    int to;
+    uint16_t len;
+    uint8_t *data;
+} sim_event_t;
+
+static sim_node_t nodes[MAX_NODES];
+static int node_count = 0;
+static int current = -1;
+static uint8_t image[IMAGE_SIZE];
+
+static sim_event_t events[MAX_EVENTS];
+static int event_count = 0;
+static uint32_t loss_permille = 0;
+static uint32_t frames_sent = 0;
+static uint32_t frames_lost = 0;
+static int64_t http_chunk_us = HTTP_CHUNK_US;
+
+/*******************************************************
+ *                Troca de contexto entre nós
+ *******************************************************/
+
+static void enter(int i)
+{
+    memcpy(&ota, &nodes[i].ota_state, sizeof(ota));
+    memcpy(children, nodes[i].children_state, sizeof(children));
+    current = i;
+}
+
+static void leave(void)
+{
+    memcpy(&nodes[current].ota_state, &ota, sizeof(ota));
+    memcpy(nodes[current].children_state, children, sizeof(children));
+    current = -1;
+}
+
+static int node_by_addr(const mesh_addr_t *addr)
+{
+    for (int i = 0; i < node_count; i++)
+    {
+        if (memcmp(nodes[i].addr.addr, addr->addr, 6) == 0)
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/*******************************************************
+ *                Partição OTA de cada nó
+ *******************************************************/
+
+const esp_partition_t *esp_ota_get_next_update_partition(const esp_partition_t *start_from)
+{
+    return &nodes[current].part;
+}
+
+esp_err_t esp_ota_begin(const esp_partition_t *partition, size_t image_size, esp_ota_handle_t *out_handle)
+{
+    nodes[current].flash_len = 0;
+    nodes[current].begins++;
+    *out_handle = current + 1;
+    return ESP_OK;
+}
+
+esp_err_t esp_ota_write(esp_ota_handle_t handle, const void *data, size_t size)
+{
+    sim_node_t *n = &nodes[handle - 1];
+    if (n->flash_len + size > n->part.size)
+    {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    memcpy(n->flash + n->flash_len, data, size);
+    n->flash_len += size;
+    return ESP_OK;
+}
+
+esp_err_t esp_ota_end(esp_ota_handle_t handle)
+{
+    sim_node_t *n = &nodes[handle - 1];
+    return n->flash_len == IMAGE_SIZE && memcmp(n->flash, image, IMAGE_SIZE) == 0 ? ESP_OK
+                                                                                  : ESP_ERR_OTA_VALIDATE_FAILED;
+}
+
+esp_err_t esp_ota_abort(esp_ota_handle_t handle)
+{
+    return ESP_OK;
+}
+
+esp_err_t esp_ota_set_boot_partition(const esp_partition_t *partition)
+{
+    nodes[current].done_us = esp_timer_get_time();
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_read(const esp_partition_t *partition, size_t src_offset, void *dst, size_t size)
+{
+    for (int i = 0; i < node_count; i++)
+    {
+        if (&nodes[i].part == partition)
+        {
+            if (src_offset + size > nodes[i].flash_len)
+            {
+                return ESP_ERR_INVALID_SIZE;
+            }
+            memcpy(dst, nodes[i].flash + src_offset, size);
+            return ESP_OK;
+        }
+    }
+    return ESP_ERR_NOT_FOUND;
+}
+
+/*******************************************************
+ *                Rede
+ *******************************************************/
+
+/**
+ * @brief Um quadro ocupa o rádio do nó que transmite pelo tempo de ar; perdas são sorteadas.
+ */
+static esp_err_t sim_send(const mesh_addr_t *to, const uint8_t *data, uint16_t size, int flag)
+{
+    sim_node_t *src = &nodes[current];
+    int dst = to ? node_by_addr(to) : 0;
+    if (dst < 0 || event_count == MAX_EVENTS)
+    {
+        return ESP_ERR_MESH_NO_ROUTE_FOUND;
+    }
+
+    int64_t now = esp_timer_get_time();
+    int64_t start = src->tx_free_us > now ? src->tx_free_us : now;
+    src->tx_free_us = start + (int64_t)size * 8 * 1000000 / LINK_BPS;
+    frames_sent++;
+
+    if (loss_permille && esp_random() % 1000 < loss_permille)
+    {
+        frames_lost++;
+        return ESP_OK;
+    }
+
+    sim_event_t *ev = &events[event_count++];
+    ev->at_us = src->tx_free_us + LINK_LAT_US;
+    ev->from = current;
+    ev->to = dst;
+    ev->len = size;
+    ev->data = malloc(size);
+    memcpy(ev->data, data, size);
+    return ESP_OK;
+}
+
+static void sim_reset(void)
+{
+    for (int i = 0; i < node_count; i++)
+    {
+        free(nodes[i].flash);
+    }
+    for (int i = 0; i < event_count; i++)
+    {
+        free(events[i].data);
+    }
+    memset(nodes, 0, sizeof(nodes));
+    node_count = 0;
+    event_count = 0;
+    frames_sent = frames_lost = 0;
+    loss_permille = 0;
+    host_mesh_reset();
+    host_mesh_send_hook = sim_send;
+}
+
+static int add_node(int parent)
+{
+    sim_node_t *n = &nodes[node_count];
+    uint8_t mac[6] = {0x24, 0x6F, 0x28, 0x00, (uint8_t)(node_count >> 8), (uint8_t)(node_count * 2)};
+    memcpy(n->addr.addr, mac, 6);
+    n->parent = parent;
+    n->layer = parent < 0 ? 1 : nodes[parent].layer + 1;
+    n->part.size = 1500 * 1024;
+    n->flash = malloc(n->part.size);
+    n->done_us = -1;
+    return node_count++;
+}
+
+static void connect_child(int child)
+{
+    enter(nodes[child].parent);
+    mesh_ota_child_connected(nodes[child].addr.addr);
+    leave();
+}
+
+static void disconnect_child(int child)
+{
+    enter(nodes[child].parent);
+    mesh_ota_child_disconnected(nodes[child].addr.addr);
+    leave();
+}
+
+/**
+ * @brief Numeração em largura com fanout fixo: o pai de i é (i - 1) / fanout.
+ */
+static void build_tree(int count, int fanout)
+{
+    sim_reset();
+    for (int i = 0; i < count; i++)
+    {
+        add_node(i ? (i - 1) / fanout : -1);
+    }
+    for (int i = 1; i < count; i++)
+    {
+        connect_child(i);
+    }
+}
+
+static int pop_event(void)
+{
+    int best = -1;
+    for (int i = 0; i < event_count; i++)
+    {
+        if (best < 0 || events[i].at_us < events[best].at_us)
+        {
+            best = i;
+        }
+    }
+    return best;
+}
+
+typedef void (*sim_hook_t)(int64_t now_us);
+
+/**
+ * @brief Roda o rollout até todos os nós gravarem a imagem (ou o limite de tempo).
+ *
+ * @return Tempo até o último nó terminar, em ms; -1 se algum não terminou.
+ */
+static void deliver(int ev)
+{
+    sim_event_t e = events[ev];
+    events[ev] = events[--event_count];
+    host_clock_set_us(e.at_us);
+    enter(e.to);
+    mesh_ota_handle_rx(&nodes[e.from].addr, e.data, e.len);
+    leave();
+    free(e.data);
+}
+
+static int64_t run_rollout(int64_t limit_us, sim_hook_t hook)
+{
+    int64_t t0 = esp_timer_get_time();
+    int64_t next_tick = t0 + TICK_US;
+    int64_t next_chunk = t0;
+    int done = 0;
+
+    enter(0);
+    CHECK_INT(begin_image(0x1234567, IMAGE_SIZE), ESP_OK);
+    leave();
+
+    while (done < node_count && esp_timer_get_time() - t0 < limit_us)
+    {
+        int ev = pop_event();
+        int64_t at = ev >= 0 ? events[ev].at_us : INT64_MAX;
+
+        if (nodes[0].ota_state.state == OTA_RECEIVING && next_chunk <= at && next_chunk <= next_tick)
+        {
+            // Próximo bloco do download HTTP do root
+            host_clock_set_us(next_chunk);
+            enter(0);
+            uint16_t seq = ota.next;
+            write_next_chunk(image + (size_t)seq * MESH_OTA_CHUNK_SIZE, chunk_len(seq));
+            leave();
+            next_chunk += http_chunk_us;
+        }
+        else if (next_tick <= at)
+        {
+            host_clock_set_us(next_tick);
+            for (int i = 0; i < node_count; i++)
+            {
+                if (!nodes[i].rebooted)
+                {
+                    enter(i);
+                    nodes[i].rebooted = ota_tick();
+                    leave();
+                }
+            }
+            if (hook)
+            {
+                hook(next_tick - t0);
+            }
+            next_tick += TICK_US;
+        }
+        else
+        {
+            deliver(ev);
+        }
+
+        done = 0;
+        for (int i = 0; i < node_count; i++)
+        {
+            done += nodes[i].done_us >= 0;
+        }
+    }
+
+    int64_t last = 0;
+    for (int i = 0; i < node_count; i++)
+    {
+        if (nodes[i].done_us < 0)
+        {
+            return -1;
+        }
+        CHECK_INT(nodes[i].flash_len, IMAGE_SIZE);
+        CHECK(memcmp(nodes[i].flash, image, IMAGE_SIZE) == 0);
+        last = nodes[i].done_us - t0 > last ? nodes[i].done_us - t0 : last;
+    }
+    return last / 1000;
+}
+
+/*******************************************************
+ *                Testes
+ *******************************************************/
+
+static void test_chain_delivers_identical_image(void)
+{
+    build_tree(4, 1);
+    CHECK(run_rollout(120LL * 1000000, NULL) > 0);
+    for (int i = 0; i < node_count; i++)
+    {
+        CHECK_INT(nodes[i].begins, 1);
+    }
+}
+
+static void test_lossy_links_recover(void)
+{
+    build_tree(13, 3);
+    loss_permille = 50;
+    int64_t ms = run_rollout(600LL * 1000000, NULL);
+    CHECK(ms > 0);
+    CHECK(frames_lost > 0);
+    printf("  13 nós com 5%% de perda: %" PRId64 " ms, %" PRIu32 " de %" PRIu32 " quadros perdidos\n", ms,
+           frames_lost, frames_sent);
+}
+
+static int reconnect_node = -1;
+
+static void disconnect_hook(int64_t now_us)
+{
+    // O nó cai no meio da transferência e volta 3 s depois no mesmo pai
+    if (now_us == 1 * 1000000)
+    {
+        CHECK(nodes[reconnect_node].ota_state.next > 0);
+        CHECK(nodes[reconnect_node].ota_state.next < nodes[reconnect_node].ota_state.chunks);
+        disconnect_child(reconnect_node);
+    }
+    else if (now_us == 4 * 1000000)
+    {
+        connect_child(reconnect_node);
+    }
+}
+
+static void test_rejoin_resumes_mid_transfer(void)
+{
+    build_tree(7, 2);
+    reconnect_node = 2; // filho do root, pai dos nós 5 e 6
+    CHECK(run_rollout(300LL * 1000000, disconnect_hook) > 0);
+
+    // Retomou do bloco em que parou, sem recomeçar a gravação
+    CHECK_INT(nodes[reconnect_node].begins, 1);
+    CHECK_INT(nodes[5].begins, 1);
+}
+
+static void test_all_nodes_reboot_after_children(void)
+{
+    build_tree(5, 2);
+    CHECK(run_rollout(120LL * 1000000, NULL) > 0);
+
+    // Entregues as últimas confirmações, cada pai reinicia no tick seguinte
+    int ev;
+    while ((ev = pop_event()) >= 0)
+    {
+        deliver(ev);
+    }
+    for (int t = 0; t < 2; t++)
+    {
+        host_clock_set_us(esp_timer_get_time() + TICK_US);
+        for (int i = 0; i < node_count; i++)
+        {
+            enter(i);
+            nodes[i].rebooted |= ota_tick();
+            leave();
+        }
+    }
+    for (int i = 0; i < node_count; i++)
+    {
+        CHECK(nodes[i].rebooted);
+    }
+}
+
+/**
+ * @brief Reinício do nó com a imagem nova: a RAM se perde, o id gravado na NVS fica.
+ */
+static void reboot_node(int i)
+{
+    enter(i);
+    memset(&ota, 0, sizeof(ota));
+    memset(children, 0, sizeof(children));
+    load_installed_id();
+    leave();
+    nodes[i].rebooted = false;
+}
+
+static void test_rebooted_child_not_reflashed(void)
+{
+    int ev;
+
+    host_nvs_reset();
+    build_tree(3, 2);
+    CHECK(run_rollout(120LL * 1000000, NULL) > 0);
+    while ((ev = pop_event()) >= 0)
+    {
+        deliver(ev);
+    }
+    CHECK_INT(nodes[1].ota_state.installed_id, 0x1234567);
+
+    // O filho 1 reinicia antes do root (que espera o filho 2 também) e volta ao mesmo pai
+    disconnect_child(1);
+    reboot_node(1);
+    CHECK_INT(nodes[1].ota_state.state, OTA_IDLE);
+    CHECK_INT(nodes[0].ota_state.state, OTA_COMPLETE);
+    connect_child(1);
+    while ((ev = pop_event()) >= 0)
+    {
+        deliver(ev);
+    }
+
+    // O START da mesma imagem é confirmado sem gravar de novo
+    CHECK_INT(nodes[1].begins, 1);
+    CHECK_INT(nodes[1].ota_state.state, OTA_IDLE);
+    enter(0);
+    ota_child_t *child = find_child(nodes[1].addr.addr);
+    CHECK(child != NULL);
+    CHECK_INT(child ? child->next : 0, ota.chunks);
+    CHECK(all_children_done());
+    leave();
+
+    // Imagem diferente: grava normalmente
+    enter(0);
+    CHECK_INT(begin_image(0x7654321, IMAGE_SIZE), ESP_OK);
+    leave();
+    while ((ev = pop_event()) >= 0)
+    {
+        deliver(ev);
+    }
+    CHECK_INT(nodes[1].begins, 2);
+    CHECK_INT(nodes[1].ota_state.state, OTA_RECEIVING);
+}
+
+/*******************************************************
+ *                Tempo de rollout
+ *******************************************************/
+
+static int64_t rollout_ms(int count, int fanout)
+{
+    build_tree(count, fanout);
+    int64_t ms = run_rollout(900LL * 1000000, NULL);
+    CHECK(ms > 0);
+    return ms;
+}
+
+/**
+ * @brief Rollout com repasse em pipeline (o módulo real) contra a estimativa sem pipeline.
+ *
+ * Sem pipeline, cada camada só começa a repassar depois de gravar a imagem
+ * inteira: download no root + soma, por camada, do tempo de um pai com a
+ * imagem pronta entregá-la a todos os seus filhos (medido com o próprio
+ * módulo em uma estrela de um nível).
+ */
+static void bench_rollout(void)
+{
+    int64_t hop[7] = {0};
+    http_chunk_us = 0;
+    for (int f = 1; f <= 6; f++)
+    {
+        hop[f] = rollout_ms(f + 1, f);
+    }
+    http_chunk_us = HTTP_CHUNK_US;
+    int64_t download = (int64_t)(IMAGE_SIZE / MESH_OTA_CHUNK_SIZE) * HTTP_CHUNK_US / 1000;
+
+    printf("Rollout de %d KB (download no root: %" PRId64 " ms; um salto com a imagem pronta: %" PRId64
+           " ms para 1 filho, %" PRId64 " ms para 6):\n",
+           IMAGE_SIZE / 1024, download, hop[1], hop[6]);
+    printf("  nós  fanout  camadas  pipeline (ms)  sem pipeline (ms)\n");
+
+    static const int configs[][2] = {{2, 1}, {3, 1}, {4, 1}, {6, 1}, {8, 1}, {13, 3}, {40, 3}, {21, 4}, {43, 6}};
+    for (size_t c = 0; c < sizeof(configs) / sizeof(configs[0]); c++)
+    {
+        int count = configs[c][0], fanout = configs[c][1];
+        int64_t ms = rollout_ms(count, fanout);
+        int layers = nodes[count - 1].layer;
+
+        int64_t store_forward = download;
+        for (int l = 1; l < layers; l++)
+        {
+            int widest = 0;
+            for (int i = 0; i < count; i++)
+            {
+                int kids = 0;
+                for (int j = 0; j < count; j++)
+                {
+                    kids += nodes[j].parent == i;
+                }
+                widest = nodes[i].layer == l && kids > widest ? kids : widest;
+            }
+            store_forward += hop[widest];
+        }
+
+        printf("  %3d  %6d  %7d  %13" PRId64 "  %17" PRId64 "\n", count, fanout, layers, ms, store_forward);
+        CHECK(ms <= store_forward);
+    }
+}
+
+int main(void)
+{
+    for (size_t i = 0; i < sizeof(image); i++)
+    {
+        image[i] = (uint8_t)(esp_random() >> 24);
+    }
+    mesh_ota_init();
+
+    RUN_TEST(test_chain_delivers_identical_image);
+    RUN_TEST(test_lossy_links_recover);
+    RUN_TEST(test_rejoin_resumes_mid_transfer);
+    RUN_TEST(test_all_nodes_reboot_after_children);
+    RUN_TEST(test_rebooted_child_not_reflashed);
+    RUN_TEST(bench_rollout);
+
+    sim_reset();
+    return HOST_TEST_RESULT();
+}
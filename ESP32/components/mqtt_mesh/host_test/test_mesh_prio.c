@@ -0,0 +1,326 @@
+/**
+ * @file test_mesh_prio.c
+ * @brief Filas de recepção por classe: ordem, descarte de volume, slot tomado pelo controle, estatísticas e marca de controle.
+ *
+ * O benchmark simula a task de recepção e a rx_worker com custos de
+ * processamento fixos e mede o p99 do ping com e sem carga de relatórios,
+ * com o pong marcado como controle e sem a marca (mesma fila dos relatórios).
+ */
+
+#include "host_test.h"
+#include "../mesh_prio.c"
+
+#define CTRL_LEN (4) // padrões de CONFIG_MESH_PRIO_CTRL_QUEUE_LEN e CONFIG_MESH_PRIO_BULK_QUEUE_LEN
+#define BULK_LEN (6)
+
+static const mesh_addr_t from = {.addr = {0x24, 0x6F, 0x28, 0x00, 0x00, 0x20}};
+
+static void prio_reset(int ctrl_len, int bulk_len)
+{
+    if (slots)
+    {
+        for (int c = 0; c < MESH_PRIO_CLASSES; c++)
+        {
+            vQueueDelete(free_q[c]);
+            vQueueDelete(ready_q[c]);
+        }
+        vSemaphoreDelete(ready_sem);
+        free(slots);
+        slots = NULL;
+    }
+    memset(&stats, 0, sizeof(stats));
+    CHECK_INT(mesh_prio_init(ctrl_len, bulk_len), ESP_OK);
+}
+
+static esp_err_t submit_byte(mesh_prio_t prio, uint8_t tag)
+{
+    uint8_t frame[2] = {tag, 0};
+    return mesh_prio_submit(prio, &from, frame, sizeof(frame));
+}
+
+/**
+ * @brief Próximo quadro sem esperar; devolve o primeiro byte (ou -1) e libera o slot.
+ */
+static int next_byte(mesh_prio_t *prio)
+{
+    mesh_prio_msg_t *msg = mesh_prio_next(0, prio);
+    if (!msg)
+    {
+        return -1;
+    }
+    int b = msg->data[0];
+    mesh_prio_release(msg);
+    return b;
+}
+
+static void test_ctrl_first(void)
+{
+    mesh_prio_t prio;
+
+    prio_reset(CTRL_LEN, BULK_LEN);
+    CHECK_INT(submit_byte(MESH_PRIO_BULK, 1), ESP_OK);
+    CHECK_INT(submit_byte(MESH_PRIO_BULK, 2), ESP_OK);
+    CHECK_INT(submit_byte(MESH_PRIO_CTRL, 10), ESP_OK);
+
+    CHECK_INT(next_byte(&prio), 10);
+    CHECK_INT(prio, MESH_PRIO_CTRL);
+    CHECK_INT(next_byte(&prio), 1);
+    CHECK_INT(prio, MESH_PRIO_BULK);
+    CHECK_INT(next_byte(&prio), 2);
+    CHECK_INT(next_byte(&prio), -1);
+
+    uint8_t big[MESH_PRIO_FRAME_MAX + 1] = {0};
+    CHECK_INT(mesh_prio_submit(MESH_PRIO_BULK, &from, big, sizeof(big)), ESP_ERR_INVALID_ARG);
+}
+
+static void test_bulk_shed_when_full(void)
+{
+    mesh_prio_stats_t s;
+
+    prio_reset(CTRL_LEN, BULK_LEN);
+    for (int i = 0; i < BULK_LEN; i++)
+    {
+        CHECK_INT(submit_byte(MESH_PRIO_BULK, i), ESP_OK);
+    }
+    // Volume nunca toma slot de controle
+    CHECK_INT(submit_byte(MESH_PRIO_BULK, 99), ESP_ERR_NO_MEM);
+
+    mesh_prio_get_stats(&s, false);
+    CHECK_INT(s.queued[MESH_PRIO_BULK], BULK_LEN);
+    CHECK_INT(s.shed[MESH_PRIO_BULK], 1);
+    CHECK_INT(s.shed[MESH_PRIO_CTRL], 0);
+
+    // Os que entraram saem na ordem
+    for (int i = 0; i < BULK_LEN; i++)
+    {
+        CHECK_INT(next_byte(NULL), i);
+    }
+}
+
+static void test_ctrl_steals_bulk_slot(void)
+{
+    mesh_prio_stats_t s;
+    mesh_prio_t prio;
+
+    prio_reset(2, 3);
+    CHECK_INT(submit_byte(MESH_PRIO_CTRL, 10), ESP_OK);
+    CHECK_INT(submit_byte(MESH_PRIO_CTRL, 11), ESP_OK);
+
+    // Controle sem slot próprio: usa um de volume livre, sem descartar nada
+    CHECK_INT(submit_byte(MESH_PRIO_CTRL, 12), ESP_OK);
+    mesh_prio_get_stats(&s, false);
+    CHECK_INT(s.shed[MESH_PRIO_BULK], 0);
+
+    CHECK_INT(submit_byte(MESH_PRIO_BULK, 1), ESP_OK);
+    CHECK_INT(submit_byte(MESH_PRIO_BULK, 2), ESP_OK);
+    CHECK_INT(submit_byte(MESH_PRIO_BULK, 3), ESP_ERR_NO_MEM);
+
+    // Nenhum slot livre: o volume mais antigo (1) cede o seu
+    CHECK_INT(submit_byte(MESH_PRIO_CTRL, 13), ESP_OK);
+    mesh_prio_get_stats(&s, false);
+    CHECK_INT(s.shed[MESH_PRIO_BULK], 2);
+
+    // Só controle na fila de volume: nada mais a tomar, o controle é descartado
+    CHECK_INT(next_byte(NULL), 10);
+    CHECK_INT(next_byte(NULL), 11);
+    CHECK_INT(next_byte(NULL), 12);
+    CHECK_INT(next_byte(&prio), 13);
+    CHECK_INT(prio, MESH_PRIO_CTRL);
+    CHECK_INT(next_byte(NULL), 2);
+    CHECK_INT(next_byte(NULL), -1);
+
+    // Cada slot voltou à classe de origem: 2 de controle e 3 de volume de novo
+    for (int i = 0; i < 2; i++)
+    {
+        CHECK_INT(submit_byte(MESH_PRIO_CTRL, 20 + i), ESP_OK);
+    }
+    for (int i = 0; i < 3; i++)
+    {
+        CHECK_INT(submit_byte(MESH_PRIO_BULK, 30 + i), ESP_OK);
+    }
+    CHECK_INT(submit_byte(MESH_PRIO_BULK, 40), ESP_ERR_NO_MEM);
+
+    // Volume todo ocupado por controle: o próximo controle não tem de onde tirar
+    prio_reset(1, 1);
+    CHECK_INT(submit_byte(MESH_PRIO_CTRL, 1), ESP_OK);
+    CHECK_INT(submit_byte(MESH_PRIO_CTRL, 2), ESP_OK);
+    CHECK_INT(submit_byte(MESH_PRIO_CTRL, 3), ESP_ERR_NO_MEM);
+    mesh_prio_get_stats(&s, false);
+    CHECK_INT(s.shed[MESH_PRIO_CTRL], 1);
+}
+
+static void test_stats_reset(void)
+{
+    mesh_prio_stats_t s;
+
+    prio_reset(1, 1);
+    CHECK_INT(submit_byte(MESH_PRIO_BULK, 1), ESP_OK);
+    CHECK_INT(submit_byte(MESH_PRIO_BULK, 2), ESP_ERR_NO_MEM);
+    host_clock_advance_ms(25);
+    CHECK_INT(next_byte(NULL), 1);
+
+    mesh_prio_get_stats(&s, true);
+    CHECK_INT(s.shed[MESH_PRIO_BULK], 1);
+    CHECK_INT(s.max_wait_ms[MESH_PRIO_BULK], 25);
+
+    // Descartes e espera são por relatório; os enfileirados seguem acumulando
+    mesh_prio_get_stats(&s, true);
+    CHECK_INT(s.shed[MESH_PRIO_BULK], 0);
+    CHECK_INT(s.max_wait_ms[MESH_PRIO_BULK], 0);
+    CHECK_INT(s.queued[MESH_PRIO_BULK], 1);
+}
+
+static void test_ctrl_magic(void)
+{
+    static const uint8_t pong[] = "\xAB{\"type\":\"pong\",\"mac\":\"24:6F:28:00:00:20\"}";
+    static const uint8_t report[] = "{\"mac\":\"24:6F:28:00:00:20\",\"hops\":2}";
+    // Pong sem marca (o antigo strstr): é só mais um JSON
+    static const uint8_t bare_pong[] = "{\"mac\":\"24:6F:28:00:00:20\", \"type\": \"pong\"}";
+    static const uint8_t others[] = {0xA7, 0xA8, 0xA9, 0xAA};
+
+    CHECK(mesh_prio_is_ctrl_frame(pong, sizeof(pong)));
+    CHECK(pong[1] == '{');
+    CHECK(!mesh_prio_is_ctrl_frame(report, sizeof(report)));
+    CHECK(!mesh_prio_is_ctrl_frame(bare_pong, sizeof(bare_pong)));
+    CHECK(!mesh_prio_is_ctrl_frame(pong, 0));
+    for (size_t i = 0; i < sizeof(others); i++)
+    {
+        CHECK(!mesh_prio_is_ctrl_frame(&others[i], 1));
+    }
+}
+
+/* --- p99 do ping com e sem carga --- */
+
+#define SIM_MS (60000)
+#define PING_EVERY_MS (100)
+#define CTRL_COST_MS (1) // pong: parse e publicação direta
+#define BULK_COST_MS (8) // relatório: parse, cache de topologia e outbox MQTT
+
+#define PING_TAG (0xAB)
+#define REPORT_TAG ('{')
+
+typedef struct {
+    int64_t p99_ms;
+    int64_t max_ms;
+    int lost;
+    int reports_shed;
+} ping_result_t;
+
+static int cmp_i64(const void *a, const void *b)
+{
+    int64_t x = *(const int64_t *)a, y = *(const int64_t *)b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * @param reports_per_s Relatórios chegando ao root por segundo (chegadas pseudoaleatórias).
+ * @param tagged Pong marcado (fila de controle) ou não (mesma fila dos relatórios).
+ */
+static ping_result_t run_ping(int reports_per_s, bool tagged)
+{
+    static int64_t lat[SIM_MS / PING_EVERY_MS];
+    int n = 0, sent = 0;
+    int64_t busy_until = 0;
+    uint32_t seed = 7;
+    mesh_prio_stats_t s;
+    ping_result_t r = {0};
+
+    prio_reset(CTRL_LEN, BULK_LEN);
+    int64_t t0 = host_clock_us() / 1000;
+
+    for (int t = 0; t < SIM_MS; t++)
+    {
+        int64_t now = t0 + t;
+
+        // Recepção: relatórios (taxa média reports_per_s) e um ping a cada PING_EVERY_MS
+        seed = seed * 1103515245 + 12345;
+        if ((int)((seed >> 8) % 1000) < reports_per_s)
+        {
+            submit_byte(MESH_PRIO_BULK, REPORT_TAG);
+        }
+        if (t % PING_EVERY_MS == 0)
+        {
+            uint8_t frame[sizeof(int64_t) + 1] = {PING_TAG};
+            memcpy(frame + 1, &now, sizeof(now));
+            sent++;
+            mesh_prio_submit(tagged ? MESH_PRIO_CTRL : MESH_PRIO_BULK, &from, frame, sizeof(frame));
+        }
+
+        // rx_worker: um quadro por vez, com o custo da sua classe
+        while (now >= busy_until)
+        {
+            mesh_prio_msg_t *msg = mesh_prio_next(0, NULL);
+            if (!msg)
+            {
+                break;
+            }
+            if (msg->data[0] == PING_TAG)
+            {
+                int64_t rx_ms;
+                memcpy(&rx_ms, msg->data + 1, sizeof(rx_ms));
+                busy_until = now + CTRL_COST_MS;
+                lat[n++] = busy_until - rx_ms;
+            }
+            else
+            {
+                busy_until = now + BULK_COST_MS;
+            }
+            mesh_prio_release(msg);
+        }
+        host_clock_advance_ms(1);
+    }
+
+    qsort(lat, n, sizeof(lat[0]), cmp_i64);
+    r.p99_ms = n ? lat[n * 99 / 100] : -1;
+    r.max_ms = n ? lat[n - 1] : -1;
+    r.lost = sent - n;
+    mesh_prio_get_stats(&s, true);
+    r.reports_shed = s.shed[MESH_PRIO_BULK];
+    return r;
+}
+
+static void bench_ping_p99(void)
+{
+    static const int loads[] = {0, 60, 100, 200};
+    ping_result_t res[4][2];
+
+    printf("\nping no root: p99 / máx. (perdidos) com relatórios chegando; controle %d ms, relatório %d ms\n",
+           CTRL_COST_MS, BULK_COST_MS);
+    printf("  %-14s %-26s %-26s %s\n", "relatórios/s", "pong sem marca", "pong marcado (0xAB)", "relatórios descartados");
+    for (int l = 0; l < 4; l++)
+    {
+        char cols[2][32];
+        for (int m = 0; m < 2; m++)
+        {
+            res[l][m] = run_ping(loads[l], m == 1);
+            snprintf(cols[m], sizeof(cols[m]), "%lld / %lld ms (%d)", (long long)res[l][m].p99_ms,
+                     (long long)res[l][m].max_ms, res[l][m].lost);
+        }
+        printf("  %-14d %-26s %-26s %d\n", loads[l], cols[0], cols[1], res[l][1].reports_shed);
+    }
+    printf("\n");
+
+    // Sem carga, iguais; com carga, o pong marcado só espera o relatório em andamento
+    CHECK_INT(res[0][0].p99_ms, CTRL_COST_MS);
+    CHECK_INT(res[0][1].p99_ms, CTRL_COST_MS);
+    for (int l = 1; l < 4; l++)
+    {
+        CHECK(res[l][1].max_ms <= BULK_COST_MS + CTRL_COST_MS);
+        CHECK_INT(res[l][1].lost, 0);
+        CHECK(res[l][0].p99_ms > res[l][1].p99_ms);
+    }
+    // Sobrecarga: sem a marca o pong disputa slot com os relatórios e se perde
+    CHECK(res[3][0].lost > 0);
+    CHECK(res[3][1].reports_shed > 0);
+}
+
+int main(void)
+{
+    RUN_TEST(test_ctrl_first);
+    RUN_TEST(test_bulk_shed_when_full);
+    RUN_TEST(test_ctrl_steals_bulk_slot);
+    RUN_TEST(test_stats_reset);
+    RUN_TEST(test_ctrl_magic);
+    RUN_TEST(bench_ping_p99);
+    return HOST_TEST_RESULT();
+}
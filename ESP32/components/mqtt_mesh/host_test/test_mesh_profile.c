@@ -0,0 +1,175 @@
+/**
+ * @file test_mesh_profile.c
+ * @brief Coleta de CPU por task com os contadores de run-time do FreeRTOS simulados, e o JSON do perfil.
+ *
+ * O dublê soma a cada task, a cada vTaskDelay, a sua fração do tempo em cada
+ * um dos portNUM_PROCESSORS núcleos, como no FreeRTOS SMP do ESP-IDF.
+ */
+
+#include "host_test.h"
+#include "cJSON.h"
+#include "esp_heap_caps.h"
+#include "freertos/task.h"
+#include "mesh_profile.h"
+#include <string.h>
+
+static struct host_task *handle(int i)
+{
+    return (struct host_task *)(uintptr_t)(i + 1);
+}
+
+static void set_tasks(void)
+{
+    static const char *const names[] = {"mesh_report", "IDLE0", "a_very_long_task_name_here", "mqtt_task"};
+    static const uint16_t load[] = {250, 600, 0, 75};
+    TaskStatus_t tasks[4] = {0};
+
+    for (int i = 0; i < 4; i++)
+    {
+        tasks[i].xHandle = handle(i);
+        tasks[i].pcTaskName = names[i];
+        tasks[i].uxCurrentPriority = 5 - i;
+        tasks[i].usStackHighWaterMark = 1000 + 100 * i;
+        // Contadores já andando desde o boot: só a diferença na janela conta
+        tasks[i].ulRunTimeCounter = 123456 * (i + 1);
+    }
+    host_tasks_set(tasks, load, 4);
+}
+
+static void test_collect_cpu_per_task(void)
+{
+    mesh_profile_t p;
+
+    set_tasks();
+    int64_t t0 = host_clock_us();
+    CHECK_INT(mesh_profile_collect(2000, &p), ESP_OK);
+
+    CHECK_INT(host_clock_us() - t0, 2000 * 1000);
+    CHECK_INT(p.window_ms, 2000);
+    CHECK_INT(p.task_count, 4);
+
+    // Frações da CPU inteira (todos os núcleos), não de um núcleo só
+    CHECK_STR(p.tasks[0].name, "mesh_report");
+    CHECK_INT(p.tasks[0].cpu_permille, 250);
+    CHECK_INT(p.tasks[1].cpu_permille, 600);
+    CHECK_INT(p.tasks[2].cpu_permille, 0);
+    CHECK_INT(p.tasks[3].cpu_permille, 75);
+    int sum = 0;
+    for (int i = 0; i < p.task_count; i++)
+    {
+        sum += p.tasks[i].cpu_permille;
+    }
+    CHECK(sum <= 1000);
+
+    CHECK_INT(strlen(p.tasks[2].name), MESH_PROFILE_NAME_LEN - 1);
+    CHECK_INT(p.tasks[1].priority, 4);
+    CHECK_INT(p.tasks[3].stack_free, 1300);
+
+    CHECK_INT(p.heap_free, host_heap_free);
+    CHECK_INT(p.heap_min_free, host_heap_min_free);
+    CHECK_INT(p.heap_largest, host_heap_largest);
+}
+
+static void test_collect_counts_cjson(void)
+{
+    mesh_profile_t p;
+
+    mesh_profile_init();
+    cJSON *leak = cJSON_CreateObject();
+    cJSON_AddStringToObject(leak, "k", "v");
+
+    CHECK_INT(mesh_profile_collect(10, &p), ESP_OK);
+    CHECK_INT(p.cjson_live, 4); // objeto, item, valor e chave
+    CHECK_INT(p.cjson_allocs, 0); // nada alocado dentro da janela
+
+    cJSON_Delete(leak);
+    CHECK_INT(mesh_profile_collect(10, &p), ESP_OK);
+    CHECK_INT(p.cjson_live, 0);
+}
+
+static void test_collect_without_tasks(void)
+{
+    mesh_profile_t p;
+
+    host_tasks_set(NULL, NULL, 0);
+    CHECK_INT(mesh_profile_collect(100, &p), ESP_OK);
+    CHECK_INT(p.task_count, 0);
+}
+
+static void test_to_json(void)
+{
+    mesh_profile_t p = {
+        .window_ms = 5000,
+        .heap_free = 1234,
+        .cjson_allocs = 7,
+        .cjson_live = -1,
+        .task_count = 2,
+        .tasks = {{"mesh_report", 5, 125, 800}, {"no_stats", 1, -1, 900}},
+    };
+
+    char *str = mesh_profile_to_json(&p, "24:6F:28:00:00:11", 1024);
+    CHECK(str != NULL);
+    cJSON *json = cJSON_Parse(str);
+    CHECK(json != NULL);
+
+    CHECK_STR(cJSON_GetObjectItem(json, "type")->valuestring, "profile");
+    CHECK_STR(cJSON_GetObjectItem(json, "mac")->valuestring, "24:6F:28:00:00:11");
+    CHECK_INT(cJSON_GetObjectItem(json, "window_ms")->valueint, 5000);
+    CHECK_INT(cJSON_GetObjectItem(cJSON_GetObjectItem(json, "heap"), "free")->valueint, 1234);
+    CHECK_INT(cJSON_GetObjectItem(cJSON_GetObjectItem(json, "cjson"), "live")->valueint, -1);
+
+    cJSON *tasks = cJSON_GetObjectItem(json, "tasks");
+    CHECK_INT(cJSON_GetArraySize(tasks), 2);
+    CHECK(cJSON_GetObjectItem(cJSON_GetArrayItem(tasks, 0), "cpu")->valuedouble == 12.5);
+    CHECK_INT(cJSON_GetObjectItem(cJSON_GetArrayItem(tasks, 1), "cpu")->valueint, -1);
+    CHECK(cJSON_GetObjectItem(json, "tasks_omitted") == NULL);
+
+    cJSON_Delete(json);
+    cJSON_free(str);
+}
+
+static void test_to_json_drops_tasks_to_fit(void)
+{
+    mesh_profile_t p = {.window_ms = 1000, .task_count = MESH_PROFILE_MAX_TASKS};
+    for (int i = 0; i < p.task_count; i++)
+    {
+        snprintf(p.tasks[i].name, sizeof(p.tasks[i].name), "task_%02d", i);
+        p.tasks[i].cpu_permille = 10 * i;
+    }
+
+    char *full = mesh_profile_to_json(&p, "mac", 4096);
+    size_t full_len = strlen(full);
+    cJSON_free(full);
+
+    // Limite no meio: só tasks do fim saem, e o JSON fica abaixo do limite
+    size_t max_len = full_len / 2;
+    char *str = mesh_profile_to_json(&p, "mac", max_len);
+    CHECK(strlen(str) < max_len);
+    cJSON *json = cJSON_Parse(str);
+    int kept = cJSON_GetArraySize(cJSON_GetObjectItem(json, "tasks"));
+    CHECK(kept > 0 && kept < p.task_count);
+    CHECK_INT(cJSON_GetObjectItem(json, "tasks_omitted")->valueint, p.task_count - kept);
+    CHECK_STR(cJSON_GetObjectItem(cJSON_GetArrayItem(cJSON_GetObjectItem(json, "tasks"), 0), "name")->valuestring,
+              "task_00");
+    cJSON_Delete(json);
+    cJSON_free(str);
+
+    // Nem o cabeçalho cabe: sai sem tasks mesmo assim
+    str = mesh_profile_to_json(&p, "mac", 16);
+    CHECK(str != NULL);
+    json = cJSON_Parse(str);
+    CHECK_INT(cJSON_GetArraySize(cJSON_GetObjectItem(json, "tasks")), 0);
+    CHECK_INT(cJSON_GetObjectItem(json, "tasks_omitted")->valueint, p.task_count);
+    cJSON_Delete(json);
+    cJSON_free(str);
+}
+
+int main(void)
+{
+    RUN_TEST(test_collect_cpu_per_task);
+    RUN_TEST(test_collect_counts_cjson);
+    RUN_TEST(test_collect_without_tasks);
+    RUN_TEST(test_to_json);
+    RUN_TEST(test_to_json_drops_tasks_to_fit);
+    return HOST_TEST_RESULT();
+}
@@ -0,0 +1,328 @@
+/**
+ * @file test_mesh_ps.c
+ * @brief Comandos retidos para filhos em PS (entrega, fila cheia, aviso de duty, expiração) e rádio ligado.
+ *
+ * O benchmark simula um filho em PS que abre a janela de atividade a cada
+ * relatório e compara, para vários intervalos, o rádio ligado do filho com a
+ * latência dos comandos retidos no pai até a janela seguinte.
+ */
+
+#include "host_test.h"
+#include "../mesh_ps.c"
+
+#define HOLD_MAX (8)
+#define HOLD_TIMEOUT_MS (60000)
+#define DUTY (10)
+#define WINDOW_MS (500) // padrão de CONFIG_MESH_PS_LISTEN_WINDOW_MS
+
+static const mesh_addr_t child_a = {.addr = {0x24, 0x6F, 0x28, 0x00, 0x00, 0x20}};
+static const mesh_addr_t child_b = {.addr = {0x24, 0x6F, 0x28, 0x00, 0x00, 0x30}};
+
+static int sent_to(const mesh_addr_t *to)
+{
+    int n = 0;
+    for (int i = 0; i < host_mesh_sent_count; i++)
+    {
+        n += memcmp(host_mesh_sent[i].to.addr, to->addr, 6) == 0;
+    }
+    return n;
+}
+
+static void reset(void)
+{
+    host_mesh_reset();
+    host_mesh_ps = true;
+    host_mesh_duty = DUTY;
+    CHECK_INT(mesh_ps_init(DUTY, MESH_PS_DEVICE_DUTY_REQUEST, HOLD_MAX, HOLD_TIMEOUT_MS), ESP_OK);
+    memset(held, 0, held_max * sizeof(held_frame_t));
+    for (int i = 0; i < MESH_PS_MAX_CHILDREN; i++)
+    {
+        children[i].duty = MESH_PS_DUTY_UNKNOWN;
+        children[i].woken = false;
+    }
+}
+
+static void test_release_only_that_child(void)
+{
+    static const uint8_t frame_a[] = {0xA9, 1, 2, 3};
+    static const uint8_t frame_b[] = {0xA9, 4, 5};
+
+    reset();
+    CHECK_INT(mesh_ps_hold(&child_a, frame_a, sizeof(frame_a)), ESP_OK);
+    CHECK_INT(mesh_ps_hold(&child_b, frame_b, sizeof(frame_b)), ESP_OK);
+    CHECK_INT(host_mesh_sent_count, 0);
+
+    CHECK_INT(mesh_ps_release(&child_a), 1);
+    CHECK_INT(host_mesh_sent_count, 1);
+    CHECK_INT(host_mesh_sent[0].size, sizeof(frame_a));
+    CHECK(memcmp(host_mesh_sent[0].data, frame_a, sizeof(frame_a)) == 0);
+    CHECK_INT(host_mesh_sent[0].flag, MESH_DATA_P2P);
+
+    // Já entregue: não sai de novo
+    CHECK_INT(mesh_ps_release(&child_a), 0);
+    CHECK_INT(mesh_ps_release(&child_b), 1);
+    CHECK_INT(sent_to(&child_b), 1);
+}
+
+static void test_hold_limits(void)
+{
+    uint8_t frame[MESH_PS_FRAME_MAX + 1] = {0xA9};
+
+    reset();
+    CHECK_INT(mesh_ps_hold(&child_a, frame, sizeof(frame)), ESP_ERR_INVALID_ARG);
+    for (int i = 0; i < HOLD_MAX; i++)
+    {
+        CHECK_INT(mesh_ps_hold(&child_a, frame, 16), ESP_OK);
+    }
+    // Fila cheia: o chamador envia direto
+    CHECK_INT(mesh_ps_hold(&child_a, frame, 16), ESP_ERR_NO_MEM);
+    CHECK_INT(mesh_ps_release(&child_a), HOLD_MAX);
+    CHECK_INT(mesh_ps_hold(&child_a, frame, 16), ESP_OK);
+}
+
+static void test_release_on_child_duty_event(void)
+{
+    static const uint8_t frame[] = {0xA9, 7};
+
+    reset();
+    mesh_ps_set_child_duty(child_a.addr, DUTY);
+    CHECK_INT(mesh_ps_child_duty(child_a.addr), DUTY);
+    CHECK_INT(mesh_ps_hold(&child_a, frame, sizeof(frame)), ESP_OK);
+    CHECK_INT(mesh_ps_hold(&child_b, frame, sizeof(frame)), ESP_OK);
+
+    // Duty baixo não é sinal de que acordou
+    CHECK_INT(mesh_ps_release_woken(), 0);
+
+    mesh_ps_set_child_duty(child_a.addr, 100);
+    CHECK_INT(mesh_ps_release_woken(), 1);
+    CHECK_INT(sent_to(&child_a), 1);
+    CHECK_INT(sent_to(&child_b), 0);
+
+    // O aviso vale uma vez: um quadro retido depois espera o próximo
+    CHECK_INT(mesh_ps_hold(&child_a, frame, sizeof(frame)), ESP_OK);
+    CHECK_INT(mesh_ps_release_woken(), 0);
+    mesh_ps_set_child_duty(child_a.addr, DUTY);
+    mesh_ps_set_child_duty(child_a.addr, 100);
+    CHECK_INT(mesh_ps_release_woken(), 1);
+}
+
+static void test_child_slot_freed_on_disconnect(void)
+{
+    static const uint8_t frame[] = {0xA9, 8};
+    mesh_addr_t child = {.addr = {0x24, 0x6F, 0x28, 0x00, 0x01, 0x00}};
+
+    reset();
+    // Mais filhos do que posições, entrando e saindo um de cada vez ao longo do tempo
+    for (int i = 0; i < 3 * MESH_PS_MAX_CHILDREN; i++)
+    {
+        child.addr[5] = (uint8_t)i;
+        mesh_ps_set_child_duty(child.addr, DUTY);
+        CHECK_INT(mesh_ps_child_duty(child.addr), DUTY);
+        mesh_ps_child_disconnected(child.addr);
+        CHECK_INT(mesh_ps_child_duty(child.addr), MESH_PS_DUTY_UNKNOWN);
+    }
+
+    // Tabela cheia de filhos conectados: a saída de um abre vaga para o próximo
+    for (int i = 0; i < MESH_PS_MAX_CHILDREN; i++)
+    {
+        child.addr[5] = (uint8_t)i;
+        mesh_ps_set_child_duty(child.addr, DUTY);
+    }
+    child.addr[5] = MESH_PS_MAX_CHILDREN;
+    mesh_ps_set_child_duty(child.addr, DUTY);
+    CHECK_INT(mesh_ps_child_duty(child.addr), MESH_PS_DUTY_UNKNOWN);
+
+    child.addr[5] = 3;
+    mesh_ps_set_child_duty(child.addr, 100); // acordou e saiu antes da entrega
+    mesh_ps_child_disconnected(child.addr);
+    child.addr[5] = MESH_PS_MAX_CHILDREN;
+    mesh_ps_set_child_duty(child.addr, DUTY);
+    CHECK_INT(mesh_ps_child_duty(child.addr), DUTY);
+
+    // O aviso de duty 100% do filho que saiu não entrega nada a ninguém
+    child.addr[5] = 3;
+    CHECK_INT(mesh_ps_hold(&child, frame, sizeof(frame)), ESP_OK);
+    CHECK_INT(mesh_ps_release_woken(), 0);
+    CHECK_INT(host_mesh_sent_count, 0);
+}
+
+static esp_err_t fail_send(const mesh_addr_t *to, const uint8_t *data, uint16_t size, int flag)
+{
+    return ESP_ERR_MESH_NO_ROUTE_FOUND;
+}
+
+static void test_release_expired(void)
+{
+    static const uint8_t frame[] = {0xA9, 9};
+
+    reset();
+    CHECK_INT(mesh_ps_hold(&child_a, frame, sizeof(frame)), ESP_OK);
+    host_clock_advance_ms(HOLD_TIMEOUT_MS / 2);
+    CHECK_INT(mesh_ps_hold(&child_b, frame, sizeof(frame)), ESP_OK);
+
+    CHECK_INT(mesh_ps_release_expired(), 0);
+    host_clock_advance_ms(HOLD_TIMEOUT_MS / 2 + 1);
+    CHECK_INT(mesh_ps_release_expired(), 1);
+    CHECK_INT(sent_to(&child_a), 1);
+
+    // Falha no envio direto: o quadro é descartado, não fica preso na fila
+    host_mesh_send_hook = fail_send;
+    host_clock_advance_ms(HOLD_TIMEOUT_MS);
+    CHECK_INT(mesh_ps_release_expired(), 0);
+    host_mesh_send_hook = NULL;
+    CHECK_INT(mesh_ps_release(&child_b), 0);
+}
+
+static void test_radio_on_estimate(void)
+{
+    reset();
+    uint32_t start = mesh_ps_radio_on_ms();
+
+    // 10 s a 10% e uma janela de 1 s a 100%
+    host_clock_advance_ms(10000);
+    mesh_ps_awake_begin();
+    CHECK_INT(host_mesh_duty, 100);
+    host_clock_advance_ms(1000);
+    mesh_ps_awake_end();
+    CHECK_INT(host_mesh_duty, DUTY);
+    CHECK_INT(mesh_ps_radio_on_ms() - start, 1000 + 1000);
+}
+
+/* --- Latência x energia --- */
+
+typedef struct {
+    int64_t arrived_ms;
+    uint8_t pad[8];
+} bench_frame_t;
+
+static int64_t latencies[4096];
+static int latency_count;
+
+static esp_err_t record_latency(const mesh_addr_t *to, const uint8_t *data, uint16_t size, int flag)
+{
+    bench_frame_t f;
+    memcpy(&f, data, sizeof(f));
+    if (latency_count < (int)(sizeof(latencies) / sizeof(latencies[0])))
+    {
+        latencies[latency_count++] = host_clock_us() / 1000 - f.arrived_ms;
+    }
+    return ESP_OK;
+}
+
+static int cmp_i64(const void *a, const void *b)
+{
+    int64_t x = *(const int64_t *)a, y = *(const int64_t *)b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * @brief Filho em PS com janela a cada interval_ms; comandos chegam ao pai em instantes pseudoaleatórios.
+ *
+ * O pai retém cada comando e o entrega quando o filho avisa duty de 100% (abre a janela),
+ * como a upstream_drain_task faz a cada CONFIG_MESH_UPBUF_DRAIN_INTERVAL_MS (100 ms).
+ */
+static void run_ps(int interval_ms, int *radio_pct, int64_t *avg_ms, int64_t *p99_ms)
+{
+    const int rounds = 200;
+    const int step_ms = 100;
+    int64_t sum = 0;
+
+    reset();
+    host_mesh_send_hook = record_latency;
+    latency_count = 0;
+
+    uint32_t on_start = mesh_ps_radio_on_ms();
+    int64_t t0 = host_clock_us() / 1000;
+    uint32_t seed = 12345;
+
+    for (int r = 0; r < rounds; r++)
+    {
+        for (int t = 0; t < interval_ms; t += step_ms)
+        {
+            bool window = t < WINDOW_MS;
+            if (t == 0)
+            {
+                mesh_ps_awake_begin();
+                mesh_ps_set_child_duty(child_a.addr, 100);
+            }
+            else if (t == WINDOW_MS)
+            {
+                mesh_ps_awake_end();
+                mesh_ps_set_child_duty(child_a.addr, DUTY);
+            }
+
+            // Em média 2 comandos por intervalo
+            seed = seed * 1103515245 + 12345;
+            if ((seed >> 16) % (interval_ms / step_ms) < 2)
+            {
+                bench_frame_t f = {.arrived_ms = host_clock_us() / 1000};
+                if (window)
+                {
+                    record_latency(&child_a, (const uint8_t *)&f, sizeof(f), MESH_DATA_P2P);
+                }
+                else
+                {
+                    CHECK_INT(mesh_ps_hold(&child_a, (const uint8_t *)&f, sizeof(f)), ESP_OK);
+                }
+            }
+
+            mesh_ps_release_woken();
+            mesh_ps_release_expired();
+            host_clock_advance_ms(step_ms);
+        }
+    }
+    mesh_ps_awake_end();
+    host_mesh_send_hook = NULL;
+
+    int64_t elapsed = host_clock_us() / 1000 - t0;
+    *radio_pct = (int)((int64_t)(mesh_ps_radio_on_ms() - on_start) * 100 / elapsed);
+
+    qsort(latencies, latency_count, sizeof(latencies[0]), cmp_i64);
+    for (int i = 0; i < latency_count; i++)
+    {
+        sum += latencies[i];
+    }
+    *avg_ms = latency_count ? sum / latency_count : 0;
+    *p99_ms = latency_count ? latencies[latency_count * 99 / 100] : 0;
+}
+
+static void bench_latency_vs_energy(void)
+{
+    static const int intervals[] = {1000, 2000, 5000, 10000, 30000};
+    int prev_pct = 101;
+    int64_t prev_p99 = -1;
+
+    printf("\nPS: duty %d%%, janela %d ms por relatório, comandos retidos até a janela seguinte\n", DUTY, WINDOW_MS);
+    printf("  %-12s %10s %14s %14s\n", "intervalo", "rádio", "latência média", "latência p99");
+    printf("  %-12s %9d%% %11d ms %11d ms\n", "sem PS", 100, 0, 0);
+    for (size_t i = 0; i < sizeof(intervals) / sizeof(intervals[0]); i++)
+    {
+        int pct;
+        int64_t avg, p99;
+        run_ps(intervals[i], &pct, &avg, &p99);
+        printf("  %9d ms %9d%% %11lld ms %11lld ms\n", intervals[i], pct, (long long)avg, (long long)p99);
+
+        // Rádio esperado: janela a 100% e o resto do intervalo no duty
+        int expected = (WINDOW_MS * 100 + (intervals[i] - WINDOW_MS) * DUTY) / intervals[i];
+        CHECK(pct >= expected - 1 && pct <= expected + 1);
+        // Mais economia, mais espera: nenhum comando espera mais que um intervalo
+        CHECK(pct < prev_pct);
+        CHECK(p99 > prev_p99);
+        CHECK(p99 <= intervals[i]);
+        prev_pct = pct;
+        prev_p99 = p99;
+    }
+    printf("\n");
+}
+
+int main(void)
+{
+    RUN_TEST(test_release_only_that_child);
+    RUN_TEST(test_hold_limits);
+    RUN_TEST(test_release_on_child_duty_event);
+    RUN_TEST(test_child_slot_freed_on_disconnect);
+    RUN_TEST(test_release_expired);
+    RUN_TEST(test_radio_on_estimate);
+    RUN_TEST(bench_latency_vs_energy);
+    return HOST_TEST_RESULT();
+}
@@ -0,0 +1,360 @@
+/**
+ * @file test_mesh_topo.c
+ * @brief Cache de topologia: capacidade e descartes, foreach fora do lock, sincronização e troca de root.
+ *
+ * O cenário de failover roda dois caches (root antigo e reserva) trocando o
+ * estado estático do módulo, e mede quanto tempo depois da queda do root o
+ * broker volta a ter a topologia inteira, com e sem o reserva.
+ */
+
+#include "host_test.h"
+#include "../mesh_topo.c"
+
+#define REPORT_INTERVAL_MS (10000)
+#define SYNC_INTERVALS (3)  // padrão de CONFIG_MESH_STANDBY_SYNC_INTERVALS
+#define ELECTION_MS (3000)  // queda do root até o reserva ser eleito (observado no alvo: 2-4 s)
+#define CONNECT_MS (1500)   // DHCP + conexão MQTT com a URI já resolvida
+#define PUBLISH_MS (4)      // custo de cada publicação na republicação
+#define TICK_MS (10)
+
+typedef struct {
+    topo_entry_t *entries;
+    int entry_cap;
+    uint32_t evicted;
+    SemaphoreHandle_t topo_lock;
+} topo_ctx_t;
+
+static void ctx_save(topo_ctx_t *ctx)
+{
+    ctx->entries = entries;
+    ctx->entry_cap = entry_cap;
+    ctx->evicted = evicted;
+    ctx->topo_lock = topo_lock;
+}
+
+static void ctx_load(const topo_ctx_t *ctx)
+{
+    entries = ctx->entries;
+    entry_cap = ctx->entry_cap;
+    evicted = ctx->evicted;
+    topo_lock = ctx->topo_lock;
+}
+
+static void ctx_new(topo_ctx_t *ctx, int cap)
+{
+    topo_ctx_t none = {0};
+    ctx_load(&none);
+    CHECK_INT(mesh_topo_init(cap), ESP_OK);
+    ctx_save(ctx);
+}
+
+static void ctx_free(topo_ctx_t *ctx)
+{
+    for (int i = 0; i < ctx->entry_cap; i++)
+    {
+        free(ctx->entries[i].report);
+    }
+    free(ctx->entries);
+    vSemaphoreDelete(ctx->topo_lock);
+    topo_ctx_t none = {0};
+    ctx_load(&none);
+}
+
+static int node_layer(int i)
+{
+    return i < 4 ? 2 : 3 + i % 3;
+}
+
+static void node_mac(int i, char out[18])
+{
+    snprintf(out, 18, "24:6F:28:00:%02X:%02X", i >> 8, i & 0xFF);
+}
+
+static void report(int i, int rssi)
+{
+    char mac[18], parent[18], buf[256];
+    node_mac(i, mac);
+    node_mac(node_layer(i) == 2 ? 999 : i % 4, parent);
+    int len = snprintf(buf, sizeof(buf),
+                       "{\"mac\":\"%s\",\"parent\":\"%s\",\"hops\":%d,\"rssi\":%d,\"nc\":0,\"children\":[],"
+                       "\"free_heap\":123456,\"max_ch\":6}",
+                       mac, parent, node_layer(i), rssi);
+    mesh_topo_update(buf, len);
+}
+
+static void test_capacity_and_eviction(void)
+{
+    topo_ctx_t ctx;
+    ctx_new(&ctx, 8);
+    CHECK_INT(mesh_topo_capacity(), 8);
+
+    for (int i = 0; i < 8; i++)
+    {
+        report(i, -50);
+        host_clock_advance_ms(1);
+    }
+    CHECK_INT(mesh_topo_evicted(), 0);
+
+    // Nono nó: o mais antigo (0) sai, e o descarte é contado
+    report(8, -50);
+    CHECK_INT(mesh_topo_evicted(), 1);
+    mesh_topo_node_t n;
+    char mac[18];
+    node_mac(0, mac);
+    CHECK(!mesh_topo_lookup(mac, &n));
+    node_mac(8, mac);
+    CHECK(mesh_topo_lookup(mac, &n));
+
+    // Atualizar um nó já no cache não descarta nada
+    report(8, -40);
+    CHECK_INT(mesh_topo_evicted(), 1);
+
+    ctx_free(&ctx);
+    CHECK_INT(mesh_topo_init(0), ESP_ERR_INVALID_ARG);
+}
+
+static void reentrant_cb(const mesh_topo_node_t *node, void *ctx)
+{
+    int *calls = ctx;
+    mesh_topo_node_t n;
+
+    // Com o lock ainda tomado, o dublê do mutex aborta: no alvo seria um deadlock
+    CHECK(mesh_topo_lookup(node->mac, &n));
+    mesh_topo_update(node->report, node->report_len);
+    CHECK(strstr(node->report, node->mac) != NULL);
+    (*calls)++;
+}
+
+static void test_foreach_runs_outside_lock(void)
+{
+    topo_ctx_t ctx;
+    int calls = 0;
+
+    ctx_new(&ctx, 16);
+    for (int i = 0; i < 5; i++)
+    {
+        report(i, -60);
+    }
+    CHECK_INT(mesh_topo_foreach(reentrant_cb, &calls), 5);
+    CHECK_INT(calls, 5);
+    ctx_free(&ctx);
+
+    ctx_new(&ctx, 16);
+    CHECK_INT(mesh_topo_foreach(reentrant_cb, &calls), 0);
+    ctx_free(&ctx);
+}
+
+static void test_sync_round_trip(void)
+{
+    topo_ctx_t root, standby;
+    uint8_t frame[512];
+    int cursor = 0;
+    int frames = 0;
+    size_t len;
+
+    ctx_new(&standby, 64);
+    ctx_new(&root, 64);
+    for (int i = 0; i < 40; i++)
+    {
+        report(i, -40 - i);
+    }
+
+    // Quadros pequenos: o cache vai em vários, cada relatório inteiro em um deles
+    while (ctx_load(&root), (len = mesh_topo_build_sync(frame, sizeof(frame), &cursor)) > 0)
+    {
+        CHECK(mesh_topo_is_sync_frame(frame, len));
+        CHECK(frame[len - 1] == '\n');
+        ctx_load(&standby);
+        mesh_topo_handle_sync(frame, len);
+        frames++;
+    }
+    CHECK(frames > 1);
+
+    ctx_load(&standby);
+    CHECK_INT(mesh_topo_foreach(reentrant_cb, &(int){0}), 40);
+    char best[18];
+    int rssi;
+    CHECK(mesh_topo_best_standby(best, &rssi));
+    CHECK_STR(best, "24:6F:28:00:00:00");
+    CHECK_INT(rssi, -40);
+
+    ctx_free(&standby);
+    ctx_load(&root);
+    ctx_free(&root);
+}
+
+/* --- Cenário de failover --- */
+
+typedef struct {
+    int nodes;
+    int standby_cap;  // 0 = sem reserva
+    int64_t seen_ms[512];
+    int seen;
+    int64_t now_ms;
+} broker_t;
+
+static void broker_publish(broker_t *b, const char *report, size_t len)
+{
+    for (int i = 0; i < b->nodes; i++)
+    {
+        char mac[18];
+        node_mac(i, mac);
+        if (b->seen_ms[i] < 0 && strstr(report, mac))
+        {
+            b->seen_ms[i] = b->now_ms;
+            b->seen++;
+        }
+    }
+}
+
+static void republish_cb(const mesh_topo_node_t *node, void *ctx)
+{
+    broker_t *b = ctx;
+    b->now_ms += PUBLISH_MS;
+    broker_publish(b, node->report, node->report_len);
+}
+
+/**
+ * @brief Root cai em fail_ms. Devolve quanto tempo o broker fica sem a topologia inteira (ms).
+ */
+static int64_t run_failover(int nodes, int standby_cap, int64_t fail_ms, int64_t *root_gap_ms)
+{
+    static broker_t b;
+    topo_ctx_t root, standby;
+    uint8_t frame[1024];
+    int64_t connect_ms = fail_ms + ELECTION_MS + CONNECT_MS;
+    bool announced = false;
+
+    memset(&b, 0, sizeof(b));
+    b.nodes = nodes;
+    for (int i = 0; i < nodes; i++)
+    {
+        b.seen_ms[i] = -1;
+    }
+
+    ctx_new(&standby, standby_cap ? standby_cap : 8);
+    ctx_new(&root, standby_cap ? standby_cap : 128); // mesmo Kconfig em todos os nós
+
+    for (b.now_ms = 0; b.seen < nodes; b.now_ms += TICK_MS)
+    {
+        // Cada nó reporta no seu intervalo, com fase própria; sem root, o relatório se perde
+        for (int i = 0; i < nodes; i++)
+        {
+            int64_t phase = (int64_t)i * REPORT_INTERVAL_MS / nodes;
+            if (b.now_ms < phase || (b.now_ms - phase) % REPORT_INTERVAL_MS != 0)
+            {
+                continue;
+            }
+            if (b.now_ms < fail_ms)
+            {
+                ctx_load(&root);
+                report(i, -40 - i);
+            }
+            else if (b.now_ms >= connect_ms)
+            {
+                char mac[18];
+                char buf[64];
+                node_mac(i, mac);
+                ctx_load(&standby);
+                report(i, -40 - i);
+                int len = snprintf(buf, sizeof(buf), "{\"mac\":\"%s\"}", mac);
+                broker_publish(&b, buf, len);
+            }
+        }
+
+        // Root antigo espelha o cache no reserva a cada SYNC_INTERVALS relatórios
+        if (standby_cap && b.now_ms < fail_ms && b.now_ms % (REPORT_INTERVAL_MS * SYNC_INTERVALS) == 0)
+        {
+            int cursor = 0;
+            size_t len;
+            while (ctx_load(&root), (len = mesh_topo_build_sync(frame, sizeof(frame), &cursor)) > 0)
+            {
+                ctx_load(&standby);
+                mesh_topo_handle_sync(frame, len);
+            }
+        }
+
+        // Reserva conectado ao broker: a task de reconfiguração republica o cache
+        if (standby_cap && !announced && b.now_ms >= connect_ms)
+        {
+            ctx_load(&standby);
+            int64_t start = b.now_ms;
+            mesh_topo_foreach(republish_cb, &b);
+            b.now_ms = start;
+            announced = true;
+        }
+
+        if (b.now_ms > fail_ms + 20 * REPORT_INTERVAL_MS)
+        {
+            break;
+        }
+    }
+
+    int64_t last = 0;
+    for (int i = 0; i < nodes; i++)
+    {
+        if (b.seen_ms[i] > last)
+        {
+            last = b.seen_ms[i];
+        }
+    }
+
+    ctx_load(&standby);
+    ctx_free(&standby);
+    ctx_load(&root);
+    ctx_free(&root);
+
+    *root_gap_ms = connect_ms - fail_ms;
+    return b.seen == nodes ? last - fail_ms : -1;
+}
+
+static void bench_failover(void)
+{
+    static const int sizes[] = {10, 40, 100};
+    static const struct {
+        const char *name;
+        int cap;
+    } modes[] = {{"sem reserva", 0}, {"reserva, cache 24", 24}, {"reserva, cache 64", 64}, {"reserva, cache 128", 128}};
+    int64_t gap[4][3];
+    int64_t root_gap;
+
+    printf("\nfailover: queda do root até o broker ter a topologia inteira (ms)\n");
+    printf("  eleição %d ms, conexão %d ms, relatório a cada %d ms\n", ELECTION_MS, CONNECT_MS, REPORT_INTERVAL_MS);
+    printf("  %-20s %8s %8s %8s\n", "", "10 nós", "40 nós", "100 nós");
+    for (int m = 0; m < 4; m++)
+    {
+        printf("  %-20s", modes[m].name);
+        for (int s = 0; s < 3; s++)
+        {
+            // Queda logo antes de uma sincronização: o pior caso do reserva
+            gap[m][s] = run_failover(sizes[s], modes[m].cap, REPORT_INTERVAL_MS * SYNC_INTERVALS * 3 - TICK_MS,
+                                     &root_gap);
+            printf(" %8lld", (long long)gap[m][s]);
+        }
+        printf("\n");
+    }
+    printf("  root_gap_ms publicado: %lld\n\n", (long long)root_gap);
+
+    CHECK_INT(root_gap, ELECTION_MS + CONNECT_MS);
+    for (int s = 0; s < 3; s++)
+    {
+        // Sem reserva, só os próximos relatórios; com reserva que comporta a rede, logo após conectar
+        CHECK(gap[0][s] > ELECTION_MS + CONNECT_MS);
+        CHECK(gap[3][s] <= ELECTION_MS + CONNECT_MS + sizes[s] * PUBLISH_MS);
+        CHECK(gap[3][s] < gap[0][s]);
+    }
+    // O cache antigo (24) não cobre 40 ou 100 nós: os que faltam esperam o próximo relatório
+    CHECK(gap[1][0] == gap[3][0]);
+    CHECK(gap[1][1] > gap[2][1]);
+    CHECK(gap[2][1] == gap[3][1]);
+    CHECK(gap[2][2] > gap[3][2]);
+}
+
+int main(void)
+{
+    RUN_TEST(test_capacity_and_eviction);
+    RUN_TEST(test_foreach_runs_outside_lock);
+    RUN_TEST(test_sync_round_trip);
+    RUN_TEST(bench_failover);
+    return HOST_TEST_RESULT();
+}
@@ -0,0 +1,435 @@
+/**
+ * @file test_mesh_upbuf.c
+ * @brief Transbordo e ordem do buffer do uplink, despejo em lotes na flash e recuperação após reboot.
+ *
+ * O módulo é incluído como fonte para que reboot() possa zerar o estado
+ * estático, como acontece no boot real, mantendo o NVS simulado.
+ */
+
+#include "host_test.h"
+#include "../mesh_upbuf.c"
+
+static void reboot(void)
+{
+    if (spill_nvs)
+    {
+        nvs_close(spill_nvs);
+    }
+    vSemaphoreDelete(buf_lock);
+    free(ring);
+    free(spill_counts);
+    free(batch_buf);
+    free(front_buf);
+
+    buf_lock = NULL;
+    ring = NULL;
+    ring_cap = ring_head = ring_used = ring_count = 0;
+    spill_enabled = false;
+    spill_limit = 0;
+    spill_nvs = 0;
+    spill_head = spill_tail = 0;
+    spill_counts = NULL;
+    spill_msgs = 0;
+    batch_buf = front_buf = NULL;
+    front_len = front_pos = 0;
+    front_loaded = false;
+    head_seq = 0;
+    memset(&stats, 0, sizeof(stats));
+}
+
+static size_t make_msg(char *out, int seq, size_t len)
+{
+    memset(out, 'x', len);
+    int n = snprintf(out, len, "{\"seq\":%d,\"pad\":\"", seq);
+    out[n] = 'x';
+    out[len - 2] = '"';
+    out[len - 1] = '}';
+    return len;
+}
+
+static int msg_seq(const char *msg)
+{
+    int seq = -1;
+    sscanf(msg, "{\"seq\":%d", &seq);
+    return seq;
+}
+
+/**
+ * @brief Entrega tudo o que está pendente e confere a ordem. Devolve quantas mensagens saíram.
+ */
+static int drain_in_order(int *first, int *last)
+{
+    char buf[1600];
+    int count = 0, prev = -1;
+
+    *first = -1;
+    size_t len;
+    uint32_t token;
+    while ((len = mesh_upbuf_peek(buf, sizeof(buf) - 1, &token)) > 0)
+    {
+        buf[len] = '\0';
+        int seq = msg_seq(buf);
+        CHECK(seq > prev);
+        if (*first < 0)
+        {
+            *first = seq;
+        }
+        prev = seq;
+        CHECK(mesh_upbuf_consume(token));
+        count++;
+    }
+    *last = prev;
+    CHECK_INT(mesh_upbuf_pending(), 0);
+    return count;
+}
+
+static void test_ram_overflow_drops_oldest(void)
+{
+    char msg[32];
+    mesh_upbuf_stats_t st;
+    int first, last;
+
+    reboot();
+    CHECK_INT(mesh_upbuf_push("x", 1), ESP_ERR_INVALID_STATE);
+    CHECK_INT(mesh_upbuf_init(120, false, 0), ESP_OK);
+
+    // 20 bytes + 2 de cabeçalho: cabem 5 no buffer de 120
+    for (int i = 0; i < 8; i++)
+    {
+        CHECK_INT(mesh_upbuf_push(msg, make_msg(msg, i, 20)), ESP_OK);
+    }
+    CHECK_INT(mesh_upbuf_pending(), 5);
+    mesh_upbuf_get_stats(&st);
+    CHECK_INT(st.pushed, 8);
+    CHECK_INT(st.dropped, 3);
+
+    CHECK_INT(drain_in_order(&first, &last), 5);
+    CHECK_INT(first, 3);
+    CHECK_INT(last, 7);
+
+    CHECK_INT(mesh_upbuf_push(msg, 0), ESP_ERR_INVALID_STATE);
+    CHECK_INT(mesh_upbuf_push(msg, 119), ESP_ERR_INVALID_SIZE);
+}
+
+static void test_wraparound_and_small_reader(void)
+{
+    char msg[64], out[64];
+
+    reboot();
+    mesh_upbuf_init(100, false, 0);
+
+    // Entradas que atravessam o fim do buffer circular
+    for (int i = 0; i < 20; i++)
+    {
+        mesh_upbuf_push(msg, make_msg(msg, i, 30));
+        if (i % 2)
+        {
+            uint32_t token;
+            size_t len = mesh_upbuf_peek(out, sizeof(out), &token);
+            CHECK_INT(len, 30);
+            CHECK_INT(memcmp(out, "{\"seq\":", 7), 0);
+            CHECK(mesh_upbuf_consume(token));
+        }
+    }
+    CHECK(mesh_upbuf_pending() > 0);
+
+    // Leitor menor que a entrada: a entrada é descartada
+    size_t pending = mesh_upbuf_pending();
+    CHECK_INT(mesh_upbuf_peek(out, 10, NULL), 0);
+    CHECK_INT(mesh_upbuf_pending(), pending - 1);
+}
+
+static void test_spill_is_batched(void)
+{
+    char msg[256];
+    mesh_upbuf_stats_t st;
+    int first, last;
+    const int total = 150;
+
+    reboot();
+    host_nvs_reset();
+    CHECK_INT(mesh_upbuf_init(8192, true, 4), ESP_OK);
+    CHECK(spill_enabled);
+    uint32_t writes_before = host_nvs_writes("nvs_upbuf");
+    uint32_t commits_before = host_nvs_commits("nvs_upbuf");
+
+    for (int i = 0; i < total; i++)
+    {
+        mesh_upbuf_push(msg, make_msg(msg, i, 200));
+    }
+    mesh_upbuf_get_stats(&st);
+    uint32_t writes = host_nvs_writes("nvs_upbuf") - writes_before;
+    uint32_t commits = host_nvs_commits("nvs_upbuf") - commits_before;
+
+    // 8 KB de RAM + 4 lotes de ~3 KB; o que passa disso sai do lote mais antigo
+    CHECK(st.spilled > 0);
+    CHECK_INT(st.pushed, total);
+    CHECK_INT(mesh_upbuf_pending() + st.dropped, total);
+    CHECK(host_nvs_used("nvs_upbuf") <= host_nvs_capacity("nvs_upbuf"));
+
+    // Uma gravação de lote + head/tail por lote, nunca uma por mensagem
+    uint32_t batches = spill_tail;
+    CHECK(commits == batches);
+    CHECK(writes <= batches * 4);
+    printf("  %" PRIu32 " mensagens na flash em %" PRIu32 " lotes: %.2f gravações e %.2f commits por mensagem "
+           "(uma mensagem por blob: 3 gravações e 1 commit)\n",
+           st.spilled, batches, (double)writes / st.spilled, (double)commits / st.spilled);
+
+    size_t pending = mesh_upbuf_pending();
+    CHECK_INT(drain_in_order(&first, &last), pending);
+    CHECK_INT(last, total - 1);
+    CHECK_INT(first, total - (int)pending);
+    CHECK_INT(host_nvs_used("nvs_upbuf"), 2 * 32); // só head e tail
+}
+
+static void test_spill_max_clamped_to_partition(void)
+{
+    char msg[1500];
+    mesh_upbuf_stats_t st;
+    int first, last;
+
+    reboot();
+    host_nvs_reset();
+    mesh_upbuf_init(4096, true, 64);
+    CHECK_INT(spill_limit, 6);
+
+    // Relatórios grandes enchem a partição: nenhuma gravação pode falhar por falta de espaço
+    for (int i = 0; i < 400; i++)
+    {
+        mesh_upbuf_push(msg, make_msg(msg, i, 1400));
+        CHECK(host_nvs_used("nvs_upbuf") <= host_nvs_capacity("nvs_upbuf"));
+    }
+    mesh_upbuf_get_stats(&st);
+    CHECK_INT(spill_tail - spill_head, 6);
+    CHECK_INT(mesh_upbuf_pending() + st.dropped, 400);
+
+    size_t pending = mesh_upbuf_pending();
+    CHECK_INT(drain_in_order(&first, &last), pending);
+    CHECK_INT(last, 399);
+}
+
+static void test_reboot_recovers_flash(void)
+{
+    char msg[256];
+    int first, last;
+
+    reboot();
+    host_nvs_reset();
+    mesh_upbuf_init(2048, true, 4);
+    for (int i = 0; i < 40; i++)
+    {
+        mesh_upbuf_push(msg, make_msg(msg, i, 200));
+    }
+    size_t in_flash = spill_msgs;
+    CHECK(in_flash > 0);
+
+    // Entrega metade do primeiro lote antes de cair
+    char out[256];
+    uint32_t token;
+    CHECK(mesh_upbuf_peek(out, sizeof(out), &token) > 0);
+    CHECK(mesh_upbuf_consume(token));
+    CHECK(mesh_upbuf_peek(out, sizeof(out), &token) > 0);
+    CHECK(mesh_upbuf_consume(token));
+
+    // O que estava na RAM se perde; o lote pela metade volta inteiro
+    reboot();
+    mesh_upbuf_init(2048, true, 4);
+    CHECK_INT(mesh_upbuf_pending(), in_flash);
+    CHECK_INT(drain_in_order(&first, &last), in_flash);
+    CHECK_INT(first, 0);
+}
+
+static void test_overflow_between_peek_and_consume(void)
+{
+    char msg[32], out[32];
+    uint32_t token;
+    mesh_upbuf_stats_t st;
+
+    reboot();
+    mesh_upbuf_init(120, false, 0);
+    for (int i = 0; i < 5; i++)
+    {
+        mesh_upbuf_push(msg, make_msg(msg, i, 20));
+    }
+
+    // 0 é enviado; durante o envio chega o 5 e o transbordo descarta o 0
+    CHECK_INT(mesh_upbuf_peek(out, sizeof(out), &token), 20);
+    CHECK_INT(msg_seq(out), 0);
+    mesh_upbuf_push(msg, make_msg(msg, 5, 20));
+
+    // O consume não leva o 1, que ainda não saiu
+    CHECK(!mesh_upbuf_consume(token));
+    CHECK_INT(mesh_upbuf_pending(), 5);
+    CHECK_INT(mesh_upbuf_peek(out, sizeof(out), &token), 20);
+    CHECK_INT(msg_seq(out), 1);
+    CHECK(mesh_upbuf_consume(token));
+    mesh_upbuf_get_stats(&st);
+    CHECK_INT(st.drained, 1);
+    CHECK_INT(st.dropped, 1);
+
+    // Mover a frente para a flash não é tirá-la da fila
+    reboot();
+    host_nvs_reset();
+    mesh_upbuf_init(120, true, 2);
+    for (int i = 0; i < 5; i++)
+    {
+        mesh_upbuf_push(msg, make_msg(msg, i, 20));
+    }
+    CHECK_INT(mesh_upbuf_peek(out, sizeof(out), &token), 20);
+    mesh_upbuf_push(msg, make_msg(msg, 5, 20));
+    CHECK(spill_msgs > 0);
+    CHECK(mesh_upbuf_consume(token));
+    CHECK_INT(mesh_upbuf_peek(out, sizeof(out), &token), 20);
+    CHECK_INT(msg_seq(out), 1);
+}
+
+/* --- Queda do uplink: perda e tempo para esvaziar --- */
+
+#define SIM_MSG_LEN (300)     // relatório típico
+#define SIM_MSG_EVERY_MS (1000) // root com 10 nós a 10 s, ou um nó com interval 1000
+#define SIM_DRAIN_MS (100)    // CONFIG_MESH_UPBUF_DRAIN_INTERVAL_MS
+
+typedef struct {
+    int produced;
+    int lost;
+    int drain_ms;
+} outage_result_t;
+
+/**
+ * @brief Uplink fora por outage_ms; depois a drain task entrega uma mensagem a cada SIM_DRAIN_MS.
+ *
+ * Enquanto houver fila, as mensagens novas também vão para o buffer (como em send_upstream()).
+ * Uma mensagem nova chega entre o peek e o consume quando os instantes coincidem, o que
+ * exercita o transbordo durante o envio.
+ */
+static outage_result_t run_outage(int outage_ms, bool flash_spill, int spill_max)
+{
+    char msg[SIM_MSG_LEN], out[SIM_MSG_LEN];
+    outage_result_t r = {0};
+    int prev = -1, delivered = 0;
+    uint32_t token;
+
+    reboot();
+    host_nvs_reset();
+    mesh_upbuf_init(8192, flash_spill, spill_max);
+
+    for (int t = 0;; t += SIM_DRAIN_MS)
+    {
+        bool up = t >= outage_ms;
+        bool produce = t % SIM_MSG_EVERY_MS == 0 && t < outage_ms + 600000;
+        size_t len = 0;
+
+        if (up && mesh_upbuf_pending() > 0)
+        {
+            len = mesh_upbuf_peek(out, sizeof(out), &token);
+        }
+        if (produce)
+        {
+            make_msg(msg, r.produced++, SIM_MSG_LEN);
+            if (!up || mesh_upbuf_pending() > 0)
+            {
+                mesh_upbuf_push(msg, SIM_MSG_LEN);
+            }
+            else
+            {
+                prev = r.produced - 1;
+                delivered++;
+            }
+        }
+        if (len > 0)
+        {
+            // Entregue ao uplink: em ordem e sem repetição
+            int seq = msg_seq(out);
+            CHECK(seq > prev);
+            prev = seq;
+            delivered++;
+            mesh_upbuf_consume(token);
+        }
+
+        if (up && mesh_upbuf_pending() == 0 && r.drain_ms == 0)
+        {
+            r.drain_ms = t - outage_ms;
+        }
+        if (up && mesh_upbuf_pending() == 0 && !produce && t >= outage_ms + 600000)
+        {
+            break;
+        }
+    }
+
+    r.lost = r.produced - delivered;
+    mesh_upbuf_stats_t st;
+    mesh_upbuf_get_stats(&st);
+    CHECK(r.lost <= (int)st.dropped);
+    return r;
+}
+
+static void bench_outage(void)
+{
+    static const int outages_s[] = {10, 60, 300, 900, 3600};
+    const size_t n = sizeof(outages_s) / sizeof(outages_s[0]);
+
+    printf("\nqueda do uplink: mensagens de %d B a cada %d ms, buffer de 8 KB, entrega a cada %d ms\n", SIM_MSG_LEN,
+           SIM_MSG_EVERY_MS, SIM_DRAIN_MS);
+    printf("  %-8s %10s %-24s %-24s %-24s\n", "queda", "geradas", "só RAM", "RAM + 4 lotes", "RAM + 6 lotes");
+    for (size_t i = 0; i < n; i++)
+    {
+        outage_result_t res[3] = {
+            run_outage(outages_s[i] * 1000, false, 0),
+            run_outage(outages_s[i] * 1000, true, 4),
+            run_outage(outages_s[i] * 1000, true, 6),
+        };
+        char cols[3][32];
+        for (int c = 0; c < 3; c++)
+        {
+            snprintf(cols[c], sizeof(cols[c]), "%d perdidas, %d.%d s", res[c].lost, res[c].drain_ms / 1000,
+                     res[c].drain_ms % 1000 / 100);
+        }
+        printf("  %6d s %10d %-24s %-24s %-24s\n", outages_s[i], outages_s[i] * 1000 / SIM_MSG_EVERY_MS, cols[0],
+               cols[1], cols[2]);
+
+        // Quedas curtas cabem na RAM; mais flash, menos perda e mais tempo para esvaziar
+        if (i == 0)
+        {
+            CHECK_INT(res[0].lost, 0);
+        }
+        CHECK(res[1].lost <= res[0].lost);
+        CHECK(res[2].lost <= res[1].lost);
+        CHECK(res[2].drain_ms >= res[0].drain_ms);
+    }
+    printf("\n");
+}
+
+static void test_full_partition_erase_is_local(void)
+{
+    nvs_handle_t h;
+    uint8_t v = 0;
+
+    reboot();
+    host_nvs_reset();
+    nvs_flash_init_partition("nvs_custom");
+    nvs_open_from_partition("nvs_custom", "limits", NVS_READWRITE, &h);
+    nvs_set_u8(h, "layer", 2);
+
+    // A partição do buffer é apagada; os limites em nvs_custom continuam lá
+    host_nvs_fail_init("nvs_upbuf", ESP_ERR_NVS_NO_FREE_PAGES);
+    mesh_upbuf_init(1024, true, 2);
+    CHECK(spill_enabled);
+    CHECK_INT(host_nvs_erases("nvs_upbuf"), 1);
+    CHECK_INT(host_nvs_erases("nvs_custom"), 0);
+    CHECK_INT(nvs_get_u8(h, "layer", &v), ESP_OK);
+    CHECK_INT(v, 2);
+    nvs_close(h);
+}
+
+int main(void)
+{
+    RUN_TEST(test_ram_overflow_drops_oldest);
+    RUN_TEST(test_wraparound_and_small_reader);
+    RUN_TEST(test_spill_is_batched);
+    RUN_TEST(test_spill_max_clamped_to_partition);
+    RUN_TEST(test_reboot_recovers_flash);
+    RUN_TEST(test_overflow_between_peek_and_consume);
+    RUN_TEST(test_full_partition_erase_is_local);
+    RUN_TEST(bench_outage);
+    return HOST_TEST_RESULT();
+}
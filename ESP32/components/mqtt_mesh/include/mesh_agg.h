@@ -0,0 +1,40 @@
+/**
+ * @file mesh_agg.h
+ * @brief Agregação dos relatórios de status dos filhos nos nós intermediários.
+ *
+ * Cada nó guarda os relatórios recebidos dos filhos até o seu próprio ciclo de
+ * envio e os junta ao seu relatório em um único quadro
+ * {"type":"agg","reports":[...]}, sempre limitado a MESH_AGG_FRAME_MAX bytes.
+ * Assim o nó raiz recebe um quadro por subárvore a cada intervalo.
+ */
+
+#ifndef MESH_AGG_H
+#define MESH_AGG_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "esp_err.h"
+
+#define MESH_AGG_FRAME_MAX (1460)
+
+/**
+ * @brief Envia um quadro (terminado em '\0', len sem o terminador) ao pai.
+ */
+typedef void (*mesh_agg_send_fn)(const char *frame, size_t len);
+
+/**
+ * @brief Chamado para cada relatório individual contido em um quadro agregado.
+ */
+typedef void (*mesh_agg_report_cb)(const char *report, size_t len, void *ctx);
+
+esp_err_t mesh_agg_init(mesh_agg_send_fn send_fn);
+
+bool mesh_agg_is_frame(const char *payload, size_t len);
+
+void mesh_agg_push(const char *payload, size_t len);
+void mesh_agg_flush(const char *own_report, size_t len);
+
+int mesh_agg_foreach(const char *frame, size_t len, mesh_agg_report_cb cb, void *ctx);
+
+#endif // MESH_AGG_H
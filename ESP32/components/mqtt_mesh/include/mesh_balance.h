@@ -0,0 +1,53 @@
+/**
+ * @file mesh_balance.h
+ * @brief Limites de capacidade por nó e assistente de balanceamento da árvore.
+ *
+ * Cada nó pode ter o próprio max_children e uma preferência de camada
+ * (folha ou automático), definidos pelo comando "limits" e gravados na
+ * partição "nvs_custom". O root usa o cache de topologia (mesh_topo) para
+ * sugerir limites que reduzam a profundidade da árvore, a quantidade de
+ * filhos do próprio root e a de filhos pendurados em pais com enlace fraco.
+ */
+
+#ifndef MESH_BALANCE_H
+#define MESH_BALANCE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+
+#define MESH_BALANCE_MAX_ADVICE (16)
+
+typedef enum {
+    MESH_LAYER_PREF_AUTO = 0,
+    MESH_LAYER_PREF_LEAF, // nunca aceita filhos (esp_mesh_set_type(MESH_LEAF))
+} mesh_layer_pref_t;
+
+typedef struct {
+    int8_t max_children; // -1 = usa o valor global do comando "config"
+    uint8_t layer_pref;  // mesh_layer_pref_t
+} mesh_node_limits_t;
+
+typedef struct {
+    char mac[18];
+    mesh_node_limits_t limits;
+    const char *reason;
+} mesh_balance_advice_t;
+
+typedef struct {
+    int nodes;
+    int max_layer;
+    float avg_layer;
+    size_t count;
+    mesh_balance_advice_t advice[MESH_BALANCE_MAX_ADVICE];
+} mesh_balance_report_t;
+
+esp_err_t mesh_balance_load_limits(mesh_node_limits_t *limits);
+esp_err_t mesh_balance_save_limits(const mesh_node_limits_t *limits);
+
+void mesh_balance_advise(int cap, int strong_rssi, int weak_rssi, mesh_balance_report_t *out);
+char *mesh_balance_to_json(const mesh_balance_report_t *report, bool applied);
+
+#endif // MESH_BALANCE_H
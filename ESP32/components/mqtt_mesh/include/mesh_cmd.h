@@ -0,0 +1,87 @@
+/**
+ * @file mesh_cmd.h
+ * @brief Motor de comandos compartilhado pelos caminhos MQTT (root) e mesh (demais nós).
+ *
+ * Cada comando é registrado uma única vez com um opcode compacto. No root, o
+ * JSON recebido do broker é validado e convertido em um mesh_cmd_t (forma
+ * binária), que é repassado aos nós pela mesh. Os dois caminhos chamam
+ * mesh_cmd_dispatch(), que indexa a tabela pelo opcode.
+ *
+ * Formato JSON aceito no tópico mesh/cmd:
+ *   {"action":"<nome>", "target":"AA:BB:CC:DD:EE:FF", ...argumentos}
+ *   {"op":<opcode>, ...}  (equivalente numérico de "action")
+ * Sem "target", o comando vale para todos os nós (broadcast).
+ */
+
+#ifndef MESH_CMD_H
+#define MESH_CMD_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "cJSON.h"
+#include "esp_err.h"
+
+#define MESH_CMD_MAX_OPS  (32)
+#define MESH_CMD_ARGS_MAX (240)
+
+// Flags de registro
+#define MESH_CMD_F_ROOT_ONLY (1 << 0) // executado só no root, nunca repassado pela mesh
+#define MESH_CMD_F_TARGETED  (1 << 1) // exige "target"
+
+// Flags do comando
+#define MESH_CMD_BROADCAST (1 << 0)
+
+typedef enum {
+    MESH_CMD_SRC_MQTT = 0,
+    MESH_CMD_SRC_MESH,
+} mesh_cmd_src_t;
+
+typedef struct {
+    uint8_t op;
+    uint8_t flags;
+    uint8_t target[6]; // MAC do AP, como exibido no configurador
+    uint16_t args_len;
+    uint8_t args[MESH_CMD_ARGS_MAX];
+} mesh_cmd_t;
+
+/**
+ * @brief Valida os argumentos do JSON e os grava em cmd->args/args_len.
+ */
+typedef esp_err_t (*mesh_cmd_parse_fn)(const cJSON *json, mesh_cmd_t *cmd);
+
+typedef void (*mesh_cmd_handler_fn)(const mesh_cmd_t *cmd, mesh_cmd_src_t src);
+
+/**
+ * @brief Repassa o quadro binário de um comando pela mesh (somente no root).
+ *
+ * @param target MAC (do AP) do nó de destino ou NULL para todos os nós.
+ */
+typedef void (*mesh_cmd_forward_fn)(const uint8_t *frame, size_t len, const uint8_t *target);
+
+typedef struct {
+    const char *name;
+    uint8_t flags;
+    uint16_t args_size; // tamanho fixo dos argumentos; 0 = variável (até MESH_CMD_ARGS_MAX)
+    mesh_cmd_parse_fn parse;
+    mesh_cmd_handler_fn handler;
+} mesh_cmd_def_t;
+
+esp_err_t mesh_cmd_init(mesh_cmd_forward_fn forward);
+esp_err_t mesh_cmd_register(uint8_t op, const mesh_cmd_def_t *def);
+
+esp_err_t mesh_cmd_from_json(const char *json, size_t len, mesh_cmd_t *cmd);
+
+bool mesh_cmd_is_frame(const uint8_t *data, size_t len);
+esp_err_t mesh_cmd_decode(const uint8_t *data, size_t len, mesh_cmd_t *cmd);
+size_t mesh_cmd_encode(const mesh_cmd_t *cmd, uint8_t *out, size_t size);
+
+void mesh_cmd_dispatch(const mesh_cmd_t *cmd, mesh_cmd_src_t src);
+
+bool mesh_cmd_is_for_me(const mesh_cmd_t *cmd);
+
+esp_err_t mesh_cmd_send(uint8_t op, const char *target_mac, const void *args, size_t args_len);
+bool mesh_cmd_parse_mac(const char *str, uint8_t mac[6]);
+
+#endif // MESH_CMD_H
@@ -0,0 +1,38 @@
+/**
+ * @file mesh_ota.h
+ * @brief Distribuição de firmware (OTA) pela própria rede mesh.
+ *
+ * O root baixa a imagem por HTTP e a grava na partição OTA livre. Cada nó
+ * repassa aos seus filhos diretos os blocos que já gravou, lendo-os de volta
+ * da própria partição, enquanto ainda recebe os seguintes do pai; assim todas
+ * as camadas avançam em paralelo. Os filhos confirmam (ACK) o próximo bloco
+ * esperado, o que permite retomar a transferência após uma reconexão.
+ */
+
+#ifndef MESH_OTA_H
+#define MESH_OTA_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "esp_mesh.h"
+
+#define MESH_OTA_CHUNK_SIZE   (1024)
+#define MESH_OTA_WINDOW       (4)
+#define MESH_OTA_MAX_CHILDREN (10)
+
+esp_err_t mesh_ota_init(void);
+
+esp_err_t mesh_ota_start_from_url(const char *url);
+
+bool mesh_ota_is_frame(const uint8_t *data, size_t len);
+void mesh_ota_handle_rx(const mesh_addr_t *from, const uint8_t *data, size_t len);
+
+void mesh_ota_child_connected(const uint8_t mac[6]);
+void mesh_ota_child_disconnected(const uint8_t mac[6]);
+
+int mesh_ota_progress(void);
+
+#endif // MESH_OTA_H
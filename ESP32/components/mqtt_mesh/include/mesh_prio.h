@@ -0,0 +1,61 @@
+/**
+ * @file mesh_prio.h
+ * @brief Filas de recepção por classe de prioridade: controle (comandos, pongs) antes de volume (relatórios).
+ *
+ * Mensagens JSON de controle enviadas ao root (pongs, respostas a comandos) vão
+ * marcadas com o byte MESH_PRIO_CTRL_MAGIC na frente, para serem classificadas
+ * sem parse; quem recebe tira a marca antes de processar ou publicar.
+ *
+ * A task de recepção só lê da mesh, classifica e copia cada quadro para um
+ * slot pré-alocado da sua classe; o processamento é feito por outra task, que
+ * sempre atende a fila de controle primeiro. Sob sobrecarga, quadros de volume
+ * são descartados: um quadro de volume sem slot livre é perdido, e um quadro
+ * de controle sem slot livre toma o slot do quadro de volume mais antigo.
+ */
+
+#ifndef MESH_PRIO_H
+#define MESH_PRIO_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "esp_mesh.h"
+#include "freertos/FreeRTOS.h"
+
+#define MESH_PRIO_FRAME_MAX (1500)
+#define MESH_PRIO_CTRL_MAGIC (0xAB)
+
+typedef enum {
+    MESH_PRIO_CTRL = 0,
+    MESH_PRIO_BULK,
+    MESH_PRIO_CLASSES,
+} mesh_prio_t;
+
+typedef struct {
+    mesh_addr_t from;
+    uint8_t pool;      // classe dona do slot (um slot de volume pode carregar controle)
+    int64_t rx_us;
+    size_t len;
+    uint8_t data[MESH_PRIO_FRAME_MAX + 1]; // sempre terminado em '\0'
+} mesh_prio_msg_t;
+
+typedef struct {
+    uint32_t queued[MESH_PRIO_CLASSES];
+    uint32_t shed[MESH_PRIO_CLASSES];        // descartes desde a última leitura com reset
+    uint32_t max_wait_ms[MESH_PRIO_CLASSES]; // maior espera na fila desde a última leitura com reset
+} mesh_prio_stats_t;
+
+esp_err_t mesh_prio_init(int ctrl_len, int bulk_len);
+
+esp_err_t mesh_prio_submit(mesh_prio_t prio, const mesh_addr_t *from, const uint8_t *data, size_t len);
+
+mesh_prio_msg_t *mesh_prio_next(TickType_t wait, mesh_prio_t *prio);
+void mesh_prio_release(mesh_prio_msg_t *msg);
+
+void mesh_prio_get_stats(mesh_prio_stats_t *stats, bool reset);
+
+bool mesh_prio_is_ctrl_frame(const uint8_t *data, size_t len);
+
+#endif // MESH_PRIO_H
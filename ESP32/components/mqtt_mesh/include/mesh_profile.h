@@ -0,0 +1,46 @@
+/**
+ * @file mesh_profile.h
+ * @brief Coleta sob demanda de uso de CPU por task, stack, heap e alocações do cJSON.
+ *
+ * A coleta (mesh_profile_collect) e a serialização (mesh_profile_to_json) são
+ * separadas: a primeira lê o FreeRTOS e o heap durante uma janela de
+ * amostragem, a segunda só formata o resultado.
+ */
+
+#ifndef MESH_PROFILE_H
+#define MESH_PROFILE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+
+#define MESH_PROFILE_MAX_TASKS (20)
+#define MESH_PROFILE_NAME_LEN  (16)
+
+typedef struct {
+    char name[MESH_PROFILE_NAME_LEN];
+    uint8_t priority;
+    int16_t cpu_permille; // fração do tempo de CPU na janela (0..1000); -1 sem run-time stats
+    uint32_t stack_free;  // menor espaço livre de stack já visto (bytes)
+} mesh_profile_task_t;
+
+typedef struct {
+    uint32_t window_ms;
+    uint32_t heap_free;
+    uint32_t heap_min_free;
+    uint32_t heap_largest;
+    uint32_t cjson_allocs; // alocações do cJSON durante a janela
+    uint32_t cjson_frees;
+    int32_t cjson_live;    // alocações do cJSON ainda não liberadas (desde o boot)
+    int task_count;
+    mesh_profile_task_t tasks[MESH_PROFILE_MAX_TASKS];
+} mesh_profile_t;
+
+void mesh_profile_init(void);
+
+esp_err_t mesh_profile_collect(uint32_t window_ms, mesh_profile_t *out);
+
+char *mesh_profile_to_json(const mesh_profile_t *profile, const char *mac_str, size_t max_len);
+
+#endif // MESH_PROFILE_H
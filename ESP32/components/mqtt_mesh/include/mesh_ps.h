@@ -0,0 +1,46 @@
+/**
+ * @file mesh_ps.h
+ * @brief Modo de economia de energia (PS) alinhado aos relatórios.
+ *
+ * Com o PS da mesh habilitado, o nó fica com o rádio no duty cycle configurado
+ * e só sobe para 100% durante a janela de atividade aberta a cada relatório:
+ * envia o relatório e as mensagens pendentes em rajada e escuta comandos.
+ * O pai guarda os comandos destinados a um filho direto em PS e os entrega
+ * quando recebe algo dele ou quando o filho avisa duty de 100% (acabou de
+ * acordar). O tempo estimado de rádio ligado é acumulado e publicado nos
+ * relatórios.
+ */
+
+#ifndef MESH_PS_H
+#define MESH_PS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "esp_mesh.h"
+
+#define MESH_PS_FRAME_MAX (256)
+#define MESH_PS_DUTY_UNKNOWN (-1)
+
+esp_err_t mesh_ps_init(int dev_duty, int dev_duty_type, int hold_max, uint32_t hold_timeout_ms);
+bool mesh_ps_enabled(void);
+
+void mesh_ps_awake_begin(void);
+void mesh_ps_awake_end(void);
+
+void mesh_ps_set_parent_duty(int duty);
+void mesh_ps_set_child_duty(const uint8_t child_sta[6], int duty);
+void mesh_ps_child_disconnected(const uint8_t child_sta[6]);
+int mesh_ps_child_duty(const uint8_t child_sta[6]);
+
+esp_err_t mesh_ps_hold(const mesh_addr_t *child, const uint8_t *frame, size_t len);
+int mesh_ps_release(const mesh_addr_t *child);
+int mesh_ps_release_woken(void);
+int mesh_ps_release_expired(void);
+
+uint32_t mesh_ps_radio_on_ms(void);
+int mesh_ps_radio_on_pct(void);
+
+#endif // MESH_PS_H
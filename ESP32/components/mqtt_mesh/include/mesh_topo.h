@@ -0,0 +1,54 @@
+/**
+ * @file mesh_topo.h
+ * @brief Cache da topologia no root (último relatório de cada nó).
+ *
+ * O root guarda o relatório mais recente de cada nó e alguns campos já
+ * extraídos (pai, camada, RSSI, filhos). O cache é espelhado periodicamente
+ * para o nó reserva (standby), que o republica assim que assume como root.
+ */
+
+#ifndef MESH_TOPO_H
+#define MESH_TOPO_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+
+#define MESH_TOPO_NO_RSSI (-127)
+
+typedef struct {
+    char mac[18];
+    char parent[18];
+    int layer;
+    int rssi;
+    int child_count;
+    int max_children; // limite efetivo informado pelo nó; -1 = desconhecido
+    int64_t last_seen_us;
+    const char *report;
+    size_t report_len;
+} mesh_topo_node_t;
+
+/**
+ * @brief Chamado sobre uma cópia do cache, fora do lock: pode publicar, enviar pela mesh
+ * ou usar as demais funções do mesh_topo.
+ */
+typedef void (*mesh_topo_node_cb)(const mesh_topo_node_t *node, void *ctx);
+
+esp_err_t mesh_topo_init(int max_nodes);
+int mesh_topo_capacity(void);
+uint32_t mesh_topo_evicted(void);
+
+void mesh_topo_update(const char *report, size_t len);
+void mesh_topo_expire(int64_t max_age_us);
+int mesh_topo_foreach(mesh_topo_node_cb cb, void *ctx);
+bool mesh_topo_lookup(const char *mac, mesh_topo_node_t *out);
+
+bool mesh_topo_best_standby(char mac_out[18], int *rssi_out);
+
+size_t mesh_topo_build_sync(uint8_t *out, size_t size, int *cursor);
+bool mesh_topo_is_sync_frame(const uint8_t *data, size_t len);
+void mesh_topo_handle_sync(const uint8_t *data, size_t len);
+
+#endif // MESH_TOPO_H
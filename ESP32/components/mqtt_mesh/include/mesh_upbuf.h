@@ -0,0 +1,39 @@
+/**
+ * @file mesh_upbuf.h
+ * @brief Buffer de mensagens pendentes para o uplink (pai/root ou broker MQTT).
+ *
+ * Enquanto o nó estiver sem pai, durante a troca de root ou com o broker
+ * desconectado, as mensagens destinadas ao uplink são guardadas em um buffer
+ * circular limitado. Quando ele enche, a mensagem mais antiga é descartada ou,
+ * se habilitado, movida com as seguintes, em um lote, para a partição
+ * "nvs_upbuf" na flash (spill_max é o número de lotes).
+ * As mensagens são entregues em ordem (primeiro as da flash).
+ */
+
+#ifndef MESH_UPBUF_H
+#define MESH_UPBUF_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+
+typedef struct {
+    uint32_t pushed;
+    uint32_t dropped;
+    uint32_t spilled;
+    uint32_t drained;
+} mesh_upbuf_stats_t;
+
+esp_err_t mesh_upbuf_init(size_t capacity, bool flash_spill, int spill_max);
+
+esp_err_t mesh_upbuf_push(const void *data, size_t len);
+
+size_t mesh_upbuf_peek(void *out, size_t out_size, uint32_t *seq);
+bool mesh_upbuf_consume(uint32_t seq);
+
+size_t mesh_upbuf_pending(void);
+void mesh_upbuf_get_stats(mesh_upbuf_stats_t *stats);
+
+#endif // MESH_UPBUF_H
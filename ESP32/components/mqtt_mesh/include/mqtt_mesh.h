@@ -5,12 +5,23 @@
  * This module handles periodic reporting of MAC address and hop count
  * from each node to its parent in the mesh network. The root node prints
  * the information it receives.
+ *
+ * It also provides an application data channel: any node can publish a
+ * buffer with mesh_publish(), which the root republishes on the MQTT topic
+ * mesh/node/<mac>/<topic_suffix>. Messages published by the broker on
+ * mesh/node/<mac>/down/<topic_suffix> are delivered to the callback that
+ * node registered with mesh_subscribe().
  */
 
 #ifndef MQTT_MESH_H
 #define MQTT_MESH_H
 
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
 #include "esp_err.h"
+#include "mqtt_client.h"
 
 #define LED_RED    23
 #define LED_BLUE    22
@@ -22,4 +33,51 @@ void mesh_disconnected_indicator(void);
 void mesh_update_led_layer(int layer);
 void blink_all_leds(void);
 
+/*******************************************************
+ *                Application data channel
+ *******************************************************/
+#define MESH_APP_FRAME_MAX   (1460)
+#define MESH_APP_TOPIC_MAX   (48)
+#define MESH_APP_MAX_SUBS    (8)
+#define MESH_APP_TOPIC_BASE  "mesh/node/"
+
+/**
+ * @brief Callback de dados de downlink (broker -> nó).
+ */
+typedef void (*mesh_app_rx_cb_t)(const char *topic_suffix, const uint8_t *data, size_t len, void *ctx);
+
+/**
+ * @brief Mensagem reservada na fila de envio (ver mesh_publish_begin()).
+ */
+typedef struct mesh_app_msg mesh_app_msg_t;
+
+typedef struct {
+    uint32_t queued;
+    uint32_t sent;
+    uint32_t dropped;   // fila cheia
+    uint32_t buffered;  // uplink fora: guardada no buffer do uplink (mesh_upbuf)
+    uint32_t failed;    // descartada: buffer do uplink indisponível ou quadro inválido
+    uint32_t delivered; // downlink entregue a um callback
+} mesh_app_stats_t;
+
+esp_err_t mesh_app_init(int queue_len);
+
+esp_err_t mesh_publish(const char *topic_suffix, const void *buf, size_t len, int qos);
+
+mesh_app_msg_t *mesh_publish_begin(const char *topic_suffix, int qos, uint8_t **payload, size_t *max_len);
+esp_err_t mesh_publish_commit(mesh_app_msg_t *msg, size_t len);
+void mesh_publish_abort(mesh_app_msg_t *msg);
+
+esp_err_t mesh_subscribe(const char *topic_suffix, mesh_app_rx_cb_t cb, void *ctx);
+
+bool mesh_app_is_frame(const uint8_t *data, size_t len);
+void mesh_app_handle_rx(const uint8_t *data, size_t len);
+bool mesh_app_publish_frame(const uint8_t *frame, size_t len);
+
+void mesh_app_mqtt_connected(esp_mqtt_client_handle_t client);
+void mesh_app_mqtt_disconnected(void);
+bool mesh_app_handle_mqtt(const char *topic, int topic_len, const char *data, int data_len);
+
+void mesh_app_get_stats(mesh_app_stats_t *stats);
+
 #endif // MQTT_MESH_H
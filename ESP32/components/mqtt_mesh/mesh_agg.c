@@ -0,0 +1,257 @@
+/**
+ * @file mesh_agg.c
+ * @brief Junta os relatórios dos filhos com o relatório do próprio nó em um único quadro por intervalo.
+ */
+
+#include "mesh_agg.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include <string.h>
+
+#define TAG "MESH_AGG"
+
+#define AGG_PREFIX "{\"type\":\"agg\",\"reports\":["
+#define AGG_SUFFIX "]}"
+#define AGG_PREFIX_LEN (sizeof(AGG_PREFIX) - 1)
+#define AGG_SUFFIX_LEN (sizeof(AGG_SUFFIX) - 1)
+#define AGG_BODY_MAX (MESH_AGG_FRAME_MAX - AGG_PREFIX_LEN - AGG_SUFFIX_LEN - 1)
+
+static SemaphoreHandle_t agg_lock = NULL;
+static mesh_agg_send_fn agg_send = NULL;
+
+// Relatórios pendentes dos filhos, já separados por vírgula: {...},{...}
+static char pending[AGG_BODY_MAX + 1];
+static size_t pending_len = 0;
+static int pending_count = 0;
+
+// Espaço reservado para o relatório do próprio nó (tamanho do último enviado)
+static size_t own_reserve = 0;
+
+static char frame_buf[MESH_AGG_FRAME_MAX];
+
+esp_err_t mesh_agg_init(mesh_agg_send_fn send_fn)
+{
+    if (!send_fn)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (!agg_lock)
+    {
+        agg_lock = xSemaphoreCreateMutex();
+        if (!agg_lock)
+        {
+            return ESP_ERR_NO_MEM;
+        }
+    }
+    agg_send = send_fn;
+    return ESP_OK;
+}
+
+bool mesh_agg_is_frame(const char *payload, size_t len)
+{
+    return len >= AGG_PREFIX_LEN + AGG_SUFFIX_LEN &&
+           memcmp(payload, AGG_PREFIX, AGG_PREFIX_LEN) == 0;
+}
+
+/**
+ * @brief Remove o '\0' final (se houver) e espaços do fim do payload.
+ */
+static size_t trim_len(const char *payload, size_t len)
+{
+    while (len > 0 && (payload[len - 1] == '\0' || payload[len - 1] == ' ' ||
+                       payload[len - 1] == '\r' || payload[len - 1] == '\n'))
+    {
+        len--;
+    }
+    return len;
+}
+
+/**
+ * @brief Monta {"type":"agg","reports":[body]} em frame_buf. Chamar com agg_lock.
+ */
+static size_t build_frame(const char *body, size_t body_len)
+{
+    memcpy(frame_buf, AGG_PREFIX, AGG_PREFIX_LEN);
+    memcpy(frame_buf + AGG_PREFIX_LEN, body, body_len);
+    memcpy(frame_buf + AGG_PREFIX_LEN + body_len, AGG_SUFFIX, AGG_SUFFIX_LEN);
+    size_t len = AGG_PREFIX_LEN + body_len + AGG_SUFFIX_LEN;
+    frame_buf[len] = '\0';
+    return len;
+}
+
+/**
+ * @brief Envia o que estiver pendente como um quadro próprio. Chamar com agg_lock.
+ */
+static void send_pending_locked(void)
+{
+    if (pending_len == 0)
+    {
+        return;
+    }
+    size_t len = build_frame(pending, pending_len);
+    ESP_LOGD(TAG, "Enviando %d relatórios pendentes (%u bytes)", pending_count, (unsigned)len);
+    agg_send(frame_buf, len);
+    pending_len = 0;
+    pending_count = 0;
+}
+
+static void append_locked(const char *entry, size_t entry_len, int count)
+{
+    if (pending_len > 0)
+    {
+        pending[pending_len++] = ',';
+    }
+    memcpy(pending + pending_len, entry, entry_len);
+    pending_len += entry_len;
+    pending[pending_len] = '\0';
+    pending_count += count;
+}
+
+void mesh_agg_push(const char *payload, size_t len)
+{
+    if (!agg_lock || !payload)
+    {
+        return;
+    }
+
+    len = trim_len(payload, len);
+
+    const char *entry = payload;
+    size_t entry_len = len;
+    int count = 1;
+
+    if (mesh_agg_is_frame(payload, len))
+    {
+        // Quadro agregado de um filho: aproveita só o conteúdo do array
+        entry = payload + AGG_PREFIX_LEN;
+        entry_len = len - AGG_PREFIX_LEN - AGG_SUFFIX_LEN;
+        count = mesh_agg_foreach(payload, len, NULL, NULL);
+        if (entry_len == 0)
+        {
+            return;
+        }
+    }
+    else if (len == 0 || payload[0] != '{')
+    {
+        ESP_LOGW(TAG, "⚠️ Relatório descartado: não é um objeto JSON");
+        return;
+    }
+
+    xSemaphoreTake(agg_lock, portMAX_DELAY);
+
+    size_t budget = AGG_BODY_MAX > own_reserve + 1 ? AGG_BODY_MAX - own_reserve - 1 : 0;
+    size_t needed = pending_len + (pending_len ? 1 : 0) + entry_len;
+
+    if (needed > budget)
+    {
+        send_pending_locked();
+    }
+
+    if (entry_len > budget)
+    {
+        // Não cabe junto com o nosso relatório: repassa sozinho
+        size_t frame_len = build_frame(entry, entry_len);
+        agg_send(frame_buf, frame_len);
+    }
+    else
+    {
+        append_locked(entry, entry_len, count);
+    }
+
+    xSemaphoreGive(agg_lock);
+}
+
+void mesh_agg_flush(const char *own_report, size_t len)
+{
+    if (!agg_lock)
+    {
+        return;
+    }
+
+    len = own_report ? trim_len(own_report, len) : 0;
+
+    xSemaphoreTake(agg_lock, portMAX_DELAY);
+
+    own_reserve = len;
+
+    if (len > 0)
+    {
+        if (pending_len + (pending_len ? 1 : 0) + len > AGG_BODY_MAX)
+        {
+            send_pending_locked();
+        }
+        if (len > AGG_BODY_MAX)
+        {
+            ESP_LOGW(TAG, "⚠️ Relatório próprio maior que o quadro (%u bytes), descartado", (unsigned)len);
+        }
+        else
+        {
+            append_locked(own_report, len, 1);
+        }
+    }
+
+    ESP_LOGD(TAG, "Flush com %d relatórios", pending_count);
+    send_pending_locked();
+
+    xSemaphoreGive(agg_lock);
+}
+
+int mesh_agg_foreach(const char *frame, size_t len, mesh_agg_report_cb cb, void *ctx)
+{
+    len = trim_len(frame, len);
+    if (!mesh_agg_is_frame(frame, len))
+    {
+        return 0;
+    }
+
+    const char *p = frame + AGG_PREFIX_LEN;
+    const char *end = frame + len - AGG_SUFFIX_LEN;
+    const char *start = NULL;
+    int depth = 0;
+    bool in_str = false;
+    int count = 0;
+
+    for (; p < end; p++)
+    {
+        char c = *p;
+        if (in_str)
+        {
+            if (c == '\\' && p + 1 < end)
+            {
+                p++;
+            }
+            else if (c == '"')
+            {
+                in_str = false;
+            }
+            continue;
+        }
+
+        if (c == '"')
+        {
+            in_str = true;
+        }
+        else if (c == '{')
+        {
+            if (depth++ == 0)
+            {
+                start = p;
+            }
+        }
+        else if (c == '}' && depth > 0)
+        {
+            if (--depth == 0 && start)
+            {
+                if (cb)
+                {
+                    cb(start, (size_t)(p - start + 1), ctx);
+                }
+                count++;
+                start = NULL;
+            }
+        }
+    }
+
+    return count;
+}
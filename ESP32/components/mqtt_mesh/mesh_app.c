@@ -0,0 +1,566 @@
+/**
+ * @file mesh_app.c
+ * @brief Canal de dados da aplicação: fila de envio por nó, quadros binários e mapeamento para tópicos MQTT no root.
+ *
+ * Cada mensagem ocupa um slot pré-alocado de MESH_APP_FRAME_MAX bytes que já é
+ * o próprio quadro enviado pela mesh: [cabeçalho][tópico][payload]. O payload é
+ * escrito direto na posição final (mesh_publish_begin/commit), sem cópias
+ * intermediárias nem JSON. Um quadro que não pode ser enviado (sem pai ou,
+ * no root, sem broker) vai para o buffer do uplink (mesh_upbuf), como os
+ * relatórios, e é publicado quando a conexão volta.
+ */
+
+#include "mqtt_mesh.h"
+#include "esp_log.h"
+#include "esp_mac.h"
+#include "esp_mesh.h"
+#include "mesh_upbuf.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TAG "MESH_APP"
+
+#define MESH_APP_MAGIC 0xA7
+#define MESH_APP_UP    1
+#define MESH_APP_DOWN  2
+
+#define DOWN_SEGMENT "/down/"
+
+typedef struct __attribute__((packed)) {
+    uint8_t magic;
+    uint8_t type;
+    uint8_t qos;
+    uint8_t topic_len;
+    uint8_t mac[6]; // origem (UP) ou destino (DOWN), MAC do AP como no restante do projeto
+    uint16_t payload_len;
+} mesh_app_hdr_t;
+
+#define PAYLOAD_MAX_FOR(topic_len) (MESH_APP_FRAME_MAX - sizeof(mesh_app_hdr_t) - (topic_len))
+
+struct mesh_app_msg {
+    uint8_t frame[MESH_APP_FRAME_MAX];
+};
+
+typedef struct {
+    char topic[MESH_APP_TOPIC_MAX];
+    mesh_app_rx_cb_t cb;
+    void *ctx;
+} mesh_app_sub_t;
+
+static mesh_app_msg_t *slots = NULL;
+static QueueHandle_t free_q = NULL; // slots livres
+static QueueHandle_t send_q = NULL; // slots prontos para envio, em ordem
+
+// Escrita por mesh_subscribe (task da aplicação), lida pela recepção: acesso sob subs_mux
+static mesh_app_sub_t subs[MESH_APP_MAX_SUBS];
+static int sub_count = 0;
+static portMUX_TYPE subs_mux = portMUX_INITIALIZER_UNLOCKED;
+
+static esp_mqtt_client_handle_t app_mqtt = NULL;
+static bool app_mqtt_connected = false;
+
+static mesh_app_stats_t stats;
+static portMUX_TYPE stats_mux = portMUX_INITIALIZER_UNLOCKED;
+
+#define STAT_INC(field)                \
+    do                                 \
+    {                                  \
+        portENTER_CRITICAL(&stats_mux); \
+        stats.field++;                 \
+        portEXIT_CRITICAL(&stats_mux);  \
+    } while (0)
+
+static void get_own_mac(uint8_t mac[6])
+{
+    esp_read_mac(mac, ESP_MAC_WIFI_STA);
+    mac[5]++;
+}
+
+static void mac_to_topic(const uint8_t *mac, char *str)
+{
+    sprintf(str, "%02X:%02X:%02X:%02X:%02X:%02X",
+            mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+}
+
+static bool parse_mac(const char *str, size_t len, uint8_t mac[6])
+{
+    unsigned int b[6];
+    char tmp[18];
+
+    if (len != 17)
+    {
+        return false;
+    }
+    memcpy(tmp, str, 17);
+    tmp[17] = '\0';
+    if (sscanf(tmp, "%2x:%2x:%2x:%2x:%2x:%2x", &b[0], &b[1], &b[2], &b[3], &b[4], &b[5]) != 6)
+    {
+        return false;
+    }
+    for (int i = 0; i < 6; i++)
+    {
+        mac[i] = (uint8_t)b[i];
+    }
+    return true;
+}
+
+static bool valid_suffix(const char *topic_suffix, size_t len)
+{
+    // "down" e "down/..." são reservados para o downlink; '+' e '#' são curingas MQTT
+    return len > 0 && len < MESH_APP_TOPIC_MAX &&
+           strcmp(topic_suffix, "down") != 0 &&
+           strncmp(topic_suffix, "down/", 5) != 0 &&
+           !strpbrk(topic_suffix, "+#");
+}
+
+/**
+ * @brief Publica um quadro de uplink no broker (somente no root).
+ */
+static bool publish_frame_to_mqtt(const mesh_app_hdr_t *hdr, const uint8_t *frame)
+{
+    char topic[sizeof(MESH_APP_TOPIC_BASE) + 18 + MESH_APP_TOPIC_MAX];
+    char mac_str[18];
+
+    if (!app_mqtt || !app_mqtt_connected)
+    {
+        return false;
+    }
+
+    mac_to_topic(hdr->mac, mac_str);
+    snprintf(topic, sizeof(topic), MESH_APP_TOPIC_BASE "%s/%.*s",
+             mac_str, hdr->topic_len, (const char *)(frame + sizeof(*hdr)));
+
+    const char *payload = (const char *)(frame + sizeof(*hdr) + hdr->topic_len);
+    return esp_mqtt_client_publish(app_mqtt, topic, payload, hdr->payload_len, hdr->qos, 0) >= 0;
+}
+
+static void deliver_local(const char *topic_suffix, size_t topic_len, const uint8_t *data, size_t len)
+{
+    mesh_app_sub_t sub = {.cb = NULL};
+
+    // Copia a assinatura sob o lock; o callback roda fora dele
+    portENTER_CRITICAL(&subs_mux);
+    for (int i = 0; i < sub_count; i++)
+    {
+        if (strlen(subs[i].topic) == topic_len && memcmp(subs[i].topic, topic_suffix, topic_len) == 0)
+        {
+            sub = subs[i];
+            break;
+        }
+    }
+    portEXIT_CRITICAL(&subs_mux);
+
+    if (!sub.cb)
+    {
+        ESP_LOGD(TAG, "Downlink sem assinante: %.*s", (int)topic_len, topic_suffix);
+        return;
+    }
+    sub.cb(sub.topic, data, len, sub.ctx);
+    STAT_INC(delivered);
+}
+
+/**
+ * @brief Guarda no buffer do uplink um quadro que não pôde ser enviado agora.
+ */
+static void buffer_frame(const uint8_t *frame, size_t len)
+{
+    if (mesh_upbuf_push(frame, len) == ESP_OK)
+    {
+        STAT_INC(buffered);
+    }
+    else
+    {
+        STAT_INC(failed);
+        ESP_LOGW(TAG, "❌ Mensagem da aplicação descartada: buffer do uplink indisponível");
+    }
+}
+
+/**
+ * @brief Envia um quadro da fila: ao broker no root, ao root da mesh nos demais nós.
+ */
+static void app_tx_one(const mesh_app_msg_t *msg)
+{
+    const mesh_app_hdr_t *hdr = (const mesh_app_hdr_t *)msg->frame;
+    size_t frame_len = sizeof(*hdr) + hdr->topic_len + hdr->payload_len;
+    bool ok;
+
+    // Com mensagens já no buffer, a nova entra atrás delas para manter a ordem
+    if (mesh_upbuf_pending() > 0)
+    {
+        ok = false;
+    }
+    else if (esp_mesh_is_root())
+    {
+        ok = publish_frame_to_mqtt(hdr, msg->frame);
+    }
+    else
+    {
+        mesh_data_t data = {
+            .proto = MESH_PROTO_BIN,
+            .tos = MESH_TOS_P2P,
+            .data = (uint8_t *)msg->frame,
+            .size = frame_len};
+        ok = esp_mesh_send(NULL, &data, 0, NULL, 0) == ESP_OK;
+    }
+
+    if (ok)
+    {
+        STAT_INC(sent);
+    }
+    else
+    {
+        buffer_frame(msg->frame, frame_len);
+    }
+}
+
+static void app_tx_task(void *arg)
+{
+    mesh_app_msg_t *msg;
+
+    while (true)
+    {
+        if (xQueueReceive(send_q, &msg, portMAX_DELAY) != pdTRUE)
+        {
+            continue;
+        }
+        app_tx_one(msg);
+        xQueueSend(free_q, &msg, 0);
+    }
+}
+
+esp_err_t mesh_app_init(int queue_len)
+{
+    if (slots)
+    {
+        return ESP_OK;
+    }
+    if (queue_len <= 0)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    slots = calloc(queue_len, sizeof(mesh_app_msg_t));
+    free_q = xQueueCreate(queue_len, sizeof(mesh_app_msg_t *));
+    send_q = xQueueCreate(queue_len, sizeof(mesh_app_msg_t *));
+    if (!slots || !free_q || !send_q)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+
+    for (int i = 0; i < queue_len; i++)
+    {
+        mesh_app_msg_t *msg = &slots[i];
+        xQueueSend(free_q, &msg, 0);
+    }
+
+    xTaskCreate(app_tx_task, "app_tx", 3072, NULL, 5, NULL);
+    return ESP_OK;
+}
+
+mesh_app_msg_t *mesh_publish_begin(const char *topic_suffix, int qos, uint8_t **payload, size_t *max_len)
+{
+    mesh_app_msg_t *msg = NULL;
+
+    if (!free_q || !topic_suffix || !payload)
+    {
+        return NULL;
+    }
+
+    size_t topic_len = strlen(topic_suffix);
+    if (!valid_suffix(topic_suffix, topic_len))
+    {
+        ESP_LOGW(TAG, "⚠️ Tópico inválido: %s", topic_suffix);
+        return NULL;
+    }
+
+    // Não bloqueia: fila cheia descarta a mensagem nova
+    if (xQueueReceive(free_q, &msg, 0) != pdTRUE)
+    {
+        STAT_INC(dropped);
+        return NULL;
+    }
+
+    mesh_app_hdr_t *hdr = (mesh_app_hdr_t *)msg->frame;
+    hdr->magic = MESH_APP_MAGIC;
+    hdr->type = MESH_APP_UP;
+    hdr->qos = qos < 0 ? 0 : (qos > 2 ? 2 : qos);
+    hdr->topic_len = topic_len;
+    hdr->payload_len = 0;
+    get_own_mac(hdr->mac);
+    memcpy(msg->frame + sizeof(*hdr), topic_suffix, topic_len);
+
+    *payload = msg->frame + sizeof(*hdr) + topic_len;
+    if (max_len)
+    {
+        *max_len = PAYLOAD_MAX_FOR(topic_len);
+    }
+    return msg;
+}
+
+esp_err_t mesh_publish_commit(mesh_app_msg_t *msg, size_t len)
+{
+    if (!msg)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    mesh_app_hdr_t *hdr = (mesh_app_hdr_t *)msg->frame;
+    if (len > PAYLOAD_MAX_FOR(hdr->topic_len))
+    {
+        mesh_publish_abort(msg);
+        return ESP_ERR_INVALID_SIZE;
+    }
+    hdr->payload_len = len;
+
+    if (xQueueSend(send_q, &msg, 0) != pdTRUE)
+    {
+        mesh_publish_abort(msg);
+        STAT_INC(dropped);
+        return ESP_ERR_NO_MEM;
+    }
+    STAT_INC(queued);
+    return ESP_OK;
+}
+
+void mesh_publish_abort(mesh_app_msg_t *msg)
+{
+    if (msg)
+    {
+        xQueueSend(free_q, &msg, 0);
+    }
+}
+
+esp_err_t mesh_publish(const char *topic_suffix, const void *buf, size_t len, int qos)
+{
+    uint8_t *payload;
+    size_t max_len;
+
+    if (!free_q)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (!buf && len > 0)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (!topic_suffix || !valid_suffix(topic_suffix, strlen(topic_suffix)))
+    {
+        ESP_LOGW(TAG, "⚠️ Tópico inválido: %s", topic_suffix ? topic_suffix : "(null)");
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    // Aqui o begin só falha com a fila cheia
+    mesh_app_msg_t *msg = mesh_publish_begin(topic_suffix, qos, &payload, &max_len);
+    if (!msg)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    if (len > max_len)
+    {
+        mesh_publish_abort(msg);
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    memcpy(payload, buf, len);
+    return mesh_publish_commit(msg, len);
+}
+
+esp_err_t mesh_subscribe(const char *topic_suffix, mesh_app_rx_cb_t cb, void *ctx)
+{
+    if (!topic_suffix || !cb || strlen(topic_suffix) >= MESH_APP_TOPIC_MAX)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    esp_err_t err = ESP_OK;
+    portENTER_CRITICAL(&subs_mux);
+    if (sub_count >= MESH_APP_MAX_SUBS)
+    {
+        err = ESP_ERR_NO_MEM;
+    }
+    else
+    {
+        strcpy(subs[sub_count].topic, topic_suffix);
+        subs[sub_count].cb = cb;
+        subs[sub_count].ctx = ctx;
+        sub_count++;
+    }
+    portEXIT_CRITICAL(&subs_mux);
+    return err;
+}
+
+bool mesh_app_is_frame(const uint8_t *data, size_t len)
+{
+    return len >= sizeof(mesh_app_hdr_t) && data[0] == MESH_APP_MAGIC;
+}
+
+static bool frame_complete(const uint8_t *data, size_t len)
+{
+    const mesh_app_hdr_t *hdr = (const mesh_app_hdr_t *)data;
+    return mesh_app_is_frame(data, len) && sizeof(*hdr) + hdr->topic_len + hdr->payload_len <= len;
+}
+
+/**
+ * @brief Publica no broker um quadro de uplink guardado no buffer (somente no root).
+ *
+ * @return false se o broker ainda está fora; quadros inválidos são descartados (true).
+ */
+bool mesh_app_publish_frame(const uint8_t *frame, size_t len)
+{
+    const mesh_app_hdr_t *hdr = (const mesh_app_hdr_t *)frame;
+
+    if (!frame_complete(frame, len) || hdr->type != MESH_APP_UP)
+    {
+        ESP_LOGW(TAG, "⚠️ Quadro da aplicação inválido no buffer, descartado");
+        STAT_INC(failed);
+        return true;
+    }
+    if (!publish_frame_to_mqtt(hdr, frame))
+    {
+        return false;
+    }
+    STAT_INC(sent);
+    return true;
+}
+
+void mesh_app_handle_rx(const uint8_t *data, size_t len)
+{
+    const mesh_app_hdr_t *hdr = (const mesh_app_hdr_t *)data;
+
+    if (!frame_complete(data, len))
+    {
+        ESP_LOGW(TAG, "⚠️ Quadro da aplicação truncado");
+        return;
+    }
+
+    const char *topic = (const char *)(data + sizeof(*hdr));
+    const uint8_t *payload = data + sizeof(*hdr) + hdr->topic_len;
+
+    if (hdr->type == MESH_APP_UP)
+    {
+        if (!esp_mesh_is_root())
+        {
+            return;
+        }
+        if (mesh_upbuf_pending() == 0 && publish_frame_to_mqtt(hdr, data))
+        {
+            STAT_INC(sent);
+        }
+        else
+        {
+            // Broker fora: o quadro do filho espera no buffer do root
+            buffer_frame(data, sizeof(*hdr) + hdr->topic_len + hdr->payload_len);
+        }
+    }
+    else if (hdr->type == MESH_APP_DOWN)
+    {
+        deliver_local(topic, hdr->topic_len, payload, hdr->payload_len);
+    }
+}
+
+void mesh_app_mqtt_connected(esp_mqtt_client_handle_t client)
+{
+    app_mqtt = client;
+    app_mqtt_connected = true;
+    esp_mqtt_client_subscribe(client, MESH_APP_TOPIC_BASE "+" DOWN_SEGMENT "#", 1);
+}
+
+void mesh_app_mqtt_disconnected(void)
+{
+    app_mqtt_connected = false;
+}
+
+/**
+ * @brief Trata mesh/node/<mac>/down/<sufixo> recebido do broker (somente no root).
+ *
+ * @return true se o tópico pertence ao canal da aplicação.
+ */
+bool mesh_app_handle_mqtt(const char *topic, int topic_len, const char *data, int data_len)
+{
+    const size_t base_len = sizeof(MESH_APP_TOPIC_BASE) - 1;
+    const size_t down_len = sizeof(DOWN_SEGMENT) - 1;
+
+    if (topic_len < (int)base_len || memcmp(topic, MESH_APP_TOPIC_BASE, base_len) != 0)
+    {
+        return false;
+    }
+
+    const char *mac_str = topic + base_len;
+    size_t rest = topic_len - base_len;
+    uint8_t mac[6];
+
+    if (rest < 17 + down_len || !parse_mac(mac_str, 17, mac) ||
+        memcmp(mac_str + 17, DOWN_SEGMENT, down_len) != 0)
+    {
+        return true; // uplink de outro nó ou tópico malformado: nada a fazer
+    }
+
+    const char *suffix = mac_str + 17 + down_len;
+    size_t suffix_len = rest - 17 - down_len;
+    if (suffix_len == 0 || suffix_len >= MESH_APP_TOPIC_MAX ||
+        (size_t)data_len > PAYLOAD_MAX_FOR(suffix_len))
+    {
+        ESP_LOGW(TAG, "⚠️ Downlink inválido ou grande demais para um quadro");
+        return true;
+    }
+
+    uint8_t own[6];
+    get_own_mac(own);
+    if (memcmp(own, mac, 6) == 0)
+    {
+        deliver_local(suffix, suffix_len, (const uint8_t *)data, data_len);
+        return true;
+    }
+
+    uint8_t *frame = malloc(sizeof(mesh_app_hdr_t) + suffix_len + data_len);
+    if (!frame)
+    {
+        return true;
+    }
+
+    mesh_app_hdr_t *hdr = (mesh_app_hdr_t *)frame;
+    hdr->magic = MESH_APP_MAGIC;
+    hdr->type = MESH_APP_DOWN;
+    hdr->qos = 0;
+    hdr->topic_len = suffix_len;
+    hdr->payload_len = data_len;
+    memcpy(hdr->mac, mac, 6);
+    memcpy(frame + sizeof(*hdr), suffix, suffix_len);
+    memcpy(frame + sizeof(*hdr) + suffix_len, data, data_len);
+
+    // Endereço mesh é o MAC STA (MAC do AP - 1)
+    mesh_addr_t dest;
+    memcpy(dest.addr, mac, 6);
+    dest.addr[5]--;
+
+    mesh_data_t mdata = {
+        .proto = MESH_PROTO_BIN,
+        .tos = MESH_TOS_P2P,
+        .data = frame,
+        .size = sizeof(*hdr) + suffix_len + data_len};
+
+    if (esp_mesh_send(&dest, &mdata, MESH_DATA_P2P, NULL, 0) != ESP_OK)
+    {
+        ESP_LOGW(TAG, "❌ Falha ao enviar downlink para %.17s", mac_str);
+        STAT_INC(failed);
+    }
+
+    free(frame);
+    return true;
+}
+
+void mesh_app_get_stats(mesh_app_stats_t *out)
+{
+    if (!out)
+    {
+        return;
+    }
+    portENTER_CRITICAL(&stats_mux);
+    *out = stats;
+    portEXIT_CRITICAL(&stats_mux);
+}
@@ -0,0 +1,282 @@
+/**
+ * @file mesh_balance.c
+ * @brief Persistência dos limites do nó e regras do assistente de balanceamento.
+ *
+ * Os limites ficam no namespace "limits" da partição "nvs_custom" (chaves
+ * "max_ch" e "layer"). O assistente roda só no root, sobre o cache de topologia.
+ */
+
+#include "mesh_balance.h"
+#include "cJSON.h"
+#include "esp_log.h"
+#include "mesh_topo.h"
+#include "nvs.h"
+#include "nvs_flash.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define TAG "MESH_BALANCE"
+
+#define LIMITS_PARTITION "nvs_custom"
+#define LIMITS_NAMESPACE "limits"
+
+static esp_err_t open_limits(nvs_open_mode_t mode, nvs_handle_t *handle)
+{
+    esp_err_t err = nvs_flash_init_partition(LIMITS_PARTITION);
+    if (err == ESP_ERR_NVS_NO_FREE_PAGES || err == ESP_ERR_NVS_NEW_VERSION_FOUND)
+    {
+        nvs_flash_erase_partition(LIMITS_PARTITION);
+        err = nvs_flash_init_partition(LIMITS_PARTITION);
+    }
+    if (err != ESP_OK)
+    {
+        return err;
+    }
+    return nvs_open_from_partition(LIMITS_PARTITION, LIMITS_NAMESPACE, mode, handle);
+}
+
+/**
+ * @brief Lê os limites gravados. Sem registro na flash, devolve os padrões (global, automático).
+ */
+esp_err_t mesh_balance_load_limits(mesh_node_limits_t *limits)
+{
+    nvs_handle_t handle;
+
+    limits->max_children = -1;
+    limits->layer_pref = MESH_LAYER_PREF_AUTO;
+
+    esp_err_t err = open_limits(NVS_READWRITE, &handle);
+    if (err != ESP_OK)
+    {
+        ESP_LOGW(TAG, "⚠️ Limites do nó indisponíveis: %s", esp_err_to_name(err));
+        return err;
+    }
+
+    nvs_get_i8(handle, "max_ch", &limits->max_children);
+    nvs_get_u8(handle, "layer", &limits->layer_pref);
+    nvs_close(handle);
+
+    if (limits->layer_pref > MESH_LAYER_PREF_LEAF)
+    {
+        limits->layer_pref = MESH_LAYER_PREF_AUTO;
+    }
+    ESP_LOGI(TAG, "📐 Limites do nó: max_children=%d, camada=%s", limits->max_children,
+             limits->layer_pref == MESH_LAYER_PREF_LEAF ? "folha" : "auto");
+    return ESP_OK;
+}
+
+esp_err_t mesh_balance_save_limits(const mesh_node_limits_t *limits)
+{
+    nvs_handle_t handle;
+
+    esp_err_t err = open_limits(NVS_READWRITE, &handle);
+    if (err != ESP_OK)
+    {
+        return err;
+    }
+
+    err = nvs_set_i8(handle, "max_ch", limits->max_children);
+    if (err == ESP_OK)
+    {
+        err = nvs_set_u8(handle, "layer", limits->layer_pref);
+    }
+    if (err == ESP_OK)
+    {
+        err = nvs_commit(handle);
+    }
+    nvs_close(handle);
+    return err;
+}
+
+typedef struct {
+    char mac[18];
+    int layer;
+    int rssi;
+    int child_count;
+    int max_children;
+} balance_node_t;
+
+typedef struct {
+    balance_node_t *nodes;
+    int cap;
+    int count;
+} balance_snapshot_t;
+
+static void snapshot_cb(const mesh_topo_node_t *node, void *ctx)
+{
+    balance_snapshot_t *snap = ctx;
+    if (snap->count >= snap->cap)
+    {
+        return;
+    }
+
+    balance_node_t *n = &snap->nodes[snap->count++];
+    strlcpy(n->mac, node->mac, sizeof(n->mac));
+    n->layer = node->layer;
+    n->rssi = node->rssi;
+    n->child_count = node->child_count;
+    n->max_children = node->max_children;
+}
+
+static void add_advice(mesh_balance_report_t *out, const balance_node_t *n, int max_children, uint8_t layer_pref,
+                       const char *reason)
+{
+    if (out->count >= MESH_BALANCE_MAX_ADVICE)
+    {
+        return;
+    }
+
+    mesh_balance_advice_t *a = &out->advice[out->count++];
+    strlcpy(a->mac, n->mac, sizeof(a->mac));
+    a->limits.max_children = max_children;
+    a->limits.layer_pref = layer_pref;
+    a->reason = reason;
+}
+
+static bool is_strong_relay(const balance_node_t *n, int strong_rssi)
+{
+    return n->layer == 2 && n->rssi >= strong_rssi;
+}
+
+/**
+ * @brief Vagas que os nós fortes da camada 2 terão depois das sugestões, para os filhos que saem do root.
+ *
+ * Cada nó conta até o próprio max_children (fanout, se também vai ser elevado); limite desconhecido não conta.
+ */
+static int layer2_spare(const balance_snapshot_t *snap, int fanout, int strong_rssi, bool deep)
+{
+    int spare = 0;
+
+    for (int i = 0; i < snap->count; i++)
+    {
+        const balance_node_t *n = &snap->nodes[i];
+        if (!is_strong_relay(n, strong_rssi) || n->max_children < 0)
+        {
+            continue;
+        }
+        int limit = deep && n->max_children < fanout ? fanout : n->max_children;
+        spare += limit > n->child_count ? limit - n->child_count : 0;
+    }
+    return spare;
+}
+
+/**
+ * @brief Sugere limites por nó a partir da topologia conhecida pelo root.
+ *
+ * fanout é o menor número de filhos por pai (até cap) com que root, camada 2 e camada 3
+ * comportam todos os nós conhecidos.
+ *
+ * - Árvore com mais de 2 camadas: root e nós da camada 2 com RSSI forte passam a aceitar
+ *   fanout filhos, para que os nós profundos se reconectem mais perto do root.
+ * - Root com mais de fanout filhos: reduzido até fanout, no limite das vagas que os nós
+ *   fortes da camada 2 têm para receber os filhos que saem dele.
+ * - Enlace fraco sem filhos: vira folha. Enlace fraco com vários filhos: limitado a 1.
+ *
+ * A sugestão do root, se houver, é sempre a última: aplicá-la reinicia a mesh dele e
+ * a rede inteira se reorganiza em torno do novo limite.
+ *
+ * @param cap Máximo de filhos aceito pelos comandos config e limits (CONFIG_MESH_AP_CONNECTIONS).
+ */
+void mesh_balance_advise(int cap, int strong_rssi, int weak_rssi, mesh_balance_report_t *out)
+{
+    balance_snapshot_t snap = {.cap = mesh_topo_capacity()};
+    int fanout = 1;
+    int root = -1;
+    int layer_sum = 0;
+
+    memset(out, 0, sizeof(*out));
+    snap.nodes = snap.cap ? calloc(snap.cap, sizeof(balance_node_t)) : NULL;
+    if (!snap.nodes)
+    {
+        return;
+    }
+    mesh_topo_foreach(snapshot_cb, &snap);
+
+    for (int i = 0; i < snap.count; i++)
+    {
+        layer_sum += snap.nodes[i].layer;
+        if (snap.nodes[i].layer > out->max_layer)
+        {
+            out->max_layer = snap.nodes[i].layer;
+        }
+    }
+    out->nodes = snap.count;
+    out->avg_layer = snap.count ? (float)layer_sum / snap.count : 0;
+    bool deep = out->max_layer > 2;
+
+    // Menor número de filhos por pai com que root, camada 2 e camada 3 comportam todos os nós
+    while (fanout < cap && fanout + fanout * fanout < snap.count - 1)
+    {
+        fanout++;
+    }
+
+    for (int i = 0; i < snap.count; i++)
+    {
+        const balance_node_t *n = &snap.nodes[i];
+        bool weak = n->layer > 1 && n->rssi != MESH_TOPO_NO_RSSI && n->rssi < weak_rssi;
+
+        if (n->layer == 1)
+        {
+            root = i; // por último, depois dos nós que vão receber os filhos dele
+        }
+        else if (deep && is_strong_relay(n, strong_rssi) && n->max_children >= 0 && n->max_children < fanout)
+        {
+            add_advice(out, n, fanout, MESH_LAYER_PREF_AUTO, "raso e forte: aceita mais filhos");
+        }
+        else if (weak && n->child_count == 0 && n->max_children != 0)
+        {
+            add_advice(out, n, 0, MESH_LAYER_PREF_LEAF, "enlace fraco: apenas folha");
+        }
+        else if (weak && n->child_count > 1 && n->max_children != 1)
+        {
+            add_advice(out, n, 1, MESH_LAYER_PREF_AUTO, "enlace fraco: menos filhos");
+        }
+    }
+
+    if (root >= 0)
+    {
+        const balance_node_t *n = &snap.nodes[root];
+        int excess = n->child_count - fanout;
+        int spare = excess > 0 ? layer2_spare(&snap, fanout, strong_rssi, deep) : 0;
+
+        if (excess > 0 && spare > 0)
+        {
+            int limit = n->child_count - (spare < excess ? spare : excess);
+            add_advice(out, n, limit, MESH_LAYER_PREF_AUTO, "root sobrecarregado: filhos vão para a camada 2");
+        }
+        else if (deep && n->max_children >= 0 && n->max_children < fanout)
+        {
+            add_advice(out, n, fanout, MESH_LAYER_PREF_AUTO, "raso e forte: aceita mais filhos");
+        }
+    }
+    free(snap.nodes);
+}
+
+/**
+ * @brief Serializa o resultado do assistente. O chamador libera com cJSON_free().
+ */
+char *mesh_balance_to_json(const mesh_balance_report_t *report, bool applied)
+{
+    cJSON *json = cJSON_CreateObject();
+    cJSON_AddStringToObject(json, "type", "advice");
+    cJSON_AddNumberToObject(json, "nodes", report->nodes);
+    cJSON_AddNumberToObject(json, "max_layer", report->max_layer);
+    cJSON_AddNumberToObject(json, "avg_layer", report->avg_layer);
+    cJSON_AddBoolToObject(json, "applied", applied);
+
+    cJSON *list = cJSON_AddArrayToObject(json, "suggestions");
+    for (size_t i = 0; i < report->count; i++)
+    {
+        const mesh_balance_advice_t *a = &report->advice[i];
+        cJSON *item = cJSON_CreateObject();
+        cJSON_AddStringToObject(item, "mac", a->mac);
+        cJSON_AddNumberToObject(item, "max_children", a->limits.max_children);
+        cJSON_AddStringToObject(item, "layer", a->limits.layer_pref == MESH_LAYER_PREF_LEAF ? "leaf" : "auto");
+        cJSON_AddStringToObject(item, "reason", a->reason);
+        cJSON_AddItemToArray(list, item);
+    }
+
+    char *out = cJSON_PrintUnformatted(json);
+    cJSON_Delete(json);
+    return out;
+}
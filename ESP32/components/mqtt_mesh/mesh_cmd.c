@@ -0,0 +1,300 @@
+/**
+ * @file mesh_cmd.c
+ * @brief Tabela de comandos indexada por opcode, conversão JSON -> binário e despacho único.
+ *
+ * Quadro binário (magic 0xA9): [magic][op][flags][target 6][args_len 2][args].
+ */
+
+#include "mesh_cmd.h"
+#include "esp_log.h"
+#include "esp_mac.h"
+#include "esp_mesh.h"
+#include <stdio.h>
+#include <string.h>
+
+#define TAG "MESH_CMD"
+
+#define MESH_CMD_MAGIC 0xA9
+
+typedef struct __attribute__((packed)) {
+    uint8_t magic;
+    uint8_t op;
+    uint8_t flags;
+    uint8_t target[6];
+    uint16_t args_len;
+} mesh_cmd_hdr_t;
+
+static mesh_cmd_def_t table[MESH_CMD_MAX_OPS];
+static mesh_cmd_forward_fn forward_fn = NULL;
+static uint8_t own_mac[6];
+
+esp_err_t mesh_cmd_init(mesh_cmd_forward_fn forward)
+{
+    forward_fn = forward;
+    esp_read_mac(own_mac, ESP_MAC_WIFI_STA);
+    own_mac[5]++;
+    return ESP_OK;
+}
+
+esp_err_t mesh_cmd_register(uint8_t op, const mesh_cmd_def_t *def)
+{
+    if (op == 0 || op >= MESH_CMD_MAX_OPS || !def || !def->name || !def->handler ||
+        def->args_size > MESH_CMD_ARGS_MAX)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (table[op].handler)
+    {
+        ESP_LOGE(TAG, "Opcode %u já registrado para '%s'", op, table[op].name);
+        return ESP_ERR_INVALID_STATE;
+    }
+    table[op] = *def;
+    return ESP_OK;
+}
+
+static uint8_t op_from_name(const char *name)
+{
+    for (int op = 1; op < MESH_CMD_MAX_OPS; op++)
+    {
+        if (table[op].name && strcmp(table[op].name, name) == 0)
+        {
+            return op;
+        }
+    }
+    return 0;
+}
+
+bool mesh_cmd_parse_mac(const char *str, uint8_t mac[6])
+{
+    unsigned int b[6];
+    char end;
+
+    if (sscanf(str, "%2x:%2x:%2x:%2x:%2x:%2x%c", &b[0], &b[1], &b[2], &b[3], &b[4], &b[5], &end) != 6)
+    {
+        return false;
+    }
+    for (int i = 0; i < 6; i++)
+    {
+        mac[i] = (uint8_t)b[i];
+    }
+    return true;
+}
+
+/**
+ * @brief Converte e valida o JSON recebido do broker. Só aqui há parse de texto.
+ *
+ * Sem "action"/"op", um JSON com "interval" é tratado como o comando "config"
+ * (formato usado pelo configurador).
+ */
+esp_err_t mesh_cmd_from_json(const char *json, size_t len, mesh_cmd_t *cmd)
+{
+    esp_err_t err = ESP_OK;
+    cJSON *root = cJSON_ParseWithLength(json, len);
+
+    if (!root || !cJSON_IsObject(root))
+    {
+        cJSON_Delete(root);
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    memset(cmd, 0, sizeof(*cmd));
+
+    cJSON *op = cJSON_GetObjectItem(root, "op");
+    cJSON *action = cJSON_GetObjectItem(root, "action");
+    cJSON *target = cJSON_GetObjectItem(root, "target");
+
+    if (cJSON_IsNumber(op) && op->valueint > 0 && op->valueint < MESH_CMD_MAX_OPS)
+    {
+        cmd->op = op->valueint;
+    }
+    else if (cJSON_IsString(action))
+    {
+        cmd->op = op_from_name(action->valuestring);
+    }
+    else if (cJSON_GetObjectItem(root, "interval"))
+    {
+        cmd->op = op_from_name("config");
+    }
+
+    const mesh_cmd_def_t *def = cmd->op ? &table[cmd->op] : NULL;
+    if (!def || !def->handler)
+    {
+        ESP_LOGW(TAG, "⚠️ Comando desconhecido");
+        err = ESP_ERR_NOT_SUPPORTED;
+        goto out;
+    }
+
+    if (target)
+    {
+        if (!cJSON_IsString(target) || !mesh_cmd_parse_mac(target->valuestring, cmd->target))
+        {
+            ESP_LOGW(TAG, "⚠️ 'target' inválido em '%s'", def->name);
+            err = ESP_ERR_INVALID_ARG;
+            goto out;
+        }
+        // Comandos do root não são repassados: outro destino seria descartado em silêncio
+        if ((def->flags & MESH_CMD_F_ROOT_ONLY) && memcmp(cmd->target, own_mac, 6) != 0)
+        {
+            ESP_LOGW(TAG, "⚠️ '%s' só roda no root: 'target' " MACSTR " rejeitado", def->name, MAC2STR(cmd->target));
+            err = ESP_ERR_NOT_ALLOWED;
+            goto out;
+        }
+    }
+    else if (def->flags & MESH_CMD_F_TARGETED)
+    {
+        ESP_LOGW(TAG, "⚠️ '%s' exige 'target'", def->name);
+        err = ESP_ERR_INVALID_ARG;
+        goto out;
+    }
+    else
+    {
+        cmd->flags |= MESH_CMD_BROADCAST;
+    }
+
+    if (def->parse)
+    {
+        err = def->parse(root, cmd);
+        if (err != ESP_OK)
+        {
+            ESP_LOGW(TAG, "⚠️ Argumentos inválidos para '%s'", def->name);
+            goto out;
+        }
+    }
+    if (def->args_size && cmd->args_len != def->args_size)
+    {
+        err = ESP_ERR_INVALID_SIZE;
+    }
+
+out:
+    cJSON_Delete(root);
+    return err;
+}
+
+bool mesh_cmd_is_frame(const uint8_t *data, size_t len)
+{
+    return len >= sizeof(mesh_cmd_hdr_t) && data[0] == MESH_CMD_MAGIC;
+}
+
+esp_err_t mesh_cmd_decode(const uint8_t *data, size_t len, mesh_cmd_t *cmd)
+{
+    const mesh_cmd_hdr_t *hdr = (const mesh_cmd_hdr_t *)data;
+
+    if (!mesh_cmd_is_frame(data, len) || hdr->op == 0 || hdr->op >= MESH_CMD_MAX_OPS ||
+        hdr->args_len > MESH_CMD_ARGS_MAX || sizeof(*hdr) + hdr->args_len > len)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    const mesh_cmd_def_t *def = &table[hdr->op];
+    if (!def->handler || (def->args_size && hdr->args_len != def->args_size))
+    {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    cmd->op = hdr->op;
+    cmd->flags = hdr->flags;
+    memcpy(cmd->target, hdr->target, 6);
+    cmd->args_len = hdr->args_len;
+    memcpy(cmd->args, data + sizeof(*hdr), hdr->args_len);
+    return ESP_OK;
+}
+
+size_t mesh_cmd_encode(const mesh_cmd_t *cmd, uint8_t *out, size_t size)
+{
+    size_t len = sizeof(mesh_cmd_hdr_t) + cmd->args_len;
+    if (len > size)
+    {
+        return 0;
+    }
+
+    mesh_cmd_hdr_t *hdr = (mesh_cmd_hdr_t *)out;
+    hdr->magic = MESH_CMD_MAGIC;
+    hdr->op = cmd->op;
+    hdr->flags = cmd->flags;
+    memcpy(hdr->target, cmd->target, 6);
+    hdr->args_len = cmd->args_len;
+    memcpy(out + sizeof(*hdr), cmd->args, cmd->args_len);
+    return len;
+}
+
+bool mesh_cmd_is_for_me(const mesh_cmd_t *cmd)
+{
+    return (cmd->flags & MESH_CMD_BROADCAST) || memcmp(cmd->target, own_mac, 6) == 0;
+}
+
+/**
+ * @brief Executa o comando se for para este nó e, no root, repassa aos demais.
+ */
+void mesh_cmd_dispatch(const mesh_cmd_t *cmd, mesh_cmd_src_t src)
+{
+    if (cmd->op == 0 || cmd->op >= MESH_CMD_MAX_OPS || !table[cmd->op].handler)
+    {
+        return;
+    }
+
+    const mesh_cmd_def_t *def = &table[cmd->op];
+    bool for_me = mesh_cmd_is_for_me(cmd);
+
+    // O root nunca repassa estes comandos: vindos da mesh a outro nó, são de um par qualquer
+    if ((def->flags & MESH_CMD_F_ROOT_ONLY) && src == MESH_CMD_SRC_MESH && !esp_mesh_is_root())
+    {
+        ESP_LOGW(TAG, "⚠️ '%s' só roda no root: quadro da mesh descartado", def->name);
+        return;
+    }
+
+    if (src == MESH_CMD_SRC_MQTT && esp_mesh_is_root() && forward_fn &&
+        !(def->flags & MESH_CMD_F_ROOT_ONLY) &&
+        ((cmd->flags & MESH_CMD_BROADCAST) || !for_me))
+    {
+        uint8_t frame[sizeof(mesh_cmd_hdr_t) + MESH_CMD_ARGS_MAX];
+        size_t len = mesh_cmd_encode(cmd, frame, sizeof(frame));
+        ESP_LOGI(TAG, "🔁 Repassando '%s' pela mesh (%u bytes)", def->name, (unsigned)len);
+        forward_fn(frame, len, (cmd->flags & MESH_CMD_BROADCAST) ? NULL : cmd->target);
+    }
+
+    if (for_me)
+    {
+        def->handler(cmd, src);
+    }
+    else if (def->flags & MESH_CMD_F_ROOT_ONLY)
+    {
+        ESP_LOGW(TAG, "⚠️ '%s' só roda no root: descartado para " MACSTR, def->name, MAC2STR(cmd->target));
+    }
+}
+
+/**
+ * @brief Gera um comando no próprio root (sem passar pelo broker) e o envia pela mesh.
+ *
+ * @param target_mac MAC do AP do destino ("AA:BB:...") ou NULL para todos os nós.
+ */
+esp_err_t mesh_cmd_send(uint8_t op, const char *target_mac, const void *args, size_t args_len)
+{
+    mesh_cmd_t cmd = {0};
+
+    if (op == 0 || op >= MESH_CMD_MAX_OPS || !table[op].handler || args_len > MESH_CMD_ARGS_MAX ||
+        (table[op].args_size && args_len != table[op].args_size))
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    cmd.op = op;
+    if (target_mac)
+    {
+        if (!mesh_cmd_parse_mac(target_mac, cmd.target))
+        {
+            return ESP_ERR_INVALID_ARG;
+        }
+    }
+    else
+    {
+        cmd.flags |= MESH_CMD_BROADCAST;
+    }
+    cmd.args_len = args_len;
+    if (args_len)
+    {
+        memcpy(cmd.args, args, args_len);
+    }
+
+    mesh_cmd_dispatch(&cmd, MESH_CMD_SRC_MQTT);
+    return ESP_OK;
+}
@@ -0,0 +1,649 @@
+/**
+ * @file mesh_ota.c
+ * @brief OTA pela mesh: o root baixa a imagem e cada pai repassa os blocos aos filhos em pipeline.
+ *
+ * Quadros (binários, magic 0xA8):
+ *  - START: pai -> filho, anuncia a imagem (id, tamanho). Reenviado quando um filho se conecta.
+ *  - CHUNK: pai -> filho, bloco "seq" de até MESH_OTA_CHUNK_SIZE bytes.
+ *  - ACK:   filho -> pai, "seq" é o próximo bloco que o filho espera (retomada).
+ *
+ * O pai não guarda os blocos em RAM: ele os relê da partição OTA onde acabou de gravá-los.
+ *
+ * O id da última imagem gravada por completo fica no namespace "ota" da partição
+ * "nvs_custom". Depois de reiniciar com ela, o nó responde ao START da mesma imagem
+ * (o pai ainda pode estar em OTA_COMPLETE) com um ACK de todos os blocos, sem gravá-la de novo.
+ */
+
+#include "mesh_ota.h"
+#include "esp_http_client.h"
+#include "esp_log.h"
+#include "esp_ota_ops.h"
+#include "esp_partition.h"
+#include "esp_random.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "nvs.h"
+#include "nvs_flash.h"
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TAG "MESH_OTA"
+
+#define MESH_OTA_MAGIC 0xA8
+#define OTA_START 1
+#define OTA_CHUNK 2
+#define OTA_ACK   3
+
+#define RETRY_TIMEOUT_US   (2000 * 1000)
+#define REBOOT_TIMEOUT_US  (60 * 1000 * 1000)
+#define URL_MAX            (256)
+
+#define OTA_NVS_PARTITION "nvs_custom"
+#define OTA_NVS_NAMESPACE "ota"
+
+typedef struct __attribute__((packed)) {
+    uint8_t magic;
+    uint8_t type;
+    uint16_t seq;
+    uint32_t image_id;
+    uint32_t total;
+    uint16_t len;
+} mesh_ota_hdr_t;
+
+typedef enum {
+    OTA_IDLE = 0,
+    OTA_RECEIVING,
+    OTA_COMPLETE,
+} mesh_ota_state_t;
+
+typedef struct {
+    bool used;
+    mesh_addr_t addr;
+    uint16_t next;     // próximo bloco confirmado pelo filho
+    uint16_t sent;     // próximo bloco a ser enviado
+    bool started;      // filho já confirmou o START desta imagem
+    int64_t last_progress_us;
+} ota_child_t;
+
+static struct {
+    mesh_ota_state_t state;
+    uint32_t image_id;
+    uint32_t total;
+    uint16_t chunks;
+    uint16_t next; // blocos gravados em sequência
+    const esp_partition_t *part;
+    esp_ota_handle_t handle;
+    mesh_addr_t parent;
+    bool is_source;
+    int64_t start_us;
+    int64_t complete_us;
+    uint32_t installed_id; // última imagem gravada por completo (NVS), 0 se nenhuma
+} ota;
+
+static ota_child_t children[MESH_OTA_MAX_CHILDREN];
+static SemaphoreHandle_t ota_lock = NULL;
+static uint8_t frame_buf[sizeof(mesh_ota_hdr_t) + MESH_OTA_CHUNK_SIZE];
+static char url_buf[URL_MAX];
+
+static esp_err_t open_ota_nvs(nvs_open_mode_t mode, nvs_handle_t *handle)
+{
+    esp_err_t err = nvs_flash_init_partition(OTA_NVS_PARTITION);
+    if (err == ESP_ERR_NVS_NO_FREE_PAGES || err == ESP_ERR_NVS_NEW_VERSION_FOUND)
+    {
+        nvs_flash_erase_partition(OTA_NVS_PARTITION);
+        err = nvs_flash_init_partition(OTA_NVS_PARTITION);
+    }
+    if (err != ESP_OK)
+    {
+        return err;
+    }
+    return nvs_open_from_partition(OTA_NVS_PARTITION, OTA_NVS_NAMESPACE, mode, handle);
+}
+
+static void load_installed_id(void)
+{
+    nvs_handle_t handle;
+
+    ota.installed_id = 0;
+    if (open_ota_nvs(NVS_READONLY, &handle) == ESP_OK)
+    {
+        nvs_get_u32(handle, "installed", &ota.installed_id);
+        nvs_close(handle);
+    }
+}
+
+static void save_installed_id(uint32_t image_id)
+{
+    nvs_handle_t handle;
+
+    ota.installed_id = image_id;
+    esp_err_t err = open_ota_nvs(NVS_READWRITE, &handle);
+    if (err == ESP_OK)
+    {
+        err = nvs_set_u32(handle, "installed", image_id);
+        if (err == ESP_OK)
+        {
+            err = nvs_commit(handle);
+        }
+        nvs_close(handle);
+    }
+    if (err != ESP_OK)
+    {
+        // Sem o registro, o START da mesma imagem depois do reboot a grava de novo
+        ESP_LOGW(TAG, "⚠️ Falha ao gravar o id da imagem: %s", esp_err_to_name(err));
+    }
+}
+
+static uint16_t chunk_len(uint16_t seq)
+{
+    uint32_t offset = (uint32_t)seq * MESH_OTA_CHUNK_SIZE;
+    uint32_t left = ota.total - offset;
+    return left > MESH_OTA_CHUNK_SIZE ? MESH_OTA_CHUNK_SIZE : (uint16_t)left;
+}
+
+static esp_err_t send_frame(const mesh_addr_t *to, uint8_t type, uint16_t seq, const uint8_t *payload, uint16_t len)
+{
+    mesh_ota_hdr_t *hdr = (mesh_ota_hdr_t *)frame_buf;
+    hdr->magic = MESH_OTA_MAGIC;
+    hdr->type = type;
+    hdr->seq = seq;
+    hdr->image_id = ota.image_id;
+    hdr->total = ota.total;
+    hdr->len = len;
+    if (payload && payload != frame_buf + sizeof(*hdr))
+    {
+        memcpy(frame_buf + sizeof(*hdr), payload, len);
+    }
+
+    mesh_data_t data = {
+        .proto = MESH_PROTO_BIN,
+        .tos = MESH_TOS_P2P,
+        .data = frame_buf,
+        .size = sizeof(*hdr) + len};
+    return esp_mesh_send(to, &data, MESH_DATA_P2P, NULL, 0);
+}
+
+/**
+ * @brief Envia ao filho os blocos já gravados que cabem na janela. Chamar com ota_lock.
+ */
+static void pump_child(ota_child_t *child)
+{
+    if (!child->started)
+    {
+        return;
+    }
+
+    while (child->sent < ota.next && child->sent < child->next + MESH_OTA_WINDOW)
+    {
+        uint16_t seq = child->sent;
+        uint16_t len = chunk_len(seq);
+        uint8_t *payload = frame_buf + sizeof(mesh_ota_hdr_t);
+
+        if (esp_partition_read(ota.part, (size_t)seq * MESH_OTA_CHUNK_SIZE, payload, len) != ESP_OK ||
+            send_frame(&child->addr, OTA_CHUNK, seq, payload, len) != ESP_OK)
+        {
+            // Tenta de novo no próximo timeout
+            break;
+        }
+        child->sent++;
+    }
+}
+
+static void pump_all_children(void)
+{
+    for (int i = 0; i < MESH_OTA_MAX_CHILDREN; i++)
+    {
+        if (children[i].used)
+        {
+            pump_child(&children[i]);
+        }
+    }
+}
+
+static void announce_to_child(ota_child_t *child)
+{
+    if (ota.state == OTA_IDLE)
+    {
+        return;
+    }
+    child->started = false;
+    child->last_progress_us = esp_timer_get_time();
+    send_frame(&child->addr, OTA_START, 0, NULL, 0);
+}
+
+static ota_child_t *find_child(const uint8_t mac[6])
+{
+    for (int i = 0; i < MESH_OTA_MAX_CHILDREN; i++)
+    {
+        if (children[i].used && memcmp(children[i].addr.addr, mac, 6) == 0)
+        {
+            return &children[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Inicia (ou reinicia) a gravação local de uma nova imagem. Chamar com ota_lock.
+ */
+static esp_err_t begin_image(uint32_t image_id, uint32_t total)
+{
+    if (ota.state == OTA_RECEIVING)
+    {
+        esp_ota_abort(ota.handle);
+    }
+
+    ota.state = OTA_IDLE;
+    ota.part = esp_ota_get_next_update_partition(NULL);
+    if (!ota.part || total == 0 || total > ota.part->size)
+    {
+        ESP_LOGE(TAG, "❌ Sem partição OTA adequada para %" PRIu32 " bytes", total);
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    esp_err_t err = esp_ota_begin(ota.part, OTA_WITH_SEQUENTIAL_WRITES, &ota.handle);
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "❌ esp_ota_begin falhou: %s", esp_err_to_name(err));
+        return err;
+    }
+
+    ota.image_id = image_id;
+    ota.total = total;
+    ota.chunks = (total + MESH_OTA_CHUNK_SIZE - 1) / MESH_OTA_CHUNK_SIZE;
+    ota.next = 0;
+    ota.state = OTA_RECEIVING;
+    ota.start_us = esp_timer_get_time();
+    ota.complete_us = 0;
+
+    ESP_LOGI(TAG, "📦 Nova imagem %08" PRIx32 ": %" PRIu32 " bytes em %u blocos na partição %s",
+             image_id, total, ota.chunks, ota.part->label);
+
+    for (int i = 0; i < MESH_OTA_MAX_CHILDREN; i++)
+    {
+        if (children[i].used)
+        {
+            children[i].next = 0;
+            children[i].sent = 0;
+            announce_to_child(&children[i]);
+        }
+    }
+    return ESP_OK;
+}
+
+/**
+ * @brief Grava o próximo bloco em sequência e repassa aos filhos. Chamar com ota_lock.
+ */
+static esp_err_t write_next_chunk(const uint8_t *data, uint16_t len)
+{
+    esp_err_t err = esp_ota_write(ota.handle, data, len);
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "❌ esp_ota_write falhou no bloco %u: %s", ota.next, esp_err_to_name(err));
+        return err;
+    }
+    ota.next++;
+
+    if (ota.next == ota.chunks)
+    {
+        err = esp_ota_end(ota.handle);
+        if (err == ESP_OK)
+        {
+            err = esp_ota_set_boot_partition(ota.part);
+        }
+        if (err != ESP_OK)
+        {
+            ESP_LOGE(TAG, "❌ Imagem inválida: %s", esp_err_to_name(err));
+            ota.state = OTA_IDLE;
+            return err;
+        }
+        ota.state = OTA_COMPLETE;
+        ota.complete_us = esp_timer_get_time();
+        save_installed_id(ota.image_id);
+        ESP_LOGI(TAG, "✅ Imagem recebida em %" PRId64 " ms", (ota.complete_us - ota.start_us) / 1000);
+    }
+
+    pump_all_children();
+    return ESP_OK;
+}
+
+static bool all_children_done(void)
+{
+    for (int i = 0; i < MESH_OTA_MAX_CHILDREN; i++)
+    {
+        if (children[i].used && children[i].next < ota.chunks)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Retransmissões por timeout.
+ *
+ * @return true quando a imagem está gravada e os filhos terminaram (ou desistiram): hora de reiniciar.
+ */
+static bool ota_tick(void)
+{
+    xSemaphoreTake(ota_lock, portMAX_DELAY);
+
+    int64_t now = esp_timer_get_time();
+    for (int i = 0; i < MESH_OTA_MAX_CHILDREN && ota.state != OTA_IDLE; i++)
+    {
+        ota_child_t *child = &children[i];
+        if (!child->used || child->next >= ota.chunks || now - child->last_progress_us < RETRY_TIMEOUT_US)
+        {
+            continue;
+        }
+        if (!child->started)
+        {
+            announce_to_child(child);
+        }
+        else if (child->next < ota.next)
+        {
+            // Go-back-N a partir do último bloco confirmado
+            child->sent = child->next;
+            child->last_progress_us = now;
+            pump_child(child);
+        }
+    }
+
+    bool reboot = ota.state == OTA_COMPLETE &&
+                  (all_children_done() || now - ota.complete_us > REBOOT_TIMEOUT_US);
+
+    xSemaphoreGive(ota_lock);
+    return reboot;
+}
+
+static void ota_task(void *arg)
+{
+    while (true)
+    {
+        vTaskDelay(pdMS_TO_TICKS(500));
+
+        if (ota_tick())
+        {
+            ESP_LOGW(TAG, "🔁 Reiniciando com o novo firmware...");
+            vTaskDelay(pdMS_TO_TICKS(1000));
+            esp_restart();
+        }
+    }
+}
+
+esp_err_t mesh_ota_init(void)
+{
+    if (ota_lock)
+    {
+        return ESP_OK;
+    }
+    ota_lock = xSemaphoreCreateMutex();
+    if (!ota_lock)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    load_installed_id();
+    xTaskCreate(ota_task, "mesh_ota", 3072, NULL, 4, NULL);
+    return ESP_OK;
+}
+
+static void ota_download_task(void *arg)
+{
+    uint8_t *buf = malloc(MESH_OTA_CHUNK_SIZE);
+    esp_http_client_config_t config = {
+        .url = url_buf,
+        .timeout_ms = 10000,
+    };
+    esp_http_client_handle_t client = esp_http_client_init(&config);
+    esp_err_t err = buf && client ? esp_http_client_open(client, 0) : ESP_ERR_NO_MEM;
+    int64_t total = 0;
+
+    if (err == ESP_OK)
+    {
+        total = esp_http_client_fetch_headers(client);
+    }
+    if (err != ESP_OK || total <= 0)
+    {
+        ESP_LOGE(TAG, "❌ Falha ao baixar %s (%s)", url_buf, esp_err_to_name(err));
+        goto out;
+    }
+
+    xSemaphoreTake(ota_lock, portMAX_DELAY);
+    err = begin_image(esp_random() | 1, (uint32_t)total);
+    xSemaphoreGive(ota_lock);
+    if (err != ESP_OK)
+    {
+        goto out;
+    }
+
+    while (true)
+    {
+        // Sempre lê um bloco inteiro (exceto o último) para manter o alinhamento com os filhos
+        int got = 0;
+        int want = total - (int64_t)ota.next * MESH_OTA_CHUNK_SIZE > MESH_OTA_CHUNK_SIZE
+                       ? MESH_OTA_CHUNK_SIZE
+                       : (int)(total - (int64_t)ota.next * MESH_OTA_CHUNK_SIZE);
+        while (got < want)
+        {
+            int r = esp_http_client_read(client, (char *)buf + got, want - got);
+            if (r <= 0)
+            {
+                break;
+            }
+            got += r;
+        }
+        if (got != want)
+        {
+            ESP_LOGE(TAG, "❌ Download interrompido no bloco %u", ota.next);
+            xSemaphoreTake(ota_lock, portMAX_DELAY);
+            esp_ota_abort(ota.handle);
+            ota.state = OTA_IDLE;
+            xSemaphoreGive(ota_lock);
+            break;
+        }
+
+        xSemaphoreTake(ota_lock, portMAX_DELAY);
+        err = write_next_chunk(buf, got);
+        bool done = ota.state != OTA_RECEIVING;
+        xSemaphoreGive(ota_lock);
+
+        if (err != ESP_OK || done)
+        {
+            break;
+        }
+    }
+
+out:
+    if (client)
+    {
+        esp_http_client_close(client);
+        esp_http_client_cleanup(client);
+    }
+    free(buf);
+    ota.is_source = false;
+    vTaskDelete(NULL);
+}
+
+esp_err_t mesh_ota_start_from_url(const char *url)
+{
+    if (!ota_lock || !url)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (ota.is_source || ota.state == OTA_RECEIVING)
+    {
+        ESP_LOGW(TAG, "⚠️ Já existe uma atualização em andamento");
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (strlen(url) >= URL_MAX)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    strcpy(url_buf, url);
+    ota.is_source = true;
+    if (xTaskCreate(ota_download_task, "ota_download", 6144, NULL, 5, NULL) != pdPASS)
+    {
+        ota.is_source = false;
+        return ESP_ERR_NO_MEM;
+    }
+    ESP_LOGI(TAG, "⬇️ Baixando firmware de %s", url);
+    return ESP_OK;
+}
+
+bool mesh_ota_is_frame(const uint8_t *data, size_t len)
+{
+    return len >= sizeof(mesh_ota_hdr_t) && data[0] == MESH_OTA_MAGIC;
+}
+
+static void handle_start(const mesh_addr_t *from, const mesh_ota_hdr_t *hdr)
+{
+    ota.parent = *from;
+
+    if (ota.state == OTA_IDLE && hdr->image_id == ota.installed_id)
+    {
+        // Já reiniciou com esta imagem: confirma todos os blocos para o pai dar este filho por concluído
+        ota.image_id = hdr->image_id;
+        ota.total = hdr->total;
+        ota.chunks = (hdr->total + MESH_OTA_CHUNK_SIZE - 1) / MESH_OTA_CHUNK_SIZE;
+        ESP_LOGI(TAG, "✅ Imagem %08" PRIx32 " já instalada", ota.image_id);
+        send_frame(&ota.parent, OTA_ACK, ota.chunks, NULL, 0);
+        return;
+    }
+
+    if (ota.state == OTA_IDLE || hdr->image_id != ota.image_id)
+    {
+        if (begin_image(hdr->image_id, hdr->total) != ESP_OK)
+        {
+            return;
+        }
+    }
+    else
+    {
+        ESP_LOGI(TAG, "⏯️ Retomando imagem %08" PRIx32 " no bloco %u", ota.image_id, ota.next);
+    }
+
+    send_frame(&ota.parent, OTA_ACK, ota.next, NULL, 0);
+}
+
+static void handle_chunk(const mesh_addr_t *from, const mesh_ota_hdr_t *hdr, const uint8_t *payload)
+{
+    if (ota.state != OTA_RECEIVING || hdr->image_id != ota.image_id)
+    {
+        return;
+    }
+
+    if (hdr->seq == ota.next && hdr->len == chunk_len(hdr->seq))
+    {
+        write_next_chunk(payload, hdr->len);
+    }
+
+    // Confirma sempre: blocos fora de ordem fazem o pai voltar ao último confirmado
+    send_frame(from, OTA_ACK, ota.next, NULL, 0);
+}
+
+static void handle_ack(const mesh_addr_t *from, const mesh_ota_hdr_t *hdr)
+{
+    ota_child_t *child = find_child(from->addr);
+
+    if (!child || hdr->image_id != ota.image_id)
+    {
+        return;
+    }
+
+    if (!child->started || hdr->seq > child->next)
+    {
+        child->last_progress_us = esp_timer_get_time();
+    }
+    child->started = true;
+    child->next = hdr->seq;
+    if (child->sent < child->next)
+    {
+        child->sent = child->next;
+    }
+    pump_child(child);
+}
+
+void mesh_ota_handle_rx(const mesh_addr_t *from, const uint8_t *data, size_t len)
+{
+    const mesh_ota_hdr_t *hdr = (const mesh_ota_hdr_t *)data;
+
+    if (!ota_lock || !mesh_ota_is_frame(data, len) || sizeof(*hdr) + hdr->len > len)
+    {
+        return;
+    }
+
+    xSemaphoreTake(ota_lock, portMAX_DELAY);
+    switch (hdr->type)
+    {
+    case OTA_START:
+        handle_start(from, hdr);
+        break;
+    case OTA_CHUNK:
+        handle_chunk(from, hdr, data + sizeof(*hdr));
+        break;
+    case OTA_ACK:
+        handle_ack(from, hdr);
+        break;
+    default:
+        break;
+    }
+    xSemaphoreGive(ota_lock);
+}
+
+void mesh_ota_child_connected(const uint8_t mac[6])
+{
+    if (!ota_lock)
+    {
+        return;
+    }
+
+    xSemaphoreTake(ota_lock, portMAX_DELAY);
+    ota_child_t *child = find_child(mac);
+    for (int i = 0; !child && i < MESH_OTA_MAX_CHILDREN; i++)
+    {
+        if (!children[i].used)
+        {
+            child = &children[i];
+            memset(child, 0, sizeof(*child));
+            memcpy(child->addr.addr, mac, 6);
+            child->used = true;
+        }
+    }
+    if (child)
+    {
+        child->next = 0;
+        child->sent = 0;
+        announce_to_child(child);
+    }
+    xSemaphoreGive(ota_lock);
+}
+
+void mesh_ota_child_disconnected(const uint8_t mac[6])
+{
+    if (!ota_lock)
+    {
+        return;
+    }
+
+    xSemaphoreTake(ota_lock, portMAX_DELAY);
+    ota_child_t *child = find_child(mac);
+    if (child)
+    {
+        child->used = false;
+    }
+    xSemaphoreGive(ota_lock);
+}
+
+int mesh_ota_progress(void)
+{
+    if (ota.state == OTA_IDLE || ota.chunks == 0)
+    {
+        return -1;
+    }
+    return (int)((uint32_t)ota.next * 100 / ota.chunks);
+}
@@ -0,0 +1,186 @@
+/**
+ * @file mesh_prio.c
+ * @brief Slots pré-alocados por classe e filas de prontos atendidas em ordem de prioridade.
+ *
+ * Há um único produtor (a task de recepção) e um único consumidor (a task de
+ * processamento). Um slot volta sempre à fila livre da sua classe de origem.
+ */
+
+#include "mesh_prio.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define TAG "MESH_PRIO"
+
+static mesh_prio_msg_t *slots = NULL;
+static QueueHandle_t free_q[MESH_PRIO_CLASSES];
+static QueueHandle_t ready_q[MESH_PRIO_CLASSES];
+static SemaphoreHandle_t ready_sem = NULL; // sinaliza "há algo nas filas de prontos"
+
+static mesh_prio_stats_t stats;
+static portMUX_TYPE stats_mux = portMUX_INITIALIZER_UNLOCKED;
+
+#define STAT_INC(field)                \
+    do                                 \
+    {                                  \
+        portENTER_CRITICAL(&stats_mux); \
+        stats.field++;                 \
+        portEXIT_CRITICAL(&stats_mux);  \
+    } while (0)
+
+esp_err_t mesh_prio_init(int ctrl_len, int bulk_len)
+{
+    int lens[MESH_PRIO_CLASSES] = {ctrl_len, bulk_len};
+
+    if (slots)
+    {
+        return ESP_OK;
+    }
+    if (ctrl_len <= 0 || bulk_len <= 0)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    slots = calloc(ctrl_len + bulk_len, sizeof(mesh_prio_msg_t));
+    ready_sem = xSemaphoreCreateBinary();
+    if (!slots || !ready_sem)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+
+    mesh_prio_msg_t *msg = slots;
+    for (int c = 0; c < MESH_PRIO_CLASSES; c++)
+    {
+        free_q[c] = xQueueCreate(lens[c], sizeof(mesh_prio_msg_t *));
+        // Um slot de volume pode acabar na fila de controle: cada fila comporta todos os slots
+        ready_q[c] = xQueueCreate(ctrl_len + bulk_len, sizeof(mesh_prio_msg_t *));
+        if (!free_q[c] || !ready_q[c])
+        {
+            return ESP_ERR_NO_MEM;
+        }
+        for (int i = 0; i < lens[c]; i++, msg++)
+        {
+            msg->pool = c;
+            xQueueSend(free_q[c], &msg, 0);
+        }
+    }
+    return ESP_OK;
+}
+
+/**
+ * @brief Copia o quadro recebido para a fila da sua classe. Não bloqueia.
+ *
+ * @return ESP_ERR_NO_MEM se o quadro foi descartado por falta de slot.
+ */
+esp_err_t mesh_prio_submit(mesh_prio_t prio, const mesh_addr_t *from, const uint8_t *data, size_t len)
+{
+    mesh_prio_msg_t *msg = NULL;
+
+    if (!slots || prio >= MESH_PRIO_CLASSES || len > MESH_PRIO_FRAME_MAX)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (xQueueReceive(free_q[prio], &msg, 0) != pdTRUE && prio == MESH_PRIO_CTRL)
+    {
+        // Controle nunca espera por volume: usa um slot de volume livre ou o do quadro de volume mais antigo
+        if (xQueueReceive(free_q[MESH_PRIO_BULK], &msg, 0) != pdTRUE &&
+            xQueueReceive(ready_q[MESH_PRIO_BULK], &msg, 0) == pdTRUE)
+        {
+            STAT_INC(shed[MESH_PRIO_BULK]);
+        }
+    }
+
+    if (!msg)
+    {
+        STAT_INC(shed[prio]);
+        ESP_LOGD(TAG, "Quadro de %u bytes descartado (classe %d)", (unsigned)len, prio);
+        return ESP_ERR_NO_MEM;
+    }
+
+    msg->from = *from;
+    msg->rx_us = esp_timer_get_time();
+    msg->len = len;
+    memcpy(msg->data, data, len);
+    msg->data[len] = '\0';
+
+    xQueueSend(ready_q[prio], &msg, 0);
+    STAT_INC(queued[prio]);
+    xSemaphoreGive(ready_sem);
+    return ESP_OK;
+}
+
+/**
+ * @brief Próximo quadro a processar: sempre o de controle, se houver.
+ */
+mesh_prio_msg_t *mesh_prio_next(TickType_t wait, mesh_prio_t *prio)
+{
+    mesh_prio_msg_t *msg = NULL;
+
+    if (!slots)
+    {
+        return NULL;
+    }
+
+    while (true)
+    {
+        for (int c = 0; c < MESH_PRIO_CLASSES; c++)
+        {
+            if (xQueueReceive(ready_q[c], &msg, 0) == pdTRUE)
+            {
+                uint32_t wait_ms = (esp_timer_get_time() - msg->rx_us) / 1000;
+                portENTER_CRITICAL(&stats_mux);
+                if (wait_ms > stats.max_wait_ms[c])
+                {
+                    stats.max_wait_ms[c] = wait_ms;
+                }
+                portEXIT_CRITICAL(&stats_mux);
+
+                if (prio)
+                {
+                    *prio = c;
+                }
+                return msg;
+            }
+        }
+        if (xSemaphoreTake(ready_sem, wait) != pdTRUE)
+        {
+            return NULL;
+        }
+    }
+}
+
+void mesh_prio_release(mesh_prio_msg_t *msg)
+{
+    if (msg)
+    {
+        xQueueSend(free_q[msg->pool], &msg, 0);
+    }
+}
+
+/**
+ * @param reset Zera descartes e maior espera (o relatório mostra só o que houve no intervalo).
+ */
+void mesh_prio_get_stats(mesh_prio_stats_t *out, bool reset)
+{
+    portENTER_CRITICAL(&stats_mux);
+    *out = stats;
+    if (reset)
+    {
+        memset(stats.shed, 0, sizeof(stats.shed));
+        memset(stats.max_wait_ms, 0, sizeof(stats.max_wait_ms));
+    }
+    portEXIT_CRITICAL(&stats_mux);
+}
+
+/**
+ * @brief Quadro de controle marcado: [MESH_PRIO_CTRL_MAGIC] seguido do JSON.
+ */
+bool mesh_prio_is_ctrl_frame(const uint8_t *data, size_t len)
+{
+    return len >= 1 && data[0] == MESH_PRIO_CTRL_MAGIC;
+}
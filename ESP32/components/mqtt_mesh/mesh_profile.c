@@ -0,0 +1,195 @@
+/**
+ * @file mesh_profile.c
+ * @brief Perfil de tasks, stack e heap do nó, publicado sob demanda pelo comando "profile".
+ */
+
+#include "mesh_profile.h"
+#include "cJSON.h"
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TAG "MESH_PROFILE"
+
+static atomic_uint cjson_allocs = 0;
+static atomic_uint cjson_frees = 0;
+
+static void *counting_malloc(size_t size)
+{
+    void *ptr = malloc(size);
+    if (ptr)
+    {
+        atomic_fetch_add(&cjson_allocs, 1);
+    }
+    return ptr;
+}
+
+static void counting_free(void *ptr)
+{
+    if (ptr)
+    {
+        atomic_fetch_add(&cjson_frees, 1);
+    }
+    free(ptr);
+}
+
+/**
+ * @brief Instala os hooks de contagem do cJSON. Deve ser chamada antes de qualquer uso do cJSON.
+ */
+void mesh_profile_init(void)
+{
+    cJSON_Hooks hooks = {
+        .malloc_fn = counting_malloc,
+        .free_fn = counting_free,
+    };
+    cJSON_InitHooks(&hooks);
+}
+
+#if configUSE_TRACE_FACILITY
+static TaskStatus_t *snapshot(UBaseType_t *count, configRUN_TIME_COUNTER_TYPE *total)
+{
+    // Margem para tasks criadas entre a contagem e a leitura
+    UBaseType_t cap = uxTaskGetNumberOfTasks() + 4;
+    TaskStatus_t *tasks = malloc(cap * sizeof(TaskStatus_t));
+    if (!tasks)
+    {
+        return NULL;
+    }
+    *count = uxTaskGetSystemState(tasks, cap, total);
+    return tasks;
+}
+#endif
+
+esp_err_t mesh_profile_collect(uint32_t window_ms, mesh_profile_t *out)
+{
+    memset(out, 0, sizeof(*out));
+    out->window_ms = window_ms;
+
+#if configUSE_TRACE_FACILITY
+    UBaseType_t count_a = 0, count_b = 0;
+    configRUN_TIME_COUNTER_TYPE total_a = 0, total_b = 0;
+
+    unsigned allocs_a = atomic_load(&cjson_allocs);
+    unsigned frees_a = atomic_load(&cjson_frees);
+
+    TaskStatus_t *a = snapshot(&count_a, &total_a);
+    if (!a)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+
+    vTaskDelay(pdMS_TO_TICKS(window_ms));
+
+    TaskStatus_t *b = snapshot(&count_b, &total_b);
+    if (!b)
+    {
+        free(a);
+        return ESP_ERR_NO_MEM;
+    }
+
+    out->cjson_allocs = atomic_load(&cjson_allocs) - allocs_a;
+    out->cjson_frees = atomic_load(&cjson_frees) - frees_a;
+
+    configRUN_TIME_COUNTER_TYPE total = total_b - total_a;
+#if portNUM_PROCESSORS > 1
+    // Cada núcleo acumula o próprio tempo: a janela vale total * núcleos
+    // (portNUM_PROCESSORS existe em todo IDF; configNUMBER_OF_CORES só a partir do 5.2)
+    total *= portNUM_PROCESSORS;
+#endif
+
+    for (UBaseType_t i = 0; i < count_b && out->task_count < MESH_PROFILE_MAX_TASKS; i++)
+    {
+        mesh_profile_task_t *t = &out->tasks[out->task_count++];
+        strlcpy(t->name, b[i].pcTaskName, sizeof(t->name));
+        t->priority = b[i].uxCurrentPriority;
+        t->stack_free = b[i].usStackHighWaterMark;
+        t->cpu_permille = -1;
+
+#if configGENERATE_RUN_TIME_STATS
+        configRUN_TIME_COUNTER_TYPE before = 0;
+        for (UBaseType_t j = 0; j < count_a; j++)
+        {
+            if (a[j].xHandle == b[i].xHandle)
+            {
+                before = a[j].ulRunTimeCounter;
+                break;
+            }
+        }
+        if (total > 0)
+        {
+            t->cpu_permille = (int16_t)((uint64_t)(b[i].ulRunTimeCounter - before) * 1000 / total);
+        }
+#endif
+    }
+
+    free(a);
+    free(b);
+#else
+    vTaskDelay(pdMS_TO_TICKS(window_ms));
+    ESP_LOGW(TAG, "⚠️ CONFIG_FREERTOS_USE_TRACE_FACILITY desabilitado: sem dados por task");
+#endif
+
+    out->cjson_live = (int32_t)(atomic_load(&cjson_allocs) - atomic_load(&cjson_frees));
+    out->heap_free = heap_caps_get_free_size(MALLOC_CAP_DEFAULT);
+    out->heap_min_free = heap_caps_get_minimum_free_size(MALLOC_CAP_DEFAULT);
+    out->heap_largest = heap_caps_get_largest_free_block(MALLOC_CAP_DEFAULT);
+    return ESP_OK;
+}
+
+/**
+ * @brief Serializa o perfil. Tasks são omitidas do fim se o JSON passar de max_len.
+ *
+ * @return String alocada (liberar com cJSON_free) ou NULL.
+ */
+char *mesh_profile_to_json(const mesh_profile_t *p, const char *mac_str, size_t max_len)
+{
+    int task_count = p->task_count;
+
+    while (true)
+    {
+        cJSON *json = cJSON_CreateObject();
+        cJSON_AddStringToObject(json, "type", "profile");
+        cJSON_AddStringToObject(json, "mac", mac_str);
+        cJSON_AddNumberToObject(json, "window_ms", p->window_ms);
+
+        cJSON *heap = cJSON_AddObjectToObject(json, "heap");
+        cJSON_AddNumberToObject(heap, "free", p->heap_free);
+        cJSON_AddNumberToObject(heap, "min_free", p->heap_min_free);
+        cJSON_AddNumberToObject(heap, "largest", p->heap_largest);
+
+        cJSON *cj = cJSON_AddObjectToObject(json, "cjson");
+        cJSON_AddNumberToObject(cj, "allocs", p->cjson_allocs);
+        cJSON_AddNumberToObject(cj, "frees", p->cjson_frees);
+        cJSON_AddNumberToObject(cj, "live", p->cjson_live);
+
+        cJSON *tasks = cJSON_AddArrayToObject(json, "tasks");
+        for (int i = 0; i < task_count; i++)
+        {
+            const mesh_profile_task_t *t = &p->tasks[i];
+            cJSON *item = cJSON_CreateObject();
+            cJSON_AddStringToObject(item, "name", t->name);
+            cJSON_AddNumberToObject(item, "prio", t->priority);
+            cJSON_AddNumberToObject(item, "cpu", t->cpu_permille < 0 ? -1 : t->cpu_permille / 10.0);
+            cJSON_AddNumberToObject(item, "stack_free", t->stack_free);
+            cJSON_AddItemToArray(tasks, item);
+        }
+        if (task_count < p->task_count)
+        {
+            cJSON_AddNumberToObject(json, "tasks_omitted", p->task_count - task_count);
+        }
+
+        char *str = cJSON_PrintUnformatted(json);
+        cJSON_Delete(json);
+
+        if (!str || strlen(str) < max_len || task_count == 0)
+        {
+            return str;
+        }
+        cJSON_free(str);
+        task_count--;
+    }
+}
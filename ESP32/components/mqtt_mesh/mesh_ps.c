@@ -0,0 +1,401 @@
+/**
+ * @file mesh_ps.c
+ * @brief Janelas de atividade, comandos retidos para filhos em PS e estimativa de rádio ligado.
+ *
+ * O rádio ligado é estimado integrando o duty cycle em execução
+ * (esp_mesh_get_running_active_duty_cycle) entre cada mudança conhecida.
+ */
+
+#include "mesh_ps.h"
+#include "esp_log.h"
+#include "esp_mesh.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define TAG "MESH_PS"
+
+#define MESH_PS_MAX_CHILDREN (10)
+
+typedef enum {
+    HELD_FREE = 0,
+    HELD_WAITING,
+    HELD_SENDING,
+} held_state_t;
+
+typedef struct {
+    held_state_t state;
+    mesh_addr_t child;
+    int64_t held_us;
+    uint16_t len;
+    uint8_t frame[MESH_PS_FRAME_MAX];
+} held_frame_t;
+
+typedef struct {
+    uint8_t sta[6];
+    int duty;
+    bool woken; // avisou duty 100% (janela de atividade) e ainda não teve os quadros entregues
+} child_duty_t;
+
+static SemaphoreHandle_t ps_lock = NULL;
+static held_frame_t *held = NULL;
+static int held_max = 0;
+static int64_t hold_timeout_us = 0;
+
+static child_duty_t children[MESH_PS_MAX_CHILDREN];
+
+static int cfg_duty = 100;
+static int cfg_duty_type = MESH_PS_DEVICE_DUTY_REQUEST;
+static bool awake = false;
+
+static int current_duty = 100;
+static int64_t last_account_us = 0; // desde o boot, com o rádio a 100% até o PS ser ligado
+static int64_t radio_on_us = 0;
+
+/**
+ * @brief Soma o tempo desde a última amostra com o duty vigente e lê o novo. Chamar com ps_lock.
+ */
+static void account(void)
+{
+    int64_t now = esp_timer_get_time();
+    radio_on_us += (now - last_account_us) * current_duty / 100;
+    last_account_us = now;
+
+    int dev = 100, nwk = 100;
+    if (esp_mesh_is_ps_enabled() && esp_mesh_get_running_active_duty_cycle(&dev, &nwk) == ESP_OK)
+    {
+        current_duty = dev > 0 && dev <= 100 ? dev : 100;
+    }
+    else
+    {
+        current_duty = 100;
+    }
+}
+
+esp_err_t mesh_ps_init(int dev_duty, int dev_duty_type, int hold_max_frames, uint32_t hold_timeout_ms)
+{
+    if (ps_lock)
+    {
+        return ESP_OK;
+    }
+
+    ps_lock = xSemaphoreCreateMutex();
+    held = calloc(hold_max_frames, sizeof(held_frame_t));
+    if (!ps_lock || !held)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+
+    held_max = hold_max_frames;
+    hold_timeout_us = (int64_t)hold_timeout_ms * 1000;
+    cfg_duty = dev_duty;
+    cfg_duty_type = dev_duty_type;
+    for (int i = 0; i < MESH_PS_MAX_CHILDREN; i++)
+    {
+        children[i].duty = MESH_PS_DUTY_UNKNOWN;
+    }
+    return ESP_OK;
+}
+
+bool mesh_ps_enabled(void)
+{
+    return ps_lock && esp_mesh_is_ps_enabled();
+}
+
+/**
+ * @brief Abre a janela de atividade: rádio a 100% até mesh_ps_awake_end().
+ */
+void mesh_ps_awake_begin(void)
+{
+    if (!mesh_ps_enabled() || awake)
+    {
+        return;
+    }
+
+    xSemaphoreTake(ps_lock, portMAX_DELAY);
+    esp_err_t err = esp_mesh_set_active_duty_cycle(100, MESH_PS_DEVICE_DUTY_DEMAND);
+    awake = err == ESP_OK;
+    account();
+    xSemaphoreGive(ps_lock);
+
+    if (err != ESP_OK)
+    {
+        ESP_LOGW(TAG, "⚠️ Falha ao abrir janela de atividade: %s", esp_err_to_name(err));
+    }
+}
+
+void mesh_ps_awake_end(void)
+{
+    if (!awake)
+    {
+        return;
+    }
+
+    xSemaphoreTake(ps_lock, portMAX_DELAY);
+    esp_mesh_set_active_duty_cycle(cfg_duty, cfg_duty_type);
+    awake = false;
+    account();
+    xSemaphoreGive(ps_lock);
+}
+
+void mesh_ps_set_parent_duty(int duty)
+{
+    if (!ps_lock)
+    {
+        return;
+    }
+
+    // O duty da rede pode mudar o nosso duty em execução
+    xSemaphoreTake(ps_lock, portMAX_DELAY);
+    account();
+    xSemaphoreGive(ps_lock);
+    ESP_LOGD(TAG, "Duty do pai: %d, em execução: %d", duty, current_duty);
+}
+
+void mesh_ps_set_child_duty(const uint8_t child_sta[6], int duty)
+{
+    child_duty_t *slot = NULL;
+
+    if (!ps_lock)
+    {
+        return;
+    }
+
+    xSemaphoreTake(ps_lock, portMAX_DELAY);
+    for (int i = 0; i < MESH_PS_MAX_CHILDREN; i++)
+    {
+        if (children[i].duty != MESH_PS_DUTY_UNKNOWN && memcmp(children[i].sta, child_sta, 6) == 0)
+        {
+            slot = &children[i];
+            break;
+        }
+        if (!slot && children[i].duty == MESH_PS_DUTY_UNKNOWN)
+        {
+            slot = &children[i];
+        }
+    }
+    if (slot)
+    {
+        memcpy(slot->sta, child_sta, 6);
+        slot->duty = duty;
+        slot->woken = duty >= 100;
+    }
+    xSemaphoreGive(ps_lock);
+}
+
+/**
+ * @brief Libera a posição do filho que saiu: a tabela é fixa e, sem isso, encheria com filhos antigos.
+ */
+void mesh_ps_child_disconnected(const uint8_t child_sta[6])
+{
+    if (!ps_lock)
+    {
+        return;
+    }
+
+    xSemaphoreTake(ps_lock, portMAX_DELAY);
+    for (int i = 0; i < MESH_PS_MAX_CHILDREN; i++)
+    {
+        if (children[i].duty != MESH_PS_DUTY_UNKNOWN && memcmp(children[i].sta, child_sta, 6) == 0)
+        {
+            children[i].duty = MESH_PS_DUTY_UNKNOWN;
+            children[i].woken = false;
+            break;
+        }
+    }
+    xSemaphoreGive(ps_lock);
+}
+
+int mesh_ps_child_duty(const uint8_t child_sta[6])
+{
+    int duty = MESH_PS_DUTY_UNKNOWN;
+
+    if (!ps_lock)
+    {
+        return duty;
+    }
+
+    xSemaphoreTake(ps_lock, portMAX_DELAY);
+    for (int i = 0; i < MESH_PS_MAX_CHILDREN; i++)
+    {
+        if (children[i].duty != MESH_PS_DUTY_UNKNOWN && memcmp(children[i].sta, child_sta, 6) == 0)
+        {
+            duty = children[i].duty;
+            break;
+        }
+    }
+    xSemaphoreGive(ps_lock);
+    return duty;
+}
+
+/**
+ * @brief Retém um quadro para o filho até a próxima janela de atividade dele.
+ *
+ * @return ESP_ERR_NO_MEM sem posição livre: o chamador deve enviar o quadro direto.
+ */
+esp_err_t mesh_ps_hold(const mesh_addr_t *child, const uint8_t *frame, size_t len)
+{
+    held_frame_t *slot = NULL;
+
+    if (!ps_lock || len > MESH_PS_FRAME_MAX)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    xSemaphoreTake(ps_lock, portMAX_DELAY);
+    for (int i = 0; i < held_max; i++)
+    {
+        if (held[i].state == HELD_FREE)
+        {
+            slot = &held[i];
+            break;
+        }
+    }
+    if (slot)
+    {
+        slot->state = HELD_WAITING;
+        slot->child = *child;
+        slot->held_us = esp_timer_get_time();
+        slot->len = len;
+        memcpy(slot->frame, frame, len);
+    }
+    xSemaphoreGive(ps_lock);
+
+    if (!slot)
+    {
+        ESP_LOGW(TAG, "⚠️ Fila de comandos retidos cheia, enviando direto a " MACSTR, MAC2STR(child->addr));
+        return ESP_ERR_NO_MEM;
+    }
+    ESP_LOGI(TAG, "💤 Comando retido para " MACSTR " (%u bytes)", MAC2STR(child->addr), (unsigned)len);
+    return ESP_OK;
+}
+
+/**
+ * @brief Envia (fora do lock) os quadros retidos que satisfazem o filtro.
+ *
+ * @param child Filho que acabou de acordar, ou NULL para os quadros expirados.
+ */
+static int release_matching(const mesh_addr_t *child)
+{
+    int sent = 0;
+    int64_t now = esp_timer_get_time();
+
+    if (!ps_lock)
+    {
+        return 0;
+    }
+
+    for (int i = 0; i < held_max; i++)
+    {
+        held_frame_t *h = &held[i];
+
+        xSemaphoreTake(ps_lock, portMAX_DELAY);
+        bool match = h->state == HELD_WAITING &&
+                     (child ? memcmp(h->child.addr, child->addr, 6) == 0 : now - h->held_us > hold_timeout_us);
+        if (match)
+        {
+            h->state = HELD_SENDING;
+        }
+        xSemaphoreGive(ps_lock);
+
+        if (!match)
+        {
+            continue;
+        }
+
+        mesh_data_t data = {
+            .proto = MESH_PROTO_BIN,
+            .tos = MESH_TOS_P2P,
+            .data = h->frame,
+            .size = h->len};
+        esp_err_t err = esp_mesh_send(&h->child, &data, MESH_DATA_P2P, NULL, 0);
+        if (err != ESP_OK)
+        {
+            ESP_LOGW(TAG, "❌ Falha ao entregar comando retido a " MACSTR ": %s", MAC2STR(h->child.addr), esp_err_to_name(err));
+        }
+        else
+        {
+            sent++;
+        }
+
+        xSemaphoreTake(ps_lock, portMAX_DELAY);
+        h->state = HELD_FREE;
+        xSemaphoreGive(ps_lock);
+    }
+    return sent;
+}
+
+/**
+ * @brief Entrega os quadros retidos para um filho direto que acabou de transmitir.
+ *
+ * O chamador confere que child está na lista de estações do AP: o remetente de um
+ * quadro recebido é a origem, que pode estar vários saltos abaixo.
+ */
+int mesh_ps_release(const mesh_addr_t *child)
+{
+    return release_matching(child);
+}
+
+/**
+ * @brief Entrega os quadros dos filhos que avisaram, por MESH_EVENT_PS_CHILD_DUTY, que estão a 100%.
+ *
+ * Chamar de uma task: esp_mesh_send pode bloquear, o que não cabe no handler de eventos.
+ */
+int mesh_ps_release_woken(void)
+{
+    int sent = 0;
+
+    if (!ps_lock)
+    {
+        return 0;
+    }
+
+    for (int i = 0; i < MESH_PS_MAX_CHILDREN; i++)
+    {
+        mesh_addr_t child;
+
+        xSemaphoreTake(ps_lock, portMAX_DELAY);
+        bool woken = children[i].woken;
+        children[i].woken = false;
+        memcpy(child.addr, children[i].sta, 6);
+        xSemaphoreGive(ps_lock);
+
+        if (woken)
+        {
+            sent += release_matching(&child);
+        }
+    }
+    return sent;
+}
+
+/**
+ * @brief Entrega direto os quadros retidos há mais que o limite (filho pode ter mudado de pai).
+ */
+int mesh_ps_release_expired(void)
+{
+    return release_matching(NULL);
+}
+
+uint32_t mesh_ps_radio_on_ms(void)
+{
+    int64_t on_us;
+
+    if (!ps_lock)
+    {
+        return esp_timer_get_time() / 1000;
+    }
+
+    xSemaphoreTake(ps_lock, portMAX_DELAY);
+    account();
+    on_us = radio_on_us;
+    xSemaphoreGive(ps_lock);
+    return on_us / 1000;
+}
+
+int mesh_ps_radio_on_pct(void)
+{
+    int64_t uptime_ms = esp_timer_get_time() / 1000;
+    return uptime_ms > 0 ? (int)((int64_t)mesh_ps_radio_on_ms() * 100 / uptime_ms) : 100;
+}
@@ -0,0 +1,378 @@
+/**
+ * @file mesh_topo.c
+ * @brief Cache de topologia do root e sincronização com o nó reserva.
+ *
+ * Quadro de sincronização (magic 0xAA): [magic] seguido de relatórios JSON
+ * separados por '\n'. Um cache grande é enviado em vários quadros.
+ */
+
+#include "mesh_topo.h"
+#include "cJSON.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TAG "MESH_TOPO"
+
+#define MESH_TOPO_SYNC_MAGIC 0xAA
+
+typedef struct {
+    bool used;
+    mesh_topo_node_t node;
+    char *report;
+} topo_entry_t;
+
+#define EVICT_LOG_EVERY 32
+
+static topo_entry_t *entries = NULL;
+static int entry_cap = 0;
+static uint32_t evicted = 0;
+static SemaphoreHandle_t topo_lock = NULL;
+
+/**
+ * @param max_nodes Nós guardados; acima disso o relatório mais antigo é descartado (e contado).
+ */
+esp_err_t mesh_topo_init(int max_nodes)
+{
+    if (topo_lock)
+    {
+        return ESP_OK;
+    }
+    if (max_nodes <= 0)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    entries = calloc(max_nodes, sizeof(topo_entry_t));
+    topo_lock = xSemaphoreCreateMutex();
+    if (!entries || !topo_lock)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    entry_cap = max_nodes;
+    return ESP_OK;
+}
+
+int mesh_topo_capacity(void)
+{
+    return entry_cap;
+}
+
+/**
+ * @brief Nós descartados por falta de espaço no cache desde o boot.
+ */
+uint32_t mesh_topo_evicted(void)
+{
+    return evicted;
+}
+
+static void copy_str(char *dst, size_t size, const cJSON *item)
+{
+    if (cJSON_IsString(item))
+    {
+        strlcpy(dst, item->valuestring, size);
+    }
+    else
+    {
+        dst[0] = '\0';
+    }
+}
+
+/**
+ * @brief Encontra a entrada do nó ou uma livre (ou a mais antiga). Chamar com topo_lock.
+ */
+static topo_entry_t *slot_for(const char *mac)
+{
+    topo_entry_t *free_slot = NULL;
+    topo_entry_t *oldest = &entries[0];
+
+    for (int i = 0; i < entry_cap; i++)
+    {
+        topo_entry_t *e = &entries[i];
+        if (e->used && strcmp(e->node.mac, mac) == 0)
+        {
+            return e;
+        }
+        if (!e->used && !free_slot)
+        {
+            free_slot = e;
+        }
+        if (e->used && e->node.last_seen_us < oldest->node.last_seen_us)
+        {
+            oldest = e;
+        }
+    }
+    if (free_slot)
+    {
+        return free_slot;
+    }
+
+    if (evicted++ % EVICT_LOG_EVERY == 0)
+    {
+        ESP_LOGW(TAG, "⚠️ Cache de topologia cheio (%d nós): %s descartado para receber %s (%" PRIu32 " descartes)",
+                 entry_cap, oldest->node.mac, mac, evicted);
+    }
+    return oldest;
+}
+
+void mesh_topo_update(const char *report, size_t len)
+{
+    if (!topo_lock || !report || len == 0)
+    {
+        return;
+    }
+
+    cJSON *json = cJSON_ParseWithLength(report, len);
+    cJSON *mac = cJSON_GetObjectItem(json, "mac");
+    if (!cJSON_IsString(mac) || !cJSON_GetObjectItem(json, "hops"))
+    {
+        cJSON_Delete(json);
+        return;
+    }
+
+    char *copy = malloc(len + 1);
+    if (!copy)
+    {
+        cJSON_Delete(json);
+        return;
+    }
+    memcpy(copy, report, len);
+    copy[len] = '\0';
+
+    xSemaphoreTake(topo_lock, portMAX_DELAY);
+
+    topo_entry_t *e = slot_for(mac->valuestring);
+    free(e->report);
+    memset(e, 0, sizeof(*e));
+    e->used = true;
+    e->report = copy;
+
+    mesh_topo_node_t *n = &e->node;
+    copy_str(n->mac, sizeof(n->mac), mac);
+    copy_str(n->parent, sizeof(n->parent), cJSON_GetObjectItem(json, "parent"));
+    n->layer = cJSON_GetObjectItem(json, "hops")->valueint;
+
+    cJSON *rssi = cJSON_GetObjectItem(json, "rssi");
+    n->rssi = cJSON_IsNumber(rssi) ? rssi->valueint : MESH_TOPO_NO_RSSI;
+
+    cJSON *nc = cJSON_GetObjectItem(json, "nc");
+    n->child_count = cJSON_IsNumber(nc) ? nc->valueint : cJSON_GetArraySize(cJSON_GetObjectItem(json, "children"));
+
+    cJSON *max_ch = cJSON_GetObjectItem(json, "max_ch");
+    n->max_children = cJSON_IsNumber(max_ch) ? max_ch->valueint : -1;
+
+    n->last_seen_us = esp_timer_get_time();
+    n->report = e->report;
+    n->report_len = len;
+
+    xSemaphoreGive(topo_lock);
+    cJSON_Delete(json);
+}
+
+void mesh_topo_expire(int64_t max_age_us)
+{
+    if (!topo_lock)
+    {
+        return;
+    }
+
+    int64_t now = esp_timer_get_time();
+    xSemaphoreTake(topo_lock, portMAX_DELAY);
+    for (int i = 0; i < entry_cap; i++)
+    {
+        if (entries[i].used && now - entries[i].node.last_seen_us > max_age_us)
+        {
+            free(entries[i].report);
+            memset(&entries[i], 0, sizeof(entries[i]));
+        }
+    }
+    xSemaphoreGive(topo_lock);
+}
+
+/**
+ * @brief Copia o cache (campos e relatórios) sob o lock e chama cb para cada nó depois de soltá-lo.
+ *
+ * @return Nós visitados, ou -1 sem memória para a cópia.
+ */
+int mesh_topo_foreach(mesh_topo_node_cb cb, void *ctx)
+{
+    int count = 0;
+    size_t report_bytes = 0;
+
+    if (!topo_lock)
+    {
+        return 0;
+    }
+
+    xSemaphoreTake(topo_lock, portMAX_DELAY);
+    for (int i = 0; i < entry_cap; i++)
+    {
+        if (entries[i].used)
+        {
+            count++;
+            report_bytes += entries[i].node.report_len + 1;
+        }
+    }
+
+    mesh_topo_node_t *copy = count ? malloc(count * sizeof(mesh_topo_node_t) + report_bytes) : NULL;
+    if (count && !copy)
+    {
+        xSemaphoreGive(topo_lock);
+        ESP_LOGW(TAG, "❌ Sem memória para copiar %d nós do cache", count);
+        return -1;
+    }
+
+    char *reports = (char *)(copy + count);
+    int n = 0;
+    for (int i = 0; i < entry_cap; i++)
+    {
+        if (entries[i].used)
+        {
+            copy[n] = entries[i].node;
+            memcpy(reports, entries[i].report, copy[n].report_len + 1);
+            copy[n].report = reports;
+            reports += copy[n].report_len + 1;
+            n++;
+        }
+    }
+    xSemaphoreGive(topo_lock);
+
+    for (int i = 0; i < count; i++)
+    {
+        cb(&copy[i], ctx);
+    }
+    free(copy);
+    return count;
+}
+
+/**
+ * @brief Copia os campos de um nó do cache (sem o relatório, que só é válido com o lock).
+ */
+bool mesh_topo_lookup(const char *mac, mesh_topo_node_t *out)
+{
+    bool found = false;
+
+    if (!topo_lock)
+    {
+        return false;
+    }
+
+    xSemaphoreTake(topo_lock, portMAX_DELAY);
+    for (int i = 0; i < entry_cap; i++)
+    {
+        if (entries[i].used && strcmp(entries[i].node.mac, mac) == 0)
+        {
+            *out = entries[i].node;
+            out->report = NULL;
+            out->report_len = 0;
+            found = true;
+            break;
+        }
+    }
+    xSemaphoreGive(topo_lock);
+    return found;
+}
+
+/**
+ * @brief Escolhe o nó da camada 2 com o melhor RSSI para ser o root reserva.
+ */
+bool mesh_topo_best_standby(char mac_out[18], int *rssi_out)
+{
+    const mesh_topo_node_t *best = NULL;
+
+    if (!topo_lock)
+    {
+        return false;
+    }
+
+    xSemaphoreTake(topo_lock, portMAX_DELAY);
+    for (int i = 0; i < entry_cap; i++)
+    {
+        const mesh_topo_node_t *n = &entries[i].node;
+        if (entries[i].used && n->layer == 2 && n->rssi != MESH_TOPO_NO_RSSI &&
+            (!best || n->rssi > best->rssi))
+        {
+            best = n;
+        }
+    }
+    if (best)
+    {
+        strcpy(mac_out, best->mac);
+        if (rssi_out)
+        {
+            *rssi_out = best->rssi;
+        }
+    }
+    xSemaphoreGive(topo_lock);
+    return best != NULL;
+}
+
+/**
+ * @brief Monta o próximo quadro de sincronização a partir de *cursor.
+ *
+ * @return Tamanho do quadro, ou 0 quando não há mais relatórios.
+ */
+size_t mesh_topo_build_sync(uint8_t *out, size_t size, int *cursor)
+{
+    size_t len = 1;
+
+    if (!topo_lock || size < 2)
+    {
+        return 0;
+    }
+
+    out[0] = MESH_TOPO_SYNC_MAGIC;
+
+    xSemaphoreTake(topo_lock, portMAX_DELAY);
+    for (; *cursor < entry_cap; (*cursor)++)
+    {
+        topo_entry_t *e = &entries[*cursor];
+        if (!e->used)
+        {
+            continue;
+        }
+        if (len + e->node.report_len + 1 > size)
+        {
+            if (len == 1)
+            {
+                continue; // relatório maior que o quadro: não sincroniza
+            }
+            break;
+        }
+        memcpy(out + len, e->report, e->node.report_len);
+        len += e->node.report_len;
+        out[len++] = '\n';
+    }
+    xSemaphoreGive(topo_lock);
+
+    return len > 1 ? len : 0;
+}
+
+bool mesh_topo_is_sync_frame(const uint8_t *data, size_t len)
+{
+    return len >= 1 && data[0] == MESH_TOPO_SYNC_MAGIC;
+}
+
+void mesh_topo_handle_sync(const uint8_t *data, size_t len)
+{
+    const char *p = (const char *)data + 1;
+    const char *end = (const char *)data + len;
+
+    while (p < end)
+    {
+        const char *nl = memchr(p, '\n', end - p);
+        if (!nl)
+        {
+            break;
+        }
+        if (nl > p)
+        {
+            mesh_topo_update(p, nl - p);
+        }
+        p = nl + 1;
+    }
+}
@@ -0,0 +1,519 @@
+/**
+ * @file mesh_upbuf.c
+ * @brief Buffer circular (com opção de despejo na flash) para mensagens do uplink.
+ *
+ * Cada entrada no buffer circular é gravada como [len (2 bytes)][dados].
+ * Na flash, as entradas mais antigas são movidas em lotes: cada lote vira um
+ * blob "b<seq>" ([n (2 bytes)] seguido de n entradas no mesmo formato) no
+ * namespace "upbuf" da partição "nvs_upbuf", só dele. "head" e "tail" guardam
+ * a faixa de lotes válidos. Há uma gravação por lote despejado e outra por
+ * lote entregue; um lote entregue pela metade volta inteiro depois de um reboot.
+ *
+ * head_seq muda a cada mensagem que sai da frente da fila (entregue ou
+ * descartada). O peek devolve o valor atual e o consume só avança se ele não
+ * mudou, para que um transbordo entre o envio e o consume não leve junto a
+ * mensagem seguinte, que ainda não saiu.
+ */
+
+#include "mesh_upbuf.h"
+#include "esp_log.h"
+#include "esp_partition.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "nvs.h"
+#include "nvs_flash.h"
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TAG "MESH_UPBUF"
+
+#define SPILL_PARTITION "nvs_upbuf"
+#define SPILL_NAMESPACE "upbuf"
+#define SPILL_BATCH_SIZE (3072) // um lote por página de 4 KB do NVS, com folga para os cabeçalhos
+#define ENTRY_HDR 2
+#define BATCH_HDR 2
+
+static SemaphoreHandle_t buf_lock = NULL;
+
+static uint8_t *ring = NULL;
+static size_t ring_cap = 0;
+static size_t ring_head = 0; // posição da entrada mais antiga
+static size_t ring_used = 0; // bytes ocupados (cabeçalhos incluídos)
+static size_t ring_count = 0;
+
+static bool spill_enabled = false;
+static int spill_limit = 0;
+static nvs_handle_t spill_nvs = 0;
+static uint32_t spill_head = 0; // próximo lote a ser lido
+static uint32_t spill_tail = 0; // próximo lote a ser gravado
+static uint16_t *spill_counts = NULL; // mensagens restantes por lote, indexado por seq % spill_limit
+static size_t spill_msgs = 0;
+
+static uint8_t *batch_buf = NULL; // lote sendo montado para gravação
+static uint8_t *front_buf = NULL; // lote mais antigo, lido da flash para entrega
+static size_t front_len = 0;
+static size_t front_pos = 0;
+static bool front_loaded = false;
+
+static uint32_t head_seq = 0; // muda quando a mensagem da frente sai (ver mesh_upbuf_peek)
+
+static mesh_upbuf_stats_t stats;
+
+static void ring_read(size_t pos, uint8_t *out, size_t len)
+{
+    for (size_t i = 0; i < len; i++)
+    {
+        out[i] = ring[(pos + i) % ring_cap];
+    }
+}
+
+static void ring_write(size_t pos, const uint8_t *in, size_t len)
+{
+    for (size_t i = 0; i < len; i++)
+    {
+        ring[(pos + i) % ring_cap] = in[i];
+    }
+}
+
+static size_t ring_front_len(void)
+{
+    uint8_t hdr[ENTRY_HDR];
+    ring_read(ring_head, hdr, ENTRY_HDR);
+    return (size_t)hdr[0] | ((size_t)hdr[1] << 8);
+}
+
+static void ring_drop_front(void)
+{
+    size_t len = ring_front_len();
+    ring_head = (ring_head + ENTRY_HDR + len) % ring_cap;
+    ring_used -= ENTRY_HDR + len;
+    ring_count--;
+}
+
+static size_t get_u16(const uint8_t *p)
+{
+    return (size_t)p[0] | ((size_t)p[1] << 8);
+}
+
+static void put_u16(uint8_t *p, size_t v)
+{
+    p[0] = v & 0xFF;
+    p[1] = (v >> 8) & 0xFF;
+}
+
+static void spill_key(char *key, uint32_t seq)
+{
+    snprintf(key, 16, "b%" PRIu32, seq);
+}
+
+static uint16_t *spill_count(uint32_t seq)
+{
+    return &spill_counts[seq % spill_limit];
+}
+
+static void spill_save_range(void)
+{
+    nvs_set_u32(spill_nvs, "head", spill_head);
+    nvs_set_u32(spill_nvs, "tail", spill_tail);
+    nvs_commit(spill_nvs);
+}
+
+/**
+ * @brief Apaga o lote mais antigo (sem gravar a faixa). As mensagens que restavam nele contam como descartadas.
+ */
+static void spill_drop_oldest(void)
+{
+    char key[16];
+    spill_key(key, spill_head);
+    nvs_erase_key(spill_nvs, key);
+
+    uint16_t *left = spill_count(spill_head);
+    stats.dropped += *left;
+    spill_msgs -= *left;
+    *left = 0;
+    spill_head++;
+    front_loaded = false;
+    head_seq++;
+}
+
+/**
+ * @brief Carrega o lote mais antigo em front_buf. Um lote ilegível é descartado.
+ */
+static bool spill_load_front(void)
+{
+    while (!front_loaded && spill_head != spill_tail)
+    {
+        char key[16];
+        spill_key(key, spill_head);
+        size_t len = SPILL_BATCH_SIZE;
+        if (nvs_get_blob(spill_nvs, key, front_buf, &len) == ESP_OK && len >= BATCH_HDR)
+        {
+            // Pula as mensagens do lote já entregues (a contagem em RAM volta cheia depois de um reboot)
+            size_t total = get_u16(front_buf);
+            uint16_t *left = spill_count(spill_head);
+            if (*left == 0 || *left > total)
+            {
+                spill_msgs = spill_msgs - *left + total;
+                *left = total;
+            }
+            front_pos = BATCH_HDR;
+            for (size_t skip = total - *left; skip > 0 && front_pos + ENTRY_HDR <= len; skip--)
+            {
+                front_pos += ENTRY_HDR + get_u16(front_buf + front_pos);
+            }
+            front_len = len;
+            front_loaded = true;
+        }
+        else
+        {
+            ESP_LOGW(TAG, "⚠️ Lote %" PRIu32 " ilegível na flash, descartado", spill_head);
+            spill_drop_oldest();
+            spill_save_range();
+        }
+    }
+    return front_loaded;
+}
+
+/**
+ * @brief Avança para a próxima mensagem do lote carregado; esgotado, o lote é apagado.
+ */
+static void spill_advance_front(void)
+{
+    head_seq++;
+    front_pos += ENTRY_HDR + get_u16(front_buf + front_pos);
+    spill_msgs--;
+    uint16_t *left = spill_count(spill_head);
+    if (*left > 0)
+    {
+        (*left)--;
+    }
+    if (*left == 0 || front_pos + ENTRY_HDR > front_len)
+    {
+        spill_msgs -= *left;
+        *left = 0;
+        char key[16];
+        spill_key(key, spill_head);
+        nvs_erase_key(spill_nvs, key);
+        spill_head++;
+        spill_save_range();
+        front_loaded = false;
+    }
+}
+
+/**
+ * @brief Move as entradas mais antigas do buffer circular para a flash em um único lote. Chamar com buf_lock.
+ *
+ * O lote é preenchido até o limite (e não só o necessário para a nova mensagem),
+ * para que as próximas mensagens caibam na RAM sem outra gravação.
+ */
+static bool spill_batch(void)
+{
+    size_t pos = BATCH_HDR;
+    size_t count = 0;
+
+    while (ring_count > 0)
+    {
+        size_t len = ring_front_len();
+        if (pos + ENTRY_HDR + len > SPILL_BATCH_SIZE)
+        {
+            break;
+        }
+        ring_read(ring_head, batch_buf + pos, ENTRY_HDR + len);
+        pos += ENTRY_HDR + len;
+        count++;
+        ring_drop_front();
+    }
+    if (count == 0)
+    {
+        // A mensagem mais antiga sozinha não cabe em um lote
+        return false;
+    }
+    put_u16(batch_buf, count);
+
+    if ((int)(spill_tail - spill_head) >= spill_limit)
+    {
+        spill_drop_oldest();
+    }
+
+    char key[16];
+    spill_key(key, spill_tail);
+    esp_err_t err = nvs_set_blob(spill_nvs, key, batch_buf, pos);
+    if (err != ESP_OK)
+    {
+        ESP_LOGW(TAG, "⚠️ Falha ao gravar lote na flash: %s (%u mensagens perdidas)", esp_err_to_name(err),
+                 (unsigned)count);
+        stats.dropped += count;
+        if (spill_msgs == 0)
+        {
+            head_seq++; // o lote perdido era a frente da fila
+        }
+        return true;
+    }
+
+    *spill_count(spill_tail) = count;
+    spill_tail++;
+    spill_msgs += count;
+    spill_save_range();
+    stats.spilled += count;
+    return true;
+}
+
+/**
+ * @brief Quantos lotes cabem na partição: um por página, menos a página livre
+ * que o NVS exige para compactar e a que guarda head/tail.
+ */
+static int spill_fit(void)
+{
+    const esp_partition_t *part = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_DATA_NVS,
+                                                           SPILL_PARTITION);
+    if (!part)
+    {
+        return 0;
+    }
+    int pages = (int)(part->size / 4096);
+    return pages > 2 ? pages - 2 : 0;
+}
+
+static void spill_recover(void)
+{
+    nvs_get_u32(spill_nvs, "head", &spill_head);
+    nvs_get_u32(spill_nvs, "tail", &spill_tail);
+
+    // Limite reduzido desde a gravação: mantém só os lotes mais novos
+    while ((int)(spill_tail - spill_head) > spill_limit)
+    {
+        spill_drop_oldest();
+    }
+
+    for (uint32_t seq = spill_head; seq != spill_tail; seq++)
+    {
+        char key[16];
+        spill_key(key, seq);
+        size_t len = SPILL_BATCH_SIZE;
+        if (nvs_get_blob(spill_nvs, key, front_buf, &len) == ESP_OK && len >= BATCH_HDR)
+        {
+            *spill_count(seq) = get_u16(front_buf);
+            spill_msgs += *spill_count(seq);
+        }
+    }
+    spill_save_range();
+}
+
+esp_err_t mesh_upbuf_init(size_t capacity, bool flash_spill, int spill_max)
+{
+    if (ring)
+    {
+        return ESP_OK;
+    }
+
+    buf_lock = xSemaphoreCreateMutex();
+    ring = malloc(capacity);
+    if (!buf_lock || !ring)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    ring_cap = capacity;
+
+    if (flash_spill && spill_max > 0)
+    {
+        int fit = spill_fit();
+        if (spill_max > fit)
+        {
+            ESP_LOGW(TAG, "⚠️ A partição %s comporta %d lotes, não %d", SPILL_PARTITION, fit, spill_max);
+            spill_max = fit;
+        }
+
+        esp_err_t err = spill_max > 0 ? nvs_flash_init_partition(SPILL_PARTITION) : ESP_ERR_NOT_FOUND;
+        if (err == ESP_ERR_NVS_NO_FREE_PAGES || err == ESP_ERR_NVS_NEW_VERSION_FOUND)
+        {
+            // A partição é só do buffer: apagá-la perde apenas mensagens antigas
+            nvs_flash_erase_partition(SPILL_PARTITION);
+            err = nvs_flash_init_partition(SPILL_PARTITION);
+        }
+        if (err == ESP_OK)
+        {
+            err = nvs_open_from_partition(SPILL_PARTITION, SPILL_NAMESPACE, NVS_READWRITE, &spill_nvs);
+        }
+        if (err == ESP_OK)
+        {
+            spill_counts = calloc(spill_max, sizeof(uint16_t));
+            batch_buf = malloc(SPILL_BATCH_SIZE);
+            front_buf = malloc(SPILL_BATCH_SIZE);
+            if (!spill_counts || !batch_buf || !front_buf)
+            {
+                return ESP_ERR_NO_MEM;
+            }
+            spill_limit = spill_max;
+            spill_recover();
+            spill_enabled = true;
+            ESP_LOGI(TAG, "💾 Despejo em flash habilitado (%u mensagens pendentes em %" PRIu32 " lotes)",
+                     (unsigned)spill_msgs, spill_tail - spill_head);
+        }
+        else
+        {
+            ESP_LOGW(TAG, "⚠️ Despejo em flash indisponível: %s", esp_err_to_name(err));
+        }
+    }
+
+    return ESP_OK;
+}
+
+esp_err_t mesh_upbuf_push(const void *data, size_t len)
+{
+    if (!ring || !data || len == 0)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (len > 0xFFFF || len + ENTRY_HDR > ring_cap)
+    {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    xSemaphoreTake(buf_lock, portMAX_DELAY);
+
+    while (ring_used + ENTRY_HDR + len > ring_cap)
+    {
+        if (!(spill_enabled && spill_batch()))
+        {
+            // Sem nada na flash, a frente do buffer circular é a frente da fila
+            if (spill_msgs == 0)
+            {
+                head_seq++;
+            }
+            ring_drop_front();
+            stats.dropped++;
+        }
+    }
+
+    uint8_t hdr[ENTRY_HDR] = {len & 0xFF, (len >> 8) & 0xFF};
+    size_t tail = (ring_head + ring_used) % ring_cap;
+    ring_write(tail, hdr, ENTRY_HDR);
+    ring_write((tail + ENTRY_HDR) % ring_cap, data, len);
+    ring_used += ENTRY_HDR + len;
+    ring_count++;
+    stats.pushed++;
+
+    xSemaphoreGive(buf_lock);
+    return ESP_OK;
+}
+
+/**
+ * @brief Copia a mensagem mais antiga sem removê-la.
+ *
+ * @param seq Recebe o identificador da mensagem copiada, a passar para mesh_upbuf_consume().
+ */
+size_t mesh_upbuf_peek(void *out, size_t out_size, uint32_t *seq)
+{
+    size_t len = 0;
+
+    if (!ring)
+    {
+        return 0;
+    }
+
+    xSemaphoreTake(buf_lock, portMAX_DELAY);
+
+    while (spill_enabled && len == 0 && spill_load_front())
+    {
+        len = get_u16(front_buf + front_pos);
+        if (len > out_size || front_pos + ENTRY_HDR + len > front_len)
+        {
+            // Entrada corrompida ou maior que o buffer: descarta
+            spill_advance_front();
+            stats.dropped++;
+            len = 0;
+        }
+        else
+        {
+            memcpy(out, front_buf + front_pos + ENTRY_HDR, len);
+        }
+    }
+    if (len == 0 && ring_count > 0)
+    {
+        len = ring_front_len();
+        if (len > out_size)
+        {
+            ring_drop_front();
+            stats.dropped++;
+            head_seq++;
+            len = 0;
+        }
+        else
+        {
+            ring_read((ring_head + ENTRY_HDR) % ring_cap, out, len);
+        }
+    }
+    if (seq)
+    {
+        *seq = head_seq;
+    }
+
+    xSemaphoreGive(buf_lock);
+    return len;
+}
+
+/**
+ * @brief Remove a mensagem lida por mesh_upbuf_peek(), se ela ainda for a mais antiga.
+ *
+ * @return false se ela já saiu da fila (descartada por transbordo depois do peek); nada é removido.
+ */
+bool mesh_upbuf_consume(uint32_t seq)
+{
+    bool consumed = true;
+
+    if (!ring)
+    {
+        return false;
+    }
+
+    xSemaphoreTake(buf_lock, portMAX_DELAY);
+
+    if (seq != head_seq)
+    {
+        consumed = false;
+    }
+    else if (spill_enabled && spill_load_front())
+    {
+        spill_advance_front();
+        stats.drained++;
+    }
+    else if (ring_count > 0)
+    {
+        ring_drop_front();
+        head_seq++;
+        stats.drained++;
+    }
+    else
+    {
+        consumed = false;
+    }
+
+    xSemaphoreGive(buf_lock);
+    return consumed;
+}
+
+size_t mesh_upbuf_pending(void)
+{
+    if (!ring)
+    {
+        return 0;
+    }
+
+    xSemaphoreTake(buf_lock, portMAX_DELAY);
+    size_t n = ring_count + spill_msgs;
+    xSemaphoreGive(buf_lock);
+    return n;
+}
+
+void mesh_upbuf_get_stats(mesh_upbuf_stats_t *out)
+{
+    if (!out || !buf_lock)
+    {
+        return;
+    }
+    xSemaphoreTake(buf_lock, portMAX_DELAY);
+    *out = stats;
+    xSemaphoreGive(buf_lock);
+}
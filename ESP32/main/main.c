@@ -7,6 +7,7 @@
    CONDITIONS OF ANY KIND, either express or implied.
 */
 #include <inttypes.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "cJSON.h"
@@ -16,8 +17,20 @@
 #include "esp_mac.h"
 #include "esp_mesh.h"
 #include "esp_mesh_internal.h"
+#include "esp_timer.h"
 #include "esp_wifi.h"
 #include "hal/gpio_types.h"
+#include "lwip/netdb.h"
+#include "lwip/sockets.h"
+#include "mesh_agg.h"
+#include "mesh_balance.h"
+#include "mesh_cmd.h"
+#include "mesh_ota.h"
+#include "mesh_prio.h"
+#include "mesh_profile.h"
+#include "mesh_ps.h"
+#include "mesh_topo.h"
+#include "mesh_upbuf.h"
 #include "mqtt_client.h"
 #include "mqtt_mesh.h"
 #include "nvs_flash.h"
@@ -36,11 +49,13 @@
 #define GPIO_OUTPUT_PIN_SEL ((1ULL << LED_RED) | (1ULL << LED_BLUE) | (1ULL << LED_GREEN))
 
 #define MAX_ROUTING_TABLE_SIZE 20
+#define MESH_MAX_CHILDREN CONFIG_MESH_AP_CONNECTIONS  // teto de max_children em config, limits e rebalance
 
 static const char *TAG = "MAIN_CONFIG";
 static int report_interval_ms = 10000;
 static unsigned int blockTask = 0;
 static int current_max_children = MESH_CONNECTION_PER_HOP;
+static mesh_node_limits_t node_limits = {.max_children = -1, .layer_pref = MESH_LAYER_PREF_AUTO};
 static bool mesh_active = false;
 volatile bool pending_mesh_restart = false;
 static bool mesh_was_stopped = false;
@@ -66,21 +81,51 @@ static mesh_addr_t mesh_parent_addr;
 static int mesh_layer = -1;
 static esp_netif_t *netif_sta = NULL;
 static esp_mqtt_client_handle_t mqtt_client = NULL;
+static bool mqtt_connected = false;
+static volatile bool profile_running = false;
+static char drain_buf[TX_SIZE + 1];
+static char mqtt_uri[96] = MQTT_IP;
+static bool mqtt_started = false;
+static bool is_standby = false;
+static char standby_mac[18] = "";  // escrito pela task de relatório, lido pela de reconfiguração: usar standby_get/set
+static portMUX_TYPE standby_mux = portMUX_INITIALIZER_UNLOCKED;
+static int64_t root_gap_start_us = 0;
+static int64_t root_connected_us = 0;
+static volatile bool takeover_pending = false;
+static volatile bool standby_sync_requested = false;
+static volatile bool handover_requested = false;
+static uint8_t sync_buf[TX_SIZE];
 
 // --- Funções utilitárias ---
-static bool is_command_for_me(const char *target_mac);
-static void forward_command_to_children(const char *data, size_t data_len);
+static void forward_command_to_children(const uint8_t *data, size_t data_len, const uint8_t *target);
 static void get_mac_str(char *out, uint8_t mac[6]);
+static void send_report_frame_to_parent(const char *frame, size_t len);
+static void publish_report_cb(const char *report, size_t len, void *ctx);
+
+// --- Uplink (store-and-forward) ---
+static bool upstream_try_send(const char *payload, size_t len, mesh_prio_t prio);
+static void send_upstream(const char *payload, size_t len);
+static void send_upstream_ctrl(const char *payload, size_t len);
+static void upstream_drain_task(void *arg);
 static const char *build_node_status_json(char *mac_str, char *parent_str, int hops, char children_output[][18], int child_count);
 
 // --- Comandos P2P ---
 static void handle_ping_response(void);
-static void process_p2p_command(cJSON *cmd, const char *payload);
+static void register_mesh_commands(void);
 static void process_pong_response(cJSON *cmd, const char *payload);
 
 // --- MQTT ---
 static void mqtt_event_handler_cb(void *handler_args, esp_event_base_t base, int32_t event_id, void *event_data);
+static void mqtt_app_prepare(void);
 static void mqtt_app_start(void);
+static void mqtt_app_stop(void);
+
+// Root reserva
+#if CONFIG_MESH_STANDBY_ROOT
+static void root_standby_tick(void);
+#endif
+static void check_standby_root(void);
+static void root_announce_takeover(void);
 
 // --- Mesh ---
 void esp_mesh_p2p_rx_main(void *arg);
@@ -101,33 +146,109 @@ static void mesh_full_init_and_start(void);
 // --- Main ---
 void app_main(void);
 
-static bool is_command_for_me(const char *target_mac) {
-    char my_mac_str[18];
-    uint8_t my_mac[6];
-    esp_read_mac(my_mac, ESP_MAC_WIFI_STA);
-    my_mac[5]++;
-    sprintf(my_mac_str, "%02X:%02X:%02X:%02X:%02X:%02X",
-            my_mac[0], my_mac[1], my_mac[2],
-            my_mac[3], my_mac[4], my_mac[5]);
+/**
+ * @brief Confere se o endereço mesh (MAC STA) está conectado ao nosso AP, isto é, é um filho direto.
+ */
+static bool is_direct_child(const mesh_addr_t *addr) {
+    wifi_sta_list_t sta_list;
 
-    return strcmp(my_mac_str, target_mac) == 0;
+    if (esp_wifi_ap_get_sta_list(&sta_list) != ESP_OK) {
+        return false;
+    }
+    for (int i = 0; i < sta_list.num; i++) {
+        if (memcmp(sta_list.sta[i].mac, addr->addr, 6) == 0) {
+            return true;
+        }
+    }
+    return false;
 }
 
-static void forward_command_to_children(const char *data, size_t data_len) {
-    mesh_addr_t children[MAX_ROUTING_TABLE_SIZE];
-    int table_size = 0;
-
-    if (esp_mesh_get_routing_table(children, MAX_ROUTING_TABLE_SIZE * 6, &table_size) != ESP_OK) {
-        ESP_LOGW("MQTT CMD", "⚠️ Falha ao obter tabela de roteamento");
+/**
+ * @brief Em PS, entrega um comando que chegou para um filho ou o retém até o filho acordar.
+ *
+ * Só um filho direto é retido aqui; para um nó mais abaixo (topologia mudou desde o
+ * último relatório), o quadro segue pela mesh e o pai dele decide.
+ *
+ * @param child Endereço mesh (MAC STA) do destino.
+ */
+static void ps_deliver_to_child(const mesh_addr_t *child, const uint8_t *frame, size_t len) {
+    // Filho sem PS (duty 100%) recebe na hora
+    if (is_direct_child(child) && mesh_ps_child_duty(child->addr) < 100 && mesh_ps_hold(child, frame, len) == ESP_OK) {
         return;
     }
 
+    mesh_data_t data = {
+        .proto = MESH_PROTO_BIN,
+        .tos = MESH_TOS_P2P,
+        .data = (uint8_t *)frame,
+        .size = len};
+    esp_err_t err = esp_mesh_send(child, &data, MESH_DATA_P2P, NULL, 0);
+    if (err != ESP_OK) {
+        ESP_LOGW("MESH_PS", "❌ Falha ao enviar para " MACSTR ": %s", MAC2STR(child->addr), esp_err_to_name(err));
+    }
+}
+
+/**
+ * @brief No root com PS: manda o comando ao pai do destino (que o retém) ou retém aqui se o pai é o root.
+ *
+ * @param dest Endereço de envio; trocado pelo do pai quando ele é conhecido.
+ * @return true se o comando já foi tratado (retido ou entregue pelo próprio root).
+ */
+static bool ps_route_targeted(const uint8_t *frame, size_t len, const uint8_t *target, mesh_addr_t *dest) {
+    mesh_topo_node_t node;
+    char target_str[18], own_str[18];
+    uint8_t own[6], target_ap[6];
+
+    memcpy(target_ap, target, 6);
+    get_mac_str(target_str, target_ap);
+    if (!mesh_topo_lookup(target_str, &node)) {
+        return false;
+    }
+
+    esp_read_mac(own, ESP_MAC_WIFI_STA);
+    own[5]++;
+    get_mac_str(own_str, own);
+    if (strcmp(node.parent, own_str) == 0) {
+        ps_deliver_to_child(dest, frame, len);
+        return true;
+    }
+
+    if (mesh_cmd_parse_mac(node.parent, dest->addr)) {
+        dest->addr[5]--;
+    }
+    return false;
+}
+
+static void forward_command_to_children(const uint8_t *data, size_t data_len, const uint8_t *target) {
+    mesh_addr_t children[MAX_ROUTING_TABLE_SIZE];
+    int table_size = 0;
+
     mesh_data_t fwd_data = {
         .proto = MESH_PROTO_BIN,
         .tos = MESH_TOS_P2P,
         .data = (uint8_t *)data,
         .size = data_len};
 
+    // Comando direcionado: envia só para o destino (endereço mesh = MAC do AP - 1)
+    if (target) {
+        mesh_addr_t dest;
+        memcpy(dest.addr, target, 6);
+        dest.addr[5]--;
+        if (mesh_ps_enabled() && ps_route_targeted(data, data_len, target, &dest)) {
+            return;  // retido aqui até a próxima janela de atividade do filho
+        }
+        esp_err_t err = esp_mesh_send(&dest, &fwd_data, MESH_DATA_P2P, NULL, 0);
+        if (err != ESP_OK) {
+            ESP_LOGW("MQTT CMD", "❌ Falha ao enviar para " MACSTR ": %s", MAC2STR(target), esp_err_to_name(err));
+        }
+        return;
+    }
+
+    if (esp_mesh_get_routing_table(children, MAX_ROUTING_TABLE_SIZE * 6, &table_size) != ESP_OK) {
+        ESP_LOGW("MQTT CMD", "⚠️ Falha ao obter tabela de roteamento");
+        return;
+    }
+
     for (int i = 0; i < table_size; ++i) {
         if (i == 0) continue;
         esp_err_t err = esp_mesh_send(&children[i], &fwd_data, MESH_DATA_P2P, NULL, 0);
@@ -159,60 +280,360 @@ static void handle_ping_response(void) {
 
     const char *json_str = cJSON_PrintUnformatted(resp);
 
-    if (esp_mesh_is_root() && mqtt_client) {
-        ESP_LOGI("PING_HANDLER", "📤 Enviando resposta PONG via MQTT (sou root)");
-        esp_mqtt_client_publish(mqtt_client, "mesh/network/info", json_str, 0, 1, 0);
+    ESP_LOGI("PING_HANDLER", "📤 Enviando resposta PONG %s", esp_mesh_is_root() ? "via MQTT (sou root)" : "para o root");
+    send_upstream_ctrl(json_str, strlen(json_str));
+
+    cJSON_free((void *)json_str);
+    cJSON_Delete(resp);
+}
+
+static void process_pong_response(cJSON *cmd, const char *payload) {
+    if (esp_mesh_is_root()) {
+        ESP_LOGI("MESH", "📨 Resposta PONG recebida: %s", payload);
     } else {
-        mesh_data_t response = {
-            .proto = MESH_PROTO_BIN,
-            .tos = MESH_TOS_P2P,
-            .data = (uint8_t *)json_str,
-            .size = strlen(json_str) + 1};
+        ESP_LOGI("MESH", "🔁 Encaminhando resposta PONG para o pai");
+    }
+    send_upstream_ctrl(payload, strlen(payload));
+}
 
-        esp_err_t err = esp_mesh_send(NULL, &response, 0, NULL, 0);
-        if (err != ESP_OK) {
-            ESP_LOGW("PING_HANDLER", "❌ Falha ao enviar resposta PONG: %s", esp_err_to_name(err));
+/*******************************************************
+ *                Comandos
+ *******************************************************/
+enum {
+    CMD_OP_CONFIG = 1,
+    CMD_OP_BLINK = 2,
+    CMD_OP_PING = 3,
+    CMD_OP_OTA = 4,
+    CMD_OP_PROFILE = 5,
+    CMD_OP_STANDBY = 6,
+    CMD_OP_HANDOVER = 7,
+    CMD_OP_LIMITS = 8,
+    CMD_OP_REBALANCE = 9,
+};
+
+/**
+ * @brief Limite de filhos em vigor: o do próprio nó (comando "limits") ou o global (comando "config").
+ */
+static int effective_max_children(void) {
+    if (node_limits.layer_pref == MESH_LAYER_PREF_LEAF) {
+        return 0;
+    }
+    return node_limits.max_children > 0 ? node_limits.max_children : current_max_children;
+}
+
+typedef struct __attribute__((packed)) {
+    int32_t interval_ms;
+    int32_t max_children;  // -1 = não alterar
+} cmd_config_args_t;
+
+static esp_err_t parse_config_args(const cJSON *json, mesh_cmd_t *cmd) {
+    cJSON *interval = cJSON_GetObjectItem(json, "interval");
+    cJSON *max_children = cJSON_GetObjectItem(json, "max_children");
+
+    if (!cJSON_IsNumber(interval) || interval->valueint < 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    cmd_config_args_t args = {.interval_ms = interval->valueint, .max_children = -1};
+    if (max_children && cJSON_IsNumber(max_children)) {
+        if (max_children->valueint <= 0 || max_children->valueint > MESH_MAX_CHILDREN) {
+            ESP_LOGW("MQTT CMD", "⚠️ Valor inválido para max_children: %d", max_children->valueint);
         } else {
-            ESP_LOGI("PING_HANDLER", "📤 Resposta PONG enviada para o pai");
+            args.max_children = max_children->valueint;
         }
     }
 
-    cJSON_free((void *)json_str);
-    cJSON_Delete(resp);
+    memcpy(cmd->args, &args, sizeof(args));
+    cmd->args_len = sizeof(args);
+    return ESP_OK;
 }
 
-static void process_p2p_command(cJSON *cmd, const char *payload) {
-    cJSON *target = cJSON_GetObjectItem(cmd, "target");
-    cJSON *action = cJSON_GetObjectItem(cmd, "action");
+static void handle_config_cmd(const mesh_cmd_t *cmd, mesh_cmd_src_t src) {
+    cmd_config_args_t args;
+    memcpy(&args, cmd->args, sizeof(args));
 
-    if (!target || !action || !cJSON_IsString(target) || !cJSON_IsString(action)) return;
+    // Atualiza intervalo
+    if (args.interval_ms != 0) {
+        blockTask = 0;
+        report_interval_ms = args.interval_ms;
+        ESP_LOGW("MQTT CMD", "🕒 Novo intervalo de envio: %d ms", report_interval_ms);
+    } else {
+        blockTask = 1;
+        ESP_LOGW("MQTT CMD", "🛑 Task de envio bloqueada por intervalo 0");
+    }
 
-    if (is_command_for_me(target->valuestring)) {
-        if (strcmp(action->valuestring, "blink") == 0) {
-            ESP_LOGI("P2P_CMD", "✨ Comando blink recebido");
-            blink_all_leds();
-        } else if (strcmp(action->valuestring, "ping") == 0) {
-            ESP_LOGI("P2P_CMD", "🏓 Comando ping recebido");
-            handle_ping_response();
+    // Atualiza max_children e reconfigura mesh
+    if (args.max_children < 0) {
+        return;
+    }
+    if (args.max_children != current_max_children) {
+        int previous = effective_max_children();
+        current_max_children = args.max_children;
+        if (effective_max_children() == previous) {
+            // Limite próprio do nó (comando "limits") tem precedência: nada a reconfigurar
+            ESP_LOGI("MQTT CMD", "ℹ️ max_children global = %d, mantido o limite do nó (%d)", current_max_children, previous);
+            return;
         }
+        ESP_LOGW("MQTT CMD", "🆕 max_children alterado para %d, reconfiguração agendada...", current_max_children);
+        pending_mesh_restart = true;
+        mesh_was_stopped = false;
     } else {
-        ESP_LOGI("P2P_CMD", "🔁 Comando não é para mim, repassando...");
-        // forward_command_to_children(payload, strlen(payload) + 1);
+        ESP_LOGI("MQTT CMD", "ℹ️ max_children já está em %d, sem necessidade de reconfigurar", current_max_children);
     }
 }
 
-static void process_pong_response(cJSON *cmd, const char *payload) {
-    if (esp_mesh_is_root() && mqtt_client) {
-        ESP_LOGI("MESH", "📨 Resposta PONG recebida: %s", payload);
-        esp_mqtt_client_publish(mqtt_client, "mesh/network/info", payload, 0, 1, 0);
+static void handle_blink_cmd(const mesh_cmd_t *cmd, mesh_cmd_src_t src) {
+    ESP_LOGI("P2P_CMD", "✨ Comando blink recebido");
+    blink_all_leds();
+}
+
+static void handle_ping_cmd(const mesh_cmd_t *cmd, mesh_cmd_src_t src) {
+    handle_ping_response();
+}
+
+static esp_err_t parse_ota_args(const cJSON *json, mesh_cmd_t *cmd) {
+    cJSON *url = cJSON_GetObjectItem(json, "url");
+
+    if (!cJSON_IsString(url) || strlen(url->valuestring) >= MESH_CMD_ARGS_MAX) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    cmd->args_len = strlen(url->valuestring) + 1;
+    memcpy(cmd->args, url->valuestring, cmd->args_len);
+    return ESP_OK;
+}
+
+static void handle_ota_cmd(const mesh_cmd_t *cmd, mesh_cmd_src_t src) {
+    // Atualização de firmware de toda a rede: o root baixa a imagem e distribui pela mesh
+    ESP_LOGW("MQTT CMD", "⬆️ OTA solicitado: %s", (const char *)cmd->args);
+    mesh_ota_start_from_url((const char *)cmd->args);
+}
+
+#define PROFILE_WINDOW_DEFAULT_MS 5000
+#define PROFILE_WINDOW_MAX_MS 60000
+
+static esp_err_t parse_profile_args(const cJSON *json, mesh_cmd_t *cmd) {
+    cJSON *window = cJSON_GetObjectItem(json, "window_ms");
+    uint32_t window_ms = PROFILE_WINDOW_DEFAULT_MS;
+
+    if (window) {
+        if (!cJSON_IsNumber(window) || window->valueint < 100 || window->valueint > PROFILE_WINDOW_MAX_MS) {
+            return ESP_ERR_INVALID_ARG;
+        }
+        window_ms = window->valueint;
+    }
+
+    memcpy(cmd->args, &window_ms, sizeof(window_ms));
+    cmd->args_len = sizeof(window_ms);
+    return ESP_OK;
+}
+
+/**
+ * @brief Amostra CPU/stack/heap durante a janela pedida e publica o resultado pelo root.
+ */
+static void profile_task(void *arg) {
+    static mesh_profile_t profile;
+    uint32_t window_ms = (uint32_t)(uintptr_t)arg;
+    char mac_str[18];
+    uint8_t mac[6];
+
+    esp_read_mac(mac, ESP_MAC_WIFI_STA);
+    mac[5]++;
+    get_mac_str(mac_str, mac);
+
+    if (mesh_profile_collect(window_ms, &profile) == ESP_OK) {
+        char *json_str = mesh_profile_to_json(&profile, mac_str, TX_SIZE);
+        if (json_str) {
+            ESP_LOGI("PROFILE", "📊 Perfil coletado (%u tasks, heap livre %" PRIu32 ")",
+                     (unsigned)profile.task_count, profile.heap_free);
+            send_upstream(json_str, strlen(json_str));
+            cJSON_free(json_str);
+        }
     } else {
-        ESP_LOGI("MESH", "🔁 Encaminhando resposta PONG para o pai");
-        mesh_data_t forward = {
-            .proto = MESH_PROTO_BIN,
-            .tos = MESH_TOS_P2P,
-            .data = (uint8_t *)payload,
-            .size = strlen(payload) + 1};
-        esp_mesh_send(NULL, &forward, 0, NULL, 0);
+        ESP_LOGW("PROFILE", "⚠️ Falha ao coletar perfil");
+    }
+
+    profile_running = false;
+    vTaskDelete(NULL);
+}
+
+static void handle_profile_cmd(const mesh_cmd_t *cmd, mesh_cmd_src_t src) {
+    uint32_t window_ms;
+    memcpy(&window_ms, cmd->args, sizeof(window_ms));
+
+    if (profile_running) {
+        ESP_LOGW("PROFILE", "⚠️ Perfil já em andamento, comando ignorado");
+        return;
+    }
+
+    // A coleta espera a janela inteira: roda fora da task de RX/MQTT
+    profile_running = true;
+    if (xTaskCreate(profile_task, "profile", 4096, (void *)(uintptr_t)window_ms, 3, NULL) != pdPASS) {
+        profile_running = false;
+    }
+}
+
+/**
+ * @brief Nó escolhido como root reserva: recebe a URI do broker já resolvida e deixa o cliente pronto.
+ */
+static void handle_standby_cmd(const mesh_cmd_t *cmd, mesh_cmd_src_t src) {
+    if (esp_mesh_is_root() || cmd->args_len == 0 || cmd->args[cmd->args_len - 1] != '\0') {
+        return;
+    }
+
+    strlcpy(mqtt_uri, (const char *)cmd->args, sizeof(mqtt_uri));
+    mqtt_app_prepare();
+    if (!is_standby) {
+        ESP_LOGI("STANDBY", "🟡 Este nó é o root reserva (broker %s)", mqtt_uri);
+    }
+    is_standby = true;
+}
+
+static void standby_get(char out[18]) {
+    taskENTER_CRITICAL(&standby_mux);
+    memcpy(out, standby_mac, sizeof(standby_mac));
+    taskEXIT_CRITICAL(&standby_mux);
+}
+
+#if CONFIG_MESH_STANDBY_ROOT
+static void standby_set(const char *mac) {
+    taskENTER_CRITICAL(&standby_mux);
+    strlcpy(standby_mac, mac, sizeof(standby_mac));
+    taskEXIT_CRITICAL(&standby_mux);
+}
+#endif
+
+static void handle_handover_cmd(const mesh_cmd_t *cmd, mesh_cmd_src_t src) {
+    char standby[18];
+
+    // Sincroniza o reserva e só então cede o root (feito na task de reconfiguração)
+    standby_get(standby);
+    ESP_LOGW("STANDBY", "🔀 Troca de root solicitada (reserva: %s)", standby[0] ? standby : "nenhum");
+    handover_requested = true;
+}
+
+static esp_err_t parse_limits_args(const cJSON *json, mesh_cmd_t *cmd) {
+    cJSON *max_children = cJSON_GetObjectItem(json, "max_children");
+    cJSON *layer = cJSON_GetObjectItem(json, "layer");
+    mesh_node_limits_t limits = {.max_children = -1, .layer_pref = MESH_LAYER_PREF_AUTO};
+
+    if (max_children) {
+        if (!cJSON_IsNumber(max_children) || max_children->valueint < -1 ||
+            max_children->valueint > MESH_MAX_CHILDREN) {
+            return ESP_ERR_INVALID_ARG;
+        }
+        limits.max_children = max_children->valueint;
+    }
+    if (layer) {
+        if (!cJSON_IsString(layer)) {
+            return ESP_ERR_INVALID_ARG;
+        }
+        if (strcmp(layer->valuestring, "leaf") == 0) {
+            limits.layer_pref = MESH_LAYER_PREF_LEAF;
+        } else if (strcmp(layer->valuestring, "auto") != 0) {
+            return ESP_ERR_INVALID_ARG;
+        }
+    }
+    if (limits.max_children == 0) {
+        limits.layer_pref = MESH_LAYER_PREF_LEAF;
+    }
+
+    memcpy(cmd->args, &limits, sizeof(limits));
+    cmd->args_len = sizeof(limits);
+    return ESP_OK;
+}
+
+/**
+ * @brief Limites próprios do nó: gravados na flash e aplicados reiniciando só a mesh deste nó.
+ */
+static void handle_limits_cmd(const mesh_cmd_t *cmd, mesh_cmd_src_t src) {
+    mesh_node_limits_t limits;
+    memcpy(&limits, cmd->args, sizeof(limits));
+
+    if (limits.max_children == node_limits.max_children && limits.layer_pref == node_limits.layer_pref) {
+        ESP_LOGI("MQTT CMD", "ℹ️ Limites do nó sem alteração");
+        return;
+    }
+
+    int previous = effective_max_children();
+    bool was_leaf = node_limits.layer_pref == MESH_LAYER_PREF_LEAF;
+    node_limits = limits;
+
+    esp_err_t err = mesh_balance_save_limits(&node_limits);
+    if (err != ESP_OK) {
+        ESP_LOGW("MQTT CMD", "⚠️ Falha ao gravar limites do nó: %s", esp_err_to_name(err));
+    }
+
+    if (effective_max_children() != previous || was_leaf != (node_limits.layer_pref == MESH_LAYER_PREF_LEAF)) {
+        ESP_LOGW("MQTT CMD", "🆕 Limites do nó: max_children=%d%s, reconfiguração agendada...",
+                 effective_max_children(), node_limits.layer_pref == MESH_LAYER_PREF_LEAF ? " (folha)" : "");
+        pending_mesh_restart = true;
+        mesh_was_stopped = false;
+    }
+}
+
+static esp_err_t parse_rebalance_args(const cJSON *json, mesh_cmd_t *cmd) {
+    cJSON *apply = cJSON_GetObjectItem(json, "apply");
+
+    if (apply && !cJSON_IsBool(apply)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    cmd->args[0] = cJSON_IsTrue(apply);
+    cmd->args_len = 1;
+    return ESP_OK;
+}
+
+/**
+ * @brief Roda o assistente de balanceamento sobre a topologia em cache e publica as sugestões.
+ *
+ * Com "apply": true, envia o comando "limits" a cada nó sugerido. A sugestão do root vem
+ * por último: reiniciar a mesh dele derruba a rede por alguns segundos, e os filhos que
+ * excedem o novo limite se reconectam aos nós da camada 2 que já aceitam mais filhos.
+ */
+static void handle_rebalance_cmd(const mesh_cmd_t *cmd, mesh_cmd_src_t src) {
+    static mesh_balance_report_t report;
+    bool apply = cmd->args[0];
+
+    mesh_balance_advise(MESH_MAX_CHILDREN, CONFIG_MESH_BALANCE_STRONG_RSSI, CONFIG_MESH_BALANCE_WEAK_RSSI, &report);
+    ESP_LOGI("BALANCE", "📐 %d nós, camada máx. %d, média %.2f: %u sugestões",
+             report.nodes, report.max_layer, report.avg_layer, (unsigned)report.count);
+
+    char *json_str = mesh_balance_to_json(&report, apply);
+    if (json_str) {
+        send_upstream(json_str, strlen(json_str));
+        cJSON_free(json_str);
+    }
+
+    if (!apply) {
+        return;
+    }
+    for (size_t i = 0; i < report.count; i++) {
+        mesh_cmd_send(CMD_OP_LIMITS, report.advice[i].mac, &report.advice[i].limits, sizeof(mesh_node_limits_t));
+    }
+}
+
+/**
+ * @brief Tabela única de comandos, usada tanto pelo caminho MQTT (root) quanto pelo RX da mesh.
+ */
+static void register_mesh_commands(void) {
+    static const struct {
+        uint8_t op;
+        mesh_cmd_def_t def;
+    } commands[] = {
+        {CMD_OP_CONFIG, {"config", 0, sizeof(cmd_config_args_t), parse_config_args, handle_config_cmd}},
+        {CMD_OP_BLINK, {"blink", MESH_CMD_F_TARGETED, 0, NULL, handle_blink_cmd}},
+        {CMD_OP_PING, {"ping", MESH_CMD_F_TARGETED, 0, NULL, handle_ping_cmd}},
+        {CMD_OP_OTA, {"ota", MESH_CMD_F_ROOT_ONLY, 0, parse_ota_args, handle_ota_cmd}},
+        {CMD_OP_PROFILE, {"profile", 0, sizeof(uint32_t), parse_profile_args, handle_profile_cmd}},
+        {CMD_OP_STANDBY, {"standby", MESH_CMD_F_TARGETED, 0, NULL, handle_standby_cmd}},
+        {CMD_OP_HANDOVER, {"handover", MESH_CMD_F_ROOT_ONLY, 0, NULL, handle_handover_cmd}},
+        {CMD_OP_LIMITS, {"limits", MESH_CMD_F_TARGETED, sizeof(mesh_node_limits_t), parse_limits_args, handle_limits_cmd}},
+        {CMD_OP_REBALANCE, {"rebalance", MESH_CMD_F_ROOT_ONLY, 1, parse_rebalance_args, handle_rebalance_cmd}},
+    };
+
+    ESP_ERROR_CHECK(mesh_cmd_init(forward_command_to_children));
+    for (size_t i = 0; i < sizeof(commands) / sizeof(commands[0]); i++) {
+        ESP_ERROR_CHECK(mesh_cmd_register(commands[i].op, &commands[i].def));
     }
 }
 
@@ -228,11 +649,69 @@ static const char *build_node_status_json(char *mac_str, char *parent_str, int h
     }
     cJSON_AddItemToObject(json, "children", children_array);
 
+    // Filhos diretos (a lista acima é a tabela de roteamento inteira) e limite em vigor
+    wifi_sta_list_t sta_list;
+    if (esp_wifi_ap_get_sta_list(&sta_list) == ESP_OK) {
+        cJSON_AddNumberToObject(json, "nc", sta_list.num);
+    }
+    cJSON_AddNumberToObject(json, "max_ch", effective_max_children());
+
+    // Estimativa de rádio ligado desde o boot (100% sem PS)
+    cJSON_AddNumberToObject(json, "radio_ms", mesh_ps_radio_on_ms());
+    cJSON_AddNumberToObject(json, "radio_pct", mesh_ps_radio_on_pct());
+    int dev_duty, nwk_duty;
+    if (mesh_ps_enabled() && esp_mesh_get_running_active_duty_cycle(&dev_duty, &nwk_duty) == ESP_OK) {
+        cJSON_AddNumberToObject(json, "duty", dev_duty);
+    }
+
+    // Filas de recepção: descartes de volume e maior espera do controle desde o último relatório
+    mesh_prio_stats_t prio_stats;
+    mesh_prio_get_stats(&prio_stats, true);
+    if (prio_stats.shed[MESH_PRIO_BULK] || prio_stats.shed[MESH_PRIO_CTRL]) {
+        cJSON_AddNumberToObject(json, "shed", prio_stats.shed[MESH_PRIO_BULK] + prio_stats.shed[MESH_PRIO_CTRL]);
+    }
+    cJSON_AddNumberToObject(json, "ctrl_wait_ms", prio_stats.max_wait_ms[MESH_PRIO_CTRL]);
+    if (esp_mesh_is_root() && mesh_topo_evicted()) {
+        cJSON_AddNumberToObject(json, "topo_evicted", mesh_topo_evicted());
+    }
+
+    // RSSI do enlace com o pai (no root, com o roteador): usado na escolha do root reserva
+    wifi_ap_record_t ap_info;
+    if (esp_wifi_sta_get_ap_info(&ap_info) == ESP_OK) {
+        cJSON_AddNumberToObject(json, "rssi", ap_info.rssi);
+    }
+
+    int ota_progress = mesh_ota_progress();
+    if (ota_progress >= 0) {
+        cJSON_AddNumberToObject(json, "ota", ota_progress);
+    }
+
     const char *json_str = cJSON_PrintUnformatted(json);
     cJSON_Delete(json);
     return json_str;
 }
 
+/**
+ * @brief Devolve ao broker o motivo de um comando recusado (JSON inválido, destino proibido...).
+ */
+static void reject_mqtt_command(const char *data, int data_len, esp_err_t err) {
+    cJSON *resp = cJSON_CreateObject();
+    cJSON_AddStringToObject(resp, "type", "cmd_error");
+    cJSON_AddStringToObject(resp, "error", esp_err_to_name(err));
+
+    cJSON *cmd = cJSON_ParseWithLength(data, data_len);
+    cJSON *action = cJSON_GetObjectItem(cmd, "action");
+    if (cJSON_IsString(action)) {
+        cJSON_AddStringToObject(resp, "action", action->valuestring);
+    }
+    cJSON_Delete(cmd);
+
+    const char *json_str = cJSON_PrintUnformatted(resp);
+    send_upstream_ctrl(json_str, strlen(json_str));
+    cJSON_free((void *)json_str);
+    cJSON_Delete(resp);
+}
+
 /**
  * @brief Callback de eventos MQTT
  */
@@ -242,12 +721,21 @@ static void mqtt_event_handler_cb(void *handler_args, esp_event_base_t base, int
 
     switch (event->event_id) {
         case MQTT_EVENT_CONNECTED:
-            ESP_LOGI("MQTT HANDLER", "MQTT connected");
+            ESP_LOGI("MQTT HANDLER", "MQTT connected (%u mensagens pendentes)", (unsigned)mesh_upbuf_pending());
+            mqtt_connected = true;
             esp_mqtt_client_subscribe(client, "mesh/cmd", 0);
+            mesh_app_mqtt_connected(client);
+            // A republicação da topologia envia muito: fica para a task de reconfiguração
+            if (root_gap_start_us != 0) {
+                root_connected_us = esp_timer_get_time();
+                takeover_pending = true;
+            }
             break;
 
         case MQTT_EVENT_DISCONNECTED:
             ESP_LOGW("MQTT HANDLER", "MQTT disconnected");
+            mqtt_connected = false;
+            mesh_app_mqtt_disconnected();
             break;
 
         case MQTT_EVENT_DATA: {
@@ -255,64 +743,19 @@ static void mqtt_event_handler_cb(void *handler_args, esp_event_base_t base, int
                      event->topic_len, event->topic,
                      event->data_len, event->data);
 
-            cJSON *cmd = cJSON_ParseWithLength(event->data, event->data_len);
-            if (!cmd) {
-                ESP_LOGW("MQTT CMD", "⚠️ Comando inválido recebido");
+            // Downlink do canal de dados da aplicação: mesh/node/<mac>/down/...
+            if (mesh_app_handle_mqtt(event->topic, event->topic_len, event->data, event->data_len)) {
                 break;
             }
 
-            cJSON *interval = cJSON_GetObjectItem(cmd, "interval");
-            if (interval && cJSON_IsNumber(interval)) {
-                cJSON *max_children = cJSON_GetObjectItem(cmd, "max_children");
-
-                // Atualiza intervalo
-                if (interval->valueint != 0) {
-                    blockTask = 0;
-                    report_interval_ms = interval->valueint;
-                    ESP_LOGW("MQTT CMD", "🕒 Novo intervalo de envio: %d ms", report_interval_ms);
-                } else {
-                    blockTask = 1;
-                    ESP_LOGW("MQTT CMD", "🛑 Task de envio bloqueada por intervalo 0");
-                }
-
-                forward_command_to_children(event->data, event->data_len);
-
-                // Atualiza max_children e reconfigura mesh
-                if (max_children && cJSON_IsNumber(max_children)) {
-                    int new_max = max_children->valueint;
-
-                    if (new_max <= 0 || new_max > MAX_ROUTING_TABLE_SIZE) {
-                        ESP_LOGW("MQTT CMD", "⚠️ Valor inválido para max_children: %d", new_max);
-                    } else if (new_max != current_max_children) {
-                        current_max_children = new_max;
-                        ESP_LOGW("MQTT CMD", "🆕 max_children alterado para %d, reconfiguração agendada...", current_max_children);
-                        pending_mesh_restart = true;
-                        mesh_was_stopped = false;
-                    } else {
-                        ESP_LOGI("MQTT CMD", "ℹ️ max_children já está em %d, sem necessidade de reconfigurar", current_max_children);
-                    }
-                }
-            } else {
-                cJSON *target = cJSON_GetObjectItem(cmd, "target");
-                cJSON *action = cJSON_GetObjectItem(cmd, "action");
-
-                if (target && action && cJSON_IsString(target) && cJSON_IsString(action)) {
-                    if (is_command_for_me(target->valuestring)) {
-                        if (strcmp(action->valuestring, "blink") == 0) {
-                            ESP_LOGI("MQTT CMD", "✨ Blink recebido para mim");
-                            blink_all_leds();
-                        } else if (strcmp(action->valuestring, "ping") == 0) {
-                            ESP_LOGI("MQTT CMD", "🏓 Comando ping é para mim, respondendo diretamente");
-                            handle_ping_response();  // responderá via MQTT no nó raiz
-                        }
-                    } else {
-                        ESP_LOGI("MQTT CMD", "🔁 Repassando comando para os filhos do nó raiz...");
-                        forward_command_to_children(event->data, event->data_len);
-                    }
-                }
+            mesh_cmd_t cmd;
+            esp_err_t err = mesh_cmd_from_json(event->data, event->data_len, &cmd);
+            if (err != ESP_OK) {
+                ESP_LOGW("MQTT CMD", "⚠️ Comando inválido recebido: %s", esp_err_to_name(err));
+                reject_mqtt_command(event->data, event->data_len, err);
+                break;
             }
-
-            cJSON_Delete(cmd);
+            mesh_cmd_dispatch(&cmd, MESH_CMD_SRC_MQTT);
             break;
         }
 
@@ -322,19 +765,493 @@ static void mqtt_event_handler_cb(void *handler_args, esp_event_base_t base, int
     }
 }
 
-static void mqtt_app_start(void) {
+/**
+ * @brief Cria o cliente MQTT uma única vez, sem conectar. O reserva o deixa pronto antes de virar root.
+ */
+static void mqtt_app_prepare(void) {
+    if (mqtt_client) {
+        if (!mqtt_started) {
+            esp_mqtt_client_set_uri(mqtt_client, mqtt_uri);
+        }
+        return;
+    }
+
     esp_mqtt_client_config_t mqtt_cfg = {
-        .broker.address.uri = MQTT_IP,  // Ex: CONFIG_BROKER_URL
-        .network.reconnect_timeout_ms = 5000};
+        .broker.address.uri = mqtt_uri,
+        .network.reconnect_timeout_ms = 1000};
     mqtt_client = esp_mqtt_client_init(&mqtt_cfg);
     esp_mqtt_client_register_event(mqtt_client, ESP_EVENT_ANY_ID, mqtt_event_handler_cb, NULL);
-    esp_mqtt_client_start(mqtt_client);
+}
+
+static void mqtt_app_start(void) {
+    if (mqtt_started) {
+        return;
+    }
+    mqtt_app_prepare();
+    if (esp_mqtt_client_start(mqtt_client) == ESP_OK) {
+        mqtt_started = true;
+    }
+}
+
+/**
+ * @brief Para o cliente quando o nó deixa de ser root (o handle é mantido para reuso).
+ */
+static void mqtt_app_stop(void) {
+    if (!mqtt_started) {
+        return;
+    }
+    esp_mqtt_client_stop(mqtt_client);
+    mqtt_started = false;
+    mqtt_connected = false;
+    mesh_app_mqtt_disconnected();
+    ESP_LOGI("MQTT HANDLER", "⏹️ Cliente MQTT parado: nó não é mais root");
 }
 
 static void get_mac_str(char *out, uint8_t mac[6]) {
     sprintf(out, "%02X:%02X:%02X:%02X:%02X:%02X", mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
 }
 
+/**
+ * @brief Envia um quadro de relatório diretamente ao pai (e não ao root), para que ele possa agregá-lo.
+ *
+ * O BSSID do pai é lido da pilha a cada envio (mesh_parent_addr só muda no evento, depois da troca);
+ * o endereço mesh é o MAC STA, que é o do AP - 1. Se o pai não aceitar o quadro, ele segue direto
+ * para o root, sem agregação nos nós acima, em vez de esperar no buffer.
+ */
+static void send_report_frame_to_parent(const char *frame, size_t len) {
+    // Sem pai (ou com fila pendente): guarda para manter a ordem
+    if (!is_mesh_connected || mesh_upbuf_pending() > 0) {
+        mesh_upbuf_push(frame, len);
+        return;
+    }
+
+    mesh_addr_t parent_sta;
+    if (esp_mesh_get_parent_bssid(&parent_sta) != ESP_OK) {
+        memcpy(parent_sta.addr, mesh_parent_addr.addr, 6);
+    }
+    parent_sta.addr[5]--;
+
+    mesh_data_t data = {
+        .proto = MESH_PROTO_BIN,
+        .tos = MESH_TOS_P2P,
+        .data = (uint8_t *)frame,
+        .size = len + 1};
+
+    esp_err_t err = esp_mesh_send(&parent_sta, &data, MESH_DATA_P2P, NULL, 0);
+    if (err != ESP_OK) {
+        ESP_LOGW("MESH_AGG", "⚠️ Pai " MACSTR " recusou o relatório agregado (%s), enviando ao root",
+                 MAC2STR(parent_sta.addr), esp_err_to_name(err));
+        err = esp_mesh_send(NULL, &data, 0, NULL, 0);
+    }
+    if (err != ESP_OK) {
+        ESP_LOGW("MESH_AGG", "❌ Falha ao enviar relatório agregado: %s", esp_err_to_name(err));
+        mesh_upbuf_push(frame, len);
+    }
+}
+
+static void publish_report_cb(const char *report, size_t len, void *ctx) {
+    mesh_topo_update(report, len);
+    send_upstream(report, len);
+}
+
+/**
+ * @brief Publica no broker pela classe: controle é escrito já; volume vai para a outbox do cliente MQTT.
+ *
+ * A outbox é limitada (MESH_PRIO_MQTT_OUTBOX_MAX): acima disso o volume falha e fica no buffer do uplink.
+ */
+static bool mqtt_publish_prio(const char *payload, size_t len, mesh_prio_t prio) {
+    if (prio == MESH_PRIO_CTRL) {
+        return esp_mqtt_client_publish(mqtt_client, "mesh/network/info", payload, len, 1, 0) >= 0;
+    }
+    if (esp_mqtt_client_get_outbox_size(mqtt_client) > CONFIG_MESH_PRIO_MQTT_OUTBOX_MAX) {
+        return false;
+    }
+    return esp_mqtt_client_enqueue(mqtt_client, "mesh/network/info", payload, len, 1, 0, true) >= 0;
+}
+
+/**
+ * @brief Progresso da publicação de um quadro agregado do buffer, relatório a relatório.
+ */
+typedef struct {
+    int next;    // índice do próximo relatório do quadro
+    int done;    // relatórios já aceitos pelo broker, nesta ou em tentativas anteriores
+    bool failed;
+} agg_publish_t;
+
+// Quadro agregado na frente do buffer publicado pela metade (seq do mesh_upbuf_peek)
+static struct {
+    bool valid;
+    uint32_t seq;
+    int done;
+} agg_resume;
+
+static void publish_now_cb(const char *report, size_t len, void *ctx) {
+    agg_publish_t *pub = ctx;
+    if (pub->failed || pub->next++ < pub->done) {
+        return;
+    }
+    if (!mqtt_publish_prio(report, len, MESH_PRIO_BULK)) {
+        pub->failed = true;
+        return;
+    }
+    pub->done++;
+}
+
+/**
+ * @brief Publica no broker os relatórios de um quadro agregado guardado no buffer do uplink.
+ *
+ * Se o broker recusar um deles, guarda quantos já saíram: a próxima tentativa do mesmo
+ * quadro (mesmo seq) recomeça do seguinte, sem publicar de novo os já aceitos.
+ */
+static bool drain_agg_frame(const char *frame, size_t len, uint32_t seq) {
+    if (!mqtt_client || !mqtt_connected) {
+        return false;
+    }
+
+    agg_publish_t pub = {.done = (agg_resume.valid && agg_resume.seq == seq) ? agg_resume.done : 0};
+    mesh_agg_foreach(frame, len, publish_now_cb, &pub);
+    if (pub.failed) {
+        agg_resume.valid = true;
+        agg_resume.seq = seq;
+        agg_resume.done = pub.done;
+        return false;
+    }
+    agg_resume.valid = false;
+    return true;
+}
+
+static void send_upstream_cb(const char *report, size_t len, void *ctx) {
+    send_upstream(report, len);
+}
+
+/**
+ * @brief Tenta entregar uma mensagem ao uplink agora: broker MQTT no root, root da mesh nos demais nós.
+ *
+ * @return false se o uplink não está disponível ou o envio falhou.
+ */
+static bool upstream_try_send(const char *payload, size_t len, mesh_prio_t prio) {
+    if (esp_mesh_is_root()) {
+        if (!mqtt_client || !mqtt_connected) {
+            return false;
+        }
+        // Dados da aplicação guardados no buffer vão para o tópico do nó de origem
+        if (mesh_app_is_frame((const uint8_t *)payload, len)) {
+            return mesh_app_publish_frame((const uint8_t *)payload, len);
+        }
+        return mqtt_publish_prio(payload, len, prio);
+    }
+
+    if (!is_mesh_connected) {
+        return false;
+    }
+
+    mesh_data_t data = {
+        .proto = MESH_PROTO_BIN,
+        .tos = MESH_TOS_P2P,
+        .data = (uint8_t *)payload,
+        .size = len + 1};
+    if (prio != MESH_PRIO_CTRL) {
+        return esp_mesh_send(NULL, &data, 0, NULL, 0) == ESP_OK;
+    }
+
+    // Controle vai marcado, para o rx do root classificar sem parse
+    uint8_t *tagged = malloc(len + 2);
+    if (!tagged) {
+        return false;
+    }
+    tagged[0] = MESH_PRIO_CTRL_MAGIC;
+    memcpy(tagged + 1, payload, len);
+    tagged[len + 1] = '\0';
+    data.data = tagged;
+    data.size = len + 2;
+    esp_err_t err = esp_mesh_send(NULL, &data, 0, NULL, 0);
+    free(tagged);
+    return err == ESP_OK;
+}
+
+/**
+ * @brief Envia ao uplink ou, se ele estiver fora (ou já houver fila), guarda no buffer.
+ */
+static void send_upstream(const char *payload, size_t len) {
+    // No root, um quadro agregado vira uma mensagem por relatório, cada uma com o seu lugar no buffer
+    if (esp_mesh_is_root() && mesh_agg_is_frame(payload, len)) {
+        mesh_agg_foreach(payload, len, send_upstream_cb, NULL);
+        return;
+    }
+
+    if (mesh_upbuf_pending() == 0 && upstream_try_send(payload, len, MESH_PRIO_BULK)) {
+        return;
+    }
+
+    if (mesh_upbuf_push(payload, len) != ESP_OK) {
+        ESP_LOGW("UPBUF", "⚠️ Mensagem de %u bytes descartada", (unsigned)len);
+    }
+}
+
+/**
+ * @brief Como send_upstream(), mas passa à frente do que está no buffer (pongs e respostas a comandos).
+ */
+static void send_upstream_ctrl(const char *payload, size_t len) {
+    if (upstream_try_send(payload, len, MESH_PRIO_CTRL)) {
+        return;
+    }
+
+    if (mesh_upbuf_push(payload, len) != ESP_OK) {
+        ESP_LOGW("UPBUF", "⚠️ Mensagem de %u bytes descartada", (unsigned)len);
+    }
+}
+
+/**
+ * @brief Entrega a mensagem mais antiga do buffer do uplink.
+ *
+ * @return false se o buffer está vazio ou o uplink ainda está fora.
+ */
+static bool upstream_drain_one(void) {
+    mesh_upbuf_stats_t stats;
+    uint32_t seq;
+
+    size_t len = mesh_upbuf_peek(drain_buf, TX_SIZE, &seq);
+    if (len == 0) {
+        return false;
+    }
+    drain_buf[len] = '\0';
+
+    // Quadro agregado guardado antes de este nó virar root: publicado relatório a relatório
+    bool sent = esp_mesh_is_root() && mesh_agg_is_frame(drain_buf, len)
+                    ? drain_agg_frame(drain_buf, len, seq)
+                    : upstream_try_send(drain_buf, len, MESH_PRIO_BULK);
+    if (!sent) {
+        return false;
+    }
+    // Se um transbordo já tirou a mensagem da fila durante o envio, a seguinte fica
+    if (!mesh_upbuf_consume(seq)) {
+        ESP_LOGD("UPBUF", "Mensagem entregue já tinha saído do buffer");
+    }
+    if (mesh_upbuf_pending() == 0) {
+        mesh_upbuf_get_stats(&stats);
+        ESP_LOGI("UPBUF", "✅ Buffer esvaziado (entregues:%" PRIu32 ", descartadas:%" PRIu32 ", flash:%" PRIu32 ")",
+                 stats.drained, stats.dropped, stats.spilled);
+    }
+    return true;
+}
+
+/**
+ * @brief Esvazia o buffer do uplink em ritmo controlado depois que a conexão volta.
+ */
+static void upstream_drain_task(void *arg) {
+    while (true) {
+        vTaskDelay(pdMS_TO_TICKS(CONFIG_MESH_UPBUF_DRAIN_INTERVAL_MS));
+
+        // Comandos retidos: filhos que avisaram estar acordados e os que passaram do limite
+        if (mesh_ps_enabled()) {
+            mesh_ps_release_woken();
+            mesh_ps_release_expired();
+        }
+
+        // Em PS, o buffer é esvaziado em rajada na janela de atividade (report_node_info_task)
+        if (mesh_upbuf_pending() == 0 || (mesh_ps_enabled() && !esp_mesh_is_root())) {
+            continue;
+        }
+
+        if (!upstream_drain_one()) {
+            // Uplink ainda fora: espera mais antes de tentar de novo
+            vTaskDelay(pdMS_TO_TICKS(1000));
+        }
+    }
+}
+
+/*******************************************************
+ *                Root reserva
+ *******************************************************/
+
+static void republish_topology_cb(const mesh_topo_node_t *node, void *ctx) {
+    send_upstream(node->report, node->report_len);
+}
+
+#if CONFIG_MESH_STANDBY_ROOT
+#define STANDBY_RSSI_HYSTERESIS 6  // dB que um candidato precisa ganhar para trocar o reserva
+
+typedef struct {
+    const char *mac;
+    int rssi;
+    bool found;
+} topo_lookup_t;
+
+static void topo_lookup_cb(const mesh_topo_node_t *node, void *ctx) {
+    topo_lookup_t *lookup = ctx;
+    if (node->layer == 2 && strcmp(node->mac, lookup->mac) == 0) {
+        lookup->rssi = node->rssi;
+        lookup->found = true;
+    }
+}
+
+/**
+ * @brief Troca o host da URI do broker pelo IP resolvido, para o reserva não depender de DNS ao assumir.
+ */
+static void resolve_broker_uri(char *out, size_t size) {
+    const char *sep = strstr(mqtt_uri, "://");
+    const char *host = sep ? sep + 3 : mqtt_uri;
+    size_t host_len = strcspn(host, ":/");
+    char host_str[64];
+    char ip_str[16];
+
+    strlcpy(out, mqtt_uri, size);
+    if (host_len == 0 || host_len >= sizeof(host_str)) {
+        return;
+    }
+    memcpy(host_str, host, host_len);
+    host_str[host_len] = '\0';
+
+    struct addrinfo hints = {.ai_family = AF_INET, .ai_socktype = SOCK_STREAM};
+    struct addrinfo *res = NULL;
+    if (getaddrinfo(host_str, NULL, &hints, &res) != 0 || !res) {
+        return;
+    }
+    inet_ntoa_r(((struct sockaddr_in *)res->ai_addr)->sin_addr, ip_str, sizeof(ip_str));
+    freeaddrinfo(res);
+
+    snprintf(out, size, "%.*s%s%s", (int)(host - mqtt_uri), mqtt_uri, ip_str, host + host_len);
+}
+
+/**
+ * @brief Executada pelo root a cada relatório: expira nós sumidos e, a cada N intervalos,
+ * escolhe o reserva (nó da camada 2 com melhor RSSI) e agenda a sincronização do cache.
+ */
+static void root_standby_tick(void) {
+    static unsigned int ticks = 0;
+    char best[18];
+    char standby[18];
+    char uri[sizeof(mqtt_uri)];
+    int best_rssi;
+
+    mesh_topo_expire((int64_t)report_interval_ms * 5 * 1000);
+
+    if (++ticks % CONFIG_MESH_STANDBY_SYNC_INTERVALS != 0 || !mesh_topo_best_standby(best, &best_rssi)) {
+        return;
+    }
+
+    // Histerese: mantém o reserva atual enquanto ele não ficar claramente pior
+    standby_get(standby);
+    if (standby[0] && strcmp(best, standby) != 0) {
+        topo_lookup_t current = {.mac = standby};
+        mesh_topo_foreach(topo_lookup_cb, &current);
+        if (current.found && current.rssi + STANDBY_RSSI_HYSTERESIS > best_rssi) {
+            strcpy(best, standby);
+        }
+    }
+
+    if (strcmp(best, standby) != 0) {
+        ESP_LOGI("STANDBY", "🟡 Novo root reserva: %s (rssi %d)", best, best_rssi);
+        standby_set(best);
+    }
+
+    // Reenviado a cada rodada: cobre um reserva que reiniciou
+    resolve_broker_uri(uri, sizeof(uri));
+    mesh_cmd_send(CMD_OP_STANDBY, best, uri, strlen(uri) + 1);
+    standby_sync_requested = true;
+}
+#endif // CONFIG_MESH_STANDBY_ROOT
+
+/**
+ * @brief Espelha o cache de topologia no reserva, em quadros de até TX_SIZE.
+ */
+static void root_sync_standby(void) {
+    mesh_addr_t dest;
+    char standby[18];
+    int cursor = 0;
+    int frames = 0;
+    size_t len;
+
+    standby_get(standby);
+    if (!standby[0] || !mesh_cmd_parse_mac(standby, dest.addr)) {
+        return;
+    }
+    dest.addr[5]--;  // endereço mesh = MAC STA
+
+    mesh_data_t data = {
+        .proto = MESH_PROTO_BIN,
+        .tos = MESH_TOS_P2P,
+        .data = sync_buf};
+
+    while ((len = mesh_topo_build_sync(sync_buf, sizeof(sync_buf), &cursor)) > 0) {
+        data.size = len;
+        esp_err_t err = esp_mesh_send(&dest, &data, MESH_DATA_P2P, NULL, 0);
+        if (err != ESP_OK) {
+            ESP_LOGW("STANDBY", "❌ Falha ao sincronizar com o reserva: %s", esp_err_to_name(err));
+            return;
+        }
+        frames++;
+    }
+    ESP_LOGD("STANDBY", "🔄 Topologia sincronizada com %s (%d quadros)", standby, frames);
+}
+
+static void check_standby_root(void) {
+    char standby[18];
+
+    if (!esp_mesh_is_root()) {
+        standby_sync_requested = false;
+        handover_requested = false;
+        takeover_pending = false;
+        return;
+    }
+
+    if (takeover_pending) {
+        takeover_pending = false;
+        root_announce_takeover();
+    }
+
+    if (standby_sync_requested || handover_requested) {
+        standby_sync_requested = false;
+        root_sync_standby();
+    }
+
+    if (handover_requested) {
+        handover_requested = false;
+
+        mesh_vote_t vote = {.percentage = 0.9, .is_rc_specified = false, .config.attempts = 15};
+        standby_get(standby);
+        if (standby[0] && mesh_cmd_parse_mac(standby, vote.config.rc_addr.addr)) {
+            vote.config.rc_addr.addr[5]--;
+            vote.is_rc_specified = true;
+        }
+        esp_err_t err = esp_mesh_waive_root(&vote, MESH_VOTE_REASON_ROOT_INITIATED);
+        if (err != ESP_OK) {
+            ESP_LOGW("STANDBY", "❌ esp_mesh_waive_root falhou: %s", esp_err_to_name(err));
+        }
+    }
+}
+
+/**
+ * @brief Primeira conexão ao broker depois de assumir: publica o tempo sem root e a última topologia conhecida.
+ *
+ * Roda na task de reconfiguração, não no handler MQTT: a republicação passa por send_upstream
+ * uma vez por nó do cache. O intervalo vai até a conexão ao broker, não até esta chamada.
+ */
+static void root_announce_takeover(void) {
+    if (root_gap_start_us == 0) {
+        return;
+    }
+
+    int64_t gap_ms = (root_connected_us - root_gap_start_us) / 1000;
+    root_gap_start_us = 0;
+
+    char mac_str[18];
+    char metric[128];
+    uint8_t mac[6];
+    esp_read_mac(mac, ESP_MAC_WIFI_STA);
+    mac[5]++;
+    get_mac_str(mac_str, mac);
+
+    int len = snprintf(metric, sizeof(metric),
+                       "{\"type\":\"metric\",\"mac\":\"%s\",\"name\":\"root_gap_ms\",\"value\":%" PRId64 "}",
+                       mac_str, gap_ms);
+    send_upstream(metric, len);
+
+    int n = mesh_topo_foreach(republish_topology_cb, NULL);
+    ESP_LOGI("STANDBY", "👑 Root assumido em %" PRId64 " ms (%d relatórios em cache republicados)", gap_ms, n);
+    is_standby = false;
+}
+
 static void check_and_reconfigure_mesh(void) {
     if (pending_mesh_restart) {
         if (mesh_active && !mesh_was_stopped) {
@@ -356,10 +1273,13 @@ static void check_and_reconfigure_mesh(void) {
 void mesh_reconfig_task(void *arg) {
     while (true) {
         check_and_reconfigure_mesh();
+        check_standby_root();
         vTaskDelay(pdMS_TO_TICKS(1000));
     }
 }
 
+#define PS_DRAIN_BURST 16  // mensagens pendentes enviadas por janela acordada
+
 static void report_node_info_task(void *arg) {
     mesh_data_t data;
     data.proto = MESH_PROTO_BIN;
@@ -377,6 +1297,12 @@ static void report_node_info_task(void *arg) {
             continue;
         }
 
+        // Em PS, relatório, pendências e escuta de comandos acontecem na mesma janela acordada
+        bool ps_window = mesh_ps_enabled() && !esp_mesh_is_root();
+        if (ps_window) {
+            mesh_ps_awake_begin();
+        }
+
         uint8_t mac[6];
         esp_read_mac(mac, ESP_MAC_WIFI_STA);
         mac[5]++;
@@ -408,12 +1334,30 @@ static void report_node_info_task(void *arg) {
         data.size = len + 1;
 
         if (esp_mesh_is_root()) {
-            esp_mqtt_client_publish(mqtt_client, "mesh/network/info", (const char *)tx_buf, data.size - 1, 1, 0);
+            mesh_topo_update((const char *)tx_buf, len);
+            send_upstream((const char *)tx_buf, len);
+#if CONFIG_MESH_STANDBY_ROOT
+            root_standby_tick();
+#endif
         } else {
-            esp_mesh_send(NULL, &data, 0, NULL, 0);
+#if CONFIG_MESH_REPORT_AGGREGATION
+            // Junta os relatórios dos filhos recebidos neste intervalo com o nosso
+            mesh_agg_flush((const char *)tx_buf, len);
+#else
+            send_upstream((const char *)tx_buf, len);
+#endif
         }
 
         cJSON_free((void *)json_str);
+
+#if CONFIG_MESH_ENABLE_PS
+        if (ps_window) {
+            for (int i = 0; i < PS_DRAIN_BURST && mesh_upbuf_pending() > 0 && upstream_drain_one(); i++) {
+            }
+            vTaskDelay(pdMS_TO_TICKS(CONFIG_MESH_PS_LISTEN_WINDOW_MS));
+            mesh_ps_awake_end();
+        }
+#endif
     }
 }
 
@@ -425,75 +1369,146 @@ static void report_node_info_task(void *arg) {
  *                Function Definitions
  *******************************************************/
 
+/**
+ * @brief Classifica um quadro recebido sem parse: comandos e mensagens marcadas como controle, o resto é volume.
+ */
+static mesh_prio_t rx_classify(const uint8_t *data, size_t len) {
+    if (mesh_cmd_is_frame(data, len) || mesh_prio_is_ctrl_frame(data, len)) {
+        return MESH_PRIO_CTRL;
+    }
+    return MESH_PRIO_BULK;
+}
+
+/**
+ * @brief Processa um quadro recebido da mesh (na task rx_worker, controle antes de volume).
+ */
+static void rx_process(const mesh_addr_t *from, uint8_t *data, size_t size) {
+    // Mensagem de controle (pong, resposta a comando): tira a marca, o resto é o JSON de sempre
+    bool ctrl = mesh_prio_is_ctrl_frame(data, size);
+    if (ctrl) {
+        data++;
+        size--;
+    }
+    char *payload = (char *)data;
+
+    // Um filho direto acabou de transmitir, então está acordado: entrega o que ficou retido.
+    // from é a origem do quadro, que pode ser um neto repassado por ele
+    if (mesh_ps_enabled() && is_direct_child(from)) {
+        mesh_ps_release(from);
+    }
+
+    if (mesh_ota_is_frame(data, size)) {
+        mesh_ota_handle_rx(from, data, size);
+        return;
+    }
+
+    if (mesh_cmd_is_frame(data, size)) {
+        mesh_cmd_t cmd;
+        if (mesh_cmd_decode(data, size, &cmd) != ESP_OK) {
+            ESP_LOGW("MESH_RX", "⚠️ Comando binário inválido (%u bytes)", (unsigned)size);
+        } else if (mesh_ps_enabled() && !mesh_cmd_is_for_me(&cmd)) {
+            // Em PS o root manda ao pai o comando de um filho: retém até ele acordar
+            mesh_addr_t child;
+            memcpy(child.addr, cmd.target, 6);
+            child.addr[5]--;
+            ps_deliver_to_child(&child, data, size);
+        } else {
+            mesh_cmd_dispatch(&cmd, MESH_CMD_SRC_MESH);
+        }
+        return;
+    }
+
+    if (mesh_app_is_frame(data, size)) {
+        mesh_app_handle_rx(data, size);
+        return;
+    }
+
+    // Cópia da topologia enviada pelo root ao reserva
+    if (mesh_topo_is_sync_frame(data, size)) {
+        if (!esp_mesh_is_root()) {
+            mesh_topo_handle_sync(data, size);
+        }
+        return;
+    }
+
+    // Quadros agregados não precisam de parse: o root desmonta, os demais acumulam
+    if (mesh_agg_is_frame(payload, size)) {
+        if (esp_mesh_is_root()) {
+            int n = mesh_agg_foreach(payload, size, publish_report_cb, NULL);
+            ESP_LOGD("MESH_RX", "📦 Quadro agregado com %d relatórios publicado", n);
+        } else {
+#if CONFIG_MESH_REPORT_AGGREGATION
+            mesh_agg_push(payload, size);
+#else
+            // Sem agregação aqui não há flush: repassa o quadro do filho como está
+            send_upstream(payload, size);
+#endif
+        }
+        return;
+    }
+
+    cJSON *cmd = cJSON_Parse(payload);
+    if (!cmd) {
+        ESP_LOGW("MESH_RX", "⚠️ JSON inválido recebido: %s", payload);
+        return;
+    }
+
+    cJSON *type = cJSON_GetObjectItem(cmd, "type");
+    if (type && cJSON_IsString(type) && strcmp(type->valuestring, "pong") == 0) {
+        process_pong_response(cmd, payload);
+        cJSON_Delete(cmd);
+        return;
+    }
+
+#if CONFIG_MESH_REPORT_AGGREGATION
+    // Relatório de um filho: segura até o nosso próximo envio
+    if (!esp_mesh_is_root() && cJSON_GetObjectItem(cmd, "mac") && !cJSON_GetObjectItem(cmd, "target")) {
+        mesh_agg_push(payload, size);
+        cJSON_Delete(cmd);
+        return;
+    }
+#endif
+
+    // Comandos chegam em formato binário (mesh_cmd); o JSON restante vai para o broker
+    if (esp_mesh_is_root()) {
+        if (cJSON_GetObjectItem(cmd, "hops")) {
+            mesh_topo_update(payload, strlen(payload));
+        }
+        if (ctrl) {
+            send_upstream_ctrl(payload, strlen(payload));
+        } else {
+            send_upstream(payload, strlen(payload));
+        }
+    }
+
+    cJSON_Delete(cmd);
+}
+
+/**
+ * @brief Só lê da mesh, classifica e enfileira; o processamento (que pode bloquear no MQTT) é do rx_worker.
+ */
 void esp_mesh_p2p_rx_main(void *arg) {
     mesh_data_t data;
     mesh_addr_t from;
     int flag;
     data.data = rx_buf;
-    data.size = RX_SIZE;
 
     while (true) {
-        data.size = RX_SIZE;
-        if (esp_mesh_recv(&from, &data, portMAX_DELAY, &flag, NULL, 0) == ESP_OK && data.size > 0) {
-            char *payload = (char *)data.data;
-
-            cJSON *cmd = cJSON_Parse(payload);
-            if (!cmd) {
-                ESP_LOGW("MESH_RX", "⚠️ JSON inválido recebido: %s", payload);
-                continue;
-            }
-
-            cJSON *type = cJSON_GetObjectItem(cmd, "type");
-            if (type && cJSON_IsString(type) && strcmp(type->valuestring, "pong") == 0) {
-                process_pong_response(cmd, payload);
-                cJSON_Delete(cmd);
-                continue;
-            }
-
-            cJSON *interval = cJSON_GetObjectItem(cmd, "interval");
-            if (interval && cJSON_IsNumber(interval)) {
-                cJSON *max_children = cJSON_GetObjectItem(cmd, "max_children");
-
-                // Atualiza intervalo
-                if (interval->valueint != 0) {
-                    blockTask = 0;
-                    report_interval_ms = interval->valueint;
-                    ESP_LOGW("MQTT CMD", "🕒 Novo intervalo de envio: %d ms", report_interval_ms);
-                } else {
-                    blockTask = 1;
-                    ESP_LOGW("MQTT CMD", "🛑 Task de envio bloqueada por intervalo 0");
-                }
-
-                if (max_children && cJSON_IsNumber(max_children)) {
-                    int new_max = max_children->valueint;
-
-                    if (new_max <= 0 || new_max > MAX_ROUTING_TABLE_SIZE) {
-                        ESP_LOGW("MQTT CMD", "⚠️ Valor inválido para max_children: %d", new_max);
-                    } else if (new_max != current_max_children) {
-                        current_max_children = new_max;
-                        ESP_LOGW("MQTT CMD", "🆕 max_children alterado para %d, reconfiguração agendada...", current_max_children);
-                        pending_mesh_restart = true;
-                        mesh_was_stopped = false;
-                    } else {
-                        ESP_LOGI("MQTT CMD", "ℹ️ max_children já está em %d, sem necessidade de reconfigurar", current_max_children);
-                    }
-                }
-
-                continue;
-            }
-
-            if (esp_mesh_is_root() && mqtt_client) {
-                if (!cJSON_GetObjectItem(cmd, "target")) {
-                    esp_mqtt_client_publish(mqtt_client, "mesh/network/info", payload, 0, 1, 0);
-                    cJSON_Delete(cmd);
-                    vTaskDelay(10 / portTICK_PERIOD_MS);
-                    continue;
-                }
-                ESP_LOGI("NODE_JSON", "🎯 Comando com 'target' recebido, não publicado no MQTT.");
-            }
+        data.size = RX_SIZE - 1;
+        if (esp_mesh_recv(&from, &data, portMAX_DELAY, &flag, NULL, 0) != ESP_OK || data.size == 0) {
+            continue;
+        }
+        rx_buf[data.size] = '\0';
+        mesh_prio_submit(rx_classify(rx_buf, data.size), &from, rx_buf, data.size);
+    }
+}
 
-            process_p2p_command(cmd, payload);
-            cJSON_Delete(cmd);
+static void rx_worker_task(void *arg) {
+    while (true) {
+        mesh_prio_msg_t *msg = mesh_prio_next(portMAX_DELAY, NULL);
+        if (msg) {
+            rx_process(&msg->from, msg->data, msg->len);
+            mesh_prio_release(msg);
         }
     }
 }
@@ -502,9 +1517,26 @@ esp_err_t esp_mesh_comm_p2p_start(void) {
     static bool started = false;
     if (!started) {
         started = true;
+        register_mesh_commands();
+        ESP_ERROR_CHECK(mesh_agg_init(send_report_frame_to_parent));
+        ESP_ERROR_CHECK(mesh_app_init(CONFIG_MESH_APP_QUEUE_LEN));
+        ESP_ERROR_CHECK(mesh_ota_init());
+        ESP_ERROR_CHECK(mesh_topo_init(CONFIG_MESH_TOPO_MAX_NODES));
+        ESP_ERROR_CHECK(mesh_prio_init(CONFIG_MESH_PRIO_CTRL_QUEUE_LEN, CONFIG_MESH_PRIO_BULK_QUEUE_LEN));
+#if CONFIG_MESH_ENABLE_PS
+        ESP_ERROR_CHECK(mesh_ps_init(CONFIG_MESH_PS_DEV_DUTY, CONFIG_MESH_PS_DEV_DUTY_TYPE,
+                                     CONFIG_MESH_PS_HOLD_MAX, CONFIG_MESH_PS_HOLD_TIMEOUT_MS));
+#endif
+#if CONFIG_MESH_UPBUF_FLASH_SPILL
+        ESP_ERROR_CHECK(mesh_upbuf_init(CONFIG_MESH_UPBUF_SIZE, true, CONFIG_MESH_UPBUF_SPILL_MAX));
+#else
+        ESP_ERROR_CHECK(mesh_upbuf_init(CONFIG_MESH_UPBUF_SIZE, false, 0));
+#endif
         xTaskCreate(report_node_info_task, "report_info", 4096, NULL, 5, NULL);
-        xTaskCreate(esp_mesh_p2p_rx_main, "rx_task", 4096, NULL, 5, NULL);
+        xTaskCreate(esp_mesh_p2p_rx_main, "rx_task", 3072, NULL, 6, NULL);
+        xTaskCreate(rx_worker_task, "rx_worker", 4096, NULL, 5, NULL);
         xTaskCreate(mesh_reconfig_task, "mesh_reconfig", 4096, NULL, 7, NULL);
+        xTaskCreate(upstream_drain_task, "upbuf_drain", 3072, NULL, 4, NULL);
     }
     return ESP_OK;
 }
@@ -536,12 +1568,15 @@ void mesh_event_handler(void *arg, esp_event_base_t event_base,
             ESP_LOGI(MESH_TAG, "<MESH_EVENT_CHILD_CONNECTED>aid:%d, " MACSTR "",
                      child_connected->aid,
                      MAC2STR(child_connected->mac));
+            mesh_ota_child_connected(child_connected->mac);
         } break;
         case MESH_EVENT_CHILD_DISCONNECTED: {
             mesh_event_child_disconnected_t *child_disconnected = (mesh_event_child_disconnected_t *)event_data;
             ESP_LOGI(MESH_TAG, "<MESH_EVENT_CHILD_DISCONNECTED>aid:%d, " MACSTR "",
                      child_disconnected->aid,
                      MAC2STR(child_disconnected->mac));
+            mesh_ota_child_disconnected(child_disconnected->mac);
+            mesh_ps_child_disconnected(child_disconnected->mac);
         } break;
         case MESH_EVENT_ROUTING_TABLE_ADD: {
             mesh_event_routing_table_change_t *routing_table = (mesh_event_routing_table_change_t *)event_data;
@@ -578,16 +1613,12 @@ void mesh_event_handler(void *arg, esp_event_base_t event_base,
             mesh_connected_indicator(mesh_layer);
             is_mesh_connected = true;
             if (esp_mesh_is_root()) {
+                // O cliente MQTT (único) é iniciado em IP_EVENT_STA_GOT_IP
                 esp_netif_dhcpc_stop(netif_sta);
                 esp_netif_dhcpc_start(netif_sta);
-
-                if (mqtt_client == NULL) {
-                    mqtt_app_start();  // Se nunca inicializou
-                } else {
-                    esp_mqtt_client_stop(mqtt_client);
-                    esp_mqtt_client_start(mqtt_client);  // Reinicia o cliente MQTT se já existia
-                    ESP_LOGI(MESH_TAG, "🔁 Reiniciando conexão MQTT após reconexão como root.");
-                }
+            } else {
+                mqtt_app_stop();
+                root_gap_start_us = 0;
             }
             esp_mesh_comm_p2p_start();
         } break;
@@ -598,6 +1629,10 @@ void mesh_event_handler(void *arg, esp_event_base_t event_base,
                      disconnected->reason);
             is_mesh_connected = false;
             mesh_disconnected_indicator();
+            // Perdeu o root (pai na camada 1): início da janela sem root
+            if (mesh_layer == 2 && root_gap_start_us == 0) {
+                root_gap_start_us = esp_timer_get_time();
+            }
             mesh_layer = esp_mesh_get_layer();
         } break;
         case MESH_EVENT_LAYER_CHANGE: {
@@ -610,6 +1645,9 @@ void mesh_event_handler(void *arg, esp_event_base_t event_base,
                                                                        : "");
             last_layer = mesh_layer;
             mesh_connected_indicator(mesh_layer);
+            if (!esp_mesh_is_root()) {
+                mqtt_app_stop();
+            }
         } break;
         case MESH_EVENT_ROOT_ADDRESS: {
             mesh_event_root_address_t *root_addr = (mesh_event_root_address_t *)event_data;
@@ -623,6 +1661,9 @@ void mesh_event_handler(void *arg, esp_event_base_t event_base,
                      vote_started->attempts,
                      vote_started->reason,
                      MAC2STR(vote_started->rc_addr.addr));
+            if (root_gap_start_us == 0) {
+                root_gap_start_us = esp_timer_get_time();
+            }
         } break;
         case MESH_EVENT_VOTE_STOPPED: {
             ESP_LOGI(MESH_TAG, "<MESH_EVENT_VOTE_STOPPED>");
@@ -634,12 +1675,16 @@ void mesh_event_handler(void *arg, esp_event_base_t event_base,
                      "<MESH_EVENT_ROOT_SWITCH_REQ>reason:%d, rc_addr:" MACSTR "",
                      switch_req->reason,
                      MAC2STR(switch_req->rc_addr.addr));
+            standby_sync_requested = true;  // último espelho antes de ceder o root
         } break;
         case MESH_EVENT_ROOT_SWITCH_ACK: {
             /* new root */
             mesh_layer = esp_mesh_get_layer();
             esp_mesh_get_parent_bssid(&mesh_parent_addr);
             ESP_LOGI(MESH_TAG, "<MESH_EVENT_ROOT_SWITCH_ACK>layer:%d, parent:" MACSTR "", mesh_layer, MAC2STR(mesh_parent_addr.addr));
+            if (root_gap_start_us == 0) {
+                root_gap_start_us = esp_timer_get_time();
+            }
         } break;
         case MESH_EVENT_TODS_STATE: {
             mesh_event_toDS_state_t *toDs_state = (mesh_event_toDS_state_t *)event_data;
@@ -657,6 +1702,7 @@ void mesh_event_handler(void *arg, esp_event_base_t event_base,
                      MAC2STR(root_conflict->addr),
                      root_conflict->rssi,
                      root_conflict->capacity);
+            standby_sync_requested = true;
         } break;
         case MESH_EVENT_CHANNEL_SWITCH: {
             mesh_event_channel_switch_t *channel_switch = (mesh_event_channel_switch_t *)event_data;
@@ -688,11 +1734,14 @@ void mesh_event_handler(void *arg, esp_event_base_t event_base,
         case MESH_EVENT_PS_PARENT_DUTY: {
             mesh_event_ps_duty_t *ps_duty = (mesh_event_ps_duty_t *)event_data;
             ESP_LOGI(MESH_TAG, "<MESH_EVENT_PS_PARENT_DUTY>duty:%d", ps_duty->duty);
+            mesh_ps_set_parent_duty(ps_duty->duty);
         } break;
         case MESH_EVENT_PS_CHILD_DUTY: {
             mesh_event_ps_duty_t *ps_duty = (mesh_event_ps_duty_t *)event_data;
             ESP_LOGI(MESH_TAG, "<MESH_EVENT_PS_CHILD_DUTY>cidx:%d, " MACSTR ", duty:%d", ps_duty->child_connected.aid - 1,
                      MAC2STR(ps_duty->child_connected.mac), ps_duty->duty);
+            // Com duty 100% o filho abriu a janela: upstream_drain_task entrega o que ficou retido
+            mesh_ps_set_child_duty(ps_duty->child_connected.mac, ps_duty->duty);
         } break;
         default:
             ESP_LOGI(MESH_TAG, "unknown id:%" PRId32 "", event_id);
@@ -707,7 +1756,7 @@ void ip_event_handler(void *arg, esp_event_base_t event_base,
 
     if (esp_mesh_is_root()) {
         ESP_LOGI(MESH_TAG, "entrou aqui no ROOT");
-        mqtt_app_start();  // <-- Alternativa segura
+        mqtt_app_start();  // Idempotente: reaproveita o cliente já criado (inclusive pelo reserva)
     }
 }
 
@@ -743,8 +1792,15 @@ static void mesh_full_init_and_start(void) {
     ESP_ERROR_CHECK(esp_mesh_set_max_layer(CONFIG_MESH_MAX_LAYER));
     ESP_ERROR_CHECK(esp_mesh_set_vote_percentage(1));
     ESP_ERROR_CHECK(esp_mesh_set_xon_qsize(128));
+#if CONFIG_MESH_ENABLE_PS
+    ESP_ERROR_CHECK(esp_mesh_enable_ps());
+    // Com duty cycle baixo, associações e anúncios precisam de mais folga
+    ESP_ERROR_CHECK(esp_mesh_set_ap_assoc_expire(60));
+    ESP_ERROR_CHECK(esp_mesh_set_announce_interval(600, 3300));
+#else
     ESP_ERROR_CHECK(esp_mesh_disable_ps());
     ESP_ERROR_CHECK(esp_mesh_set_ap_assoc_expire(20));
+#endif
 
     mesh_cfg_t cfg = MESH_INIT_CONFIG_DEFAULT();
     memcpy((uint8_t *)&cfg.mesh_id, MESH_ID, 6);
@@ -753,24 +1809,37 @@ static void mesh_full_init_and_start(void) {
     memcpy((uint8_t *)&cfg.router.ssid, CONFIG_MESH_ROUTER_SSID, cfg.router.ssid_len);
     memcpy((uint8_t *)&cfg.router.password, CONFIG_MESH_ROUTER_PASSWD, strlen(CONFIG_MESH_ROUTER_PASSWD));
 
-    cfg.mesh_ap.max_connection = current_max_children;
+    int max_children = effective_max_children();
+    cfg.mesh_ap.max_connection = max_children > 0 ? max_children : 1;
     cfg.mesh_ap.nonmesh_max_connection = CONFIG_MESH_NON_MESH_AP_CONNECTIONS;
     memcpy((uint8_t *)&cfg.mesh_ap.password, CONFIG_MESH_AP_PASSWD, strlen(CONFIG_MESH_AP_PASSWD));
 
     ESP_ERROR_CHECK(esp_mesh_set_ap_authmode(CONFIG_MESH_AP_AUTHMODE));
     ESP_ERROR_CHECK(esp_mesh_set_config(&cfg));
 
+    if (node_limits.layer_pref == MESH_LAYER_PREF_LEAF) {
+        ESP_ERROR_CHECK(esp_mesh_set_type(MESH_LEAF));  // nunca aceita filhos nem vira root
+    }
+
     vTaskDelay((esp_random() % 5000) / portTICK_PERIOD_MS);
     ESP_ERROR_CHECK(esp_mesh_start());
 
+#if CONFIG_MESH_ENABLE_PS
+    ESP_ERROR_CHECK(esp_mesh_set_active_duty_cycle(CONFIG_MESH_PS_DEV_DUTY, CONFIG_MESH_PS_DEV_DUTY_TYPE));
+    ESP_ERROR_CHECK(esp_mesh_set_network_duty_cycle(CONFIG_MESH_PS_NWK_DUTY, CONFIG_MESH_PS_NWK_DUTY_DURATION,
+                                                    CONFIG_MESH_PS_NWK_DUTY_RULE));
+#endif
+
     ESP_LOGI("MESH_RECONFIG", "✅ Mesh reconfigurada com sucesso");
 }
 
 void app_main(void) {
     ESP_LOGI(TAG, "Inicializando Mesh com configurações otimizadas...");
+    mesh_profile_init();  // hooks de contagem do cJSON, antes de qualquer uso
     led_gpio_init();
 
     ESP_ERROR_CHECK(nvs_flash_init());
+    mesh_balance_load_limits(&node_limits);
     ESP_ERROR_CHECK(esp_netif_init());
     ESP_ERROR_CHECK(esp_event_loop_create_default());
     ESP_ERROR_CHECK(esp_netif_create_default_wifi_mesh_netifs(&netif_sta, NULL));